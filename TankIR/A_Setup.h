@@ -3,7 +3,9 @@
 // USER SETTINGS
 //============================================================================================================================================================================================>>
 
-// THIS IS WHERE YOU SET UP THE DEVICE TO YOUR LIKING. 
+// THIS IS WHERE YOU SET UP THE DEVICE TO YOUR LIKING.
+// These are the defaults. Most of them can also be changed from a computer without reflashing, using Tools/tankconfig.py - the changed settings are
+// saved to EEPROM and used instead of these from then on, until you erase them again (Tools/tankconfig.py PORT erase). 
 
 
     // CANNON TRIGGER - 5 VOLT SIGNAL OPTION (cannon will trigger when 5 volt signal is detected on pin A0)
@@ -141,6 +143,7 @@
                                 // Options are:     
                                 //      TAMIYA_DAMAGE       // Stock Tamiya damage speed reduction profile
                                 //      OPENPANZER_DAMAGE   // Open Panzer damage profile (experimental)
+                                //      CUSTOM_DAMAGE       // Your club's own weights and speed-cut curve, set with Tools/tankconfig.py (starts out the same as Tamiya)
 
 
 
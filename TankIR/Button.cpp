@@ -1,149 +1,173 @@
-/* Button.h         Button - a library for reading button inputs
- * Source:          https://github.com/JChristensen/Button      
- * Authors:         Jack Christensen
+/* OP_Button.cpp    Open Panzer Button - interrupt driven input button with single, double and long press recognition
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton, Jack Christensen
  *
- * This library is an unmodified copy of Jack Christensen's button library. 
- * It has been renamed to OP_Button for consistency with other Open Panzer 
- * libraries and also to avoid conflicts with any of the other numerous
- * Arduino button libraries you may have already installed. 
+ * This started out as a copy of Jack Christensen's polled Button library (https://github.com/JChristensen/Button), which had to be
+ * read every time through the loop and could only tell how long the button had been held by how often it was read. Any time the loop
+ * was slow, so was the button.
  *
- * All credit goes to Jack Christensen. For more info, see:
- * https://github.com/JChristensen/Button
+ * Now the button pin has a pin change interrupt. Every time the pin changes, the interrupt writes the time and the new level into a
+ * small queue and returns. The sketch calls Update() once per loop, which works through the queue - throwing out bounces, which are
+ * changes that didn't last BUTTON_DEBOUNCE_mS - and turns the real presses and releases into gestures: a single press, a double press,
+ * or a long press. Because every change carries the time it actually happened, how long a press lasted and how far apart two presses
+ * were doesn't depend on how fast the loop is running, and nothing ever has to wait around for the button to be let go.
  *
- * Mr. Christensen's original copyright is reprinted below:
- *   
- *----------------------------------------------------------------------*
- * Arduino Button Library v1.0                                          *
- * Jack Christensen May 2011, published Mar 2012                        *
- *                                                                      *
- * Library for reading momentary contact switches like tactile button   *
- * switches. Intended for use in state machine constructs.              *
- * Use the read() function to read all buttons in the main loop,        *
- * which should execute as fast as possible.                            *
- *                                                                      *
- * This work is licensed under the Creative Commons Attribution-        *
- * ShareAlike 3.0 Unported License. To view a copy of this license,     *
- * visit http://creativecommons.org/licenses/by-sa/3.0/ or send a       *
- * letter to Creative Commons, 171 Second Street, Suite 300,            *
- * San Francisco, California, 94105, USA.                               *
- *----------------------------------------------------------------------*/
+ * See Settings.h under the INPUT BUTTON heading.
+ *
+ */
 
 #include "Button.h"
+#include "IsrStats.h"
 
-/*----------------------------------------------------------------------*
- * Button(pin, puEnable, invert, dbTime) instantiates a button object.  *
- * pin      Is the Arduino pin the button is connected to.              *
- * puEnable Enables the AVR internal pullup resistor if != 0 (can also  *
- *          use true or false).                                         *
- * invert   If invert == 0, interprets a high state as pressed, low as  *
- *          released. If invert != 0, interprets a high state as        *
- *          released, low as pressed  (can also use true or false).     *
- * dbTime   Is the debounce time in milliseconds.                       *
- *                                                                      *
- * (Note that invert cannot be implied from puEnable since an external  *
- *  pullup could be used.)                                              *
- *----------------------------------------------------------------------*/
-OP_Button::OP_Button(uint8_t pin, uint8_t puEnable, uint8_t invert, uint32_t dbTime)
-{
-    _pin = pin;
-    _puEnable = puEnable;
-    _invert = invert;
-    _dbTime = dbTime;
-    pinMode(_pin, INPUT);
-    if (_puEnable != 0)
-        digitalWrite(_pin, HIGH);       //enable pullup resistor
-    _state = digitalRead(_pin);
-    if (_invert != 0) _state = !_state;
-    _time = millis();
-    _lastState = _state;
-    _changed = 0;
-    _lastChange = _time;
-}
 
-/*----------------------------------------------------------------------*
- * read() returns the state of the button, 1==pressed, 0==released,     *
- * does debouncing, captures and maintains times, previous states, etc. *
- *----------------------------------------------------------------------*/
-uint8_t OP_Button::read(void)
-{
-    static uint32_t ms;
-    static uint8_t pinVal;
-
-    ms = millis();
-    pinVal = digitalRead(_pin);
-    if (_invert != 0) pinVal = !pinVal;
-    if (ms - _lastChange < _dbTime) {
-        _time = ms;
-        _changed = 0;
-        return _state;
-    }
-    else {
-        _lastState = _state;
-        _state = pinVal;
-        _time = ms;
-        if (_state != _lastState)   {
-            _lastChange = ms;
-            _changed = 1;
-        }
-        else {
-            _changed = 0;
-        }
-        return _state;
-    }
-}
+// Static variables must be initialized outside the class
+volatile OP_Button::button_edge OP_Button::Queue[BUTTON_EDGE_QUEUE];
+volatile uint8_t    OP_Button::Head;
+volatile uint8_t    OP_Button::Count;
+volatile boolean    OP_Button::State;
+uint16_t            OP_Button::PressTime;
+uint16_t            OP_Button::ReleaseTime;
+boolean             OP_Button::ClickPending;
+boolean             OP_Button::LongReported;
+BUTTON_GESTURE      OP_Button::Gesture;
 
-/*----------------------------------------------------------------------*
- * isPressed() and isReleased() check the button state when it was last *
- * read, and return false (0) or true (!=0) accordingly.                *
- * These functions do not cause the button to be read.                  *
- *----------------------------------------------------------------------*/
-uint8_t OP_Button::isPressed(void)
-{
-    return _state == 0 ? 0 : 1;
-}
 
-uint8_t OP_Button::isReleased(void)
+void OP_Button::begin(void)
 {
-    return _state == 0 ? 1 : 0;
+    pinMode(pin_Button, INPUT_PULLUP);                  // The button holds the pin to ground when pushed
+
+    uint8_t sreg = SREG;
+    cli();
+        Head = 0;
+        Count = 0;
+        State = (digitalRead(pin_Button) == LOW);       // In case it is being held at startup
+        LongReported = State;                           // If so, don't count it as anything
+        ClickPending = false;
+        Gesture = BUTTON_NONE;
+
+        // Start the pin change interrupt on this pin
+        *digitalPinToPCMSK(pin_Button) |= bit (digitalPinToPCMSKbit(pin_Button));     // enable pin change interrupt
+        PCIFR  |= bit (digitalPinToPCICRbit(pin_Button));                               // clear any outstanding interrupt
+        PCICR  |= bit (digitalPinToPCICRbit(pin_Button));                               // enable interrupt for the group
+    SREG = sreg;
 }
 
-/*----------------------------------------------------------------------*
- * wasPressed() and wasReleased() check the button state to see if it   *
- * changed between the last two reads and return false (0) or           *
- * true (!=0) accordingly.                                              *
- * These functions do not cause the button to be read.                  *
- *----------------------------------------------------------------------*/
-uint8_t OP_Button::wasPressed(void)
+
+// Pin change interrupt service routine for pins D0 - D7
+ISR(PCINT2_vect)
 {
-    return _state && _changed;
+    ISR_STATS(ISR_STATS_BUTTON);
+    OP_Button::PCINT_ISR();
 }
 
-uint8_t OP_Button::wasReleased(void)
+void OP_Button::PCINT_ISR(void)
 {
-    return !_state && _changed;
+    // Only pin_Button is enabled in this group, but check that it really changed - a change that already bounced back before we got
+    // here doesn't need to be recorded at all
+    boolean pressed = (digitalRead(pin_Button) == LOW);
+    uint16_t now = (uint16_t)millis();
+
+    if (Count)
+    {
+        uint8_t last = (Head + BUTTON_EDGE_QUEUE - 1) % BUTTON_EDGE_QUEUE;
+        if (Queue[last].Pressed == pressed) return;
+        if (Count == BUTTON_EDGE_QUEUE)
+        {   // Full - the button must be bouncing badly. Overwrite the newest edge so at least the level we end up at is right.
+            Queue[last].Time = now;
+            Queue[last].Pressed = pressed;
+            return;
+        }
+    }
+    else if (pressed == State) return;
+
+    Queue[Head].Time = now;
+    Queue[Head].Pressed = pressed;
+    Head = (Head + 1) % BUTTON_EDGE_QUEUE;
+    Count += 1;
 }
 
-/*----------------------------------------------------------------------*
- * pressedFor(ms) and releasedFor(ms) check to see if the button is     *
- * pressed (or released), and has been in that state for the specified  *
- * time in milliseconds. Returns false (0) or true (1) accordingly.     *
- * These functions do not cause the button to be read.                  *
- *----------------------------------------------------------------------*/
-uint8_t OP_Button::pressedFor(uint32_t ms)
+
+void OP_Button::Update(void)
 {
-    return (_state == 1 && _time - _lastChange >= ms) ? 1 : 0;
+    uint16_t now = (uint16_t)millis();
+
+    // Work through the queued edges until one of them makes a gesture (we emit one gesture per loop, any more wait for next time)
+    while (Gesture == BUTTON_NONE)
+    {
+        button_edge edge, next;
+        boolean haveNext;
+
+        uint8_t sreg = SREG;
+        cli();
+            // The time is read here with the queue, not once at the top. Otherwise an edge the ISR queued after we read it would look like it 
+            // happened in the future, and (now - edge.Time) would wrap around to nearly 65535 and pass the debounce test it should have failed. 
+            now = (uint16_t)millis();
+            if (Count == 0) { SREG = sreg; break; }
+            uint8_t tail = (Head + BUTTON_EDGE_QUEUE - Count) % BUTTON_EDGE_QUEUE;
+            edge.Time = Queue[tail].Time;
+            edge.Pressed = Queue[tail].Pressed;
+            haveNext = (Count > 1);
+            if (haveNext)
+            {
+                uint8_t n = (tail + 1) % BUTTON_EDGE_QUEUE;
+                next.Time = Queue[n].Time;
+                next.Pressed = Queue[n].Pressed;
+            }
+        SREG = sreg;
+
+        // An edge only counts if the pin then stayed put for the debounce time
+        uint16_t lasted = (haveNext ? next.Time : now) - edge.Time;
+        if (lasted < BUTTON_DEBOUNCE_mS && !haveNext) break;    // Too soon to tell, come back next time
+
+        cli();
+            Count -= 1;                                         // Done with this edge either way
+        SREG = sreg;
+
+        if (lasted >= BUTTON_DEBOUNCE_mS && edge.Pressed != State) Changed(edge.Pressed, edge.Time);
+    }
+
+    // Long press - reported as soon as it has been held long enough
+    if (State && !LongReported && Gesture == BUTTON_NONE && (uint16_t)(now - PressTime) >= BUTTON_LONG_PRESS_mS)
+    {
+        Gesture = BUTTON_LONG;
+        LongReported = true;
+    }
+
+    // Too long since the last single press for the next to be a double
+    if (ClickPending && !State && (uint16_t)(now - ReleaseTime) > BUTTON_DOUBLE_PRESS_mS) ClickPending = false;
+
+    if (Gesture != BUTTON_NONE)
+    {
+        OP_EventBus::Emit(EVENT_BUTTON, Gesture);
+        Gesture = BUTTON_NONE;
+    }
 }
 
-uint8_t OP_Button::releasedFor(uint32_t ms)
+void OP_Button::Changed(boolean pressed, uint16_t time)
 {
-    return (_state == 0 && _time - _lastChange >= ms) ? 1 : 0;
+    State = pressed;
+    if (pressed)
+    {
+        PressTime = time;
+        LongReported = false;
+    }
+    else if (!LongReported)     // The release of a long press has already been dealt with
+    {
+        if (ClickPending && (uint16_t)(PressTime - ReleaseTime) <= BUTTON_DOUBLE_PRESS_mS)
+        {
+            Gesture = BUTTON_DOUBLE;
+            ClickPending = false;
+        }
+        else
+        {
+            Gesture = BUTTON_SINGLE;
+            ClickPending = true;
+            ReleaseTime = time;
+        }
+    }
 }
 
-/*----------------------------------------------------------------------*
- * lastChange() returns the time the button last changed state,         *
- * in milliseconds.                                                     *
- *----------------------------------------------------------------------*/
-uint32_t OP_Button::lastChange(void)
+boolean OP_Button::isPressed(void)
 {
-    return _lastChange;
+    return State;
 }
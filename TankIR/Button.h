@@ -1,55 +1,74 @@
-/* OP_Button.h      Button - a library for reading button inputs
- * Source:          https://github.com/JChristensen/Button      
- * Authors:         Jack Christensen
+/* OP_Button.h      Open Panzer Button - interrupt driven input button with single, double and long press recognition
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton, Jack Christensen
  *
- * This library is an unmodified copy of Jack Christensen's button library. 
- * It has been renamed to OP_Button for consistency with other Open Panzer 
- * libraries and also to avoid conflicts with any of the other numerous
- * Arduino button libraries you may have already installed. 
+ * This started out as a copy of Jack Christensen's polled Button library (https://github.com/JChristensen/Button), which had to be
+ * read every time through the loop and could only tell how long the button had been held by how often it was read. Any time the loop
+ * was slow, so was the button.
  *
- * All credit goes to Jack Christensen. For more info, see:
- * https://github.com/JChristensen/Button
+ * Now the button pin has a pin change interrupt. Every time the pin changes, the interrupt writes the time and the new level into a
+ * small queue and returns. The sketch calls Update() once per loop, which works through the queue - throwing out bounces, which are
+ * changes that didn't last BUTTON_DEBOUNCE_mS - and turns the real presses and releases into gestures: a single press, a double press,
+ * or a long press. Because every change carries the time it actually happened, how long a press lasted and how far apart two presses
+ * were doesn't depend on how fast the loop is running, and nothing ever has to wait around for the button to be let go.
  *
- * Mr. Christensen's original copyright is reprinted below:
- *   
- *----------------------------------------------------------------------*
- * Arduino Button Library v1.0                                          *
- * Jack Christensen Mar 2012                                            *
- *                                                                      *
- * This work is licensed under the Creative Commons Attribution-        *
- * ShareAlike 3.0 Unported License. To view a copy of this license,     *
- * visit http://creativecommons.org/licenses/by-sa/3.0/ or send a       *
- * letter to Creative Commons, 171 Second Street, Suite 300,            *
- * San Francisco, California, 94105, USA.                               *
- *----------------------------------------------------------------------*/
+ * A single press is reported as soon as the button is released. If a second press follows within BUTTON_DOUBLE_PRESS_mS, that second
+ * press is reported as a double press instead of another single. So a double press gives BUTTON_SINGLE then BUTTON_DOUBLE - there is
+ * never any delay added to a single press while we wait to see if another one is coming. A long press is reported as soon as the button
+ * has been held for BUTTON_LONG_PRESS_mS, and its release is ignored.
+ *
+ * Gestures are handed to the rest of the sketch as EVENT_BUTTON events on OP_EventBus, with the gesture as the argument.
+ *
+ * See Settings.h under the INPUT BUTTON heading. The button pin must be on Port D (Arduino pins 0-7), which has the PCINT2 interrupt.
+ *
+ */
 
 #ifndef OP_BUTTON_H
 #define OP_BUTTON_H
 
 #include <Arduino.h>
+#include "Settings.h"
+#include "EventBus.h"
+
+
+typedef uint8_t BUTTON_GESTURE;
+#define BUTTON_NONE         0
+#define BUTTON_SINGLE       1
+#define BUTTON_DOUBLE       2
+#define BUTTON_LONG         3
+
 
 class OP_Button
 {
+    // Static for everything because there is only one button and one PCINT2 interrupt
     public:
-        OP_Button(uint8_t pin, uint8_t puEnable, uint8_t invert, uint32_t dbTime);
-        uint8_t read();
-        uint8_t isPressed();
-        uint8_t isReleased();
-        uint8_t wasPressed();
-        uint8_t wasReleased();
-        uint8_t pressedFor(uint32_t ms);
-        uint8_t releasedFor(uint32_t ms);
-        uint32_t lastChange();
-    
+        OP_Button(void) {}
+
+        static void             begin(void);            // Sets up pin_Button with its pullup and starts the pin change interrupt
+        static void             Update(void);           // Works through the queue of pin changes and emits EVENT_BUTTON for any gesture, call once per loop
+        static boolean          isPressed(void);        // Debounced state of the button as of the last Update
+
+        // Called by the pin change interrupt service routine, see the cpp file for details.
+        // Don't really want it public, but it has to be for the ISR to see it
+        static void             PCINT_ISR(void);
+
     private:
-        uint8_t _pin;           //arduino pin number
-        uint8_t _puEnable;      //internal pullup resistor enabled
-        uint8_t _invert;        //if 0, interpret high state as pressed, else interpret low state as pressed
-        uint8_t _state;         //current button state
-        uint8_t _lastState;     //previous button state
-        uint8_t _changed;       //state changed since last read
-        uint32_t _time;         //time of current state (all times are in ms)
-        uint32_t _lastChange;   //time of last state change
-        uint32_t _dbTime;       //debounce time
+        struct button_edge {
+            uint16_t Time;              // Low 16 bits of millis() when the pin changed
+            boolean  Pressed;           // What the pin changed to
+        };
+        static volatile button_edge Queue[BUTTON_EDGE_QUEUE];
+        static volatile uint8_t     Head;               // Where the ISR writes the next edge
+        static volatile uint8_t     Count;              // How many edges are waiting
+
+        static volatile boolean State;                  // Debounced state, true = pressed (the ISR looks at it too)
+        static uint16_t         PressTime;              // When the present (or last) press started
+        static uint16_t         ReleaseTime;            // When the last single press was released
+        static boolean          ClickPending;           // A single press was released recently enough that another would make it a double
+        static boolean          LongReported;           // The present press has already been reported as a long press
+        static BUTTON_GESTURE   Gesture;                // Gesture found by this Update, emitted at the end of it
+        static void             Changed(boolean pressed, uint16_t time);
 };
+
+
 #endif
@@ -6,11 +6,12 @@
 // We use this to detect a positive voltage on pin_VoltageTrigger (A0) and if we do, fire the cannon. 
 ISR (PCINT1_vect) 
 {
+    ISR_STATS(ISR_STATS_FIRE_INPUT);
     static unsigned long last_interrupt_time = 0;
     unsigned long interrupt_time = millis(); 
 
     // But if we have disabled this functionality, just exit. In fact in that case this code shouldn't even run, because the interrupt won't have been enabled.
-    if (USE_5VOLT_TRIGGER == false) return;
+    if (Config.Values.Use5VoltTrigger == false) return;
     
     // Check if the pin is high, and if it has been more than some minimum length of time since the last interrupt
     if (digitalRead(pin_VoltageTrigger) == HIGH &&  (interrupt_time - last_interrupt_time > 250))   // 250 mS = 1/4 second
@@ -28,22 +29,21 @@ ISR (PCINT1_vect)
 // ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
 void FireCannon()
 {
+    STACK_PROBE("FireCannon");
     if (!Tank.isDestroyed)                  // We can't fire the gun if we're destroyed (not the same as invulnerability time, which comes after respawn: we are allowed to fire then)
     {    
         if (Tank.CannonReloaded())          // Only fire if reloading is complete
         {   
             if (Tank.isRepairTank()) 
             {   
-                if (!Tank.isRepairOngoing() && !RepairOngoing)
+                if (!Tank.isRepairOngoing())
                 {
                     // If we are a repair tank, we immobilze the tank when firing the repair signal. 
-                    // This is very similar to what we do if we *receive* a repair signal
-                    RepairOngoing = REPAIR_OTHER;   // This marks the start of a repair operation - we are repairing an other vehicle
-                    Serial.println(F("Fire Repair Signal"));
+                    // This is very similar to what we do if we *receive* a repair signal. The Tank object marks the start of the repair 
+                    // operation and emits EVENT_REPAIR_STARTED, which plays the repair sound (see Events.ino)
                    
-                    // Now fire the repair signal. 
+                    // Now fire the repair signal. It gets logged from EVENT_CANNON_FIRED
                     Tank.Fire(); 
-                    TriggerRepairSound();
                 }
             }
             else
@@ -51,7 +51,6 @@ void FireCannon()
                 // This is a fighting tank. But we can't fire the cannon if we're in the midst of being repaired by another tank.
                 if (!Tank.isRepairOngoing())
                 {
-                    Serial.println(F("Fire Cannon"));  
                     Tank.Fire(); // See OP_Tank library. This starts the servo recoil, triggers the high intensity flash unit, and it sends the IR signal
                     TriggerCannonSound();
                 }
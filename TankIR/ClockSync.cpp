@@ -0,0 +1,100 @@
+/* OP_ClockSync.cpp Open Panzer Clock Sync - maps our millis() onto a computer's clock, so event logs from many boards line up
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * A computer sends us time beacons, we estimate the offset and drift between its clock and ours, and log them so its timestamps and ours can
+ * be lined up. See OP_ClockSync.h
+ *
+ */
+
+#include "ClockSync.h"
+
+
+// Static variables must be initialized outside the class
+uint32_t        OP_ClockSync::RefBoard;
+uint32_t        OP_ClockSync::RefHost;
+int32_t         OP_ClockSync::Drift16;
+uint8_t         OP_ClockSync::Beacons;
+uint32_t        OP_ClockSync::WindowBoard;
+uint32_t        OP_ClockSync::WindowHost;
+boolean         OP_ClockSync::DriftKnown;
+
+#define CLOCKSYNC_MAX_DRIFT16   ((int32_t)CLOCKSYNC_MAX_DRIFT_PPM * 16)
+
+
+void OP_ClockSync::Beacon(uint32_t hostTime, uint32_t boardTime)
+{
+    if (Beacons)
+    {
+        // How far out was our prediction
+        int32_t error = (int32_t)(hostTime - HostTime(boardTime));
+
+        if (error > CLOCKSYNC_RESET_mS || error < -CLOCKSYNC_RESET_mS)
+        {
+            Beacons = 0;                            // Nothing like it, the computer's clock has started again. Start over below.
+        }
+        else
+        {
+            // The new reference point is where we predicted, plus a quarter of the way to where the beacon says
+            RefHost = hostTime - error + error / 4;
+            RefBoard = boardTime;
+
+            // Beacons a second apart tell us little about the rate, the jitter would swamp it. So the drift is measured between two beacons
+            // at least CLOCKSYNC_DRIFT_WINDOW_mS apart, straight from what they said. The first measurement is taken as it is, after that
+            // we move a quarter of the way towards each new one.
+            uint32_t boardDelta = boardTime - WindowBoard;
+            if (boardDelta >= CLOCKSYNC_DRIFT_WINDOW_mS)
+            {
+                // How many mS more the computer's clock went than ours. That many mS over boardDelta mS is x 1000 / seconds ppm, or x 16000 in sixteenths.
+                int32_t gained = (int32_t)((hostTime - WindowHost) - boardDelta);
+                int32_t measured = gained * 16000L / (int32_t)(boardDelta / 1000);
+                if (DriftKnown) Drift16 += (measured - Drift16) / 4;
+                else            Drift16 = measured;
+                Drift16 = constrain(Drift16, -CLOCKSYNC_MAX_DRIFT16, CLOCKSYNC_MAX_DRIFT16);
+                DriftKnown = true;
+                WindowBoard = boardTime;
+                WindowHost = hostTime;
+            }
+        }
+    }
+
+    if (!Beacons)
+    {
+        RefHost = WindowHost = hostTime;
+        RefBoard = WindowBoard = boardTime;
+        Drift16 = 0;
+        DriftKnown = false;
+    }
+    if (Beacons < 255) Beacons += 1;
+
+    // Log where we stand. The offset is for right now, which is what the frame's own timestamp will be.
+    uint32_t now = millis();
+    int32_t offset = (int32_t)(HostTime(now) - now);
+    int16_t drift = DriftPPM();
+    uint8_t payload[6] = { (uint8_t)offset, (uint8_t)(offset >> 8), (uint8_t)(offset >> 16), (uint8_t)(offset >> 24), (uint8_t)drift, (uint8_t)(drift >> 8) };
+    OP_EventLog::Write(EVENT_CLOCK_SYNC, payload, 6);
+}
+
+uint32_t OP_ClockSync::HostTime(uint32_t boardTime)
+{
+    if (!Beacons) return boardTime;
+    uint32_t elapsed = boardTime - RefBoard;
+    return RefHost + elapsed + Correction(elapsed);
+}
+
+int32_t OP_ClockSync::Correction(uint32_t elapsed)
+{
+    // elapsed x ppm / 1,000,000, done in two halves so nothing overflows for the first couple of days after a beacon, without 64 bit maths.
+    int32_t ppm = Drift16 / 16;
+    return ((int32_t)(elapsed / 1000) * ppm) / 1000 + ((int32_t)(elapsed % 1000) * ppm) / 1000000L;
+}
+
+boolean OP_ClockSync::isSynced(void)
+{
+    return Beacons > 0;
+}
+
+int16_t OP_ClockSync::DriftPPM(void)
+{
+    return Drift16 / 16;
+}
@@ -0,0 +1,63 @@
+/* OP_ClockSync.h   Open Panzer Clock Sync - maps our millis() onto a computer's clock, so event logs from many boards line up
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Every frame in the event log is stamped with millis(), which starts from zero when the board is switched on, and runs a little fast or slow
+ * depending on the board's resonator (they are only good to about half a percent - several seconds an hour). So one tank's "fired" and
+ * another tank's "hit" can't be lined up by their timestamps alone.
+ *
+ * A computer listening to the boards (Tools/battleserver) sends each of them a time beacon every second or so, in a CONFIG_CMD_TIME frame
+ * carrying its own clock in mS. From those we work out:
+ *      offset          what to add to millis() to get the computer's time
+ *      drift           how many parts per million the computer's clock gains on ours (negative if ours runs fast), kept in sixteenths
+ *
+ * Each beacon is compared with what we predicted the computer's time would be, and a quarter of the difference is taken into the offset, so
+ * the jitter of a USB serial link (a few mS) is smoothed out. The drift is measured between beacons at least CLOCKSYNC_DRIFT_WINDOW_mS
+ * apart, where that jitter is small next to how far the clocks have drifted, and is smoothed the same way. A difference of more than
+ * CLOCKSYNC_RESET_mS means the computer's clock has started again (or a different computer is talking to us), and we start over from that
+ * beacon. All fixed point, no floats.
+ *
+ * Beacons get no reply, so there is nothing for the sketch to wait on. Instead, after every beacon we log an EVENT_CLOCK_SYNC frame. Its own timestamp is our millis(), and its payload is the offset at that moment and
+ * the drift, so anyone reading the log can map any of our timestamps onto the computer's clock:
+ *      computer time = time + offset + (time - sync frame time) x drift / 1,000,000
+ *
+ * Payload of EVENT_CLOCK_SYNC:
+ *      offset          int32, mS, least significant byte first
+ *      drift           int16, parts per million, same sign as above
+ *
+ * See Settings.h under the CLOCK SYNC heading.
+ *
+ */
+
+#ifndef OP_CLOCKSYNC_H
+#define OP_CLOCKSYNC_H
+
+#include <Arduino.h>
+#include "Settings.h"
+#include "EventLog.h"
+
+
+class OP_ClockSync
+{
+    // Static for everything because there is only one clock
+    public:
+        OP_ClockSync(void) {}
+
+        static void     Beacon(uint32_t hostTime, uint32_t boardTime);  // Take a beacon the computer sent, which arrived at boardTime
+        static boolean  isSynced(void);                         // Have we had a beacon yet
+        static uint32_t HostTime(uint32_t boardTime);           // Our millis() mapped onto the computer's clock (unchanged if we've never had a beacon)
+        static int16_t  DriftPPM(void);
+
+    private:
+        static uint32_t RefBoard;                   // A point where we know both clocks
+        static uint32_t RefHost;
+        static int32_t  Drift16;                    // Drift in 1/16 ppm
+        static uint8_t  Beacons;
+        static uint32_t WindowBoard;                // The beacon the drift is being measured from
+        static uint32_t WindowHost;
+        static boolean  DriftKnown;                 // We have measured it at least once
+        static int32_t  Correction(uint32_t elapsed);   // mS the drift adds up to over this many mS
+};
+
+
+#endif
@@ -0,0 +1,278 @@
+/* OP_Config.cpp    Open Panzer Config - battle settings kept in EEPROM, and a serial protocol to read and change them
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Everything in A_Setup.h is a #define, so changing teams or weight classes between matches used to mean reflashing every tank. Now those
+ * settings are copied into a device_config structure at boot, and if the EEPROM holds a valid saved configuration that is loaded over the
+ * top of them. A_Setup.h still provides the defaults - used the first time the sketch runs, or any time the EEPROM copy is missing or damaged.
+ *
+ * See OP_Config.h for the EEPROM layout and the serial protocol.
+ *
+ */
+
+#include "Config.h"
+#include "Stats.h"
+#include "ClockSync.h"
+#include <util/crc16.h>
+
+
+// Static variables must be initialized outside the class
+device_config   OP_Config::Values;
+uint8_t         OP_Config::LoadedFrom;
+uint8_t         OP_Config::RxBuffer[sizeof(device_config) + 4];
+boolean         OP_Config::RxActive;
+uint8_t         OP_Config::RxCount;
+uint32_t        OP_Config::RxStarted;
+
+#define CONFIG_HEADER_ADDRESS   ((void *)CONFIG_EEPROM_ADDRESS)
+#define CONFIG_DATA_ADDRESS     ((void *)(CONFIG_EEPROM_ADDRESS + sizeof(config_header)))
+
+
+//------------------------------------------------------------------------------------------------------------------------>>
+// LOAD AND SAVE
+//------------------------------------------------------------------------------------------------------------------------>>
+void OP_Config::GetDefaults(device_config * c)
+{
+    // Straight out of A_Setup.h
+    c->WeightClass = WEIGHT_CLASS;
+    c->CustomClass.reloadTime = CUSTOM_CANNON_RELOAD;
+    c->CustomClass.recoveryTime = CUSTOM_RECOVERY_TIME;
+    c->CustomClass.maxHits = CUSTOM_CANNON_HITS;
+    c->CustomClass.maxMGHits = CUSTOM_MG_HITS;
+    c->IR_FireProtocol = IR_FIRE_PROTOCOL;
+    c->IR_HitProtocol_2 = IR_HIT_PROTOCOL_ALT;
+    c->IR_RepairProtocol = IR_REPAIR_PROTOCOL;
+    c->IR_MGProtocol = IR_MG_PROTOCOL;
+    c->IR_Team = IR_TEAM;
+    c->Accept_MG_Damage = MG_DAMAGE;
+    c->DamageProfile = DAMAGE_PROFILE;
+    c->RepairTank = REPAIR_TANK;
+    c->RepairOnHit = REPAIR_ON_HIT;
+    c->CannonReloadNotify = CANNON_RELOAD_NOTIFY;
+    c->SendTankID = SEND_ID;
+    c->TankID = TANK_ID;
+    c->RecoilMS = RECOIL_MS;
+    c->ReturnMS = RETURN_MS;
+    c->ReverseRecoil = REVERSE_RECOIL;
+    c->RecoilEndPointMin = RECOIL_SERVO_EP_MIN;
+    c->RecoilEndPointMax = RECOIL_SERVO_EP_MAX;
+    c->Use5VoltTrigger = USE_5VOLT_TRIGGER;
+    OP_Tank::GetDamageProfile(TAMIYA_DAMAGE, &c->CustomDamage);
+}
+
+uint8_t OP_Config::begin(void)
+{
+    config_header h;
+
+    // Start with the defaults, then copy whatever the EEPROM has over the top. A configuration saved by an older version of the sketch is shorter
+    // than ours, the settings it didn't have keep their defaults. One saved by a newer version is ignored completely - we can't know if our
+    // fields still mean the same thing.
+    GetDefaults(&Values);
+    LoadedFrom = CONFIG_FROM_DEFAULTS;
+
+    eeprom_read_block(&h, CONFIG_HEADER_ADDRESS, sizeof(h));
+    if (h.Marker != CONFIG_MARKER || h.Version == 0 || h.Version > CONFIG_VERSION || h.Length == 0 || h.Length > sizeof(device_config)) return LoadedFrom;
+
+    device_config c = Values;
+    eeprom_read_block(&c, CONFIG_DATA_ADDRESS, h.Length);
+    if (CRC16((const uint8_t *)&c, h.Length) != h.CRC || !isValid(&c)) return LoadedFrom;
+
+    Values = c;
+    LoadedFrom = CONFIG_FROM_EEPROM;
+    return LoadedFrom;
+}
+
+boolean OP_Config::Save(const device_config * c)
+{
+    // The header and settings have to fit in the space set aside for them, or they would run into the battle statistics that come after.
+    // (In here because config_header is private.)
+    static_assert(sizeof(config_header) + sizeof(device_config) <= CONFIG_EEPROM_SIZE, "The configuration no longer fits in CONFIG_EEPROM_SIZE, make it bigger in Settings.h");
+
+    config_header h;
+    h.Marker = CONFIG_MARKER;
+    h.Version = CONFIG_VERSION;
+    h.Length = sizeof(device_config);
+    h.CRC = CRC16((const uint8_t *)c, sizeof(device_config));
+
+    // Update only writes the bytes that changed, EEPROM cells wear out after about 100,000 writes. Each byte takes 3.3 mS to write,
+    // so saving a whole new configuration stalls the sketch for up to a tenth of a second. That's fine for something done between matches.
+    // The header goes last, so if we lose power part way through, the CRC won't match and we'll fall back to the defaults.
+    Erase();
+    eeprom_update_block(c, CONFIG_DATA_ADDRESS, sizeof(device_config));
+    eeprom_update_block(&h, CONFIG_HEADER_ADDRESS, sizeof(h));
+
+    // Read it back to make sure
+    device_config check;
+    eeprom_read_block(&check, CONFIG_DATA_ADDRESS, sizeof(device_config));
+    return memcmp(&check, c, sizeof(device_config)) == 0;
+}
+
+void OP_Config::Erase(void)
+{
+    // Only the marker needs to go
+    eeprom_update_byte((uint8_t *)CONFIG_HEADER_ADDRESS, 0xFF);
+}
+
+boolean OP_Config::isValid(const device_config * c)
+{
+    if (c->WeightClass > LAST_WEIGHT_CLASS) return false;
+    if (c->WeightClass == WC_CUSTOM && c->CustomClass.maxHits == 0) return false;
+    if (c->IR_FireProtocol > LAST_IRPROTOCOL || c->IR_HitProtocol_2 > LAST_IRPROTOCOL || c->IR_RepairProtocol > LAST_IRPROTOCOL || c->IR_MGProtocol > LAST_IRPROTOCOL) return false;
+    if (c->IR_Team > LAST_IRTEAM) return false;
+    if (c->DamageProfile > LAST_DAMAGE_PROFILE) return false;
+    // The custom damage profile is checked even if it isn't selected, so a bad one is caught when it's written, not the day someone selects it. 
+    // Weights have to be known protocols, and the speed-cut points percents, in order (unused points, DamagePct 0, can go anywhere). 
+    uint8_t lastPct = 0;
+    for (uint8_t i=0; i<DAMAGE_WEIGHTS; i++) if (c->CustomDamage.Weight[i].Protocol > LAST_IRPROTOCOL) return false;
+    for (uint8_t i=0; i<SPEED_CUT_POINTS; i++)
+    {
+        const speed_cut_point * p = &c->CustomDamage.SpeedCut[i];
+        if (p->DamagePct == 0) continue;
+        if (p->DamagePct > 100 || p->CutPct > 100 || p->DamagePct <= lastPct) return false;
+        lastPct = p->DamagePct;
+    }
+    if (c->RecoilEndPointMin < CONFIG_MIN_END_POINT || c->RecoilEndPointMax > CONFIG_MAX_END_POINT || c->RecoilEndPointMin >= c->RecoilEndPointMax) return false;
+    return true;
+}
+
+uint8_t OP_Config::Source(void)
+{
+    return LoadedFrom;
+}
+
+uint16_t OP_Config::CRC16(const uint8_t * data, uint8_t len)
+{
+    uint16_t crc = 0xFFFF;
+    while (len--) crc = _crc_ccitt_update(crc, *data++);
+    return crc;
+}
+
+
+
+//------------------------------------------------------------------------------------------------------------------------>>
+// SERIAL PROTOCOL
+//------------------------------------------------------------------------------------------------------------------------>>
+void OP_Config::Update(void)
+{
+    // A half-received frame that has gone quiet is abandoned, so a stray start byte can't leave us stuck
+    if (RxActive && (millis() - RxStarted) > CONFIG_RX_TIMEOUT_mS) RxActive = false;
+
+    // Take only what has already arrived, we never wait for more
+    while (Serial.available())
+    {
+        uint8_t b = Serial.read();
+        if (!RxActive)
+        {
+            if (b == CONFIG_SYNC)
+            {
+                RxActive = true;
+                RxCount = 0;
+                RxStarted = millis();
+            }
+            continue;                           // Anything else between frames is ignored
+        }
+
+        RxBuffer[RxCount++] = b;
+        if (RxCount < 2) continue;              // Need the command and length first
+        uint8_t len = RxBuffer[1];
+        uint8_t err;
+        if (len > sizeof(device_config))
+        {
+            RxActive = false;
+            err = CONFIG_ERR_LENGTH;
+            Reply(CONFIG_CMD_ERROR, &err, 1);
+            continue;
+        }
+        if (RxCount < len + 3) continue;        // Command, length, payload, CRC
+
+        RxActive = false;
+        uint8_t crc = 0;
+        for (uint8_t i=0; i < len + 2; i++) crc = _crc8_ccitt_update(crc, RxBuffer[i]);
+        if (crc == RxBuffer[len + 2]) Command(RxBuffer[0], len);
+        else
+        {
+            err = CONFIG_ERR_CRC;
+            Reply(CONFIG_CMD_ERROR, &err, 1);
+        }
+    }
+}
+
+void OP_Config::Command(uint8_t cmd, uint8_t len)
+{
+    const uint8_t * payload = &RxBuffer[2];
+    uint8_t result = CONFIG_ERR_NONE;
+
+    switch (cmd)
+    {
+        case CONFIG_CMD_INFO:
+            {
+                uint8_t info[3] = { CONFIG_VERSION, sizeof(device_config), LoadedFrom };
+                Reply(cmd, info, 3);
+            }
+            return;
+
+        case CONFIG_CMD_READ:
+            Reply(cmd, &Values, sizeof(device_config));
+            return;
+
+        case CONFIG_CMD_DEFAULTS:
+            {
+                device_config d;
+                GetDefaults(&d);
+                Reply(cmd, &d, sizeof(device_config));
+            }
+            return;
+
+        case CONFIG_CMD_WRITE:
+            // The host always sends the whole thing, in our layout (it asks for our version and size first)
+            if (len != sizeof(device_config))                       result = CONFIG_ERR_LENGTH;
+            else if (!isValid((const device_config *)payload))      result = CONFIG_ERR_VALUE;
+            else if (!Save((const device_config *)payload))         result = CONFIG_ERR_VERIFY;
+            Reply(cmd, &result, 1);
+            return;
+
+        case CONFIG_CMD_ERASE:
+            Erase();
+            Reply(cmd, &result, 1);
+            return;
+
+        case CONFIG_CMD_STATS:
+            {
+                stats_record r;
+                if (len != 1)                               { result = CONFIG_ERR_LENGTH; break; }
+                if (OP_Stats::GetRecord(payload[0], &r))    Reply(cmd, &r, sizeof(stats_record));
+                else                                        Reply(cmd, NULL, 0);
+            }
+            return;
+
+        case CONFIG_CMD_CLEAR_STATS:
+            OP_Stats::Clear();
+            Reply(cmd, &result, 1);
+            return;
+
+        case CONFIG_CMD_TIME:
+            // Timed from when we read the start of the frame rather than now, which is as close to when it arrived as we can get. The rest
+            // of a beacon takes another 0.6 mS to arrive at 115200 baud.
+            if (len != 4) { result = CONFIG_ERR_LENGTH; break; }
+            OP_ClockSync::Beacon((uint32_t)payload[0] | ((uint32_t)payload[1] << 8) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24), RxStarted);
+            return;
+
+        default:
+            result = CONFIG_ERR_COMMAND;
+            break;
+    }
+    Reply(CONFIG_CMD_ERROR, &result, 1);
+}
+
+void OP_Config::Reply(uint8_t cmd, const void * payload, uint8_t len)
+{
+    // Replies are only ever sent when asked for, so it is alright for these to wait for room in the transmit buffer
+    const uint8_t * p = (const uint8_t *)payload;
+    uint8_t crc = _crc8_ccitt_update(0, cmd);
+    crc = _crc8_ccitt_update(crc, len);
+    Serial.write(CONFIG_SYNC);
+    Serial.write(cmd);
+    Serial.write(len);
+    for (uint8_t i=0; i<len; i++) { Serial.write(p[i]); crc = _crc8_ccitt_update(crc, p[i]); }
+    Serial.write(crc);
+}
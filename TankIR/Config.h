@@ -0,0 +1,134 @@
+/* OP_Config.h      Open Panzer Config - battle settings kept in EEPROM, and a serial protocol to read and change them
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Everything in A_Setup.h is a #define, so changing teams or weight classes between matches used to mean reflashing every tank. Now those
+ * settings are copied into a device_config structure at boot, and if the EEPROM holds a valid saved configuration that is loaded over the
+ * top of them. A_Setup.h still provides the defaults - used the first time the sketch runs, or any time the EEPROM copy is missing or damaged.
+ *
+ * The EEPROM copy starts with a short header: a marker byte, the layout version, how many bytes of settings follow, and a CRC of those bytes.
+ * New settings are only ever added to the end of device_config. So a configuration saved by an older version of the sketch still loads, and
+ * any settings it didn't know about keep their A_Setup.h defaults. Loading takes well under a millisecond.
+ *
+ * A computer can read and write the configuration over the serial port while the sketch is running (see Tools/tankconfig.py). Commands and
+ * replies are frames of:
+ *      0xC5            start of frame
+ *      command         one of the CONFIG_CMD_ codes below
+ *      length          number of payload bytes
+ *      payload
+ *      crc             CRC-8 (polynomial 0x07) of the command, length and payload
+ *
+ * The same frames carry the battle statistics from OP_Stats and the time beacons for OP_ClockSync, so there is only one thing listening on
+ * the serial port.
+ *
+ * A saved configuration takes effect the next time the board starts (the tool resets it for you), the running settings are never changed
+ * underneath the sketch.
+ *
+ * See Settings.h under the CONFIGURATION heading.
+ *
+ */
+
+#ifndef OP_CONFIG_H
+#define OP_CONFIG_H
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "Settings.h"
+#include "Tank.h"
+
+
+// Layout version of device_config. Bump this whenever fields are added (always at the end), and never reorder or remove them.
+#define CONFIG_VERSION          2       // 2: CustomDamage added
+#define CONFIG_MARKER           0x4F
+
+// Serial commands. The reply to each command has the same code.
+#define CONFIG_CMD_INFO         'I'     // Reply payload: CONFIG_VERSION, sizeof(device_config), CONFIG_FROM_xxx
+#define CONFIG_CMD_READ         'R'     // Reply payload: the running device_config
+#define CONFIG_CMD_DEFAULTS     'D'     // Reply payload: the A_Setup.h defaults as a device_config
+#define CONFIG_CMD_WRITE        'W'     // Payload: a whole device_config to save. Reply payload: one CONFIG_ERR_xxx byte
+#define CONFIG_CMD_ERASE        'E'     // Forget the saved configuration, go back to the defaults at next start. Reply payload: one CONFIG_ERR_xxx byte
+#define CONFIG_CMD_STATS        'S'     // Payload: how many matches back (0 = this one). Reply payload: that stats_record (see Stats.h), or nothing if there isn't one
+#define CONFIG_CMD_CLEAR_STATS  'X'     // Erase the saved battle statistics. Reply payload: one CONFIG_ERR_xxx byte
+#define CONFIG_CMD_TIME         'T'     // Payload: the computer's clock in mS, 4 bytes. No reply, see ClockSync.h
+#define CONFIG_CMD_ERROR        '?'     // Sent in reply to something we couldn't make sense of. Reply payload: one CONFIG_ERR_xxx byte
+
+#define CONFIG_ERR_NONE         0
+#define CONFIG_ERR_CRC          1       // Frame failed its CRC
+#define CONFIG_ERR_COMMAND      2       // Unknown command
+#define CONFIG_ERR_LENGTH       3       // Wrong amount of payload for the command
+#define CONFIG_ERR_VALUE        4       // A setting was out of range, nothing was saved
+#define CONFIG_ERR_VERIFY       5       // Reading back the EEPROM didn't match what we wrote
+
+// Where the running configuration came from
+#define CONFIG_FROM_DEFAULTS    0
+#define CONFIG_FROM_EEPROM      1
+
+
+// Everything that used to need a recompile. The byte layout is what goes in EEPROM and over the serial port, Tools/tankconfig.py has to agree
+// with it. (The AVR compiler doesn't pad structures, multi-byte values are least significant byte first.)
+struct device_config {
+    // Battle
+    WEIGHTCLASS WeightClass;
+    weightClassSettings CustomClass;    // Only used if WeightClass is WC_CUSTOM
+    IRTYPES  IR_FireProtocol;
+    IRTYPES  IR_HitProtocol_2;
+    IRTYPES  IR_RepairProtocol;
+    IRTYPES  IR_MGProtocol;
+    IRTEAMS  IR_Team;
+    boolean  Accept_MG_Damage;
+    uint8_t  DamageProfile;
+    boolean  RepairTank;
+    boolean  RepairOnHit;
+    boolean  CannonReloadNotify;
+    boolean  SendTankID;
+    uint16_t TankID;
+    // Recoil servo
+    uint16_t RecoilMS;
+    uint16_t ReturnMS;
+    boolean  ReverseRecoil;
+    uint16_t RecoilEndPointMin;
+    uint16_t RecoilEndPointMax;
+    // Cannon trigger
+    boolean  Use5VoltTrigger;
+    // Version 2
+    damage_profile CustomDamage;        // Only used if DamageProfile is CUSTOM_DAMAGE. Starts out as a copy of the Tamiya profile.
+};
+
+
+class OP_Config
+{
+    // Static for everything because there is only one configuration
+    public:
+        OP_Config(void) {}
+
+        static device_config Values;                        // The running configuration
+
+        static uint8_t  begin(void);                        // Loads Values from EEPROM, or the defaults. Returns CONFIG_FROM_xxx
+        static void     Update(void);                       // Looks for configuration commands on the serial port, call once per loop
+        static void     GetDefaults(device_config *);       // The A_Setup.h settings
+        static boolean  Save(const device_config *);        // Writes a configuration to EEPROM, returns false if it didn't verify
+        static void     Erase(void);                        // Invalidates the EEPROM copy
+        static boolean  isValid(const device_config *);     // Checks a configuration has sensible values before we save it
+        static uint8_t  Source(void);                       // CONFIG_FROM_xxx
+
+    private:
+        struct config_header {
+            uint8_t  Marker;
+            uint8_t  Version;
+            uint8_t  Length;
+            uint16_t CRC;
+        };
+        static uint16_t CRC16(const uint8_t *, uint8_t len);
+        static void     Reply(uint8_t cmd, const void * payload, uint8_t len);
+        static void     Command(uint8_t cmd, uint8_t len);
+        static uint8_t  LoadedFrom;
+
+        // Serial receive
+        static uint8_t  RxBuffer[sizeof(device_config) + 4];   // Command, length, payload and CRC (the start byte isn't kept)
+        static boolean  RxActive;                           // We've seen a start byte and are part way through a frame
+        static uint8_t  RxCount;                            // Bytes of it received so far
+        static uint32_t RxStarted;                          // When the frame started, so a half-received frame can be abandoned
+};
+
+
+#endif
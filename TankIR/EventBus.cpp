@@ -0,0 +1,77 @@
+/* OP_EventBus.cpp  Open Panzer Event Bus - lets one part of the sketch tell the others that something happened
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Rather than the main loop asking every part of the sketch every time through whether anything has changed - were we hit, are we
+ * still destroyed, is the repair over yet - the part that knows something happened (usually OP_Tank) emits an event, and whichever
+ * functions have subscribed to that event get called with it.
+ *
+ * Events are queued and handed out from Dispatch(), which the sketch calls once per loop. So handlers never run inside an interrupt
+ * or in the middle of some other routine, and it's safe to emit an event from anywhere, interrupts included. When nothing has
+ * happened, Dispatch() has nothing to do.
+ *
+ * The event codes are in EventCodes.h
+ *
+ */
+
+#include "EventBus.h"
+
+
+// Static variables must be initialized outside the class
+volatile OP_EventBus::event_entry OP_EventBus::Queue[EVENTBUS_QUEUE];
+volatile uint8_t            OP_EventBus::Head;
+volatile uint8_t            OP_EventBus::Count;
+volatile uint8_t            OP_EventBus::DroppedCount;
+OP_EventBus::handler_entry  OP_EventBus::Handlers[EVENTBUS_HANDLERS];
+uint8_t                     OP_EventBus::NumHandlers;
+
+
+boolean OP_EventBus::Subscribe(uint8_t code, event_handler h)
+{
+    if (NumHandlers >= EVENTBUS_HANDLERS || h == NULL) return false;
+    Handlers[NumHandlers].Code = code;
+    Handlers[NumHandlers].Handler = h;
+    NumHandlers += 1;
+    return true;
+}
+
+void OP_EventBus::Emit(uint8_t code, uint8_t arg)
+{
+    uint8_t sreg = SREG;            // Save interrupt register
+    cli();                          // Disable interrupts, we may be called from an ISR
+        if (Count < EVENTBUS_QUEUE)
+        {
+            Queue[Head].Code = code;
+            Queue[Head].Arg = arg;
+            Head = (Head + 1) % EVENTBUS_QUEUE;
+            Count += 1;
+        }
+        else if (DroppedCount < 255) DroppedCount += 1;
+    SREG = sreg;                    // Restore register
+}
+
+void OP_EventBus::Dispatch(void)
+{
+    // Handlers may emit events of their own, those get handed out in this same call. The queue size puts a limit on how far that can go.
+    while (Count)
+    {
+        uint8_t code, arg;
+        uint8_t sreg = SREG;
+        cli();
+            uint8_t tail = (Head + EVENTBUS_QUEUE - Count) % EVENTBUS_QUEUE;
+            code = Queue[tail].Code;
+            arg = Queue[tail].Arg;
+            Count -= 1;
+        SREG = sreg;
+
+        for (uint8_t i=0; i<NumHandlers; i++)
+        {
+            if (Handlers[i].Code == code) Handlers[i].Handler(arg);
+        }
+    }
+}
+
+uint8_t OP_EventBus::Dropped(void)
+{
+    return DroppedCount;
+}
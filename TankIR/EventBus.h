@@ -0,0 +1,58 @@
+/* OP_EventBus.h    Open Panzer Event Bus - lets one part of the sketch tell the others that something happened
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Rather than the main loop asking every part of the sketch every time through whether anything has changed - were we hit, are we
+ * still destroyed, is the repair over yet - the part that knows something happened (usually OP_Tank) emits an event, and whichever
+ * functions have subscribed to that event get called with it.
+ *
+ * Events are queued and handed out from Dispatch(), which the sketch calls once per loop. So handlers never run inside an interrupt
+ * or in the middle of some other routine, and it's safe to emit an event from anywhere, interrupts included. When nothing has
+ * happened, Dispatch() has nothing to do.
+ *
+ * The event codes are in EventCodes.h
+ *
+ */
+
+#ifndef OP_EVENTBUS_H
+#define OP_EVENTBUS_H
+
+#include <Arduino.h>
+#include "Settings.h"
+#include "EventCodes.h"
+
+typedef void (*event_handler)(uint8_t arg);
+
+
+class OP_EventBus
+{
+    // Static for everything because there is only one bus
+    public:
+        OP_EventBus(void) {}
+
+        static boolean  Subscribe(uint8_t code, event_handler);     // Call this function whenever this event happens. Returns false if all
+                                                                    // EVENTBUS_HANDLERS are used. An event can have any number of handlers,
+                                                                    // they are called in the order they subscribed.
+        static void     Emit(uint8_t code, uint8_t arg = 0);        // Queue an event. Safe to call from an interrupt.
+        static void     Dispatch(void);                             // Hand out any queued events, call once per loop
+        static uint8_t  Dropped(void);                              // How many events were lost because the queue was full (stops at 255)
+
+    private:
+        struct event_entry {
+            uint8_t Code;
+            uint8_t Arg;
+        };
+        struct handler_entry {
+            uint8_t Code;
+            event_handler Handler;
+        };
+        static volatile event_entry Queue[EVENTBUS_QUEUE];
+        static volatile uint8_t     Head;
+        static volatile uint8_t     Count;
+        static volatile uint8_t     DroppedCount;
+        static handler_entry        Handlers[EVENTBUS_HANDLERS];
+        static uint8_t              NumHandlers;
+};
+
+
+#endif
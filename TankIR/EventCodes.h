@@ -0,0 +1,39 @@
+/* EventCodes.h     Open Panzer Event Codes - the things that can happen to the tank, as passed around by OP_EventBus
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * This file is deliberately plain C with nothing Arduino in it, so that tools running on a computer can include it as well and
+ * always agree with the sketch on what each code means.
+ *
+ * Each event carries one byte of extra information (its "argument"), described next to each code.
+ *
+ */
+
+#ifndef OP_EVENTCODES_H
+#define OP_EVENTCODES_H
+
+#define EVENT_NONE                  0
+#define EVENT_CANNON_HIT            1       // Arg: IR protocol (IRTYPES) we were hit with. Tank.LastHitTeam() has the team.
+#define EVENT_MG_HIT                2       // Arg: IR protocol of the machine gun fire
+#define EVENT_DESTROYED             3       // Arg: IR protocol of the hit that destroyed us
+#define EVENT_RESTORED              4       // Arg: none. Done being destroyed, health is back to full (recovery/invulnerability time starts now)
+#define EVENT_REPAIR_STARTED        5       // Arg: REPAIR_SELF if we are being repaired, REPAIR_OTHER if we are a repair tank repairing someone else
+#define EVENT_REPAIR_COMPLETE       6       // Arg: REPAIR_SELF or REPAIR_OTHER
+#define EVENT_REPAIR_CANCELLED      7       // Arg: REPAIR_SELF or REPAIR_OTHER
+#define EVENT_RELOAD_COMPLETE       8       // Arg: none. The cannon can fire again
+#define EVENT_CANNON_FIRED          9       // Arg: IR protocol sent (the repair protocol if we are a repair tank)
+#define EVENT_BUTTON                10      // Arg: BUTTON_SINGLE, BUTTON_DOUBLE or BUTTON_LONG (see OP_Button.h)
+#define LAST_EVENT_CODE             EVENT_BUTTON
+
+// Codes that only ever appear in the event log, never on the event bus
+#define EVENT_SNAPSHOT              64      // Periodic state of the tank from OP_Telemetry, see Telemetry.h for the payload
+#define EVENT_CLOCK_SYNC            65      // How our clock lines up with the computer's, after each time beacon. See ClockSync.h for the payload
+#define EVENT_BOOT                  66      // Logged once at the end of setup(). Payload: uS from reset until IR reception was enabled, uint32
+
+// Arguments for the repair events (also what OP_Tank keeps track of its repair with)
+#define REPAIR_NONE                 0       // No repair operation ongoing
+#define REPAIR_SELF                 1       // We are being repaired by another tank
+#define REPAIR_OTHER                2       // We are repairing another tank
+
+
+#endif
@@ -0,0 +1,95 @@
+/* OP_EventLog.cpp  Open Panzer Event Log - compact binary log of battle events that never makes the sketch wait on the serial port
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Printing "CANNON HIT! (Tamiya)" and a health level takes around 40 characters, and at 115200 baud the serial port can only send about 11
+ * of those each millisecond. Once the 64 byte transmit buffer is full, every Serial.print() waits for room - which tends to happen right
+ * when IR is coming in thick and fast and we have better things to do.
+ *
+ * Instead, each event is written into a small RAM ring as a short binary frame, and Drain() (called once per loop) copies whole frames into
+ * the serial transmit buffer only when there is room for them. Nothing ever waits. See OP_EventLog.h for the frame layout.
+ *
+ */
+
+#include "EventLog.h"
+
+
+// Static variables must be initialized outside the class
+uint8_t             OP_EventLog::Ring[EVENTLOG_BUFFER];
+volatile uint8_t    OP_EventLog::Head;
+volatile uint8_t    OP_EventLog::Count;
+uint8_t             OP_EventLog::Sequence;
+uint8_t             OP_EventLog::CRC;
+volatile uint16_t   OP_EventLog::DroppedCount;
+
+
+void OP_EventLog::Write(uint8_t code, const uint8_t * payload, uint8_t len)
+{
+    if (len > EVENTLOG_MAX_PAYLOAD) len = EVENTLOG_MAX_PAYLOAD;
+    uint32_t now = millis();
+
+    uint8_t sreg = SREG;            // Save interrupt register
+    cli();                          // Disable interrupts, we may be called from an ISR and the frame has to go in all together
+        uint8_t seq = Sequence++;   // Thrown away frames still use up a number, that's how the decoder knows they're missing
+        if (Count + EVENTLOG_OVERHEAD + len > EVENTLOG_BUFFER)
+        {
+            DroppedCount += 1;
+        }
+        else
+        {
+            Put(EVENTLOG_SYNC);
+            CRC = 0;                // The CRC starts from the length byte
+            Put(len);
+            Put(seq);
+            Put(code);
+            for (uint8_t i=0; i<4; i++) { Put(now & 0xFF); now >>= 8; }
+            for (uint8_t i=0; i<len; i++) Put(payload[i]);
+            Put(CRC);
+        }
+    SREG = sreg;                    // Restore register
+}
+
+void OP_EventLog::Put(uint8_t b)
+{
+    Ring[Head] = b;
+    Head = (Head + 1) % EVENTLOG_BUFFER;
+    Count += 1;
+
+    // Bitwise CRC-8, polynomial x^8 + x^2 + x + 1. Slower than a table but costs no flash, and frames are short.
+    CRC ^= b;
+    for (uint8_t i=0; i<8; i++) CRC = (CRC & 0x80) ? (CRC << 1) ^ 0x07 : (CRC << 1);
+}
+
+void OP_EventLog::Drain(void)
+{
+    // Only whole frames go out, so text printed by the rest of the sketch can never end up in the middle of one
+    while (Count)
+    {
+        uint8_t tail = (Head + EVENTLOG_BUFFER - Count) % EVENTLOG_BUFFER;
+        uint8_t frameLen = Ring[(tail + 1) % EVENTLOG_BUFFER] + EVENTLOG_OVERHEAD;     // Byte after the sync is the payload length
+        if (Serial.availableForWrite() < frameLen) return;                         // No room just now, try again next loop
+
+        for (uint8_t i=0; i<frameLen; i++) Serial.write(Ring[(tail + i) % EVENTLOG_BUFFER]);
+
+        // Write() only ever adds to Head, so we can take these bytes off the count now they are sent
+        uint8_t sreg = SREG;
+        cli();
+            Count -= frameLen;
+        SREG = sreg;
+    }
+}
+
+uint8_t OP_EventLog::Free(void)
+{
+    return EVENTLOG_BUFFER - Count;     // A single byte, so reading it can't be torn by an interrupt
+}
+
+uint16_t OP_EventLog::Dropped(void)
+{
+    uint16_t d;
+    uint8_t sreg = SREG;
+    cli();
+        d = DroppedCount;
+    SREG = sreg;
+    return d;
+}
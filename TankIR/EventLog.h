@@ -0,0 +1,62 @@
+/* OP_EventLog.h    Open Panzer Event Log - compact binary log of battle events that never makes the sketch wait on the serial port
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Printing "CANNON HIT! (Tamiya)" and a health level takes around 40 characters, and at 115200 baud the serial port can only send about 11
+ * of those each millisecond. Once the 64 byte transmit buffer is full, every Serial.print() waits for room - which tends to happen right
+ * when IR is coming in thick and fast and we have better things to do.
+ *
+ * Instead, each event is written into a small RAM ring as a short binary frame, and Drain() (called once per loop) copies whole frames into
+ * the serial transmit buffer only when there is room for them. Nothing ever waits. If the ring fills up the newest frame is thrown away and
+ * counted, and because every frame carries a sequence number the decoder can tell you how many went missing.
+ *
+ * Each frame is:
+ *      0xA5            start of frame
+ *      length          number of payload bytes (0 - EVENTLOG_MAX_PAYLOAD)
+ *      sequence        counts up by one for every frame, including ones that were thrown away
+ *      code            the event code, see EventCodes.h
+ *      time            millis() when the event was logged, 4 bytes, least significant first
+ *      payload         0 or more bytes, what they mean depends on the event (see Events.ino)
+ *      crc             CRC-8 (polynomial 0x07) of everything from length through the payload
+ *
+ * Ordinary text from Serial.print() (the battle info dump, for example) can go out the same port. Frames are only ever sent whole, so text
+ * falls between them and never inside one. Use Tools/eventlog.py to turn the frames back into readable text, which shows any other text as-is.
+ *
+ * See Settings.h under the EVENT LOG heading.
+ *
+ */
+
+#ifndef OP_EVENTLOG_H
+#define OP_EVENTLOG_H
+
+#include <Arduino.h>
+#include "Settings.h"
+#include "EventCodes.h"
+
+#define EVENTLOG_SYNC           0xA5
+#define EVENTLOG_OVERHEAD       9       // Frame bytes not counting the payload
+
+
+class OP_EventLog
+{
+    // Static for everything because there is only one log
+    public:
+        OP_EventLog(void) {}
+
+        static void     Write(uint8_t code, const uint8_t * payload = NULL, uint8_t len = 0);  // Log an event. Safe to call from an interrupt.
+        static void     Drain(void);                // Copy as many whole frames as will fit into the serial transmit buffer, call once per loop
+        static uint16_t Dropped(void);              // How many frames have been thrown away because the ring was full
+        static uint8_t  Free(void);                 // Bytes of room left in the ring right now
+
+    private:
+        static void     Put(uint8_t b);             // Adds a byte to the ring and the running CRC (room has already been checked)
+        static uint8_t  Ring[EVENTLOG_BUFFER];
+        static volatile uint8_t Head;               // Where the next byte is written
+        static volatile uint8_t Count;              // How many bytes are waiting to be sent
+        static uint8_t  Sequence;
+        static uint8_t  CRC;
+        static volatile uint16_t DroppedCount;
+};
+
+
+#endif
@@ -0,0 +1,168 @@
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// EVENT HANDLERS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// The Tank object and the input button emit events when something happens (see EventCodes.h for the list). Each function below is subscribed to one of them
+// in SubscribeEvents(), and gets called from PerLoopUpdates shortly after. This used to all be done in the main loop by checking each time through whether
+// anything was different from last time, now we only do something when there is something to do.
+// If you want the sketch to do something else when one of these things happens, you can add to these functions or subscribe a new one of your own.
+//
+// Each of these also logs the event with OP_EventLog rather than printing it, so a burst of hits never has to wait on the serial port. The bytes 
+// logged with each event are listed above each function, Tools/eventlog.py knows the same list and prints them as text. 
+
+void SubscribeEvents(void)
+{
+    EventBus.Subscribe(EVENT_BUTTON,            OnButton);
+    EventBus.Subscribe(EVENT_CANNON_HIT,        OnCannonHit);
+    EventBus.Subscribe(EVENT_MG_HIT,            OnMGHit);
+    EventBus.Subscribe(EVENT_DESTROYED,         OnDestroyed);
+    EventBus.Subscribe(EVENT_RESTORED,          OnRestored);
+    EventBus.Subscribe(EVENT_REPAIR_STARTED,    OnRepairStarted);
+    EventBus.Subscribe(EVENT_REPAIR_COMPLETE,   OnRepairComplete);
+    EventBus.Subscribe(EVENT_REPAIR_CANCELLED,  OnRepairCancelled);
+    EventBus.Subscribe(EVENT_RELOAD_COMPLETE,   OnReloadComplete);
+    EventBus.Subscribe(EVENT_CANNON_FIRED,      OnCannonFired);
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// BUTTON
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// Logged: gesture
+void OnButton(uint8_t gesture)
+{
+    EventLog.Write(EVENT_BUTTON, &gesture, 1);
+
+    switch (gesture)
+    {
+        case BUTTON_SINGLE:
+            // A single press (short) of the button will fire the cannon
+            FireCannon();
+            break;
+
+        case BUTTON_DOUBLE:
+            // A double press prints the battle settings again. The first press of the two will have fired the cannon already, so this will 
+            // wait for the shot to go out (and for anything else going on to finish).
+            DumpBattleInfoWhenIdle();
+            break;
+
+        case BUTTON_LONG:
+            // User has held down the input button for two seconds (long press). This is reported right away, we don't wait for the release.
+            // Now you could take some other action here to occur on long button press
+            #ifdef SIMPLETIMER_PROFILE
+            timer.DumpProfile();    // Print timer slot and callback statistics
+            #endif
+            #ifdef TIMER1_EDGE_STATS
+            DumpTimer1EdgeStats();  // Print worst-case servo and IR edge timing
+            #endif
+            #ifdef USE_STACK_PROBE
+            OP_StackProbe::Dump();  // Print stack high-water mark and free RAM
+            #endif
+            #ifdef LOOP_PROFILE
+            OP_LoopProfile::Dump(); // Print loops per second and how long each part of the loop takes
+            #endif
+            #ifdef USE_ISR_STATS
+            OP_IsrStats::Dump();    // Print how late each interrupt handler ran and how long it took
+            #endif
+            break;
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// HITS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// By the time we get these the Tank object has already applied the damage, started the light effects and cancelled any repair that was ongoing (which
+// will have emitted its own event). If the hit destroyed us, EVENT_DESTROYED follows right behind.
+
+// Logged: protocol, team, percent health remaining
+void OnCannonHit(uint8_t protocol)
+{
+    // We flashed the onboard LED when IR signals were detected. Turn it off now they are done.
+    BoardLedOff();
+
+    uint8_t payload[3] = { protocol, Tank.LastHitTeam(), Tank.PctHealthRemaining() };
+    EventLog.Write(EVENT_CANNON_HIT, payload, 3);
+
+    if (Tank.isRepairTank() && Config.Values.RepairOnHit)
+    {
+        // We want to respond to hits with a repair signal. Otherwise the hit doesn't concern us.
+        FireCannon();
+        return;
+    }
+
+    // NOTE: Since this is the Standalone IR board, we are not a moving vehicle. Therefore, "damage" really does nothing (typically it would reduce our maximum speed)
+    // if we were, this is where we would call Tank.Damage()
+
+    if (!Tank.isDestroyed) TriggerHitReceivedSound();   // If we were destroyed, OnDestroyed plays the destroyed sound instead
+}
+
+// Logged: protocol, percent health remaining
+void OnMGHit(uint8_t protocol)
+{
+    BoardLedOff();
+
+    uint8_t payload[2] = { protocol, Tank.PctHealthRemaining() };
+    EventLog.Write(EVENT_MG_HIT, payload, 2);
+
+    if (!Tank.isDestroyed) TriggerHitReceivedSound();
+}
+
+// Logged: protocol of the hit that did it
+void OnDestroyed(uint8_t protocol)
+{
+    EventLog.Write(EVENT_DESTROYED, &protocol, 1);
+    TriggerDesroyedSound();
+}
+
+// Logged: nothing extra
+void OnRestored(uint8_t)
+{
+    // Done being destroyed. We are back at full health, though we can't be hit again until recovery (invulnerability) time is over.
+    EventLog.Write(EVENT_RESTORED);
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// REPAIRS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// Logged: REPAIR_SELF/REPAIR_OTHER, repair protocol
+void OnRepairStarted(uint8_t who)
+{
+    // If we are the one being repaired, the protocol is what we were repaired with, otherwise it's what we sent
+    uint8_t payload[2] = { who, (who == REPAIR_SELF) ? Tank.LastHitProtocol() : Tank.BattleSettings.IR_RepairProtocol };
+    EventLog.Write(EVENT_REPAIR_STARTED, payload, 2);
+
+    if (who == REPAIR_SELF) BoardLedOff();
+    // Whether we are being repaired or repairing someone else, play the repair sound
+    TriggerRepairSound();
+}
+
+// Logged: REPAIR_SELF/REPAIR_OTHER, percent health remaining
+void OnRepairComplete(uint8_t who)
+{
+    // The decoder only shows our health level if we were the one being repaired (as opposed to repairing someone else)
+    uint8_t payload[2] = { who, Tank.PctHealthRemaining() };
+    EventLog.Write(EVENT_REPAIR_COMPLETE, payload, 2);
+}
+
+// Logged: REPAIR_SELF/REPAIR_OTHER
+void OnRepairCancelled(uint8_t who)
+{
+    EventLog.Write(EVENT_REPAIR_CANCELLED, &who, 1);
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// CANNON
+// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+// Logged: protocol sent
+void OnCannonFired(uint8_t protocol)
+{
+    EventLog.Write(EVENT_CANNON_FIRED, &protocol, 1);
+}
+
+// Logged: nothing extra
+void OnReloadComplete(uint8_t)
+{
+    EventLog.Write(EVENT_RELOAD_COMPLETE);
+}
@@ -43,6 +43,8 @@
 #include "IRLib.h"
 #include "IRLibMatch.h"
 #include "Settings.h"
+#include "StackProbe.h"
+#include "IsrStats.h"
 
 
 // ==========================================================================================================================>>
@@ -250,6 +252,7 @@ void IRdecodeBase::DumpResults(void) {
  // It is better to use the overloaded function below and pass a specific, single protocol to decode,
  // assuming you know which protocol you want. 
 bool IRdecode::decode(void) {
+  STACK_PROBE("IRdecode");
   if (IRdecodeTamiya::decode())         { decode_type = IR_TAMIYA;      return true; }
   if (IRdecodeTamiya_2Shot::decode())   { decode_type = IR_TAMIYA_2SHOT; return true; }
   if (IRdecodeTamiya35::decode())       { decode_type = IR_TAMIYA_35;   return true; }
@@ -504,6 +507,9 @@ bool IRdecodeTamiya_2Shot::decode(void) {
             }
         }
     }
+
+    // No header space anywhere in the buffer
+    return false;
 }
 bool IRdecodeHengLong::decode(void) {
 // HengLong_BITS = 7
@@ -1087,6 +1093,7 @@ bool IRrecvPCI::GetResults(IRdecodeBase *decoder)
 
 ISR(INT0_vect)
 {
+    ISR_STATS(ISR_STATS_IR_RECEIVE);
     boolean StartMark;  
     if (digitalRead(IR_ReceiveParams.recvpin)) { StartMark = false; }   // When the pin goes high, a Mark has ended (switch from on to off). This is now a space. 
     else { StartMark = true; }  // When the pin goes low, a Mark has begun (signal received)
@@ -1188,6 +1195,9 @@ void IRrecvPCI::resume(void)
 // See Settings.h under Timer 2 for defines related to IR sending
 
 volatile ir_send_params_t IR_SendParams;
+#ifdef TIMER1_EDGE_STATS
+volatile uint16_t IRsendBase::MaxEdgeErrorTicks;
+#endif
                                 
 IRsendBase::IRsendBase () 
 {
@@ -1231,6 +1241,7 @@ void IRsendBase::enableIROut(unsigned char khz)
 // Timer1 Output Compare B interrupt service routine
 ISR(TIMER1_COMPB_vect)
 {   // This triggers when TCNT1 = OCR1B
+    ISR_STATS_LATE(ISR_STATS_IR_SEND, TCNT1 - OCR1B);
     IRsendBase::OCR1B_ISR();
 }
 
@@ -1238,6 +1249,33 @@ void IRsendBase::OCR1B_ISR()
 {   
     unsigned char TCCR2A_State;
     
+    // OCR1B still holds the time this edge was due
+    uint16_t EdgeTime = OCR1B;
+    
+    #ifdef TIMER1_EDGE_STATS
+    uint16_t Late = TCNT1 - EdgeTime;
+    if (Late > MaxEdgeErrorTicks) MaxEdgeErrorTicks = Late;
+    #endif
+
+    // The edge itself is the only time-critical thing here, so we make it first and do the bookkeeping after. 
+    // If this is the last bit of the last step of the last repetition, we're done. 
+    if (IR_SendParams.streamIndex == IR_SendParams.bitsToSend && 
+        IR_SendParams.currentStep >= IR_SendParams.numSteps && 
+        (uint8_t)(IR_SendParams.timesRepeated + 1) == IR_SendParams.timesToRepeat)
+    {
+        IR_SEND_PWM_STOP;   // Turn off PWM
+        stopSending();      // Turn off interrupt 
+        return;
+    }
+
+    // Otherwise toggle the PWM - if it's on, we turn it off; if it's off, we turn it on
+    TCCR2A_State = TCCR2A;
+    (TCCR2A_State & _BV(COM2B1)) ? IR_SEND_PWM_STOP : IR_SEND_PWM_START;
+
+    // The edge is out. Filling in the next step of a multi-step protocol can take a while, so let the servo ISR in if it needs to be. 
+    // We can't be re-entered ourselves until we set the next compare time below. 
+    sei();
+    
     if (IR_SendParams.streamIndex == IR_SendParams.bitsToSend) 
     {
         IR_SendParams.streamIndex = 0;          // Back to 1st bit
@@ -1254,19 +1292,16 @@ void IRsendBase::OCR1B_ISR()
         FillSendStreamMultiStep();
     }
     
-    if (IR_SendParams.timesRepeated == IR_SendParams.timesToRepeat)
-    {
-        // We're done
-        IR_SEND_PWM_STOP;   // Turn off PWM
-        stopSending();      // Turn off interrupt 
-    }
-    else
-    {
-        // Toggle the PWM - if it's on, we turn it off; if it's off, we turn it on
-        TCCR2A_State = TCCR2A;
-        (TCCR2A_State & _BV(COM2B1)) ? IR_SEND_PWM_STOP : IR_SEND_PWM_START;
-        OCR1B = TCNT1 + IR_SendParams.sendStream[IR_SendParams.streamIndex++];  // Set the length of time and increment streamIndex 
-    }   
+    // Set the length of time and increment streamIndex. We count from when this edge was due rather than from now (TCNT1), so if this ISR 
+    // was held up by another interrupt the next edge still lands where it should, and errors don't add up over the length of the signal. 
+    uint16_t Interval = IR_SendParams.sendStream[IR_SendParams.streamIndex++];
+    
+    // Unless we were held up so long the next edge time has already passed, in which case the best we can do is send it right away. 
+    uint8_t sreg = SREG;
+    cli();
+        if ((uint16_t)(TCNT1 - EdgeTime) + TIMER1_MIN_LEAD_TICKS > Interval) OCR1B = TCNT1 + TIMER1_MIN_LEAD_TICKS;
+        else                                                                  OCR1B = EdgeTime + Interval;
+    SREG = sreg;
 }
 
 void IRsendBase::startSending(void)
@@ -1290,8 +1325,11 @@ void IRsendBase::startSending(void)
     // Turn on PWM
     IR_SEND_PWM_START;              
     
-    // Set the compare time
-    OCR1B = TCNT1 + IR_SendParams.sendStream[IR_SendParams.streamIndex++];  // Set the length of time of this bit, then increment to next bit
+    // Set the compare time. Interrupts off because the servo ISR also reads Timer 1 registers, and 16 bit timer registers on the AVR share a single temporary byte. 
+    uint8_t sreg = SREG;
+    cli();
+        OCR1B = TCNT1 + IR_SendParams.sendStream[IR_SendParams.streamIndex++];  // Set the length of time of this bit, then increment to next bit
+    SREG = sreg;
 
     // Clear any pending interrupts
     TIFR1 |= (1 << OCF1B);          // Output Compare Flag 1 B (clear by writing logic one)
@@ -1313,6 +1351,25 @@ boolean IRsendBase::isSendingDone(void)
     return !IR_SendParams.sending;
 }
 
+#ifdef TIMER1_EDGE_STATS
+uint16_t IRsendBase::getMaxEdgeError_uS(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+        uint16_t Ticks = MaxEdgeErrorTicks;
+    SREG = sreg;
+    return Ticks / 2;   // Timer 1 ticks are 0.5 uS
+}
+
+void IRsendBase::clearEdgeStats(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+        MaxEdgeErrorTicks = 0;
+    SREG = sreg;
+}
+#endif
+
 void IRsendBase::FillSendStreamMultiStep(void)
 {
 // This function assumes you already have specified IR_SendParams.currentStep and IR_SendParams.sendProtocol, so make sure you did.     
@@ -44,6 +44,7 @@
 #include <Arduino.h>
 #include <avr/interrupt.h>
 #include "IRLibMatch.h"
+#include "Settings.h"
 
 // If OP_IRLib_TRACE is defined, some debugging information about the decode will be printed
 // IRLIB_TEST must be defined for the IRtest unit tests to work.  It will make some
@@ -339,8 +340,15 @@ class IRsendBase
         IRsendBase();
         static void OCR1B_ISR(void);    
         static boolean isSendingDone();
+#ifdef TIMER1_EDGE_STATS
+        static uint16_t getMaxEdgeError_uS(void);   // Worst-case lateness of any IR edge (see Settings.h)
+        static void clearEdgeStats(void);
+#endif
         
     protected:
+#ifdef TIMER1_EDGE_STATS
+        static volatile uint16_t MaxEdgeErrorTicks;
+#endif
         static void enableIROut(unsigned char khz);
         static void startSending(void);
         static void stopSending(void);
@@ -0,0 +1,131 @@
+/* OP_IsrStats.cpp  Open Panzer ISR Stats - how late our interrupts run, how long they take, and how often they pile up
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * See IsrStats.h for a description, and Settings.h under the ISR STATS heading to turn it on.
+ *
+ */
+
+#include "IsrStats.h"
+
+#ifdef USE_ISR_STATS
+
+// Names for the printout
+const __FlashStringHelper *ptrIsrName(uint8_t isr) {
+  if(isr>=ISR_STATS_COUNT) isr=0;
+  const __FlashStringHelper *Names[ISR_STATS_COUNT]={F("Servo (Timer 1 A)"),F("IR send (Timer 1 B)"),F("IR receive (INT0)"),F("Fire input (PCINT1)"),
+                                                     F("Button (PCINT2)"),F("Pulse out (Timer 0 A)"),F("LED PWM (Timer 0 B)")};
+  return Names[isr];
+};
+
+
+// Static variables must be initialized outside the class
+OP_IsrStats::isr_stats OP_IsrStats::Isr[ISR_STATS_COUNT];
+uint8_t         OP_IsrStats::Depth = 0;
+uint16_t        OP_IsrStats::Stolen = 0;
+uint16_t        OP_IsrStats::LastExit = 0;
+uint32_t        OP_IsrStats::ResetTime = 0;
+
+
+// Called at the top of a handler, so interrupts are always off here
+uint16_t OP_IsrStats::Enter(uint8_t isr, uint16_t late)
+{
+    uint16_t now = TCNT1;
+    isr_stats * s = &Isr[isr];
+
+    if (s->Count < 0xFFFFFFFF) s->Count += 1;
+    if (Depth)
+    {
+        if (s->Nested < 0xFFFF) s->Nested += 1;
+    }
+    else if ((uint16_t)(now - LastExit) < ISR_STATS_BACK_TO_BACK_TICKS)
+    {
+        if (s->BackToBack < 0xFFFF) s->BackToBack += 1;
+    }
+    Depth += 1;
+
+    if (late != ISR_STATS_NO_LATENCY) Record(s->Late, &s->MaxLateTicks, late);
+
+    return now;
+}
+
+// Called as the handler returns. The servo and IR send handlers have turned interrupts back on by then, and another handler coming in while
+// we update these would upset them (and Timer 1's shared high byte while we read it).
+void OP_IsrStats::Exit(uint8_t isr, uint16_t start, uint16_t stolen)
+{
+    uint8_t sreg = SREG;
+    cli();
+        uint16_t now = TCNT1;
+        uint16_t run = (uint16_t)(now - start) - (uint16_t)(Stolen - stolen);
+        Stolen += run;                              // Only our own time - anything that interrupted us has already added its own
+        Depth -= 1;
+        LastExit = now;
+
+        isr_stats * s = &Isr[isr];
+        s->BusyTicks += run;
+        Record(s->Run, &s->MaxRunTicks, run);
+    SREG = sreg;
+}
+
+void OP_IsrStats::Record(uint8_t * histogram, uint16_t * max, uint16_t ticks)
+{
+    if (ticks > *max) *max = ticks;
+
+    // Each bucket is twice as wide as the one before: under 1 uS (2 ticks), under 2 uS, under 4 uS and so on
+    uint8_t b = 0;
+    for (uint16_t t = ticks >> 1; t && b < ISR_STATS_BUCKETS - 1; t >>= 1) b++;
+    if (histogram[b] == 255)
+    {   // Halve them all, rounding up so a bucket with anything in it never goes back to zero
+        for (uint8_t i=0; i<ISR_STATS_BUCKETS; i++) histogram[i] = (histogram[i] + 1) >> 1;
+    }
+    histogram[b] += 1;
+}
+
+void OP_IsrStats::Reset(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+        memset(Isr, 0, sizeof(Isr));
+        ResetTime = millis();
+    SREG = sreg;
+}
+
+void OP_IsrStats::Dump(void)
+{
+    // Take a copy with interrupts off, so each line adds up. Printing takes a while and the handlers carry on meanwhile.
+    isr_stats s;
+    uint32_t elapsed;
+
+    Serial.println();
+    Serial.println(F("INTERRUPTS"));
+    Serial.println(F("Histograms: <1uS <2uS <4uS <8uS <16uS <32uS <64uS longer"));
+    for (uint8_t i=0; i<ISR_STATS_COUNT; i++)
+    {
+        uint8_t sreg = SREG;
+        cli();
+            s = Isr[i];
+            elapsed = millis() - ResetTime;
+        SREG = sreg;
+
+        Serial.print(ptrIsrName(i)); Serial.print(F(": ")); Serial.print(s.Count); Serial.print(F(" runs"));
+        if (s.Count == 0) { Serial.println(); continue; }
+
+        // Busy time in hundredths of a percent is BusyTicks / (elapsed mS x 2000 ticks) x 10,000, or BusyTicks / (elapsed / 5)
+        uint32_t busy = (elapsed >= 5) ? s.BusyTicks / (elapsed / 5) : 0;
+        Serial.print(F(", ")); Serial.print(busy / 100); Serial.print('.'); if (busy % 100 < 10) Serial.print('0'); Serial.print(busy % 100); Serial.print(F("% busy, "));
+        Serial.print(s.Nested); Serial.print(F(" nested, ")); Serial.print(s.BackToBack); Serial.println(F(" back to back"));
+
+        if (s.MaxLateTicks || s.Late[0])
+        {
+            Serial.print(F("   Late: "));
+            for (uint8_t b=0; b<ISR_STATS_BUCKETS; b++) { Serial.print(' '); Serial.print(s.Late[b]); }
+            Serial.print(F("   max ")); Serial.print(s.MaxLateTicks / 2); Serial.println(F(" uS"));
+        }
+        Serial.print(F("   Run:  "));
+        for (uint8_t b=0; b<ISR_STATS_BUCKETS; b++) { Serial.print(' '); Serial.print(s.Run[b]); }
+        Serial.print(F("   max ")); Serial.print(s.MaxRunTicks / 2); Serial.println(F(" uS"));
+    }
+    Reset();
+}
+
+#endif // USE_ISR_STATS
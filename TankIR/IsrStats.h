@@ -0,0 +1,108 @@
+/* OP_IsrStats.h    Open Panzer ISR Stats - how late our interrupts run, how long they take, and how often they pile up
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Everything time-critical in the sketch happens in an interrupt: servo pulses, IR send edges, IR receive edges, the button and the 5 volt
+ * fire input, output pulses and LED fades. They all have to share one processor, and each one that runs long holds up the others. Before
+ * asking them to do more, we want to know how much headroom they leave. For each of our interrupt handlers this keeps:
+ *
+ *      latency     how long after it was due the handler started. Only the compare interrupts know when they were due (the compare register
+ *                  holds it), so the pin change and INT0 handlers have no latency - the edge itself isn't timestamped by the hardware.
+ *      run time    how long the handler took, not counting any other of our handlers that interrupted it (the servo and IR send handlers
+ *                  re-enable interrupts part way through)
+ *      busy        total run time, as a share of the time since the last reset
+ *      nested      how many times it interrupted another of our handlers
+ *      back to back    how many times it started within ISR_STATS_BACK_TO_BACK_TICKS of another of our handlers finishing
+ *
+ * Latency and run time are kept as histograms, one byte per bucket, doubling from one bucket to the next:
+ *      under 1 uS, 2 uS, 4 uS, 8 uS, 16 uS, 32 uS, 64 uS, and anything longer
+ * plus the largest value seen. When a bucket fills up all of that histogram's buckets are halved (rounding up, so a bucket that has had
+ * anything in it never goes back to zero). Times are read from Timer 1 at half a microsecond. The Timer 0 compares only know how late they
+ * are to the nearest 4 uS, one Timer 0 count.
+ *
+ * What this can't see: the cycles the processor spends getting into and out of a handler (saving and restoring registers, up to about 3 uS
+ * for a handler that calls other functions), and the Arduino core's own interrupts (millis() on Timer 0 overflow, and Serial). When those
+ * interrupt one of ours, their time is counted in ours.
+ *
+ * Put ISR_STATS(which) or ISR_STATS_LATE(which, ticks late) at the top of a handler. It measures until the handler returns, however it
+ * returns. A long press of the input button prints the results to the Serial port and starts over.
+ *
+ * All of this only exists if USE_ISR_STATS is defined in Settings.h, otherwise the macros compile to nothing. Tools/hosttest/isr_test.cpp checks the
+ * buckets, the halving, and the nested and back to back counts, through the real INT0 and PCINT2 handlers as well as its own.
+ *
+ */
+
+#ifndef OP_IsrStats_h
+#define OP_IsrStats_h
+
+#include <Arduino.h>
+#include "Settings.h"
+
+// Our interrupt handlers
+#define ISR_STATS_SERVO         0       // TIMER1_COMPA, servo pulses (OP_Servos)
+#define ISR_STATS_IR_SEND       1       // TIMER1_COMPB, IR send edges (IRsendBase)
+#define ISR_STATS_IR_RECEIVE    2       // INT0, IR receive edges (IRrecvPCI)
+#define ISR_STATS_FIRE_INPUT    3       // PCINT1, 5 volt fire input (Cannon.ino)
+#define ISR_STATS_BUTTON        4       // PCINT2, input button (OP_Button)
+#define ISR_STATS_PULSE_OUT     5       // TIMER0_COMPA, output pulses (OP_PulseOut)
+#define ISR_STATS_LED_PWM       6       // TIMER0_COMPB, LED fades (OP_LedPWM)
+#define ISR_STATS_COUNT         7
+
+#define ISR_STATS_BUCKETS       8
+#define ISR_STATS_NO_LATENCY    0xFFFF  // For the handlers that don't know when they were due
+
+#ifdef USE_ISR_STATS
+
+class OP_IsrStats
+{
+    // Static for everything because there is only one processor
+    public:
+        OP_IsrStats(void) {}
+
+        static void     Reset(void);                // Start a new set of measurements
+        static void     Dump(void);                 // Print everything to the Serial port, then Reset()
+
+        // Declared by the ISR_STATS macros below. Measures from here until it goes out of scope.
+        class Scope
+        {   public:
+                Scope(uint8_t isr, uint16_t late) : _Isr(isr), _Stolen(Stolen) { _Start = Enter(isr, late); }
+                ~Scope() { Exit(_Isr, _Start, _Stolen); }
+            private:
+                uint8_t  _Isr;
+                uint16_t _Stolen;                   // Stolen when we started, whatever it has gone up by since was taken by handlers that interrupted us
+                uint16_t _Start;
+        };
+
+    private:
+        struct isr_stats
+        {
+            uint32_t Count;
+            uint32_t BusyTicks;
+            uint16_t MaxLateTicks;
+            uint16_t MaxRunTicks;
+            uint16_t Nested;
+            uint16_t BackToBack;
+            uint8_t  Late[ISR_STATS_BUCKETS];
+            uint8_t  Run[ISR_STATS_BUCKETS];
+        };
+        static isr_stats    Isr[ISR_STATS_COUNT];
+        static uint8_t      Depth;                  // How many of our handlers are running right now, one inside the other
+        static uint16_t     Stolen;                 // Running total of run time, so a handler can take out the time of any that interrupted it
+        static uint16_t     LastExit;               // Timer 1 when the last handler finished
+        static uint32_t     ResetTime;              // millis() at the last Reset()
+        static uint16_t     Enter(uint8_t isr, uint16_t late);
+        static void         Exit(uint8_t isr, uint16_t start, uint16_t stolen);
+        static void         Record(uint8_t * histogram, uint16_t * max, uint16_t ticks);
+};
+
+#define ISR_STATS(isr)              OP_IsrStats::Scope _IsrStats(isr, ISR_STATS_NO_LATENCY)
+#define ISR_STATS_LATE(isr, late)   OP_IsrStats::Scope _IsrStats(isr, late)
+
+#else
+
+#define ISR_STATS(isr)
+#define ISR_STATS_LATE(isr, late)
+
+#endif // USE_ISR_STATS
+
+#endif //OP_IsrStats_h
@@ -0,0 +1,201 @@
+/* OP_LedFX.cpp     Open Panzer LED Effects - layered light effects for the hit notification LEDs, run from a single timer
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Each light effect (cannon hit flicker, machine gun blink, destroyed, repair, reload notify) is a short script kept in program memory.
+ * A script is a list of simple steps - set the brightness, wait, fade to some level, fade to some random level, jump back and repeat -
+ * and any number of scripts can be written without adding any code or any timers.
+ *
+ * Effects are played on layers. Several layers can be running at the same time but only the one with the highest priority (the lowest
+ * layer number) is shown, and when it finishes the one below it shows through again. So for example the destroyed effect can be started
+ * underneath the cannon hit flicker and it will take over when the flicker is done, rather than the flicker having to start it itself.
+ *
+ * All the layers are stepped along by one repeating timer every LEDFX_TICK_mS, so instead of each effect creating and deleting
+ * its own timers we only ever use one timer slot, and what the light does is always decided in one place.
+ *
+ * Brightness in the scripts is how bright the LEDs should look, OP_LedPWM takes care of turning that into a PWM value. Each wait or
+ * fade of the layer being shown is handed to OP_LedPWM as a single fade, which it carries out in hardware-timed steps on its own.
+ *
+ * See Settings.h under the LED EFFECTS heading, and the scripts in OP_Tank.cpp for examples.
+ *
+ */
+
+#include "LedFX.h"
+
+#define LEDFX_MAX_STEPS_PER_TICK    8       // A script that jumps around without ever waiting would otherwise hang the sketch
+
+
+// Static variables must be initialized outside the class
+OP_LedFX::lfx_layer OP_LedFX::Layer[LEDFX_LAYERS];
+int8_t              OP_LedFX::Shown = -1;
+
+
+void OP_LedFX::begin(OP_SimpleTimer * t)
+{
+    OP_LedPWM::begin();                     // Sets the pin to output and off
+    StopAll();
+    Shown = -1;
+    t->setInterval(LEDFX_TICK_mS, Update);
+}
+
+void OP_LedFX::Play(uint8_t layer, const lfx_step * script, uint8_t holdTicks)
+{
+    if (layer >= LEDFX_LAYERS) return;
+    lfx_layer &L = Layer[layer];
+
+    // If this effect is already playing, just hold it again. This is how the cannon hit flicker gets extended by a second hit.
+    // Otherwise start from the top, the first steps will run on the next tick. 
+    if (L.Script != script)
+    {
+        L.Script = script;
+        L.Step = 0;
+        L.Wait = 0;
+        L.Level = 0;
+        L.Slope = 0;
+        L.Target = 0;
+        L.Period = 16;
+    }
+    L.Hold = holdTicks;
+    L.Held = true;
+}
+
+void OP_LedFX::Release(uint8_t layer)
+{
+    if (layer < LEDFX_LAYERS) Layer[layer].Held = false;
+}
+
+void OP_LedFX::Stop(uint8_t layer)
+{
+    if (layer < LEDFX_LAYERS) Layer[layer].Script = NULL;
+}
+
+void OP_LedFX::StopAll(void)
+{
+    for (uint8_t i=0; i<LEDFX_LAYERS; i++) Layer[i].Script = NULL;
+}
+
+boolean OP_LedFX::isPlaying(uint8_t layer)
+{
+    return (layer < LEDFX_LAYERS && Layer[layer].Script != NULL);
+}
+
+void OP_LedFX::Update(void)
+{
+    int8_t shown = -1;
+
+    for (uint8_t i=0; i<LEDFX_LAYERS; i++)
+    {
+        lfx_layer &L = Layer[i];
+        if (L.Script == NULL) continue;
+        L.NewSegment = false;
+
+        // Count down the hold time
+        if (L.Hold && --L.Hold == 0) L.Held = false;
+
+        // Move along whatever wait or fade is in progress, and when it is done, run the next steps
+        if (L.Wait)
+        {
+            L.Wait -= 1;
+            if (L.Wait) L.Level += L.Slope;
+            else        L.Level = (uint16_t)L.Target << 8;  // Land exactly on the target
+        }
+        if (L.Wait == 0) RunSteps(L);
+
+        // The first layer still playing is the one we see
+        if (shown < 0 && L.Script != NULL) shown = i;
+    }
+
+    // We only need to tell the PWM driver anything when a different layer is being shown, or the one being shown has just started
+    // a new wait or fade. In between, the driver carries out the fade by itself. 
+    if (shown != Shown || (shown >= 0 && Layer[shown].NewSegment))
+    {
+        if (shown < 0) OP_LedPWM::Set(0);
+        else
+        {
+            lfx_layer &L = Layer[shown];
+            OP_LedPWM::Set(L.Level >> 8);                                       // Where this layer is now (normally where the driver already is)
+            OP_LedPWM::FadeTo(L.Target, (uint16_t)L.Wait * LEDFX_TICK_mS);     // and where it is going
+        }
+        Shown = shown;
+    }
+}
+
+void OP_LedFX::RunSteps(lfx_layer &L)
+{
+    // Run steps until we get to one that takes some time, or the end
+    for (uint8_t n=0; n<LEDFX_MAX_STEPS_PER_TICK; n++)
+    {
+        lfx_step s;
+        memcpy_P(&s, &L.Script[L.Step], sizeof(lfx_step));
+        L.Step += 1;
+
+        switch (s.Op)
+        {
+            case LFX_SET:
+                L.Level = (uint16_t)s.A << 8;
+                break;
+
+            case LFX_WAIT:
+                if (s.A) { StartFade(L, L.Level >> 8, s.A); return; }
+                break;
+
+            case LFX_FADE:
+                StartFade(L, s.A, s.B ? s.B : 1);
+                return;
+
+            case LFX_RFADE:
+            {
+                // Same as the original Tamiya-style flicker: a random level, approached at a random speed
+                uint8_t target = random(s.A, s.B);
+                uint8_t rate = random(LEDFX_MIN_FADE_STEP, LEDFX_MAX_FADE_STEP);
+                uint8_t now = L.Level >> 8;
+                uint8_t distance = (target > now) ? (target - now) : (now - target);
+                uint8_t ticks = (distance + rate - 1) / rate;
+                StartFade(L, target, ticks ? ticks : 1);
+                return;
+            }
+
+            case LFX_JMP:
+                L.Step = s.A;
+                break;
+
+            case LFX_JMP_HELD:
+                if (L.Held) L.Step = s.A;
+                break;
+
+            case LFX_PERIOD:
+                L.Period = (uint16_t)s.A << 4;
+                break;
+
+            case LFX_WAITP:
+            {
+                uint8_t ticks = (L.Period >> 4) > 255 ? 255 : (L.Period >> 4);
+                StartFade(L, L.Level >> 8, ticks ? ticks : 1);
+                return;
+            }
+
+            case LFX_SCALEP:
+                L.Period = ((uint32_t)L.Period * s.A) >> 8;
+                break;
+
+            case LFX_JMP_PGT:
+                if ((L.Period >> 4) > s.B) L.Step = s.A;
+                break;
+
+            case LFX_END:
+            default:
+                L.Script = NULL;
+                return;
+        }
+    }
+}
+
+void OP_LedFX::StartFade(lfx_layer &L, uint8_t target, uint8_t ticks)
+{
+    // Work out how much to move each tick. A wait is just a fade to where we already are.
+    // (With only one tick the slope is never used, we land on the target directly, so it doesn't matter that it wouldn't fit.)
+    L.Target = target;
+    L.Wait = ticks;
+    L.NewSegment = true;
+    L.Slope = (int16_t)(((int32_t)((uint16_t)target << 8) - (int32_t)L.Level) / ticks);
+}
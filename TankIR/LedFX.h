@@ -0,0 +1,99 @@
+/* OP_LedFX.h       Open Panzer LED Effects - layered light effects for the hit notification LEDs, run from a single timer
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Each light effect (cannon hit flicker, machine gun blink, destroyed, repair, reload notify) is a short script kept in program memory.
+ * A script is a list of simple steps - set the brightness, wait, fade to some level, fade to some random level, jump back and repeat -
+ * and any number of scripts can be written without adding any code or any timers.
+ *
+ * Effects are played on layers. Several layers can be running at the same time but only the one with the highest priority (the lowest
+ * layer number) is shown, and when it finishes the one below it shows through again. So for example the destroyed effect can be started
+ * underneath the cannon hit flicker and it will take over when the flicker is done, rather than the flicker having to start it itself.
+ *
+ * All the layers are stepped along by one repeating timer every LEDFX_TICK_mS, so instead of each effect creating and deleting
+ * its own timers we only ever use one timer slot, and what the light does is always decided in one place.
+ *
+ * Brightness in the scripts is how bright the LEDs should look, OP_LedPWM takes care of turning that into a PWM value. Each wait or
+ * fade of the layer being shown is handed to OP_LedPWM as a single fade, which it carries out in hardware-timed steps on its own.
+ *
+ * See Settings.h under the LED EFFECTS heading, and the scripts in OP_Tank.cpp for examples.
+ *
+ */
+
+#ifndef OP_LedFX_h
+#define OP_LedFX_h
+
+#include <Arduino.h>
+#include "Settings.h"
+#include "SimpleTimer.h"
+#include "LedPWM.h"
+
+
+// Script instructions. Every step is three bytes: the instruction and two arguments (A and B), either of which may be unused. Write all three
+// in every step, with 0 for an argument that isn't used.
+// Jumps go to a step number within the same script, counting from 0. Times are in ticks of LEDFX_TICK_mS.
+#define LFX_END         0       //                  The effect is over, the layer is freed
+#define LFX_SET         1       // level            Set the brightness (0-255) right away
+#define LFX_WAIT        2       // ticks            Hold the present brightness this long
+#define LFX_FADE        3       // level, ticks     Fade evenly from the present brightness to level over this many ticks
+#define LFX_RFADE       4       // low, high        Fade to a random brightness between low and high (high not included), at a random
+                                //                  speed between LEDFX_MIN_FADE_STEP and LEDFX_MAX_FADE_STEP per tick
+#define LFX_JMP         5       // step             Jump to step
+#define LFX_JMP_HELD    6       // step             Jump to step if the effect is still being held (see Play and Release below)
+#define LFX_PERIOD      7       // ticks            Set the layer's period - a wait time that can be changed as the effect runs
+#define LFX_WAITP       8       //                  Hold the present brightness for the period (at least 1 tick)
+#define LFX_SCALEP      9       // n                Multiply the period by n/256 - use less than 256 to speed an effect up
+#define LFX_JMP_PGT     10      // step, ticks      Jump to step if the period is still longer than this many ticks
+
+struct lfx_step{
+    uint8_t Op;
+    uint8_t A;
+    uint8_t B;
+};
+
+// Convert milliseconds to ticks, for writing scripts
+#define LFX_mS(ms)      ((uint8_t)(((ms) + LEDFX_TICK_mS/2) / LEDFX_TICK_mS))
+
+
+class OP_LedFX
+{
+    // Static for everything because there is only one set of hit notification LEDs
+    public:
+        OP_LedFX(void) {}
+
+        // Pass the sketch's SimpleTimer, which we take one repeating slot from. The LEDs are driven by OP_LedPWM. 
+        static void     begin(OP_SimpleTimer *);
+
+        // Start a script (in PROGMEM) on a layer, replacing whatever was playing on that layer. If the same script is already playing on it,
+        // it is not restarted, only held again. holdTicks is how long the effect is "held" - after that LFX_JMP_HELD steps stop jumping,
+        // which is how an effect knows to start winding down. 0 holds it until Release() is called.
+        static void     Play(uint8_t layer, const lfx_step * script, uint8_t holdTicks = 0);
+        static void     Release(uint8_t layer);     // Let the effect on this layer wind down in its own time
+        static void     Stop(uint8_t layer);        // Stop the effect on this layer right now
+        static void     StopAll(void);
+        static boolean  isPlaying(uint8_t layer);
+
+        // Steps every layer along by one tick and sets the output. Called by the timer set up in begin().
+        static void     Update(void);
+
+    private:
+        struct lfx_layer{
+            const lfx_step * Script;    // NULL if the layer is free
+            uint8_t  Step;              // Next step to run
+            uint8_t  Wait;              // Ticks left in the present wait or fade
+            uint16_t Level;             // Present brightness, in 1/256ths so fades can move by fractions
+            int16_t  Slope;             // Change in Level per tick during a fade
+            uint8_t  Target;            // Brightness a fade will finish on
+            uint16_t Period;            // For LFX_WAITP, in 1/16ths of a tick
+            uint8_t  Hold;              // Ticks until the effect is released, 0 if held until Release()
+            boolean  Held;
+            boolean  NewSegment;        // A new wait or fade started this tick
+        };
+        static lfx_layer Layer[LEDFX_LAYERS];
+        static int8_t    Shown;         // Layer being shown, -1 for none
+        static void      RunSteps(lfx_layer &);
+        static void      StartFade(lfx_layer &, uint8_t target, uint8_t ticks);
+};
+
+
+#endif //OP_LedFX_h
@@ -0,0 +1,143 @@
+/* OP_LedPWM.cpp    Open Panzer LED PWM - gamma corrected, hardware timed fades for the hit notification LEDs
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Our eyes don't see LED brightness in a straight line - going from PWM 10 to 20 looks like a big jump, going from 240 to 250 looks like
+ * nothing at all. So a fade done in plain analogWrite steps seems to race through the dim end and then sit at bright, with visible steps
+ * along the way. Here brightness is given as how bright it should *look* (0-255), and a gamma table in program memory converts it to the
+ * PWM value that will actually look that bright.
+ *
+ * Fades are stepped by the Timer 0 Compare B interrupt, once every PWM cycle (1024 uS), so a fade only has to be asked for once and
+ * it moves in small even steps all the way to its target with no help from the main loop.
+ *
+ * The output is OC0B, which is hardwired to Arduino pin 5 (pin_HitNotifyLEDs). See Settings.h under the TIMER 0 heading.
+ *
+ */
+
+#include "LedPWM.h"
+#include "IsrStats.h"
+
+#define LED_PWM_CYCLE_uS    1024    // Timer 0 with the Arduino core's prescaler of 64 overflows every 1024 uS, and Compare B matches once per overflow
+
+
+// Perceived brightness to PWM value, gamma 2.2. Anything above zero gets at least 1 so a dim LED never goes out before it is supposed to.
+const uint8_t GammaTable[256] PROGMEM = 
+{
+      0,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+};
+
+
+// Static variables must be initialized outside the class 
+volatile uint16_t OP_LedPWM::Position;
+volatile int16_t  OP_LedPWM::Slope;
+volatile uint16_t OP_LedPWM::CyclesLeft;
+volatile uint8_t  OP_LedPWM::Target;
+
+
+void OP_LedPWM::begin(void)
+{
+    pinMode(LED_PWM_PIN, OUTPUT);
+    Set(0);
+}
+
+void OP_LedPWM::Set(uint8_t level)
+{
+    uint8_t sreg = SREG;            // Save interrupt register
+    cli();                          // Disable interrupts while we change what the ISR is working with
+        TIMSK0 &= ~_BV(OCIE0B);     // Stop any fade in progress
+        CyclesLeft = 0;
+        Target = level;
+        Position = (uint16_t)level << 8;
+        Write(level);
+    SREG = sreg;                    // Restore register
+}
+
+void OP_LedPWM::FadeTo(uint8_t level, uint16_t ms)
+{
+    // Number of PWM cycles the fade will take, rounded
+    uint16_t cycles = ((uint32_t)ms * 1000UL + LED_PWM_CYCLE_uS / 2) / LED_PWM_CYCLE_uS;
+    if (cycles == 0) { Set(level); return; }
+
+    uint8_t sreg = SREG;
+    cli();
+        Target = level;
+        CyclesLeft = cycles;
+        // With only one cycle the slope is never used, the ISR lands on the target directly, so it doesn't matter that it wouldn't fit
+        Slope = (int16_t)(((int32_t)((uint16_t)level << 8) - (int32_t)Position) / (int32_t)cycles);
+        if (!(TIMSK0 & _BV(OCIE0B)))
+        {
+            TIFR0 = _BV(OCF0B);     // Clear any stale flag (write 1 to clear)
+            TIMSK0 |= _BV(OCIE0B);  // Enable Timer 0 Output Compare B interrupt
+        }
+    SREG = sreg;
+}
+
+uint8_t OP_LedPWM::Level(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+        uint8_t level = Position >> 8;
+    SREG = sreg;
+    return level;
+}
+
+boolean OP_LedPWM::isFading(void)
+{
+    return (TIMSK0 & _BV(OCIE0B)) ? true : false;
+}
+
+void OP_LedPWM::Write(uint8_t level)
+{
+    // In Fast PWM mode a compare value of 0 still gives a sliver of a pulse every cycle, so for off we disconnect the pin from the timer 
+    // and hold it low instead. Same as analogWrite does. OCR0B is double-buffered, a new value takes effect at the start of the next cycle. 
+    uint8_t pwm = pgm_read_byte(&GammaTable[level]);
+    if (pwm == 0)
+    {
+        LED_PWM_STOP;
+        LED_PWM_PORT &= ~LED_PWM_MASK;
+    }
+    else
+    {
+        OCR0B = pwm;
+        LED_PWM_START;
+    }
+}
+
+
+// Timer 0 Output Compare B interrupt service routine
+ISR(TIMER0_COMPB_vect)
+{
+    ISR_STATS_LATE(ISR_STATS_LED_PWM, (uint8_t)(TCNT0 - OCR0B) * 8);      // Timer 0 counts every 4 uS, 8 Timer 1 ticks
+    OP_LedPWM::COMPB_ISR();
+}
+
+void OP_LedPWM::COMPB_ISR(void)
+{
+    // Move one cycle's worth along the fade. Counting down the cycles rather than checking whether we have passed the target means we can't 
+    // overshoot, and the last step lands exactly on it. 
+    if (CyclesLeft == 0) { TIMSK0 &= ~_BV(OCIE0B); return; }
+    uint8_t before = Position >> 8;
+    if (--CyclesLeft) Position += Slope;
+    else
+    {
+        Position = (uint16_t)Target << 8;
+        TIMSK0 &= ~_BV(OCIE0B);     // Done, stop the interrupt
+    }
+    // Slow fades move less than one whole level most cycles, only write when there is something new to write
+    if ((Position >> 8) != before) Write(Position >> 8);
+}
@@ -0,0 +1,49 @@
+/* OP_LedPWM.h      Open Panzer LED PWM - gamma corrected, hardware timed fades for the hit notification LEDs
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Our eyes don't see LED brightness in a straight line - going from PWM 10 to 20 looks like a big jump, going from 240 to 250 looks like
+ * nothing at all. So a fade done in plain analogWrite steps seems to race through the dim end and then sit at bright, with visible steps
+ * along the way. Here brightness is given as how bright it should *look* (0-255), and a gamma table in program memory converts it to the
+ * PWM value that will actually look that bright.
+ *
+ * Fades are stepped by the Timer 0 Compare B interrupt, once every PWM cycle (1024 uS), so a fade only has to be asked for once and
+ * it moves in small even steps all the way to its target with no help from the main loop.
+ *
+ * The output is OC0B, which is hardwired to Arduino pin 5 (pin_HitNotifyLEDs). See Settings.h under the TIMER 0 heading.
+ *
+ */
+
+#ifndef OP_LedPWM_h
+#define OP_LedPWM_h
+
+#include <Arduino.h>
+#include "Settings.h"
+
+
+class OP_LedPWM
+{
+    // Static for everything because there is only one Timer 0 Compare B
+    public:
+        OP_LedPWM(void) {}
+
+        static void     begin(void);                            // Sets the pin to output and off
+        static void     Set(uint8_t level);                     // Go to this (perceived) brightness right away
+        static void     FadeTo(uint8_t level, uint16_t ms);     // Fade evenly from the present brightness to this one over ms milliseconds
+        static uint8_t  Level(void);                            // Present (perceived) brightness
+        static boolean  isFading(void);
+
+        // Called by the timer interrupt service routine, see the cpp file for details.
+        // Don't really want it public, but it has to be for the ISR to see it
+        static void     COMPB_ISR(void);
+
+    private:
+        static volatile uint16_t Position;      // Present brightness in 1/256ths
+        static volatile int16_t  Slope;         // Change in Position per PWM cycle
+        static volatile uint16_t CyclesLeft;    // PWM cycles until the fade reaches Target, 0 if not fading
+        static volatile uint8_t  Target;
+        static void     Write(uint8_t level);
+};
+
+
+#endif //OP_LedPWM_h
@@ -0,0 +1,164 @@
+/* OP_LoopProfile.cpp   Open Panzer Loop Profile - how fast loop() goes round, and where the time goes
+ * Source:              openpanzer.org
+ * Authors:             Luke Middleton
+ *
+ * See LoopProfile.h for a description, and Settings.h under the LOOP PROFILE heading to turn it on.
+ *
+ */
+
+#include "LoopProfile.h"
+
+#ifdef LOOP_PROFILE
+
+#define LOOP_PROFILE_LONG_mS    30                  // Timer 1 rolls over every 32.7 mS, anything longer than this may have gone right round
+#define LOOP_PROFILE_MAX_TOTAL  0xF0000000UL        // Start over before the whole-loop total can overflow, about 33 minutes
+#define LOOP_PROFILE_NAME_WIDTH 10                  // Longest phase name, to line up the printout
+
+// Phase names for the printout
+const __FlashStringHelper *ptrLoopPhaseName(uint8_t phase) {
+  if(phase>LOOP_PHASES) phase=LOOP_PHASES;
+  const __FlashStringHelper *Names[LOOP_PHASES+1]={F("Button"),F("Timers"),F("IR decode"),F("Events"),F("Event log"),F("Config"),F("Stats"),F("Whole loop")};
+  return Names[phase];
+};
+
+
+// Static variables must be initialized outside the class
+OP_LoopProfile::phase_stats OP_LoopProfile::Phase[LOOP_PHASES + 1];
+uint32_t        OP_LoopProfile::LoopCount;
+uint32_t        OP_LoopProfile::ResetTime;
+uint16_t        OP_LoopProfile::LastTicks;
+uint16_t        OP_LoopProfile::LastMillis;
+uint16_t        OP_LoopProfile::LoopStartTicks;
+uint16_t        OP_LoopProfile::LoopStartMillis;
+boolean         OP_LoopProfile::Started = false;
+
+
+uint16_t OP_LoopProfile::Ticks(void)
+{
+    // The servo and IR send ISRs read and write Timer 1's 16 bit registers too, which would upset the shared high byte if one of them came
+    // in halfway through our read
+    uint8_t sreg = SREG;
+    cli();
+        uint16_t t = TCNT1;
+    SREG = sreg;
+    return t;
+}
+
+void OP_LoopProfile::Start(void)
+{
+    uint16_t t = Ticks();
+    uint16_t ms = (uint16_t)millis();
+
+    if (Started)
+    {
+        Record(LOOP_PHASE_LOOP, ((uint16_t)(ms - LoopStartMillis) >= LOOP_PROFILE_LONG_mS) ? 0xFFFF : (uint16_t)(t - LoopStartTicks));
+        if (Phase[LOOP_PHASE_LOOP].TotalTicks >= LOOP_PROFILE_MAX_TOTAL)
+        {
+            Reset();
+            return;
+        }
+    }
+    Started = true;
+    LoopCount += 1;
+
+    LoopStartTicks = LastTicks = t;
+    LoopStartMillis = LastMillis = ms;
+}
+
+void OP_LoopProfile::Mark(uint8_t phase)
+{
+    if (!Started) return;                           // We were reset partway through this loop
+
+    uint16_t t = Ticks();
+    uint16_t ms = (uint16_t)millis();
+    Record(phase, ((uint16_t)(ms - LastMillis) >= LOOP_PROFILE_LONG_mS) ? 0xFFFF : (uint16_t)(t - LastTicks));
+    LastTicks = t;
+    LastMillis = ms;
+}
+
+void OP_LoopProfile::Record(uint8_t phase, uint16_t ticks)
+{
+    phase_stats * p = &Phase[phase];
+
+    if (ticks < p->MinTicks) p->MinTicks = ticks;
+    if (ticks > p->MaxTicks) p->MaxTicks = ticks;
+    p->TotalTicks += ticks;
+
+    // Each bucket is four times as wide as the one before: under 4 ticks, under 16, under 64 and so on
+    uint8_t b = 0;
+    while (ticks >= 4 && b < LOOP_PROFILE_BUCKETS - 1) { ticks >>= 2; b++; }
+    if (p->Histogram[b] == 255)
+    {   // Halve them all, rounding up so a bucket with anything in it never goes back to zero - the rare long ones are what we're looking for
+        for (uint8_t i=0; i<LOOP_PROFILE_BUCKETS; i++) p->Histogram[i] = (p->Histogram[i] + 1) >> 1;
+    }
+    p->Histogram[b] += 1;
+}
+
+void OP_LoopProfile::Reset(void)
+{
+    for (uint8_t i=0; i<=LOOP_PHASES; i++)
+    {
+        memset(&Phase[i], 0, sizeof(phase_stats));
+        Phase[i].MinTicks = 0xFFFF;
+    }
+    LoopCount = 0;
+    ResetTime = millis();
+    Started = false;
+}
+
+uint32_t OP_LoopProfile::Loops(void)
+{
+    return LoopCount;
+}
+
+uint32_t OP_LoopProfile::LoopsPerSecond(void)
+{
+    uint32_t elapsed = millis() - ResetTime;
+    if (elapsed == 0) return 0;
+    // LoopCount x 1000 / elapsed, without LoopCount x 1000 overflowing
+    return (LoopCount / elapsed) * 1000 + ((LoopCount % elapsed) * 1000) / elapsed;
+}
+
+uint16_t OP_LoopProfile::Min_uS(uint8_t phase)
+{
+    return (Phase[phase].MinTicks == 0xFFFF) ? 0 : Phase[phase].MinTicks / 2;
+}
+
+uint16_t OP_LoopProfile::Mean_uS(uint8_t phase)
+{
+    // Every phase is measured once for every loop we counted, except the whole loop, which needs the start of the next one
+    uint32_t n = (phase == LOOP_PHASE_LOOP) ? LoopCount - 1 : LoopCount;
+    if (LoopCount == 0 || n == 0) return 0;
+    return (uint16_t)(Phase[phase].TotalTicks / n / 2);
+}
+
+uint16_t OP_LoopProfile::Max_uS(uint8_t phase)
+{
+    return Phase[phase].MaxTicks / 2;
+}
+
+uint8_t OP_LoopProfile::Bucket(uint8_t phase, uint8_t bucket)
+{
+    return Phase[phase].Histogram[bucket];
+}
+
+void OP_LoopProfile::Dump(void)
+{
+    Serial.println();
+    Serial.println(F("LOOP PROFILE (uS)"));
+    Serial.print(F("Loops per second: ")); Serial.print(LoopsPerSecond()); Serial.print(F(" (")); Serial.print(LoopCount); Serial.println(F(" loops)"));
+    Serial.println(F("Phase: min / mean / max uS, then how many times it took"));
+    Serial.println(F("<2uS <8uS <32uS <128uS <512uS <2mS <8mS longer"));
+    for (uint8_t i=0; i<=LOOP_PHASES; i++)
+    {
+        Serial.print(ptrLoopPhaseName(i)); Serial.print(F(": "));
+        for (uint8_t n=strlen_P((PGM_P)ptrLoopPhaseName(i)); n<LOOP_PROFILE_NAME_WIDTH; n++) Serial.print(' ');
+        Serial.print(Min_uS(i)); Serial.print(F(" / ")); Serial.print(Mean_uS(i)); Serial.print(F(" / ")); Serial.print(Max_uS(i)); Serial.print(F("  "));
+        for (uint8_t b=0; b<LOOP_PROFILE_BUCKETS; b++) { Serial.print(' '); Serial.print(Bucket(i, b)); }
+        Serial.println();
+    }
+    Serial.println(F("(a max of 32767 means 30 mS or more)"));
+    Reset();
+}
+
+#endif // LOOP_PROFILE
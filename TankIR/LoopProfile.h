@@ -0,0 +1,99 @@
+/* OP_LoopProfile.h Open Panzer Loop Profile - how fast loop() goes round, and where the time goes
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Everything the sketch does happens in PerLoopUpdates(), one step after another: read the button, run the timers, decode any IR, hand out
+ * events, send the event log, answer configuration commands, save statistics. A hit is only noticed when we get round to Tank.WasHit(), so
+ * if one of the other steps is slow, hits are registered late. This measures each step (a "phase") every time through the loop, and the loop
+ * as a whole.
+ *
+ * Durations are read from Timer 1, which runs freely at 2 ticks per uS for the servos and IR, so there is no timer to set up and the
+ * resolution is half a microsecond. For each phase we keep the shortest, the longest, the total (for the mean) and a histogram with one
+ * byte per bucket. The buckets go up by a factor of four:
+ *      under 2 uS, 8 uS, 32 uS, 128 uS, 512 uS, 2 mS, 8 mS, and anything longer
+ * When a bucket fills up, all of that phase's buckets are halved, so the shape of the histogram is kept however long it runs (a bucket that
+ * has had anything in it never goes back to zero, though).
+ *
+ * Timer 1 rolls over every 32.7 mS, so a phase that takes longer than that (printing the battle info, say) would look short. Each mark also
+ * glances at millis(), and anything over 30 mS is counted as the longest the timer can measure, in the top bucket.
+ *
+ * A long press of the input button prints the results to the Serial port and starts a new set of measurements. The totals would overflow
+ * after about half an hour, so the measurements also start over by themselves then. The profiler's own couple of microseconds at each mark
+ * are counted in the phase that follows.
+ *
+ * All of this only exists if LOOP_PROFILE is defined in Settings.h, otherwise the marks compile to nothing.
+ *
+ */
+
+#ifndef OP_LoopProfile_h
+#define OP_LoopProfile_h
+
+#include <Arduino.h>
+#include "Settings.h"
+
+// The phases of PerLoopUpdates(), in the order they run
+#define LOOP_PHASE_BUTTON       0       // InputButton.Update()
+#define LOOP_PHASE_TIMER        1       // timer.run(), which includes every timer callback
+#define LOOP_PHASE_HIT          2       // Tank.WasHit(), decoding IR
+#define LOOP_PHASE_DISPATCH     3       // EventBus.Dispatch(), which includes every event handler
+#define LOOP_PHASE_LOG          4       // EventLog.Drain()
+#define LOOP_PHASE_CONFIG       5       // Config.Update()
+#define LOOP_PHASE_STATS        6       // Stats.Update()
+#define LOOP_PHASES             7
+#define LOOP_PHASE_LOOP         LOOP_PHASES     // The whole way round, from one start of PerLoopUpdates() to the next, kept alongside the phases
+
+#define LOOP_PROFILE_BUCKETS    8
+
+#ifdef LOOP_PROFILE
+
+class OP_LoopProfile
+{
+    // Static for everything because there is only one loop
+    public:
+        OP_LoopProfile(void) {}
+
+        static void     Start(void);                // Call at the start of PerLoopUpdates()
+        static void     Mark(uint8_t phase);        // Call at the end of each phase
+
+        static void     Reset(void);                // Start a new set of measurements
+        static uint32_t Loops(void);                // Times round the loop since the last Reset()
+        static uint32_t LoopsPerSecond(void);
+        static uint16_t Min_uS(uint8_t phase);      // Phase is one of the LOOP_PHASE_ values, including LOOP_PHASE_LOOP
+        static uint16_t Mean_uS(uint8_t phase);
+        static uint16_t Max_uS(uint8_t phase);
+        static uint8_t  Bucket(uint8_t phase, uint8_t bucket);
+
+        // Print everything to the Serial port, then Reset()
+        static void     Dump(void);
+
+    private:
+        struct phase_stats
+        {
+            uint16_t MinTicks;
+            uint16_t MaxTicks;
+            uint32_t TotalTicks;
+            uint8_t  Histogram[LOOP_PROFILE_BUCKETS];
+        };
+        static phase_stats  Phase[LOOP_PHASES + 1];
+        static uint32_t     LoopCount;
+        static uint32_t     ResetTime;              // millis() at the last Reset()
+        static uint16_t     LastTicks;              // Timer 1 at the last mark
+        static uint16_t     LastMillis;             // And millis(), to catch anything long enough for the timer to have rolled over
+        static uint16_t     LoopStartTicks;
+        static uint16_t     LoopStartMillis;
+        static boolean      Started;                // False until the first Start() after a Reset(), so the first loop isn't measured from the Reset()
+        static void         Record(uint8_t phase, uint16_t ticks);
+        static uint16_t     Ticks(void);
+};
+
+#define LOOP_PROFILE_START()        OP_LoopProfile::Start()
+#define LOOP_PROFILE_MARK(phase)    OP_LoopProfile::Mark(phase)
+
+#else
+
+#define LOOP_PROFILE_START()
+#define LOOP_PROFILE_MARK(phase)
+
+#endif // LOOP_PROFILE
+
+#endif //OP_LoopProfile_h
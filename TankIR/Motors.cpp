@@ -47,31 +47,17 @@ void Servo_RECOIL::begin(void)
     
     this->setupRecoil_mS(ESC_Position, _RecoilmS, _ReturnmS, _Reversed);
     
-    // This servo also needs to be initialized to its end position. 
-    // Because it looks cool we will ramp it to battery, although this will also block code. 
-    uint16_t p; 
-    if (_Reversed)
-    {   // Use this instead to go straight to the end position
-        //this->writeMicroseconds(ESC_Position, this->getMinPulseWidth(this->ESC_Position));              
-        
-        p = this->getMinPulseWidth(this->ESC_Position);
-        this->setRampSpeed_mS(ESC_Position, _ReturnmS, true);
-        do {delay(1);}
-        while (this->getPulseWidth(ESC_Position) > p);
-        this->stopRamping(ESC_Position);
-        this->writeMicroseconds(ESC_Position, p);
-    }
-    else
-    {   // Use this instead to go straight to the end position
-        //this->writeMicroseconds(ESC_Position, this->getMaxPulseWidth(this->ESC_Position));
-
-        p = this->getMaxPulseWidth(this->ESC_Position);
-        this->setRampSpeed_mS(ESC_Position, _ReturnmS, false);
-        do {delay(1);}
-        while (this->getPulseWidth(ESC_Position) < p);
-        this->stopRamping(ESC_Position);    
-        this->writeMicroseconds(ESC_Position, p);
-    }
+    // This servo also needs to be initialized to its end position. Because it looks cool we ramp it to battery, but we don't wait for it to
+    // get there - the servo ISR carries the move out on its own, so the sketch can go on and start IR reception in the meantime. A recoil fired
+    // before it arrives simply takes over. The return time is for the full travel, so the move takes that fraction of it. 
+    uint16_t p = _Reversed ? this->getMinPulseWidth(this->ESC_Position) : this->getMaxPulseWidth(this->ESC_Position);
+    uint16_t now = this->getPulseWidth(ESC_Position);
+    uint16_t span = this->getMaxPulseWidth(ESC_Position) - this->getMinPulseWidth(ESC_Position);
+    uint16_t travel = (now > p) ? (now - p) : (p - now);
+    uint16_t mS = span ? (uint16_t)(((uint32_t)_ReturnmS * travel) / span) : 0;
+    this->moveTo(ESC_Position, p, mS, SERVO_PROFILE_LINEAR);
+    // Use this instead to go straight to the end position
+    //this->writeMicroseconds(ESC_Position, p);
    
     // We don't need to set anything else, unless the user wants to modify the endpoints
 }
@@ -0,0 +1,118 @@
+/* OP_PulseOut.cpp  Open Panzer Pulse Out - precisely timed one-shot output pulses
+ * Source:          openpanzer.org              
+ * Authors:         Luke Middleton
+ *
+ * Sets an output pin to its active level right away, and returns it to its idle level after a set number of microseconds. The end of the 
+ * pulse is handled by the Timer 0 Compare A interrupt, so the main loop doesn't have to poll for it and the pulse length doesn't depend on 
+ * how long the loop happens to take. Several pulses triggered together (muzzle flash and cannon sound, for example) stay in step with each other. 
+ * See Settings.h under the TIMER 0 heading for more.
+ *   
+ */ 
+
+#include "PulseOut.h"
+#include "IsrStats.h"
+
+#define PULSE_OUT_TICK_uS       4       // Timer 0 with the Arduino core's prescaler of 64 ticks once every 4 uS
+#define PULSE_OUT_CYCLE_uS      1024    // and overflows every 256 ticks
+
+
+// Static variables must be initialized outside the class 
+volatile OP_PulseOut::pulse_slot OP_PulseOut::Slot[PULSE_OUT_SLOTS];
+
+
+boolean OP_PulseOut::Trigger(uint8_t pin, uint8_t activeLevel, uint32_t length_uS)
+{
+    uint8_t port = digitalPinToPort(pin);
+    if (port == NOT_A_PORT) return false;
+    
+    // We write directly to the port rather than use digitalWrite, both here and in the ISR. This means the pin should not be one that 
+    // is presently outputting PWM from analogWrite (digitalWrite would have disconnected the PWM for us). 
+    volatile uint8_t * out = portOutputRegister(port);
+    uint8_t mask = digitalPinToBitMask(pin);
+    uint8_t i;
+
+    uint8_t sreg = SREG;            // Save interrupt register
+    cli();                          // Disable interrupts, we may be called from an ISR (cannon fire from the 5 volt trigger)
+        // If this pin is already pulsing, re-use its slot. Otherwise find a free one
+        for (i = 0; i < PULSE_OUT_SLOTS; i++)
+        {
+            if (Slot[i].port == out && Slot[i].mask == mask) break;
+        }
+        if (i == PULSE_OUT_SLOTS)
+        {
+            for (i = 0; i < PULSE_OUT_SLOTS; i++)
+            {
+                if (Slot[i].port == 0) break;
+            }
+        }
+        
+        if (i < PULSE_OUT_SLOTS)
+        {
+            if (activeLevel) *out |= mask;
+            else             *out &= ~mask;
+            Slot[i].port = out;
+            Slot[i].mask = mask;
+            Slot[i].idleLevel = !activeLevel;
+            Slot[i].due_uS = micros() + length_uS;
+
+            // Start the compare interrupt if it isn't already running. It will come back within one timer cycle and plan from there.
+            if (!(TIMSK0 & _BV(OCIE0A)))
+            {
+                TIFR0 = _BV(OCF0A);         // Clear any stale flag (write 1 to clear)
+                TIMSK0 |= _BV(OCIE0A);      // Enable Timer 0 Output Compare A interrupt
+            }
+        }
+    SREG = sreg;                    // Restore register
+
+    return (i < PULSE_OUT_SLOTS);
+}
+
+
+// Timer 0 Output Compare A interrupt service routine
+ISR(TIMER0_COMPA_vect)
+{
+    ISR_STATS_LATE(ISR_STATS_PULSE_OUT, (uint8_t)(TCNT0 - OCR0A) * 8);    // Timer 0 counts every 4 uS, 8 Timer 1 ticks
+    OP_PulseOut::COMPA_ISR();
+}
+
+
+void OP_PulseOut::COMPA_ISR(void)
+{
+    // The Arduino core runs Timer 0 in Fast PWM mode, where OCR0A is double-buffered: a value we write now only takes effect once the 
+    // timer rolls over and starts its next cycle. So while any pulse is running this interrupt fires once per cycle (every 1024 uS), and 
+    // each time it checks whether the nearest deadline falls within the *next* cycle. If it does, OCR0A is set to land exactly on it. 
+    // Any pulse longer than about 2 mS will therefore end within a few uS of its deadline. Shorter ones may end up to one cycle late. 
+    uint32_t now = micros();
+    uint32_t nearest = 0xFFFFFFFF;
+    
+    for (uint8_t i = 0; i < PULSE_OUT_SLOTS; i++)
+    {
+        if (Slot[i].port == 0) continue;
+        
+        int32_t remaining = (int32_t)(Slot[i].due_uS - now);
+        if (remaining < PULSE_OUT_TICK_uS)
+        {   // Due (within one tick), or overdue. End the pulse and free the slot
+            if (Slot[i].idleLevel) *Slot[i].port |= Slot[i].mask;
+            else                   *Slot[i].port &= ~Slot[i].mask;
+            Slot[i].port = 0;
+        }
+        else if ((uint32_t)remaining < nearest) 
+        {
+            nearest = remaining;
+        }
+    }
+
+    // Nothing left to do, stop the interrupt
+    if (nearest == 0xFFFFFFFF)
+    {
+        TIMSK0 &= ~_BV(OCIE0A);
+        return;
+    }
+
+    // How long until the next timer cycle starts, which is when a new OCR0A value will take effect
+    uint16_t toNextCycle = (uint16_t)(256 - TCNT0) * PULSE_OUT_TICK_uS;
+    
+    if (nearest < toNextCycle)                              OCR0A = 0;   // Too late to hit it exactly, take the earliest match in the next cycle
+    else if (nearest < (uint32_t)(toNextCycle + PULSE_OUT_CYCLE_uS - (PULSE_OUT_TICK_uS / 2)))    OCR0A = (nearest - toNextCycle + (PULSE_OUT_TICK_uS / 2)) / PULSE_OUT_TICK_uS; // Rounded to the nearest tick
+    // Otherwise the deadline is at least a cycle away. Leave OCR0A alone and we will be back at about this same point in the next cycle to try again. 
+}
@@ -0,0 +1,45 @@
+/* OP_PulseOut.h    Open Panzer Pulse Out - precisely timed one-shot output pulses
+ * Source:          openpanzer.org              
+ * Authors:         Luke Middleton
+ *
+ * Sets an output pin to its active level right away, and returns it to its idle level after a set number of microseconds. The end of the 
+ * pulse is handled by the Timer 0 Compare A interrupt, so the main loop doesn't have to poll for it and the pulse length doesn't depend on 
+ * how long the loop happens to take. Several pulses triggered together (muzzle flash and cannon sound, for example) stay in step with each other. 
+ * See Settings.h under the TIMER 0 heading for more.
+ *   
+ */ 
+
+#ifndef OP_PulseOut_h
+#define OP_PulseOut_h
+
+#include <Arduino.h>
+#include "Settings.h"
+
+
+class OP_PulseOut
+{   
+    // Static for everything because there is only one Timer 0 Compare A interrupt
+    public:
+        OP_PulseOut(void) {}
+        
+        // Set the pin to activeLevel now, and back to the opposite level length_uS microseconds from now. The pin must already be set to OUTPUT. 
+        // Triggering a pin that is still in the middle of a pulse restarts the countdown. Returns false if all PULSE_OUT_SLOTS are busy, 
+        // in which case the pin is left alone. 
+        static boolean  Trigger(uint8_t pin, uint8_t activeLevel, uint32_t length_uS);
+
+        // Called by the timer interrupt service routine, see the cpp file for details.
+        // Don't really want it public, but it has to be for the ISR to see it
+        static void     COMPA_ISR(void);
+
+    private:
+        struct pulse_slot {
+            volatile uint8_t * port;    // Output register of the pin, 0 if the slot is free
+            uint8_t  mask;              // Bit mask of the pin within the port
+            uint8_t  idleLevel;         // Level to return the pin to when the pulse is over
+            uint32_t due_uS;            // micros() time when the pulse ends
+        };
+        static volatile pulse_slot Slot[PULSE_OUT_SLOTS];
+};
+
+
+#endif //OP_PulseOut_h
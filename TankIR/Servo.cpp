@@ -12,6 +12,7 @@
 
 
 #include "Servo.h"
+#include "IsrStats.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                   //
@@ -28,6 +29,11 @@
 // Static variables must be initialized outside the class 
 volatile OP_Servos::PortPin OP_Servos::Channel[SERVO_OUT_COUNT]; 
 volatile uint8_t OP_Servos::CurrentChannel;
+volatile boolean OP_Servos::Updating = false;
+#ifdef TIMER1_EDGE_STATS
+volatile uint16_t OP_Servos::MaxEdgeErrorTicks[SERVO_OUT_COUNT];
+volatile uint16_t OP_Servos::GuardShifts;
+#endif
 
 // They are set to private, so you won't be able to access them from the sketch
 uint16_t OP_Servos::_GlobalMaxTicks = SERVO_uS_TO_TICKS(SERVO_OUT_MAXPULSE);
@@ -59,7 +65,10 @@ OP_Servos::OP_Servos()
                 Channel[CurrentChannel].Enabled = false;
                 Channel[CurrentChannel].TickStep = 0;       // Default to no ramp
                 Channel[CurrentChannel].RecoilState = 0;    // No recoil effect
-                Channel[CurrentChannel].RecoilTickStep_Return = 0;      // Default no return effect 
+                Channel[CurrentChannel].RecoilPending = false;
+                Channel[CurrentChannel].FrameCount = 0;
+                Channel[CurrentChannel].MoveProfile = SERVO_PROFILE_NONE;   // Not moving
+                Channel[CurrentChannel].KeyframesLeft = 0;
                 CurrentChannel++;
             }
         SREG = sreg;                    // Restore register
@@ -76,8 +85,8 @@ OP_Servos::OP_Servos()
         // Here we are setting the framespace to 12000. This gives us a minimum guaranteed refresh rate of ~50hz but because the refresh rate is dynamic 
         // and depends on the actual pulse widths, it could be as high as ~62hz (all 4 servos at minimum pulse width of 1000). 
         // Anyway, this should work fine with all normal servos. 
-        // Notice frame space gets assigned to our last "fake" servo (#5)
-        OP_Servos::setFrameSpace(5, 12000);
+        // Notice frame space gets assigned to our last "fake" servo (#5, which is index 4)
+        OP_Servos::setFrameSpace(SERVO_OUT_COUNT-1, 12000);
         
         // Don't run this again
         initialized = true;
@@ -136,12 +145,18 @@ boolean OP_Servos::isAttached(uint8_t WhatChannel)
 // Timer1 Output Compare A interrupt service routine
 ISR(TIMER1_COMPA_vect)
 {
+    ISR_STATS_LATE(ISR_STATS_SERVO, TCNT1 - OCR1A);     // OCR1A still holds the time this compare was due
     OP_Servos::OCR1A_ISR();
 }
 
 
 void OP_Servos::OCR1A_ISR()
 {
+    #ifdef TIMER1_EDGE_STATS
+    // How late are we? OCR1A still holds the time this compare was due. 
+    uint16_t Late = TCNT1 - OCR1A;
+    #endif
+
     // Set the last pin low, set the next pin high, rollover if we reached the last pin
     if(CurrentChannel >= SERVO_OUT_COUNT)
     {   // Start over
@@ -157,27 +172,41 @@ void OP_Servos::OCR1A_ISR()
     // Done with last pin, now set this pin high
     OP_Servos::setPinHigh(CurrentChannel);
 
-    // Set the duration of the pulse. We may need to modify the actual pulse if this is a ramped servo
-    if ( Channel[CurrentChannel].TickStep != 0 )
+    // If a recoil was asked for since this channel's last pulse, it starts now, with this pulse. StartRecoil() leaves it to us rather than 
+    // changing the channel itself, because it can be called from the fire input ISR, which may have interrupted us in the middle of working 
+    // out this same channel's next position below. 
+    if (Channel[CurrentChannel].RecoilPending) OP_Servos::beginRecoil(CurrentChannel);
+
+    // Set the duration of the pulse. This is always the fast path, using the position that was worked out during this channel's previous frame. 
+    OP_Servos::setPulseWidthTimer(CurrentChannel);
+
+    #ifdef TIMER1_EDGE_STATS
+    if (Late > MaxEdgeErrorTicks[CurrentChannel]) MaxEdgeErrorTicks[CurrentChannel] = Late;
+    #endif
+
+    // Go to next channel. We do this before re-enabling interrupts so the ISR is in a consistent state if anything preempts us. 
+    uint8_t ThisChannel = CurrentChannel++;
+
+    // The pin edges and the next compare are done, which is all that is time-critical here. Let the IR send ISR (and IR receive) in while we do the rest - 
+    // otherwise an IR edge that comes due now would have to wait for us to finish working out the next servo position. 
+    // That means we can be re-entered: if we were running late, setPulseWidthTimer() may have set the next compare only TIMER1_MIN_LEAD_TICKS away. 
+    // So only one of us works out positions at a time. If another is already at it (we interrupted it), we've made our edges and set the next 
+    // compare, which is all that matters to the pulse, and we leave this channel where it is for one more frame - its move just ends a frame later. 
+    if (Updating) return;
+    Updating = true;
+    sei();
+
+    // Now that the timer is set, if this servo is recoiling, following a motion profile, or ramping, work out where it should be on its next frame. 
+    // Doing it after the timer is set means the time this takes has no effect on the pulse width. 
+    if ( Channel[ThisChannel].RecoilState != 0 || Channel[ThisChannel].MoveProfile != SERVO_PROFILE_NONE )
     {
-        OP_Servos::setPulseWidthTimer_Ramp(CurrentChannel);
+        OP_Servos::updateMotion(ThisChannel);
     }
-    else 
+    else if ( Channel[ThisChannel].TickStep != 0 )
     {
-        if ( Channel[CurrentChannel].RecoilState == 1 && ((millis() - Channel[CurrentChannel].RecoilStartTime) >  Channel[CurrentChannel].RecoilTime_mS ))
-        {   // Recoil time is up. Start the return. 
-            Channel[CurrentChannel].TickStep = Channel[CurrentChannel].RecoilTickStep_Return;   // Ramp back to starting position at the rate specified in the recoil return setting
-            Channel[CurrentChannel].RecoilState = 2;                // Kickback done, on the return journey
-            OP_Servos::setPulseWidthTimer_Ramp(CurrentChannel);     // This is a ramped movement
-        }       
-        else 
-        {   // This is the regular action. It simply sets the pulse width time
-            OP_Servos::setPulseWidthTimer(CurrentChannel);
-        }
+        OP_Servos::updateRamp(ThisChannel);
     }
-
-    // Go to next channel
-    CurrentChannel++;
+    Updating = false;
 }
 
 
@@ -209,14 +238,40 @@ void OP_Servos::setPinLow(uint8_t WhatChannel)
 // After we set an output pin high, we need to set the timer to come back for the end of the pulse 
 void OP_Servos::setPulseWidthTimer(uint8_t WhatChannel)
 {
-    OCR1A = TCNT1 + Channel[WhatChannel].NumTicks; 
+    // The next compare is measured from when this one was due (OCR1A), not from when we got here (TCNT1). That way if this ISR was held up by another 
+    // interrupt, the pulse still ends on time and the delay doesn't carry over into every channel after it. 
+    uint16_t ThisCompare = OCR1A;
+    uint16_t NextCompare = ThisCompare + Channel[WhatChannel].NumTicks; 
+
+    // The next compare will end this channel's pulse and start the next channel's. If neither channel is attached it won't actually move a pin, so 
+    // there is no harm in running it a little later - and if it would land right on top of a pending IR edge, we do exactly that. Timer 1 Compare A 
+    // has priority over Compare B, so otherwise the IR edge would be the one kept waiting. This only ever stretches an unattached channel or the 
+    // frame space, never a real pulse. 
+    uint8_t NextChannel = (WhatChannel + 1 < SERVO_OUT_COUNT) ? WhatChannel + 1 : 0;
+    if (!Channel[WhatChannel].Enabled && !Channel[NextChannel].Enabled && (TIMSK1 & (1 << OCIE1B)))
+    {
+        int16_t Gap = (int16_t)(NextCompare - OCR1B);
+        if (Gap > -TIMER1_COMPARE_GUARD_TICKS && Gap < TIMER1_COMPARE_GUARD_TICKS)
+        {
+            NextCompare = OCR1B + TIMER1_COMPARE_GUARD_TICKS;
+            #ifdef TIMER1_EDGE_STATS
+            GuardShifts++;
+            #endif
+        }
+    }
+    
+    // If we were so late the next compare time has already passed, the timer would not come back around to it for 32 mS. Better to just run it ASAP. 
+    // (The frame space is longer than half the timer's range, so we compare how late we are against the interval rather than the two times against each other.)
+    if ((uint16_t)(TCNT1 - ThisCompare) + TIMER1_MIN_LEAD_TICKS > (uint16_t)(NextCompare - ThisCompare)) NextCompare = TCNT1 + TIMER1_MIN_LEAD_TICKS;
+    
+    OCR1A = NextCompare;
 }
 
 
-// This is a similar function to the above except it increments or decrements the pulsewidth by the value of Step
+// This increments or decrements the pulsewidth by the value of Step, ready for the next frame. 
 // We make it a separate function because it takes longer and this is run from within the ISR. If we don't need to use it,
-// which we often won't, the faster, inline function above will be called
-void OP_Servos::setPulseWidthTimer_Ramp(uint8_t WhatChannel)
+// which we often won't, it won't be called
+void OP_Servos::updateRamp(uint8_t WhatChannel)
 {
     // Add step to current count. Step can be positive or negative.
     uint16_t TotalTicks = (uint16_t)((int16_t)Channel[WhatChannel].NumTicks + Channel[WhatChannel].TickStep);
@@ -227,21 +282,94 @@ void OP_Servos::setPulseWidthTimer_Ramp(uint8_t WhatChannel)
     if ((TotalTicks > Channel[WhatChannel].MaxTicks) || (TotalTicks < Channel[WhatChannel].MinTicks))
     {
         TotalTicks = constrain(TotalTicks, Channel[WhatChannel].MinTicks, Channel[WhatChannel].MaxTicks);
-
-        // Exceeding the limits is also a signal we need to change the recoil status, if indeed this is a recoil event. 
-        if (Channel[WhatChannel].RecoilState == 2)
-        {// If RecoilState = 2, this means the barrel has completed the recoil and can now be reset
-            Channel[WhatChannel].TickStep = 0;      // No more ramping
-            Channel[WhatChannel].RecoilState = 0;   // Recoil over
-        }
     }
 
     // After constraint, we set the channel's current tick value to the new value (plus or minus the step)
     // This is what allows it to continue to change gradually over time
     Channel[WhatChannel].NumTicks = TotalTicks;
+}
+
+
+// Motion profile tables. Each gives the fraction of the move completed (0 - 32768) at 33 evenly spaced points in time. 
+const uint16_t TrapezoidProfile[33] PROGMEM = { 0, 72, 288, 648, 1152, 1800, 2592, 3528, 4608, 5832, 7200, 8704, 10240, 11776, 13312, 14848, 16384, 
+                                                17920, 19456, 20992, 22528, 24064, 25568, 26936, 28160, 29240, 30176, 30968, 31616, 32120, 32480, 32696, 32768 };
+const uint16_t SCurveProfile[33]    PROGMEM = { 0, 94, 368, 810, 1408, 2150, 3024, 4018, 5120, 6318, 7600, 8954, 10368, 11830, 13328, 14850, 16384, 
+                                                17918, 19440, 20938, 22400, 23814, 25168, 26450, 27648, 28750, 29744, 30618, 31360, 31958, 32400, 32674, 32768 };
+
+// Convert a phase (time through the move, 0 - 32768) into the fraction of the distance covered (also 0 - 32768) for the given profile
+uint16_t OP_Servos::easePhase(uint8_t Profile, uint16_t Phase)
+{
+    if (Profile == SERVO_PROFILE_LINEAR) return Phase;
+
+    const uint16_t * Table = (Profile == SERVO_PROFILE_SCURVE) ? SCurveProfile : TrapezoidProfile;
+    uint8_t  i = Phase >> 10;                               // Which of the 32 segments, the phase is always less than 32768 here
+    uint16_t a = pgm_read_word_near(&Table[i]);
+    uint16_t b = pgm_read_word_near(&Table[i + 1]);
+    // Straight-line interpolation between the two points. Tables always increase, so b - a is never negative
+    return a + (uint16_t)(((uint32_t)(b - a) * (Phase & 0x03FF)) >> 10);
+}
+
+// Set up a new move from the present position. This is called from the ISR as well as from the functions below (with interrupts off). 
+void OP_Servos::beginMove(uint8_t WhatChannel, uint16_t TargetTicks, uint16_t Frames, uint16_t PhaseStep, uint8_t Profile)
+{
+    Channel[WhatChannel].MoveStartTicks = Channel[WhatChannel].NumTicks;
+    Channel[WhatChannel].MoveDeltaTicks = (int16_t)TargetTicks - (int16_t)Channel[WhatChannel].NumTicks;
+    Channel[WhatChannel].MovePhase = 0;
+    Channel[WhatChannel].MovePhaseStep = PhaseStep;
+    Channel[WhatChannel].MovePhaseRem = SERVO_PHASE_END - PhaseStep * Frames;  // A multiply, but no divide
+    Channel[WhatChannel].MovePhaseErr = 0;
+    Channel[WhatChannel].MoveFrames = Frames;
+    Channel[WhatChannel].MoveProfile = Profile;
+    Channel[WhatChannel].FrameCount = Frames;
+}
+
+// Recoil and profiled moves are worked out ahead of time as a number of frames and a phase step, so all we do here is count frames and look up 
+// the next position. There is no reading the time, no dividing and no constraining. This keeps the ISR short, which matters because the IR send 
+// ISR shares Timer 1 with us. 
+void OP_Servos::updateMotion(uint8_t WhatChannel)
+{
+    if (Channel[WhatChannel].RecoilState == 1)
+    {   // Holding the recoiled position
+        if (--Channel[WhatChannel].FrameCount != 0) return;
+        
+        // Done holding, start the return to battery. We carry on below to work out the first step of it. 
+        Channel[WhatChannel].RecoilState = 2;
+        Channel[WhatChannel].KeyframesLeft = 0;
+        beginMove(WhatChannel, Channel[WhatChannel].BatteryNumTicks, Channel[WhatChannel].ReturnFrames, Channel[WhatChannel].ReturnPhaseStep, RECOIL_RETURN_PROFILE);
+    }
+
+    if (--Channel[WhatChannel].FrameCount == 0)
+    {   // Last frame of this move. Land exactly on the target
+        Channel[WhatChannel].NumTicks = Channel[WhatChannel].MoveStartTicks + Channel[WhatChannel].MoveDeltaTicks;
+        
+        if (Channel[WhatChannel].KeyframesLeft)
+        {   // Start the next keyframe, its first step will be worked out next frame
+            const servo_keyframe * k = Channel[WhatChannel].Keyframe;
+            beginMove(WhatChannel, pgm_read_word_near(&k->PulseTicks), pgm_read_word_near(&k->Frames), pgm_read_word_near(&k->PhaseStep), pgm_read_byte_near(&k->Profile));
+            Channel[WhatChannel].Keyframe = k + 1;
+            Channel[WhatChannel].KeyframesLeft--;
+        }
+        else
+        {   // All done
+            Channel[WhatChannel].MoveProfile = SERVO_PROFILE_NONE;
+            Channel[WhatChannel].RecoilState = 0;
+        }
+        return;
+    }
     
-    // Finally, set the timer
-    OCR1A = TCNT1 + TotalTicks;
+    // The phase step was rounded down, so on its own the phase would fall further and further behind, and a long move would be short of its target 
+    // until it jumped there on the last frame (a 1000 frame move is 2% short). So the remainder is carried along the same way a line is drawn on a 
+    // screen: once enough of it has built up to make a whole phase unit, the phase gets it. That makes the phase after k frames exactly 
+    // k x SERVO_PHASE_END / MoveFrames rounded down, which is still always less than SERVO_PHASE_END before the last frame. 
+    Channel[WhatChannel].MovePhase += Channel[WhatChannel].MovePhaseStep;
+    Channel[WhatChannel].MovePhaseErr += Channel[WhatChannel].MovePhaseRem;
+    if (Channel[WhatChannel].MovePhaseErr >= Channel[WhatChannel].MoveFrames)
+    {
+        Channel[WhatChannel].MovePhaseErr -= Channel[WhatChannel].MoveFrames;
+        Channel[WhatChannel].MovePhase++;
+    }
+    uint16_t Fraction = easePhase(Channel[WhatChannel].MoveProfile, Channel[WhatChannel].MovePhase);
+    Channel[WhatChannel].NumTicks = Channel[WhatChannel].MoveStartTicks + (int16_t)(((int32_t)Channel[WhatChannel].MoveDeltaTicks * Fraction) >> 15);
 }
 
 
@@ -389,39 +517,40 @@ void OP_Servos::setRampSpeed_mS(uint8_t WhatChannel, uint16_t Set_mS, uint8_t Re
 
 void OP_Servos::setupRecoil_mS(uint8_t WhatChannel, uint16_t mS_Recoil, uint16_t mS_Return, boolean Reversed)
 {
-    // Basically the same as above, only we save two tickstep values: one for "recoiling" the barrel, and one for "returning" it to start position.
+    // Similar to the above, but rather than a tick step we convert both times into a number of servo frames. The ISR then only has to count
+    // frames: hold the recoiled position for RecoilFrames, then follow the RECOIL_RETURN_PROFILE motion profile back to battery over ReturnFrames. 
     if(WhatChannel > SERVO_OUT_COUNT)
     return;
 
     // Here we constrain the number of milliseconds to some sane values, 15ms to 28 seconds
-    // Assuming 70hZ refresh, keeping it under 28,000 will keep our minimum tick at least 1
     // Anything under 15 would be superfluous because that means the servo would have to move the whole way in less than one frame. 
     mS_Recoil = constrain(mS_Recoil, 15, 28000);
     mS_Return = constrain(mS_Return, 15, 28000);
 
-    // Now convert to Ticks per frame for the return movement. The result is an integer so we are going to be truncating any decimal places in the final answer, 
-    // but the actual calculation is done in floating-point
-    int16_t Return_Ticks = (int16_t)(2000.0 / (((float)mS_Return / 1000.0) * 70.0));
+    uint16_t RecoilFrames = SERVO_FRAMES(mS_Recoil);
+    uint16_t ReturnFrames = SERVO_FRAMES(mS_Return);
 
     uint16_t RecoiledNumTicks;  // For the recoiled movement, we don't ramp - we just go straight to the servo end-point (min or max depending on reversed status)
-                                // and then wait for ms_Recoil time
+    uint16_t BatteryNumTicks;   // and then wait for mS_Recoil time before returning to the other end-point
     
     if (Reversed) 
     {   // If reversed we go up to MaxTicks for recoil, then subtract back down slowly to return
         RecoiledNumTicks = Channel[WhatChannel].MaxTicks;
-        Return_Ticks = -(abs(Return_Ticks));
+        BatteryNumTicks = Channel[WhatChannel].MinTicks;
     }
     else
     {   // If not reversed we go down to MinTicks for recoil, then add back up slowly to return
         RecoiledNumTicks = Channel[WhatChannel].MinTicks;
-        Return_Ticks =   abs(Return_Ticks);
+        BatteryNumTicks = Channel[WhatChannel].MaxTicks;
     }
 
     uint8_t sreg = SREG;        // Disable interrupts while we update the multi byte value 
     cli();
-        Channel[WhatChannel].RecoilTime_mS = mS_Recoil;             // How long to wait for the recoil action
+        Channel[WhatChannel].RecoilFrames = RecoilFrames;           // How many frames to hold the recoil position
+        Channel[WhatChannel].ReturnFrames = ReturnFrames;           // How many frames the return takes
         Channel[WhatChannel].RecoiledNumTicks = RecoiledNumTicks;   // Position of the recoiled servo (min or max depending on reversed status)
-        Channel[WhatChannel].RecoilTickStep_Return = Return_Ticks;  // Tick step to give the correct length of time for the return action
+        Channel[WhatChannel].BatteryNumTicks = BatteryNumTicks;     // Position of the servo at rest
+        Channel[WhatChannel].ReturnPhaseStep = SERVO_PHASE_END / ReturnFrames;   // Phase step to give the correct length of time for the return action
     SREG = sreg;            
 }
 
@@ -432,12 +561,12 @@ void OP_Servos::setRecoilReversed(uint8_t WhatChannel, boolean Reversed)
         if (Reversed)
         {
             Channel[WhatChannel].RecoiledNumTicks = Channel[WhatChannel].MaxTicks;
-            Channel[WhatChannel].RecoilTickStep_Return = -(abs(Channel[WhatChannel].RecoilTickStep_Return));
+            Channel[WhatChannel].BatteryNumTicks = Channel[WhatChannel].MinTicks;
         }
         else
         {
             Channel[WhatChannel].RecoiledNumTicks = Channel[WhatChannel].MinTicks;
-            Channel[WhatChannel].RecoilTickStep_Return =   abs(Channel[WhatChannel].RecoilTickStep_Return);
+            Channel[WhatChannel].BatteryNumTicks = Channel[WhatChannel].MaxTicks;
         }
     SREG = sreg;                
 }
@@ -447,22 +576,79 @@ void OP_Servos::StartRecoil(uint8_t WhatChannel)
     // This kicks off a recoil event
 
     // The first phase is to move the servo as quickly as possible back to the opposite extreme. For this we do not use ramping, we simply set the servo position to the opposite end. 
-    // Then we wait for RecoilTime_mS milliseconds to let the servo reach that position (value set by the user in OP Config). 
+    // Then we wait for RecoilFrames servo frames to let the servo reach that position (time set by the user in A_Setup.h). 
     
-    // After that time expires the servo returns to battery slowly. The length of time it takes to return is also set by the user in OP Config, but in this case we use ramping by a certain
-    // increment (RecoilTickStep_Return) that has been set to take approximately the time the user wants, and will result in the servo moving smoothly, and slowly back. 
+    // After that the servo returns to battery slowly. The length of time it takes to return is also set by the user in A_Setup.h, it has been converted to ReturnFrames
+    // frames, and the servo eases back along a motion profile (RECOIL_RETURN_PROFILE in OP_Servo.h). 
 
     // Don't start a recoil event until the last one is complete
-    if (Channel[WhatChannel].RecoilState != 0) 
+    if (WhatChannel >= SERVO_OUT_COUNT || Channel[WhatChannel].RecoilState != 0) 
     return;
     
-    // Ok, now kick it off
-    uint8_t sreg = SREG;        // Disable interrupts while we update the multi byte value 
+    // This is called from the fire input ISR as well as from the loop, so we don't touch the channel's motion here - the servo ISR may be part 
+    // way through updating it. We just flag it, and the servo ISR kicks it off at the start of this channel's next pulse, which is the soonest 
+    // the new position could go out anyway. 
+    Channel[WhatChannel].RecoilPending = true;
+}
+
+// Called from the servo ISR, with interrupts off, at the start of the channel's pulse
+void OP_Servos::beginRecoil(uint8_t WhatChannel)
+{
+    Channel[WhatChannel].RecoilPending = false;
+    if (Channel[WhatChannel].RecoilState != 0) return;                      // Already recoiling
+    
+    Channel[WhatChannel].RecoilState = 1;
+    Channel[WhatChannel].TickStep = 0;                                      // Cancel any ramping or profiled move, the recoil takes over
+    Channel[WhatChannel].MoveProfile = SERVO_PROFILE_NONE;
+    Channel[WhatChannel].NumTicks = Channel[WhatChannel].RecoiledNumTicks;  // Go straight to the other extreme
+    Channel[WhatChannel].FrameCount = Channel[WhatChannel].RecoilFrames;    // And stay there this many frames
+}
+
+void OP_Servos::moveTo(uint8_t WhatChannel, uint16_t Set_uS, uint16_t Set_mS, uint8_t Profile)
+{
+    // Move from the present position to Set_uS, taking Set_mS milliseconds to get there, following one of the SERVO_PROFILE_ motion profiles. 
+    // Unlike the ramp above, the time is the time for this move, not the time to go from one extreme to the other. 
+    if (WhatChannel >= SERVO_OUT_COUNT)
+    return;
+
+    // Each servo can have its own min and max travel values. Constrain here to stay within these limits. 
+    uint16_t Set_Ticks = constrain(SERVO_uS_TO_TICKS(Set_uS), Channel[WhatChannel].MinTicks, Channel[WhatChannel].MaxTicks);
+    uint16_t Frames = SERVO_FRAMES(Set_mS);
+    if (Profile == SERVO_PROFILE_NONE) Profile = SERVO_PROFILE_LINEAR;
+
+    uint8_t sreg = SREG;        // Disable interrupts while we update the multi byte values
     cli();
-        Channel[WhatChannel].RecoilState = 1;
-        Channel[WhatChannel].NumTicks = Channel[WhatChannel].RecoiledNumTicks;  // Go straight to the other extreme
-        Channel[WhatChannel].RecoilStartTime = millis();                        // Record the time so we know when the wait should be up
-    SREG = sreg;            
+        if (Channel[WhatChannel].RecoilState == 0)  // A recoil in progress takes priority
+        {
+            Channel[WhatChannel].TickStep = 0;      // Cancel any ramping
+            Channel[WhatChannel].KeyframesLeft = 0;
+            beginMove(WhatChannel, Set_Ticks, Frames, SERVO_PHASE_END / Frames, Profile);
+        }
+    SREG = sreg;
+}
+
+void OP_Servos::playKeyframes(uint8_t WhatChannel, const servo_keyframe * Keyframes, uint8_t Count)
+{
+    // Play a table of keyframes from PROGMEM, one after the other. Each keyframe is a move from wherever the last one ended. 
+    if (WhatChannel >= SERVO_OUT_COUNT || Count == 0)
+    return;
+
+    uint8_t sreg = SREG;        // Disable interrupts while we update the multi byte values
+    cli();
+        if (Channel[WhatChannel].RecoilState == 0)  // A recoil in progress takes priority
+        {
+            Channel[WhatChannel].TickStep = 0;      // Cancel any ramping
+            beginMove(WhatChannel, pgm_read_word_near(&Keyframes->PulseTicks), pgm_read_word_near(&Keyframes->Frames), pgm_read_word_near(&Keyframes->PhaseStep), pgm_read_byte_near(&Keyframes->Profile));
+            Channel[WhatChannel].Keyframe = Keyframes + 1;
+            Channel[WhatChannel].KeyframesLeft = Count - 1;
+        }
+    SREG = sreg;
+}
+
+boolean OP_Servos::isMoving(uint8_t WhatChannel)
+{
+    if (WhatChannel >= SERVO_OUT_COUNT) return false;
+    return (Channel[WhatChannel].RecoilState != 0 || Channel[WhatChannel].RecoilPending || Channel[WhatChannel].MoveProfile != SERVO_PROFILE_NONE);
 }
 
 void OP_Servos::setRampStepPerFrame(uint8_t WhatChannel, int16_t Step)
@@ -510,18 +696,34 @@ void OP_Servos::setFrameSpace(uint8_t WhatChannel, uint16_t Set_uS)
 }
 
 
+#ifdef TIMER1_EDGE_STATS
+// Worst-case edge error measurement. Channel 0-3 are the servos, channel 4 (SERVO_OUT_COUNT-1) is the compare that ends the frame space. 
+uint16_t OP_Servos::getMaxEdgeError_uS(uint8_t WhatChannel)
+{
+    if (WhatChannel >= SERVO_OUT_COUNT) return 0;
+    
+    uint8_t sreg = SREG;
+    cli();
+        uint16_t Ticks = MaxEdgeErrorTicks[WhatChannel];
+    SREG = sreg;
+    return SERVO_TICKS_TO_uS(Ticks);
+}
 
+uint16_t OP_Servos::getGuardShifts(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+        uint16_t Shifts = GuardShifts;
+    SREG = sreg;
+    return Shifts;
+}
 
-
-
-
-
-
-
-
-
-
-
-
-
-
+void OP_Servos::clearEdgeStats(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+        for (uint8_t i=0; i<SERVO_OUT_COUNT; i++) MaxEdgeErrorTicks[i] = 0;
+        GuardShifts = 0;
+    SREG = sreg;
+}
+#endif
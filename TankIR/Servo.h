@@ -32,6 +32,42 @@
 #define SERVO_OUT_CENTERPULSE   1500
 #define SERVO_MAXRAMP_TICKSTEP  50
 
+// Length of one complete servo frame. This is the frame space (12000 uS) plus four pulses, and since only the recoil servo is 
+// attached, the other three sit at SERVO_OUT_CENTERPULSE. The recoil pulse itself moves between its end-points so the real frame 
+// varies by a few percent either side of this, which is close enough for converting milliseconds into a number of frames. 
+#define SERVO_FRAME_uS          18000
+
+// Number of frames in a given number of milliseconds, rounded to the nearest frame but never less than one
+#define SERVO_FRAMES_ROUNDED(mS)    ((((uint32_t)(mS) * 1000UL) + (SERVO_FRAME_uS / 2)) / SERVO_FRAME_uS)
+#define SERVO_FRAMES(mS)            ((uint16_t)(SERVO_FRAMES_ROUNDED(mS) > 0 ? SERVO_FRAMES_ROUNDED(mS) : 1))
+
+// Motion profiles. A profiled move takes a servo from where it is to a new position over a set number of frames. The profile decides how the 
+// position changes along the way. Progress through the move (the "phase") runs from 0 to 32768 and is looked up in a 33 point table in flash, 
+// so each frame only costs a table read and a couple of multiplies - there is no division or floating point in the ISR. 
+#define SERVO_PROFILE_NONE      0       // Not moving
+#define SERVO_PROFILE_LINEAR    1       // Constant speed, same as the old ramp
+#define SERVO_PROFILE_TRAPEZOID 2       // Constant acceleration for the first third, constant speed for the middle third, constant deceleration for the last third
+#define SERVO_PROFILE_SCURVE    3       // Smooth start and stop (cubic ease-in/ease-out) with no sudden change in speed
+#define SERVO_PHASE_END         32768
+
+// The recoil return uses a motion profile so the barrel eases into battery rather than slamming into the end-point
+#define RECOIL_RETURN_PROFILE   SERVO_PROFILE_SCURVE
+
+// A keyframe table is a list of moves stored in flash (PROGMEM), played one after another by playKeyframes(). Use the SERVO_KEYFRAME macro to
+// create each entry, that way the frame count and phase step are worked out by the compiler and the ISR never has to divide. For example: 
+//     const servo_keyframe ElevationNod[] PROGMEM = { SERVO_KEYFRAME(1700, 400, SERVO_PROFILE_SCURVE), 
+//                                                     SERVO_KEYFRAME(1300, 800, SERVO_PROFILE_SCURVE), 
+//                                                     SERVO_KEYFRAME(1500, 400, SERVO_PROFILE_TRAPEZOID) };
+//     TankServos.playKeyframes(1, ElevationNod, 3);
+// Keyframe positions are not checked against the servo's end-points, so make sure they are within range. 
+struct servo_keyframe {
+    uint16_t PulseTicks;        // Position to move to, in ticks
+    uint16_t Frames;            // How many frames the move takes
+    uint16_t PhaseStep;         // SERVO_PHASE_END / Frames
+    uint8_t  Profile;           // One of the SERVO_PROFILE_ values above
+};
+#define SERVO_KEYFRAME(uS, mS, Profile)     { SERVO_uS_TO_TICKS(uS), SERVO_FRAMES(mS), (uint16_t)(SERVO_PHASE_END / SERVO_FRAMES(mS)), Profile }
+
 class OP_Servos
 {
     // We are using static for everything because we only want one instance of this class. 
@@ -63,6 +99,14 @@ public:
     static void setupRecoil_mS(uint8_t, uint16_t, uint16_t, boolean);       // Setup recoil parameters, pass ramping speed in mS
     static void StartRecoil(uint8_t);   // Kick off a recoil event
     static void setRecoilReversed(uint8_t, boolean);
+    static void moveTo(uint8_t, uint16_t, uint16_t, uint8_t);                  // Profiled move: channel, position in uS, time in mS, SERVO_PROFILE_
+    static void playKeyframes(uint8_t, const servo_keyframe *, uint8_t);       // Play a PROGMEM keyframe table: channel, table, number of keyframes
+    static boolean isMoving(uint8_t);                                          // True while a profiled move, keyframe table or recoil is in progress
+#ifdef TIMER1_EDGE_STATS
+    static uint16_t getMaxEdgeError_uS(uint8_t);    // Worst-case lateness of the compare that starts this channel's pulse (and ends the previous one)
+    static uint16_t getGuardShifts(void);           // How many edge-less compares were moved out of the way of an IR edge
+    static void clearEdgeStats(void);
+#endif
     
 protected:
     class PortPin
@@ -73,18 +117,35 @@ protected:
             uint16_t MinTicks;          // Minimum pulse width in ticks
             boolean  Enabled;           // Is this servo enabled (attached)
             int16_t  TickStep;          // Used for slowly ramping a servo from one position to another
-            uint8_t  RecoilState;       // Special flag for recoil effect
-            uint32_t RecoilStartTime;   // Time when recoil action starts
-            uint16_t RecoilTime_mS;     // How long to wait for the recoil action to complete
+            uint8_t  RecoilState;       // Special flag for recoil effect: 0 = no recoil, 1 = holding at the recoiled position, 2 = returning to battery
+            boolean  RecoilPending;     // Set by StartRecoil(), the ISR starts the recoil at this channel's next pulse
+            uint16_t FrameCount;        // How many frames are left in the present recoil hold or profiled move
+            uint16_t RecoilFrames;      // How many frames to hold the recoiled position before starting the return
+            uint16_t ReturnFrames;      // How many frames the return to battery takes
+            uint16_t ReturnPhaseStep;   // Phase step for the return (SERVO_PHASE_END / ReturnFrames)
             uint16_t RecoiledNumTicks;  // The full-back position of the recoiled servo, in ticks. Will equal either MaxTicks or MinTicks depending on if the servo is reversed.
-            int16_t  RecoilTickStep_Return; // Specific tick step for slowly returning the barrel to starting position after recoil kick
+            uint16_t BatteryNumTicks;   // The at-rest position the barrel returns to, in ticks. The opposite end-point from RecoiledNumTicks.
+            uint8_t  MoveProfile;       // Profile of the move in progress, SERVO_PROFILE_NONE if not moving
+            uint16_t MoveStartTicks;    // Position at the start of the move
+            int16_t  MoveDeltaTicks;    // Distance to travel, can be negative
+            uint16_t MovePhase;         // Progress through the move, 0 to SERVO_PHASE_END
+            uint16_t MovePhaseStep;     // Amount to add to the phase each frame, SERVO_PHASE_END / MoveFrames rounded down
+            uint16_t MovePhaseRem;      // What the rounding left over (SERVO_PHASE_END - MovePhaseStep x MoveFrames), carried into the phase a bit at a time
+            uint16_t MovePhaseErr;      // How much of the remainder has built up and not been added to the phase yet, always less than MoveFrames
+            uint16_t MoveFrames;        // How many frames the whole move takes
+            const servo_keyframe * Keyframe;    // Next keyframe to play (in PROGMEM)
+            uint8_t  KeyframesLeft;     // How many keyframes are left to play after the present move
     };
 
     static boolean initialized; 
-    static void setPinHigh(uint8_t) __attribute__((always_inline));
-    static void setPinLow(uint8_t) __attribute__((always_inline));    
-    static void setPulseWidthTimer(uint8_t) __attribute__((always_inline));
-    static void setPulseWidthTimer_Ramp(uint8_t);
+    static inline void setPinHigh(uint8_t) __attribute__((always_inline));
+    static inline void setPinLow(uint8_t) __attribute__((always_inline));    
+    static inline void setPulseWidthTimer(uint8_t) __attribute__((always_inline));
+    static void updateRamp(uint8_t);
+    static void updateMotion(uint8_t);
+    static void beginMove(uint8_t, uint16_t, uint16_t, uint16_t, uint8_t);
+    static void beginRecoil(uint8_t);
+    static uint16_t easePhase(uint8_t, uint16_t);
     
     // Information about each channel
     static volatile PortPin Channel[SERVO_OUT_COUNT]; 
@@ -92,6 +153,14 @@ protected:
     // current output channel
     static volatile uint8_t CurrentChannel;    
 
+    // True while the ISR is working out a channel's next position, with interrupts back on
+    static volatile boolean Updating;
+
+#ifdef TIMER1_EDGE_STATS
+    static volatile uint16_t MaxEdgeErrorTicks[SERVO_OUT_COUNT];
+    static volatile uint16_t GuardShifts;
+#endif
+
     
 private:    
     // Remember, static variables must be initialized outside the class
@@ -38,7 +38,22 @@
     
     // Each of these libraries still have many hardcoded references to Timer 1, so if you ever do decide to change the timer you will have to do more than
     // just modifing the above...
-    
+
+    // Because the servo and IR send ISRs share one timer, their compares can land close together, and the AVR will always service Compare A (servos) first.
+    // A late IR edge is worse than a late servo edge - it is what decides whether other manufacturers' boards accept our hits - so both ISRs are written
+    // to make their pin edge first and then re-enable interrupts for their bookkeeping, and both schedule their next compare from the time the edge was
+    // due (OCR1x) rather than from the time the ISR got around to running (TCNT1), so any latency never accumulates from one edge to the next.
+    // On top of that, a servo compare that won't actually move any pin (unattached channels and the frame space) will be pushed out of the way if it
+    // would land within TIMER1_COMPARE_GUARD_TICKS of a pending IR edge.
+    #define TIMER1_COMPARE_GUARD_TICKS  48          // 24 uS - comfortably longer than the servo ISR takes to reach the point where it re-enables interrupts
+    #define TIMER1_MIN_LEAD_TICKS       8           // If an ISR ran so late that its next compare time has already passed, schedule it this far from now instead of
+                                                    // waiting 32 mS for the timer to roll around to it
+
+    // Uncomment TIMER1_EDGE_STATS to measure how late each Timer 1 compare ISR actually ran (TCNT1 - OCR1x on entry) - the worst case is kept for each servo
+    // channel and for IR sending, along with the number of servo compares moved out of the way of IR edges. A long press of the input button prints them.
+    // Leave it commented out for normal use.
+    // #define TIMER1_EDGE_STATS
+
 
 // ------------------------------------------------------------------------------------------------------------------------------------------------------->>
 // TIMER 2
@@ -54,6 +69,24 @@
     #define IR_SEND_PWM_STOP        (TCCR2A &= ~(_BV(COM2B1)))      // Macro to disconnect OC2B from PWM pin
 
 
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// TIMER 0
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // Timer 0 is setup by the Arduino core for millis(), micros() and delay(), and also provides the PWM on pins 5 and 6. We leave its settings alone.
+    // With the core's prescaler of 64 it ticks once every 4 uS and overflows every 1024 uS. 
+    // [] OP_PulseOut - uses Timer 0's Output Compare A interrupt (which the core doesn't use) to end output pulses such as the muzzle flash and sound triggers
+    //    at a precise time. The OC0A pin is Arduino pin 6, which we only use as a digital output for the muzzle flash. Don't use analogWrite on it. 
+    #define PULSE_OUT_SLOTS             6           // How many output pulses can be running at the same time. Each slot costs 8 bytes of RAM. 
+                                                    // We need one for the muzzle flash and one for each of the four Audio FX triggers
+    // [] OP_LedPWM - uses Timer 0's Output Compare B for the PWM on the hit notification LEDs (OC0B is Arduino pin 5, which is why pin_HitNotifyLEDs is
+    //    pin 5), and its interrupt to step LED fades once every timer cycle. The core's analogWrite uses the same compare, so don't call analogWrite on pin 5.
+    #define LED_PWM_PIN                 5                               // Arduino pin 5 (OC0B / PD5)
+    #define LED_PWM_PORT                PORTD
+    #define LED_PWM_MASK                _BV(5)
+    #define LED_PWM_START               (TCCR0A |= _BV(COM0B1))         // Macro to connect OC0B to PWM pin
+    #define LED_PWM_STOP                (TCCR0A &= ~(_BV(COM0B1)))      // Macro to disconnect OC0B from PWM pin
+
+
 // ------------------------------------------------------------------------------------------------------------------------------------------------------->>
 // SIMPLE TIMER
 // ------------------------------------------------------------------------------------------------------------------------------------------------------->>
@@ -62,15 +95,161 @@
     // The class needs to know how many simultaneous timers may be active at any one time. We don't want this number too low or operation will be eratic, 
     // but setting it too high will waste RAM. Each additional slot costs 19 bytes of global RAM. 
 
-    // Our best estimate as of 9/22/2016 (version 00.91.06) is (on the TCB board, this is likely to be more than we need here but we're too lazy to recount): 
-    // Main Sketch:     7       At least 14 slots but shouldn't be more than 7 active at any one time
-    // OP_Tank:         11      At least 15 slots but shouldn't be possible for more than 11 to be active at one time
+    // The old estimate was copied over from the TCB board (18 slots). Recounted for this sketch now that all the hit notification LED effects share a
+    // single OP_LedFX timer instead of creating several timers each: 
+    // Main Sketch:     3       Board LED off, stack probe (only if USE_STACK_PROBE is defined), battle info printout a moment after startup
+    // OP_Tank:         6       Reload, destroyed, repair, enable hit reception (recovery time and waiting for IR sending to finish can overlap), 
+    //                          and the one OP_LedFX timer
+    // OP_Stats:        1       Saving the battle statistics
+    // OP_Telemetry:    1       State snapshots
     //-----------------------
-    // TOTAL:           18   
+    // TOTAL:           11  
 
-    #define MAX_SIMPLETIMER_SLOTS       20          // Based on the calculations above, this gives us a few extra slots in case we miscalculated or if we need to add more
+    #define MAX_SIMPLETIMER_SLOTS       12          // Based on the calculations above, this gives us a few extra slots in case we miscalculated or if we need to add more
                                                     // But any time you add more you should re-visit this list. Sometimes extra timer slots can be used that would only 
-                                                    // operate at times when other timers must be inactive, so not all new timers require the creation of new slots. 
+                                                    // operate at times when other timers must be inactive, so not all new timers require the creation of new slots.
+
+    // Rather than re-counting by hand, you can uncomment SIMPLETIMER_PROFILE to build OP_SimpleTimer with profiling instrumentation. It records the slot high-water mark,
+    // how many times setTimer() failed because all slots were in use, and for each callback function the number of calls, worst-case and mean execution time, and how
+    // late (relative to its deadline) the callback ran. A long press of the input button will dump the results to the Serial port.
+    // Leave it commented out for normal use - the statistics cost roughly 12 bytes of RAM per tracked callback.
+    // #define SIMPLETIMER_PROFILE
+    #define SIMPLETIMER_PROFILE_CALLBACKS   24      // How many distinct callback functions the profiler can keep statistics for
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// CONFIGURATION
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // The settings in A_Setup.h can be changed from a computer and saved to EEPROM without reflashing (see OP_Config.h and Tools/tankconfig.py). 
+    #define CONFIG_EEPROM_ADDRESS       0           // Where the saved configuration starts
+    #define CONFIG_EEPROM_SIZE          64          // EEPROM bytes set aside for it, with room to spare for settings added later. Config.cpp won't compile if
+                                                    // the configuration outgrows it. Anything else kept in EEPROM goes after this.
+    #define CONFIG_SYNC                 0xC5        // Start of a configuration command or reply on the serial port
+    #define CONFIG_RX_TIMEOUT_mS        100         // A command that stops arriving part way through is thrown away after this long
+    #define CONFIG_MIN_END_POINT        500         // Servo end-points outside these are refused
+    #define CONFIG_MAX_END_POINT        2500
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// INPUT BUTTON
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // The input button is read by a pin change interrupt (PCINT2, so pin_Button must be one of Arduino pins 0-7) which timestamps every change into a queue.
+    // OP_Button then sorts out bounces and presses in the background. See OP_Button.h
+    #define BUTTON_DEBOUNCE_mS          25          // A change has to last this long to count
+    #define BUTTON_LONG_PRESS_mS        2000        // Hold this long for a long press
+    #define BUTTON_DOUBLE_PRESS_mS      300         // A second press starting within this long of the first being released makes a double press
+    #define BUTTON_EDGE_QUEUE           8           // How many pin changes can wait to be looked at. Each costs 3 bytes of RAM.
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// EVENT BUS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // Hits, repairs, reloads, button presses and so on are emitted as events by whatever noticed them, and handed out once per loop by OP_EventBus to the
+    // functions that subscribed to them in setup(). See OP_EventBus.h, and EventCodes.h for the list of events.
+    #define EVENTBUS_QUEUE              8           // How many events can be waiting to be handed out. Each costs 2 bytes of RAM. A destroying cannon hit
+                                                    // that cancels a repair is the most we ever emit at once (3).
+    #define EVENTBUS_HANDLERS           18          // How many subscriptions there can be in total. Each costs 3 bytes of RAM. Events.ino has 10 and OP_Stats 6.
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// STARTUP
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // setup() enables IR reception before anything that takes time, and the recoil servo makes its way to battery under the servo ISR instead of holding
+    // up the sketch. The battle info printout is the slowest thing left (nearly 100 mS of serial output), so it waits until the sketch has been running a
+    // while, and then until nothing is going on: no IR coming in or going out, no repair under way and nothing left in the event log. How long it took 
+    // to be ready for hits is logged as an EVENT_BOOT frame, and shown at the bottom of the printout.
+    #define BOOT_INFO_DELAY_mS          1000        // How long after startup to print the battle info
+    #define BATTLE_INFO_RETRY_mS        250         // If we're busy when it's due, how long to wait before trying again
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// BATTLE STATISTICS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // Shots, hits, repairs and so on are counted for each match (each time the board is switched on) and kept in EEPROM, in a ring of records after the
+    // saved configuration. Each match has two records, saved to in turn, so a reset part way through a save never loses the whole match. The oldest 
+    // match is overwritten when the ring is full. Read them back with Tools/tankstats.py. See OP_Stats.h
+    #define STATS_EEPROM_ADDRESS        (CONFIG_EEPROM_ADDRESS + CONFIG_EEPROM_SIZE)    // Where the ring starts
+    #define STATS_EEPROM_END            (E2END + 1)                                     // And where it stops. With two 41 byte records a match, a 1K EEPROM holds 11 matches.
+    #define STATS_SAVE_mS               30000       // How often the running match is saved, if anything has changed. A cell is good for about 100,000 writes,
+                                                    // and a save rewrites only the bytes that changed, so even at this rate the EEPROM will outlast the tank.
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// EVENT LOG
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // Battle events (hits, repairs, reloads and so on) are sent out the serial port as short binary frames instead of text, so the sketch never has to wait
+    // for the serial port to catch up. Run Tools/eventlog.py on your computer to read them. See OP_EventLog.h
+    #define EVENTLOG_BUFFER             64          // Bytes of RAM to hold frames until there is room to send them. The largest frame is 15 bytes. Must be less than 256.
+    #define EVENTLOG_MAX_PAYLOAD        6           // Most extra bytes any event carries (the clock sync)
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// TELEMETRY
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // Along with the events, a snapshot of the tank's state (health, reloaded, invulnerable, repair progress, last hit) goes into the event log so a
+    // scoreboard can follow the match. See OP_Telemetry.h. The snapshot rate is what keeps the bandwidth bounded: at most 14 bytes every
+    // TELEMETRY_INTERVAL_mS, which at the default is 70 bytes a second, well under 1% of what the port can carry at 115200 baud.
+    #define TELEMETRY_INTERVAL_mS       200         // How often we look to see if the state has changed, and send a snapshot if it has
+    #define TELEMETRY_HEARTBEAT_mS      2000        // A snapshot is sent at least this often even when nothing changes, so the scoreboard knows we're still here
+    #define TELEMETRY_RESERVE           30          // A snapshot is skipped unless this much room would still be left in the event log after it, so snapshots
+                                                    // can never crowd out the events themselves. Two of the largest event frames.
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// CLOCK SYNC
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // A computer following the battle (Tools/battleserver) sends time beacons, from which we work out how our millis() lines up with its clock. The result
+    // is logged so everything in the event log can be put on the computer's timeline, and shots and hits from different tanks matched up. See OP_ClockSync.h
+    #define CLOCKSYNC_RESET_mS          1000        // A beacon this far from what we expected means the computer's clock has started again, so we do too
+    #define CLOCKSYNC_DRIFT_WINDOW_mS   30000       // Drift is measured over at least this long. Beacons jitter by a few mS, over 30 seconds that is ~100 ppm.
+    #define CLOCKSYNC_MAX_DRIFT_PPM     10000       // 1%. Ceramic resonators are good to 0.5%, anything more than this is a mistake.
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// LED EFFECTS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // The hit notification LED effects are scripts played by OP_LedFX, which steps all of them along from a single repeating SimpleTimer. See OP_LedFX.h
+    #define LEDFX_TICK_mS               20          // How often the effects are updated. Every wait and fade in the scripts is a whole number of these.
+    #define LEDFX_LAYERS                5           // How many effects can be playing at once (one per layer). Each layer costs 14 bytes of RAM. The layers
+                                                    // themselves are assigned in OP_Tank.h
+    #define LEDFX_MIN_FADE_STEP         10          // Slowest and fastest a random fade (LFX_RFADE) will change the brightness each tick
+    #define LEDFX_MAX_FADE_STEP         50
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// STACK PROBE
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // The stack grows down from the top of RAM towards our global variables, and if the two ever meet the sketch will reset or misbehave. Uncomment
+    // USE_STACK_PROBE to paint all free RAM at boot and periodically check how much of it the stack has used, interrupts included. STACK_PROBE("name") 
+    // lines in a few functions (timer callbacks, setTimer, hit processing, firing) also record which chain of them led to the deepest stack. 
+    // A long press of the input button prints the results to the Serial port. See OP_StackProbe.h
+    // Leave it commented out for normal use - it costs about 40 bytes of RAM and a few microseconds for each probe.
+    // #define USE_STACK_PROBE
+    #define STACK_PROBE_DEPTH           6           // How many levels of nested probes to remember
+    #define STACK_PROBE_INTERVAL_mS     1000        // How often to scan RAM for the deepest point the stack has reached
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// LOOP PROFILE
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // A hit is only noticed when the loop gets round to decoding IR, so a slow step anywhere in PerLoopUpdates() means hits registered late. Uncomment 
+    // LOOP_PROFILE to time every step of it (button, timers, IR decode, events, event log, config, stats) and the loop as a whole, using Timer 1. 
+    // A long press of the input button prints loops per second, and the min, mean and max of each step with a histogram of how long it took. 
+    // See OP_LoopProfile.h
+    // Leave it commented out for normal use - it costs about 150 bytes of RAM and 3 uS per step. When it's off the marks compile to nothing.
+    // #define LOOP_PROFILE
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// ISR STATS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+    // Uncomment USE_ISR_STATS to measure every one of our interrupt handlers (servos, IR send and receive, button, fire input, output pulses, LED fades): how
+    // late it started after its compare was due, how long it ran, what share of the time it kept the processor busy, and how often it interrupted or 
+    // followed straight on from another one. Latency and run time are kept as histograms. A long press of the input button prints them. Where 
+    // TIMER1_EDGE_STATS (above) gives the worst case for each servo channel, this gives the whole picture for each handler. See OP_IsrStats.h
+    // Leave it commented out for normal use - it costs 230 bytes of RAM and adds about 10 uS to every interrupt. When it's off it compiles to nothing.
+    // #define USE_ISR_STATS
+    #define ISR_STATS_BACK_TO_BACK_TICKS    20      // 10 uS. A handler that starts this soon after another finished was waiting on it.
 
 
 // ------------------------------------------------------------------------------------------------------------------------------------------------------->>
@@ -78,7 +257,7 @@
 // ------------------------------------------------------------------------------------------------------------------------------------------------------->>
     
     // Pushbutton
-        #define pin_Button               4          // Input    - Input pushbutton, can be used to fire the cannon manually
+        #define pin_Button               4          // Input    - Input pushbutton, can be used to fire the cannon manually. Must be on Port D (pins 0-7), see Input Button above
 
     // Positive voltage input
         #define pin_VoltageTrigger      A0          // Input    - Apply a positive 5v signal to this pin to fire the cannon (can be taken from a Heng Long/Taigen/Tamiya or other kind of MFU)
@@ -89,7 +268,7 @@
         #define pin_BoardLED            13          // Output   - Green LED on Arduino boards
 
     // Light outputs
-        #define pin_HitNotifyLEDs        5          // Output   - Hit notification LEDs if using the Tamiya apple. PWM capable
+        #define pin_HitNotifyLEDs        5          // Output   - Hit notification LEDs if using the Tamiya apple. Must be LED_PWM_PIN (OC0B), see Timer 0 above
         #define pin_MuzzleFlash          6          // Output   - Trigger output for Taigen High Intensity muzzle flash unit
 
     // Adafruit Audio FX board triggers
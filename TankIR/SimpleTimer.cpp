@@ -16,6 +16,7 @@
 
 
 #include "SimpleTimer.h"
+#include "StackProbe.h"
 
 
 static inline unsigned long elapsed() { return millis(); }
@@ -35,6 +36,10 @@ OP_SimpleTimer::OP_SimpleTimer() {
     }
 
     numTimers = 0;
+
+#ifdef SIMPLETIMER_PROFILE
+    ClearProfile();
+#endif
 }
 
 
@@ -90,11 +95,11 @@ void OP_SimpleTimer::run() {
                 break;
 
             case DEFCALL_RUNONLY:
-                (*callbacks[i])();
+                runCallback(i);
                 break;
 
             case DEFCALL_RUNANDDEL:
-                (*callbacks[i])();
+                runCallback(i);
                 deleteTimer(timerID[i]);    // Pass the unique ID, not the Timer Number
                 break;
         }
@@ -102,6 +107,35 @@ void OP_SimpleTimer::run() {
 }
 
 
+// call the callback function in slot i, timing it if profiling is enabled
+void OP_SimpleTimer::runCallback(int i) {
+    STACK_PROBE("timer callback");
+#ifdef SIMPLETIMER_PROFILE
+    // run() has already advanced prev_millis to the deadline we are servicing, so how far we are past it is our lateness. 
+    // Take a copy of the callback pointer because the callback may delete its own timer (or create new ones) while it runs.
+    timer_callback f = callbacks[i];
+    unsigned long late = elapsed() - prev_millis[i];
+    unsigned long start = micros();
+    (*f)();
+    unsigned long exec = micros() - start;
+
+    int p = findProfile(f);
+    if (p < 0) {
+        if (untracked < 0xFFFF) untracked++;
+        return;
+    }
+    if (profile[p].calls < 0xFFFF) {
+        profile[p].calls++;
+        profile[p].totalExec_uS += exec;
+    }
+    if (exec > profile[p].maxExec_uS) profile[p].maxExec_uS = (exec > 0xFFFF) ? 0xFFFF : exec;
+    if (late > profile[p].maxLate_mS) profile[p].maxLate_mS = (late > 0xFFFF) ? 0xFFFF : late;
+#else
+    (*callbacks[i])();
+#endif
+}
+
+
 // find the first available slot
 // return -1 if none found
 int OP_SimpleTimer::findFirstFreeSlot() {
@@ -125,11 +159,16 @@ int OP_SimpleTimer::findFirstFreeSlot() {
 
 
 int OP_SimpleTimer::setTimer(long d, timer_callback f, int n) {
+    STACK_PROBE("setTimer");
     int returnID;
     int freeTimer;
 
     freeTimer = findFirstFreeSlot();
     if (freeTimer < 0) {
+#ifdef SIMPLETIMER_PROFILE
+        if (allocFailures < 0xFFFF) allocFailures++;
+        lastFailed = f;
+#endif
         return -1;
     }
 
@@ -146,6 +185,9 @@ int OP_SimpleTimer::setTimer(long d, timer_callback f, int n) {
 
     // Increment number of timers
     numTimers++;                
+#ifdef SIMPLETIMER_PROFILE
+    if (numTimers > highWater) highWater = numTimers;
+#endif
     
     // Save timer ID to return to user
     returnID = NextID;
@@ -290,3 +332,53 @@ int OP_SimpleTimer::getTimerNum(int ID)
     
     return timerNum;
 }
+
+
+#ifdef SIMPLETIMER_PROFILE
+int OP_SimpleTimer::findProfile(timer_callback f)
+{
+    for (int p = 0; p < SIMPLETIMER_PROFILE_CALLBACKS; p++)
+    {
+        if (profile[p].callback == f) return p;
+        if (profile[p].callback == 0)
+        {   // First time we've seen this function, claim the empty entry
+            profile[p].callback = f;
+            return p;
+        }
+    }
+    return -1;
+}
+
+
+void OP_SimpleTimer::ClearProfile()
+{
+    memset(profile, 0, sizeof(profile));
+    highWater = numTimers;
+    allocFailures = 0;
+    lastFailed = 0;
+    untracked = 0;
+}
+
+
+void OP_SimpleTimer::DumpProfile()
+{
+    // Callbacks are identified by their address. These are printed as byte addresses, so you can find the function name 
+    // by looking for the same address in the output of "avr-nm -C TankIR.ino.elf"
+    Serial.println();
+    Serial.println(F("SIMPLE TIMER PROFILE"));
+    Serial.print(F("Slots in use:     ")); Serial.print(numTimers); Serial.print(F(" (high-water ")); Serial.print(highWater); Serial.print(F(" of ")); Serial.print(MAX_TIMERS); Serial.println(F(")"));
+    Serial.print(F("Alloc failures:   ")); Serial.print(allocFailures);
+    if (allocFailures) { Serial.print(F(" (last by 0x")); Serial.print((uint16_t)(uintptr_t)lastFailed * 2, HEX); Serial.print(F(")")); }
+    Serial.println();
+    if (untracked) { Serial.print(F("Untracked calls:  ")); Serial.println(untracked); }
+    Serial.println(F("Callback  Calls  Max uS  Mean uS  Max late mS"));
+    for (int p = 0; p < SIMPLETIMER_PROFILE_CALLBACKS && profile[p].callback; p++)
+    {
+        Serial.print(F("0x")); Serial.print((uint16_t)(uintptr_t)profile[p].callback * 2, HEX);
+        Serial.print(F("    ")); Serial.print(profile[p].calls);
+        Serial.print(F("  ")); Serial.print(profile[p].maxExec_uS);
+        Serial.print(F("  ")); Serial.print(profile[p].calls ? profile[p].totalExec_uS / profile[p].calls : 0);
+        Serial.print(F("  ")); Serial.println(profile[p].maxLate_mS);
+    }
+}
+#endif
@@ -76,6 +76,14 @@ public:
     // Gets the timer number (0-MAX_TIMERS) by ID
     int getTimerNum(int ID);
 
+#ifdef SIMPLETIMER_PROFILE
+    // print slot usage and per-callback statistics to the Serial port
+    void DumpProfile();
+
+    // clear all statistics
+    void ClearProfile();
+#endif
+
 private:
     // deferred call constants
     const static int DEFCALL_DONTRUN = 0;       // don't call the callback function
@@ -85,6 +93,9 @@ private:
     // find the first available slot
     int findFirstFreeSlot();
 
+    // call the callback function in slot i
+    void runCallback(int i);
+
     // value returned by the millis() function
     // in the previous run() call
     unsigned long prev_millis[MAX_TIMERS];
@@ -113,6 +124,31 @@ private:
 
     // actual number of timers in use
     int numTimers;
+
+#ifdef SIMPLETIMER_PROFILE
+    // statistics kept for each distinct callback function
+    struct callback_profile {
+        timer_callback callback;    // which function these statistics belong to (0 = unused entry)
+        uint16_t calls;             // number of times called (stops counting at 65535)
+        uint16_t maxExec_uS;        // longest execution time
+        uint32_t totalExec_uS;      // sum of all execution times, used for the mean
+        uint16_t maxLate_mS;        // latest the callback ran after its deadline
+    };
+    callback_profile profile[SIMPLETIMER_PROFILE_CALLBACKS];
+
+    // find (or create) the statistics entry for callback f, returns -1 if the table is full
+    int findProfile(timer_callback f);
+
+    // highest number of timers in use at the same time
+    int highWater;
+
+    // number of times setTimer() failed because no slot was free, and the callback of the last failure
+    uint16_t allocFailures;
+    timer_callback lastFailed;
+
+    // number of calls that could not be tracked because the profile table was full
+    uint16_t untracked;
+#endif
 };
 
 #endif
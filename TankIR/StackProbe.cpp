@@ -0,0 +1,132 @@
+/* OP_StackProbe.cpp    Open Panzer Stack Probe - stack painting and free RAM measurement
+ * Source:              openpanzer.org              
+ * Authors:             Luke Middleton
+ *
+ * See StackProbe.h for a description, and Settings.h under the STACK PROBE heading to turn it on. 
+ *   
+ */ 
+
+#include "StackProbe.h"
+
+#ifdef USE_STACK_PROBE
+
+#define STACK_PAINT     0xC5        // Any value will do as long as it isn't common. 0 and 0xFF are the ones to avoid. 
+
+// These are provided by the linker and by avr-libc's malloc
+extern uint8_t  _end;               // End of our global variables (.data and .bss), where the heap starts
+extern uint8_t  __stack;            // Top of RAM, where the stack starts
+extern char *   __brkval;           // Top of the heap, or 0 if nothing has been allocated yet
+
+// Paint all free RAM. This goes in the .init1 section so it runs straight out of reset, before the C runtime has set up the stack or 
+// cleared our variables, and before any constructors. It is naked and written in assembly because there is no stack to use yet. 
+void StackPaint(void) __attribute__ ((naked)) __attribute__ ((used)) __attribute__ ((section (".init1")));
+void StackPaint(void)
+{
+    __asm volatile ("    ldi r30, lo8(_end)     \n"
+                    "    ldi r31, hi8(_end)     \n"
+                    "    ldi r24, %0            \n"
+                    "    ldi r25, hi8(__stack)  \n"
+                    "    rjmp 2f                \n"
+                    "1:  st Z+, r24             \n"
+                    "2:  cpi r30, lo8(__stack)  \n"
+                    "    cpc r31, r25           \n"
+                    "    brlo 1b                \n"
+                    "    breq 1b                \n"
+                    : : "i" (STACK_PAINT));
+}
+
+
+// Static variables must be initialized outside the class 
+const char * OP_StackProbe::Chain[STACK_PROBE_DEPTH];
+uint8_t      OP_StackProbe::Depth = 0;
+const char * OP_StackProbe::DeepestChain[STACK_PROBE_DEPTH];
+uint8_t      OP_StackProbe::DeepestDepth = 0;
+uint16_t     OP_StackProbe::DeepestSP = 0xFFFF;
+uint16_t     OP_StackProbe::LowWater = 0xFFFF;
+
+
+uint16_t OP_StackProbe::HeapTop(void)
+{
+    return __brkval ? (uint16_t)(uintptr_t)__brkval : (uint16_t)(uintptr_t)&_end;
+}
+
+void OP_StackProbe::Update(void)
+{
+    // Start at the top of the heap and look upwards for the first byte that isn't paint. The stack has been at least that deep. 
+    // We don't need to look past the deepest point we already know about. 
+    uint8_t * p = (uint8_t *)(uintptr_t)HeapTop();
+    uint8_t * stop = (uint8_t *)(uintptr_t)LowWater;
+    if ((uint16_t)(uintptr_t)stop > (uint16_t)(uintptr_t)&__stack) stop = &__stack;
+    while (p < stop && *p == STACK_PAINT) p++;
+    LowWater = (uint16_t)(uintptr_t)p;
+}
+
+uint16_t OP_StackProbe::FreeRAM(void)
+{
+    return SP - HeapTop();
+}
+
+uint16_t OP_StackProbe::MinFreeRAM(void)
+{
+    return LowWater - HeapTop();
+}
+
+uint16_t OP_StackProbe::MaxStackUsed(void)
+{
+    return (uint16_t)(uintptr_t)&__stack - LowWater + 1;
+}
+
+OP_StackProbe::Scope::Scope(const char * name)
+{
+    uint16_t sp = SP;
+    
+    // Interrupts off, in case someone puts a probe in an interrupt routine. The chain then shows the interrupt on top of whatever it interrupted, 
+    // which is exactly what is on the stack. 
+    uint8_t sreg = SREG;
+    cli();
+        if (Depth < STACK_PROBE_DEPTH) Chain[Depth] = name;
+        Depth++;
+        if (sp < DeepestSP)
+        {
+            DeepestSP = sp;
+            DeepestDepth = Depth;
+            for (uint8_t i=0; i<Depth && i<STACK_PROBE_DEPTH; i++) DeepestChain[i] = Chain[i];
+        }
+    SREG = sreg;
+}
+
+OP_StackProbe::Scope::~Scope()
+{
+    uint8_t sreg = SREG;
+    cli();
+        Depth--;
+    SREG = sreg;
+}
+
+void OP_StackProbe::Dump(void)
+{
+    Update();
+    
+    Serial.println();
+    Serial.println(F("STACK & RAM"));
+    Serial.print(F("Globals:          ")); Serial.println((uint16_t)(uintptr_t)&_end - RAMSTART);
+    Serial.print(F("Heap:             ")); Serial.println(HeapTop() - (uint16_t)(uintptr_t)&_end);
+    Serial.print(F("Free now:         ")); Serial.println(FreeRAM());
+    Serial.print(F("Max stack used:   ")); Serial.println(MaxStackUsed());
+    Serial.print(F("Min free RAM:     ")); Serial.println(MinFreeRAM());
+    
+    if (DeepestDepth)
+    {
+        Serial.print(F("Deepest probe:    ")); Serial.print((uint16_t)(uintptr_t)&__stack - DeepestSP); Serial.println(F(" bytes of stack at"));
+        Serial.print(F("   "));
+        for (uint8_t i=0; i<DeepestDepth && i<STACK_PROBE_DEPTH; i++)
+        {
+            if (i) Serial.print(F(" > "));
+            Serial.print((const __FlashStringHelper *)DeepestChain[i]);
+        }
+        if (DeepestDepth > STACK_PROBE_DEPTH) Serial.print(F(" > ..."));
+        Serial.println();
+    }
+}
+
+#endif // USE_STACK_PROBE
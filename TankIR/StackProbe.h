@@ -0,0 +1,68 @@
+/* OP_StackProbe.h  Open Panzer Stack Probe - stack painting and free RAM measurement
+ * Source:          openpanzer.org              
+ * Authors:         Luke Middleton
+ *
+ * The ATmega328 only has 2K of RAM and the stack grows down from the top of it towards our global variables. There is nothing to stop 
+ * the two from running into each other, and when they do the result is usually a reset or some other strange behavior that has nothing 
+ * obvious to do with the cause. This tells us how close we have come. 
+ *
+ * At boot, before any of our code runs, every byte of free RAM is filled ("painted") with a known value. Every so often we look for 
+ * the lowest byte that has been overwritten, which is the deepest the stack has ever been, interrupts included. 
+ * 
+ * That tells you how much room is left but not what used it, so you can also put STACK_PROBE("name") at the top of any function you 
+ * are interested in. Probes remember the chain of probed functions that led to the deepest stack seen at any probe, for example 
+ * "timer callback > HitLEDs_CannonHit > setTimer". 
+ *
+ * All of this only exists if USE_STACK_PROBE is defined in Settings.h, otherwise the probes compile to nothing. 
+ *   
+ */ 
+
+#ifndef OP_StackProbe_h
+#define OP_StackProbe_h
+
+#include <Arduino.h>
+#include "Settings.h"
+
+#ifdef USE_STACK_PROBE
+
+class OP_StackProbe
+{   
+    // Static for everything because there is only one stack
+    public:
+        // Scans the painted RAM for the deepest the stack has been. This takes a few hundred uS, so it is run from a timer rather than every loop. 
+        static void     Update(void);
+        
+        static uint16_t FreeRAM(void);              // Bytes between the top of the heap and the stack right now
+        static uint16_t MinFreeRAM(void);           // Least there has ever been, as of the last Update()
+        static uint16_t MaxStackUsed(void);         // Most stack ever used, as of the last Update()
+
+        // Print everything to the Serial port
+        static void     Dump(void);
+
+        // Declared by the STACK_PROBE macro below. Adds its name to the chain of probed functions while it is in scope. 
+        class Scope
+        {   public:
+                Scope(const char * name);
+                ~Scope();
+        };
+
+    private:
+        static const char * Chain[STACK_PROBE_DEPTH];           // Names (in PROGMEM) of the probes presently in scope, outermost first
+        static uint8_t      Depth;                              // How many probes are in scope, can be more than STACK_PROBE_DEPTH
+        static const char * DeepestChain[STACK_PROBE_DEPTH];    // The chain when the stack was deepest at a probe
+        static uint8_t      DeepestDepth;
+        static uint16_t     DeepestSP;                          // And the stack pointer at that time
+        static uint16_t     LowWater;                           // Lowest address the stack has reached
+        
+        static uint16_t     HeapTop(void);
+};
+
+#define STACK_PROBE(name)   OP_StackProbe::Scope _StackProbe(PSTR(name))
+
+#else
+
+#define STACK_PROBE(name)
+
+#endif // USE_STACK_PROBE
+
+#endif //OP_StackProbe_h
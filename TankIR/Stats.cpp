@@ -0,0 +1,226 @@
+/* OP_Stats.cpp     Open Panzer Stats - battle statistics for each match, kept in EEPROM
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Counting is done in RAM, from the events on OP_EventBus, so nothing in the hit path goes anywhere near the EEPROM. Every STATS_SAVE_mS the
+ * record is copied and written out one byte per loop, into one of this match's pair of slots in a ring of records in EEPROM, taking turns
+ * so the last good copy is never the one being written. See OP_Stats.h
+ *
+ */
+
+#include "Stats.h"
+#include <util/crc16.h>
+#include <stddef.h>
+
+
+// Static variables must be initialized outside the class
+stats_record    OP_Stats::Current;
+stats_record    OP_Stats::Saving;
+uint8_t         OP_Stats::Slot;
+uint8_t         OP_Stats::Copy;
+uint8_t         OP_Stats::SaveIndex = sizeof(stats_record);
+uint16_t        OP_Stats::DecodeErrorsAtStart;
+boolean         OP_Stats::Changed;
+
+#define STATS_SLOTS     ((STATS_EEPROM_END - STATS_EEPROM_ADDRESS) / (2 * sizeof(stats_record)))     // Pairs of records, one match in each
+
+
+void OP_Stats::begin(OP_SimpleTimer * t)
+{
+    // Find the newest record, this match goes in the slot after it. Matches never get anywhere near 65,535 so we don't worry about the number rolling over.
+    stats_record r;
+    boolean found = false;
+    uint16_t newest = 0;
+    Slot = 0;
+    for (uint8_t i=0; i<STATS_SLOTS; i++)
+    {
+        if (ReadSlot(i, &r) && (!found || r.Match > newest))
+        {
+            found = true;
+            newest = r.Match;
+            Slot = (i + 1) % STATS_SLOTS;
+        }
+    }
+
+    memset(&Current, 0, sizeof(Current));
+    Current.Version = STATS_VERSION;
+    Current.Match = newest + 1;
+    Copy = 0;
+    DecodeErrorsAtStart = OP_Tank::UnknownIRCount;
+    Changed = false;                            // A match where nothing happens never gets written
+
+    OP_EventBus::Subscribe(EVENT_CANNON_FIRED, OnCannonFired);
+    OP_EventBus::Subscribe(EVENT_CANNON_HIT, OnCannonHit);
+    OP_EventBus::Subscribe(EVENT_MG_HIT, OnMGHit);
+    OP_EventBus::Subscribe(EVENT_DESTROYED, OnDestroyed);
+    OP_EventBus::Subscribe(EVENT_REPAIR_COMPLETE, OnRepairComplete);
+    OP_EventBus::Subscribe(EVENT_REPAIR_CANCELLED, OnRepairCancelled);
+
+    t->setInterval(STATS_SAVE_mS, SaveIfChanged);
+}
+
+uint8_t OP_Stats::Slots(void)
+{
+    return STATS_SLOTS;
+}
+
+
+
+//------------------------------------------------------------------------------------------------------------------------>>
+// COUNTING
+//------------------------------------------------------------------------------------------------------------------------>>
+void OP_Stats::OnCannonFired(uint8_t)
+{
+    Bump(&Current.ShotsFired);
+}
+
+void OP_Stats::OnCannonHit(uint8_t protocol)
+{
+    Bump(&Current.CannonHits);
+    if (protocol <= LAST_IRPROTOCOL) Bump(&Current.HitsByProtocol[protocol]);
+    IRTEAMS team = OP_Tank::LastHitTeam();
+    if (team <= LAST_IRTEAM) Bump(&Current.HitsByTeam[team]);
+}
+
+void OP_Stats::OnMGHit(uint8_t protocol)
+{
+    Bump(&Current.MGHits);
+    if (protocol <= LAST_IRPROTOCOL) Bump(&Current.HitsByProtocol[protocol]);
+}
+
+void OP_Stats::OnDestroyed(uint8_t)
+{
+    Bump(&Current.Destroyed);
+}
+
+void OP_Stats::OnRepairComplete(uint8_t who)
+{
+    if (who == REPAIR_SELF) Bump(&Current.RepairsReceived);
+    else                    Bump(&Current.RepairsGiven);
+}
+
+void OP_Stats::OnRepairCancelled(uint8_t)
+{
+    Bump(&Current.RepairsCancelled);
+}
+
+void OP_Stats::Bump(uint8_t * count)
+{
+    if (*count < 0xFF) *count += 1;
+    Changed = true;
+}
+
+void OP_Stats::Bump(uint16_t * count)
+{
+    if (*count < 0xFFFF) *count += 1;
+    Changed = true;
+}
+
+
+
+//------------------------------------------------------------------------------------------------------------------------>>
+// SAVING
+//------------------------------------------------------------------------------------------------------------------------>>
+void OP_Stats::SaveIfChanged(void)
+{
+    // Uptime and the decode error count change all the time, but on their own aren't worth wearing out the EEPROM for
+    if (Changed) Save();
+}
+
+void OP_Stats::Save(void)
+{
+    // Take a copy to write out, so the count can carry on while we write. If the last save hasn't finished, this one just starts over with newer numbers.
+    Current.Uptime_S = millis() / 1000;
+    Current.DecodeErrors = OP_Tank::UnknownIRCount - DecodeErrorsAtStart;
+    Current.Saves += 1;
+    Current.CRC = CRC8(&Current);
+    Saving = Current;
+    SaveIndex = 0;
+    Changed = false;
+}
+
+void OP_Stats::Update(void)
+{
+    // Each EEPROM byte takes 3.3 mS to write, and the EEPROM can only do one at a time. Rather than wait, we start writing one byte and
+    // come back next loop to see if it's done. Bytes that haven't changed are skipped, reading them is quick.
+    if (SaveIndex >= sizeof(stats_record) || !eeprom_is_ready()) return;
+
+    const uint8_t * src = (const uint8_t *)&Saving;
+    uint8_t * dest = SlotAddress(Slot, Copy);
+    while (SaveIndex < sizeof(stats_record))
+    {
+        uint8_t i = SaveIndex++;
+        if (eeprom_read_byte(dest + i) != src[i])
+        {
+            eeprom_write_byte(dest + i, src[i]);
+            break;
+        }
+    }
+
+    // That was the last byte of this copy, so the next save goes over the other one. Until now, a save that started over (because the last one
+    // hadn't finished) went back to this same copy and left the good one alone. The last byte is still being written, but the EEPROM won't take
+    // another until it's done.
+    if (SaveIndex >= sizeof(stats_record)) Copy ^= 1;
+}
+
+boolean OP_Stats::GetRecord(uint8_t age, stats_record * r)
+{
+    if (age == 0)
+    {
+        // This match, as it stands right now
+        *r = Current;
+        r->Uptime_S = millis() / 1000;
+        r->DecodeErrors = OP_Tank::UnknownIRCount - DecodeErrorsAtStart;
+        r->CRC = CRC8(r);
+        return true;
+    }
+    if (age >= STATS_SLOTS) return false;
+    uint8_t slot = (Slot + STATS_SLOTS - age) % STATS_SLOTS;
+    if (!ReadSlot(slot, r)) return false;
+    return r->Match == Current.Match - age;         // Anything else is a leftover from before the ring was last cleared, or a gap
+}
+
+void OP_Stats::Clear(void)
+{
+    // Marking every slot empty takes a few tens of mS, but only happens when asked
+    SaveIndex = sizeof(stats_record);
+    for (uint8_t i=0; i<STATS_SLOTS; i++) { eeprom_update_byte(SlotAddress(i, 0), 0xFF); eeprom_update_byte(SlotAddress(i, 1), 0xFF); }
+
+    memset(&Current, 0, sizeof(Current));
+    Current.Version = STATS_VERSION;
+    Current.Match = 1;
+    Slot = 0;
+    Copy = 0;
+    DecodeErrorsAtStart = OP_Tank::UnknownIRCount;
+    Changed = false;
+}
+
+boolean OP_Stats::ReadSlot(uint8_t slot, stats_record * r)
+{
+    // Both copies can be good: the last two saves of one match, or while the first save of a new match is being written, the oldest match
+    // in the other. The higher match number is newer, and within a match the higher save count (which may have rolled over).
+    stats_record other;
+    eeprom_read_block(r, SlotAddress(slot, 0), sizeof(stats_record));
+    eeprom_read_block(&other, SlotAddress(slot, 1), sizeof(stats_record));
+    boolean good = r->Version == STATS_VERSION && r->CRC == CRC8(r);
+    boolean otherGood = other.Version == STATS_VERSION && other.CRC == CRC8(&other);
+    if (otherGood && (!good || other.Match > r->Match || (other.Match == r->Match && (int8_t)(other.Saves - r->Saves) > 0)))
+    {
+        *r = other;
+        return true;
+    }
+    return good;
+}
+
+uint8_t * OP_Stats::SlotAddress(uint8_t slot, uint8_t copy)
+{
+    return (uint8_t *)(STATS_EEPROM_ADDRESS + (uint16_t)(2 * slot + copy) * sizeof(stats_record));
+}
+
+uint8_t OP_Stats::CRC8(const stats_record * r)
+{
+    const uint8_t * p = (const uint8_t *)r;
+    uint8_t crc = 0;
+    for (uint8_t i=0; i < offsetof(stats_record, CRC); i++) crc = _crc8_ccitt_update(crc, p[i]);     // Everything but the CRC itself
+    return crc;
+}
@@ -0,0 +1,100 @@
+/* OP_Stats.h       Open Panzer Stats - battle statistics for each match, kept in EEPROM
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Hits taken, shots fired, repairs and so on used to disappear every time the tank was destroyed or switched off. Now each time the board
+ * starts is counted as a new match, and OP_Stats keeps a record of it: shots fired, cannon and machine gun hits broken down by the protocol
+ * and team that hit us, how many times we were destroyed, repairs, how long we were switched on, and how much IR came in that we couldn't
+ * make sense of. A club can read back the records for the last dozen or so matches after an event (Tools/tankstats.py), without anyone
+ * needing to plug in a laptop during play.
+ *
+ * Counting is done in RAM, from the events on OP_EventBus, so nothing in the hit path goes anywhere near the EEPROM. Every STATS_SAVE_mS the
+ * record is copied and written out - one byte per loop, and only when the EEPROM is ready, so the sketch never stalls the 3.3 mS it takes to
+ * write each byte. Only bytes that have changed are written.
+ *
+ * The records live in a ring in EEPROM after the saved configuration. Each match gets the next pair of slots round the ring, overwriting the
+ * oldest match, so every slot wears out at the same (slow) rate. Saves go to the two slots of the pair in turn, so the one being written is
+ * never the last good copy: if the board is reset or loses power part way through a save (opening the serial port resets most Arduinos),
+ * that copy fails its CRC and we still have the one before it. At boot we find the newest record by its match number, which takes well under
+ * a millisecond.
+ *
+ * "Destroyed" is how many times we were killed. The IR only goes one way, so a tank can't know how many others it destroyed - add up the other
+ * tanks' records for that.
+ *
+ * See Settings.h under the BATTLE STATISTICS heading.
+ *
+ */
+
+#ifndef OP_STATS_H
+#define OP_STATS_H
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "Settings.h"
+#include "SimpleTimer.h"
+#include "EventBus.h"
+#include "Tank.h"
+
+
+#define STATS_VERSION           2       // Bump if stats_record changes, Tools/tankstats.py has to match it
+
+
+// One match. The byte layout is what goes in EEPROM and over the serial port. Counts stop at their maximum rather than rolling over.
+struct stats_record {
+    uint8_t  Version;                               // STATS_VERSION, or 0xFF for an empty slot
+    uint16_t Match;                                 // Counts up by one for every match
+    uint32_t Uptime_S;                              // Seconds the board was on
+    uint16_t ShotsFired;                            // Cannon shots (or repair signals, for a repair tank)
+    uint16_t CannonHits;
+    uint16_t MGHits;
+    uint8_t  HitsByProtocol[LAST_IRPROTOCOL + 1];   // Cannon and machine gun hits, by the IR protocol they came from
+    uint8_t  HitsByTeam[LAST_IRTEAM + 1];           // Cannon hits by the team they came from (only some protocols have teams)
+    uint8_t  Destroyed;
+    uint8_t  RepairsReceived;                       // Repairs of us that were completed
+    uint8_t  RepairsGiven;                          // Repairs of other tanks that were completed (repair tanks only)
+    uint8_t  RepairsCancelled;                      // Repairs either way that were interrupted by a hit
+    uint16_t DecodeErrors;                          // IR that came in but didn't decode as anything we take hits or repairs from
+    uint8_t  Saves;                                 // Counts up with every save of this match. Of the pair of copies, the higher one is newer.
+    uint8_t  CRC;                                   // CRC-8 of everything above
+};
+
+
+class OP_Stats
+{
+    // Static for everything because there is only one set of statistics
+    public:
+        OP_Stats(void) {}
+
+        static void     begin(OP_SimpleTimer *);    // Finds the newest record, starts a new match after it, and subscribes to the events it counts
+        static void     Update(void);               // Writes the next changed byte of a save to EEPROM if it's ready, call once per loop
+        static void     Save(void);                 // Start saving the current match now (also happens every STATS_SAVE_mS)
+        static boolean  GetRecord(uint8_t age, stats_record *);   // 0 = this match, 1 = the one before, ... Returns false if there is no such record
+        static void     Clear(void);                // Erases every saved record, and starts the count for this match again from zero
+        static uint8_t  Slots(void);                // How many matches the ring can hold
+
+        // Event handlers, public only so the event bus can see them
+        static void     OnCannonFired(uint8_t);
+        static void     OnCannonHit(uint8_t);
+        static void     OnMGHit(uint8_t);
+        static void     OnDestroyed(uint8_t);
+        static void     OnRepairComplete(uint8_t);
+        static void     OnRepairCancelled(uint8_t);
+
+    private:
+        static stats_record Current;                // The match being counted
+        static stats_record Saving;                 // Copy of it being written out
+        static uint8_t  Slot;                       // Which pair of slots in the ring this match goes in
+        static uint8_t  Copy;                       // Which of the pair the next save goes to, 0 or 1
+        static uint8_t  SaveIndex;                  // Next byte of Saving to write, or sizeof(stats_record) when not saving
+        static uint16_t DecodeErrorsAtStart;        // OP_Tank's count when the match started
+        static boolean  Changed;                    // Something has been counted since the last save
+        static void     SaveIfChanged(void);        // Timer callback
+        static uint8_t  CRC8(const stats_record *);
+        static uint8_t * SlotAddress(uint8_t slot, uint8_t copy);
+        static boolean  ReadSlot(uint8_t slot, stats_record *);     // The newer of the pair's good copies, false if neither is good
+        static void     Bump(uint8_t * count);      // Add one unless it's at 255
+        static void     Bump(uint16_t * count);
+};
+
+
+#endif
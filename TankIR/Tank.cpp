@@ -20,22 +20,18 @@ boolean         OP_Tank::isDestroyed;
 Servo_RECOIL  * OP_Tank::_RecoilServo;
 uint8_t         OP_Tank::CannonHitsTaken;
 uint8_t         OP_Tank::MGHitsTaken;
-float           OP_Tank::DamagePct;
-float           OP_Tank::DamagePctPerCannonHit;
-float           OP_Tank::DamagePctPerMGHit;
-boolean         OP_Tank::RepairOngoing;
+uint16_t        OP_Tank::UnknownIRCount;
+uint32_t        OP_Tank::DamagePoints;
+uint32_t        OP_Tank::DamagePointsMax;
+uint16_t        OP_Tank::DamagePointsPerCannonHit;
+uint16_t        OP_Tank::DamagePointsPerMGHit;
+damage_profile  OP_Tank::DamageProfile;
+uint8_t         OP_Tank::RepairOngoing;
 int             OP_Tank::RepairTimerID;
+uint32_t        OP_Tank::RepairStartTime;
 IRTYPES         OP_Tank::_lastHit;
 IRTEAMS         OP_Tank::_lastTeam;
-
-// Hit notification LED effect variables
-boolean         OP_Tank::HitLEDsOn;
-int16_t         OP_Tank::FadeStep;
-int16_t         OP_Tank::FadeTarget;
-int16_t         OP_Tank::CurrentFadeLevel;  
-boolean         OP_Tank::FadeOut;
-int             OP_Tank::FadeStep_TimerID;
-int             OP_Tank::HitLED_TimerID;
+shot_fingerprint OP_Tank::RecentShots[HIT_DEDUP_SLOTS];
 
 
 
@@ -50,11 +46,40 @@ const __FlashStringHelper *ptrWeightClassName(WEIGHTCLASS wClass) {
 // Return a character string of the name of the damage profile, used for printing
 const __FlashStringHelper *ptrDamageProfile(DAMAGEPROFILES dProfile) {
   if(dProfile>LAST_DAMAGE_PROFILE) dProfile = LAST_DAMAGE_PROFILE+1;
-  const __FlashStringHelper *Names[LAST_DAMAGE_PROFILE+2]={F("Tamiya Spec"), F("Open Panzer"), F("Unknown")};
+  const __FlashStringHelper *Names[LAST_DAMAGE_PROFILE+2]={F("Tamiya Spec"), F("Open Panzer"), F("Custom"), F("Unknown")};
   return Names[dProfile];
 };
 
 
+// The standard weight classes. Settings are defined by the Tamiya standard, see the insert to Tamiya #53447 "Hop Up Options: Battle System"
+// Tamiya classes do not accept hits from machine gun fire, so maxMGHits is left at zero, which tells LoadWeightClass to keep the custom value from A_Setup.h
+// (it only matters if the user has turned on MG damage anyway). The custom row is only a placeholder so the table can be indexed by WEIGHTCLASS. 
+const weightClassSettings WeightClassTable[LAST_WEIGHT_CLASS+1] PROGMEM = 
+{
+//    reload    recovery    hits    MG hits
+    {    0,         0,       0,      0 },       // WC_CUSTOM    - never read, custom settings come from the sketch
+    { 3000,     15000,       3,      0 },       // WC_LIGHT     - 3 second reload, 15 second recovery, 3 hits
+    { 5000,     12000,       6,      0 },       // WC_MEDIUM    - 5 second reload, 12 second recovery, 6 hits
+    { 9000,     10000,       9,      0 }        // WC_HEAVY     - 9 second reload! 10 second recovery, 9 hits
+};
+
+// The built-in damage profiles, indexed by DAMAGEPROFILES. See the damage_profile struct in OP_Tank.h for how to read these. 
+// If you add a row here, also add its #define in OP_Tank.h (before CUSTOM_DAMAGE, which moves up one) and its name to ptrDamageProfile above. 
+// A club that only wants its own rules doesn't need to touch this, see CUSTOM_DAMAGE. 
+const damage_profile DamageProfileTable[BUILT_IN_DAMAGE_PROFILES] PROGMEM = 
+{
+    // TAMIYA_DAMAGE - For reference, see the package insert to Tamiya #53447 "Hop Up Options: Battle System". The 2-shot kill code always takes half 
+    // of full health. Speed is cut to 50% until half the tank's health is gone, then to 25% until it is destroyed. 
+    {   { {IR_TAMIYA_2SHOT, DAMAGE_WEIGHT_HALF} },
+        { {50, 50}, {100, 75} } 
+    },
+    // OPENPANZER_DAMAGE - Same weights, but the speed falls off more gradually with damage
+    {   { {IR_TAMIYA_2SHOT, DAMAGE_WEIGHT_HALF} },
+        { {25, 20}, {50, 40}, {75, 60}, {100, 80} } 
+    }
+};
+
+
 
 // Constructor
 OP_Tank::OP_Tank() 
@@ -62,12 +87,12 @@ OP_Tank::OP_Tank()
     // Initialize
     CannonReloadComplete = true;
     IR_Enabled = true;
-    RepairOngoing = false;
-    HitLEDsOn = false;
+    RepairOngoing = REPAIR_NONE;
     isDestroyed = false;        
     CannonHitsTaken = 0;        
     MGHitsTaken = 0;
-    DamagePct = 0;     
+    DamagePoints = 0;     
+    DamagePointsMax = 1;                        // Real values are worked out in begin()
     DisableHitReception();                      // We start by ignoring hits
     IR_Rx = new IRrecvPCI(IR_RECEIVE_INT_NUM);  // Pass the external interrupt number to the IRrecvPCI class (Arduino Interrupt 0 on the TCB - see OP_Tank.h)
     IR_Rx->setBlinkingOnReceive(true);        // For testing only. This will cause the board LED to flash on any IR reception, whether the IR can be decoded or not.
@@ -91,34 +116,51 @@ void OP_Tank::begin(battle_settings BS, Servo_RECOIL * sr,  OP_SimpleTimer * t)
     }
 
 
+    // Start the hit notification LED effects, they will take one timer slot
+    OP_LedFX::begin(TankTimer);
+
     // Enable IR
     IR_Enabled = true;
     IR_Rx->enableIRIn();
 
     // If we aren't using a custom weight class, setup the specified Tamiya weight class
-    SetupTamiyaWeightClass(BattleSettings.WeightClass);
+    LoadWeightClass(BattleSettings.WeightClass);
+
+    // Load the damage profile, anything unknown gets the Tamiya profile. A custom profile comes with the battle settings. 
+    if (BattleSettings.DamageProfile < 0 || BattleSettings.DamageProfile > LAST_DAMAGE_PROFILE) BattleSettings.DamageProfile = TAMIYA_DAMAGE;
+    if (BattleSettings.DamageProfile == CUSTOM_DAMAGE) LoadDamageProfile(&BattleSettings.CustomDamage);
+    else GetDamageProfile(BattleSettings.DamageProfile, &DamageProfile);
 
     // Setup damage settings
+    // Rather than 100 percent, full damage is 2 x maxHits x maxMGHits points. A cannon hit is then worth exactly 2 x maxMGHits points and an MG hit 
+    // exactly 2 x maxHits points, so it always takes precisely maxHits cannon hits or maxMGHits MG hits to destroy the tank, and any mix of the two 
+    // counts each at its true fraction. The extra 2 makes the 50% of a two-shot hit a whole number too. Largest possible is 2 x 255 x 255 = 130,050. 
+    // A weight class with zero hits would be destroyed on the first hit, same as it always was. 
+    uint8_t CannonHits = BattleSettings.ClassSettings.maxHits   ? BattleSettings.ClassSettings.maxHits   : 1;
+    uint8_t MGHits     = BattleSettings.ClassSettings.maxMGHits ? BattleSettings.ClassSettings.maxMGHits : 1;
     if (BattleSettings.IR_FireProtocol != IR_DISABLED && BattleSettings.IR_MGProtocol != IR_DISABLED && BattleSettings.Accept_MG_Damage)
     {
         // The vehicle will take damage from both cannon fire and machine gun fire. 
-        DamagePctPerCannonHit = 100.0 / (float)BattleSettings.ClassSettings.maxHits;
-        DamagePctPerMGHit =     100.0 / (float)BattleSettings.ClassSettings.maxMGHits;
+        DamagePointsMax = 2UL * CannonHits * MGHits;
+        DamagePointsPerCannonHit = 2 * MGHits;
+        DamagePointsPerMGHit = 2 * CannonHits;
     }
     else if (BattleSettings.IR_FireProtocol != IR_DISABLED)
     {
         // The vehicle will take damage from cannon fire only
-        DamagePctPerCannonHit = 100.0 / (float)BattleSettings.ClassSettings.maxHits;
-        DamagePctPerMGHit = 0.0;
+        DamagePointsMax = 2UL * CannonHits;
+        DamagePointsPerCannonHit = 2;
+        DamagePointsPerMGHit = 0;
     }
     else
     {
         // The vhicle will only take damage from machine gun fire (unlikely you would want this scenario)
-        DamagePctPerCannonHit = 0.0;
-        DamagePctPerMGHit = 100.0 / (float)BattleSettings.ClassSettings.maxMGHits;      
+        DamagePointsMax = 2UL * MGHits;
+        DamagePointsPerCannonHit = 0;
+        DamagePointsPerMGHit = 2;
     }
-    //Serial.print(F("Damage per Cannon Hit: "));   Serial.println(DamagePctPerCannonHit,2);
-    //Serial.print(F("Damage per MG Hit: "));       Serial.println(DamagePctPerMGHit,2);
+    //Serial.print(F("Damage per Cannon Hit: "));   Serial.print(DamagePointsPerCannonHit); Serial.print(F("/")); Serial.println(DamagePointsMax);
+    //Serial.print(F("Damage per MG Hit: "));       Serial.print(DamagePointsPerMGHit);     Serial.print(F("/")); Serial.println(DamagePointsMax);
 
     // Start
     EnableHitReception();      // Accept incoming hits
@@ -127,7 +169,7 @@ void OP_Tank::begin(battle_settings BS, Servo_RECOIL * sr,  OP_SimpleTimer * t)
 
 boolean OP_Tank::isRepairTank()
 {   
-    return REPAIR_TANK; // Define set in A_Setup.h
+    return BattleSettings.RepairTank;   // Default set in A_Setup.h, can be changed in the configuration saved to EEPROM
 
     // Or you could use a physical switch  - 
     
@@ -136,40 +178,22 @@ boolean OP_Tank::isRepairTank()
 //    return digitalRead(pin_RepairTank);
 }
 
-void OP_Tank::SetupTamiyaWeightClass(char weight_class)
+void OP_Tank::LoadWeightClass(WEIGHTCLASS weight_class)
 {
-    // This routine assigns settings according to the given Tamiya weight class
-    // Settings are defined by the Tamiya standard, see the insert to Tamiya #53447 "Hop Up Options: Battle System"
-    // There are three Tamiya classes: LIGHT, MEDIUM, and HEAVY.
-    // Tamiya classes do not accept hits from machine gun fire.
+    // This routine assigns settings according to the given Tamiya weight class, which are kept in WeightClassTable at the top of this file. 
+    // There are three Tamiya classes: LIGHT, MEDIUM, and HEAVY. Anything unknown defaults to MEDIUM. 
 
-    // Of course the user also has the option of creating a custom weight class, in which case this routine is skipped and the custom settings are used instead. 
+    // Of course the user also has the option of creating a custom weight class, in which case this routine is skipped and the custom settings 
+    // passed to begin() are used instead. 
+    if (weight_class == WC_CUSTOM) return;
+    if (weight_class > LAST_WEIGHT_CLASS) weight_class = WC_MEDIUM;
 
     BattleSettings.WeightClass = weight_class;
-    
-    switch (BattleSettings.WeightClass)
-    {
-        //case CUSTOM:                                              // CUSTOM
-        // The custom case is handled in the begin() function above
-        
-        case WC_LIGHT:                                              // LIGHT
-            BattleSettings.ClassSettings.reloadTime = 3000;         // 3 second reload
-            BattleSettings.ClassSettings.maxHits = 3;               // 3 hits before destruction
-            BattleSettings.ClassSettings.recoveryTime = 15000;      // 15 second recovery (invulnerability) time
-            break;
-
-        case WC_HEAVY:                                              // HEAVY
-            BattleSettings.ClassSettings.reloadTime = 9000;         // 9 second reload! 
-            BattleSettings.ClassSettings.maxHits = 9;               // 9 hits before destruction
-            BattleSettings.ClassSettings.recoveryTime = 10000;      // 10 second recovery (invulnerability) time
-            break;
-
-        case WC_MEDIUM:                                             // MEDIUM
-        default:                                                    // Anything unknown, default to MEDIUM
-            BattleSettings.ClassSettings.reloadTime = 5000;         // 5 second reload
-            BattleSettings.ClassSettings.maxHits = 6;               // 6 hits before destruction
-            BattleSettings.ClassSettings.recoveryTime = 12000;      // 12 second recovery (invulnerability) time
-    }
+
+    weightClassSettings wc;
+    memcpy_P(&wc, &WeightClassTable[weight_class], sizeof(weightClassSettings));
+    if (wc.maxMGHits == 0) wc.maxMGHits = BattleSettings.ClassSettings.maxMGHits;
+    BattleSettings.ClassSettings = wc;
 }
 
 
@@ -180,6 +204,7 @@ void OP_Tank::SetupTamiyaWeightClass(char weight_class)
 
 void OP_Tank::Fire(void)
 {
+    STACK_PROBE("Fire");
     // There is a lot going on when we fire the cannon, and the order of things can be different between airsoft and mechanical recoil, 
     // or whether the tank is a Repair tank or not. So we break it down into small parts and call them one after the other. 
     
@@ -192,12 +217,15 @@ void OP_Tank::Fire(void)
         {
             // This is a repair tank. We skip mechanical/servo recoil and airsoft. We do have a repair sound, and we also do a
             // special light effect on the hit notification LEDs (in the apple). And of course we also send the repair IR code. 
-            RepairOngoing = true;   // Set the repair flag. It is the same flag if we are being repaired as it is if we are repairing someone else. 
+            RepairOngoing = REPAIR_OTHER;   // Set the repair flag. It is the same flag if we are being repaired as it is if we are repairing someone else, but this way we know which.
             Repair_BlinkHandler();      // Do the special repair light effect (start blinking slow and gradually increase faster and faster)
             // Start the repair timer. During this time we can not fire the repair signal again, nor can we move (the move disabling is handled by the sketch)
-            TankTimer->setTimeout(REPAIR_TIME_mS, RepairOver);   // REPAIR_TIME_mS is set in OP_BattleTimes.h
+            RepairTimerID = TankTimer->setTimeout(REPAIR_TIME_mS, RepairOver);   // REPAIR_TIME_mS is set in OP_BattleTimes.h
+            RepairStartTime = millis();
             Cannon_StartReload();   // Start the reload timer - but we actually still won't be able to fire again until after the repair is over, which takes longer than reloading.
             Cannon_SendIR();        // Send the IR code
+            OP_EventBus::Emit(EVENT_REPAIR_STARTED, REPAIR_OTHER);
+            OP_EventBus::Emit(EVENT_CANNON_FIRED, BattleSettings.IR_RepairProtocol);
         }
         // Or is this a fighting tank? 
         else 
@@ -206,7 +234,7 @@ void OP_Tank::Fire(void)
             _RecoilServo->Recoil();     // Trigger recoil servo
             Cannon_Flash();             // Flash the high intensity flash unit
             Cannon_StartReload();       // Now start the reload timer
-
+            OP_EventBus::Emit(EVENT_CANNON_FIRED, BattleSettings.IR_FireProtocol);
         }
     }
 }
@@ -261,8 +289,8 @@ void OP_Tank::Cannon_StartReload(void)
 void OP_Tank::ReloadComplete(void)
 {
     CannonReloadComplete = true;
-    if (CANNON_RELOAD_NOTIFY) HitLEDs_ReloadNotify();   // If enabled, briefly blink the apple notification LEDs to signify reload is complete. 
-    Serial.println(F("Canon reloaded"));   
+    if (BattleSettings.ReloadNotify) HitLEDs_ReloadNotify();   // If enabled, briefly blink the apple notification LEDs to signify reload is complete. 
+    OP_EventBus::Emit(EVENT_RELOAD_COMPLETE);
 }
 boolean OP_Tank::CannonReloaded(void)
 {
@@ -278,13 +306,8 @@ boolean OP_Tank::CannonReloaded(void)
 void OP_Tank::TriggerMuzzleFlash(void)
 {
     // This one is a PNP transistor, so logic HIGH = OFF, LOW = ON
-    digitalWrite(pin_MuzzleFlash, LOW);
-    TankTimer->setTimeout(MUZZLE_FLASH_TRIGGER_mS, ClearMuzzleFlash);
-}
-void OP_Tank::ClearMuzzleFlash(void)
-{
-    // Muzzle flash is over. Remember, for PNP HIGH = off
-    digitalWrite(pin_MuzzleFlash, HIGH);
+    // OP_PulseOut returns the pin to HIGH (off) when the time is up
+    OP_PulseOut::Trigger(pin_MuzzleFlash, LOW, MUZZLE_FLASH_TRIGGER_mS * 1000UL);
 }
 
 
@@ -297,9 +320,9 @@ void OP_Tank::ClearMuzzleFlash(void)
 // Returns the HIT_TYPE if the tank was hit
 HIT_TYPE OP_Tank::WasHit(void)
 {
+STACK_PROBE("WasHit");
 // Initialize to false
 boolean hit = false; 
-boolean TwoShotHit = false;
 
     if (isInvulnerable || isDestroyed || IR_Enabled == false)
     {
@@ -332,12 +355,10 @@ boolean TwoShotHit = false;
                 // If so, save it to the _lastHit variable
                 if (hit) _lastHit = BattleSettings.IR_FireProtocol;
                 
-                // If the FireProtocol is set to Tamiya 2-Shot and we were hit, we want to save that because damage will be different 
-                if (hit && BattleSettings.IR_FireProtocol == IR_TAMIYA_2SHOT) { TwoShotHit = true; }
                 // But even if we weren't hit, because they set it to the 2-shot protocol, we automatically check for regular 1/16 Tamiya code as well
                 if (!hit && BattleSettings.IR_FireProtocol == IR_TAMIYA_2SHOT) { hit = IR_Decoder.decode(IR_TAMIYA); if (hit) { _lastHit = IR_TAMIYA; } }
                 // Likewise, if the FireProtocol is set to Tamiya, automatically check for Tamiya 2-Shot kill code as well
-                if (!hit && BattleSettings.IR_FireProtocol == IR_TAMIYA) { hit = TwoShotHit = IR_Decoder.decode(IR_TAMIYA_2SHOT); if (hit) { _lastHit = IR_TAMIYA_2SHOT; } }
+                if (!hit && BattleSettings.IR_FireProtocol == IR_TAMIYA) { hit = IR_Decoder.decode(IR_TAMIYA_2SHOT); if (hit) { _lastHit = IR_TAMIYA_2SHOT; } }
             }
             // Now we also check the second one, but only if the first one didn't already return a hit, and if the second one is not set to null or the same as the first
             if (!hit && BattleSettings.IR_HitProtocol_2 != IR_DISABLED && BattleSettings.IR_HitProtocol_2 != BattleSettings.IR_FireProtocol)
@@ -348,12 +369,10 @@ boolean TwoShotHit = false;
                 if (hit) _lastHit = BattleSettings.IR_HitProtocol_2;
                 
                 // Same deal here, if the user wants to check one Tamiya code, we automatically also check the other. 
-                // If the HitProtocol_2 is set to Tamiya 2-Shot and we were hit, we want to save that because damage will be different 
-                if (hit && BattleSettings.IR_HitProtocol_2 == IR_TAMIYA_2SHOT) { TwoShotHit = true; }
                 // But even if we weren't hit, because they set it to the 2-shot protocol, we automatically check for regular 1/16 Tamiya code as well
                 if (!hit && BattleSettings.IR_HitProtocol_2 == IR_TAMIYA_2SHOT) { hit = IR_Decoder.decode(IR_TAMIYA); if (hit) { _lastHit = IR_TAMIYA; } }
                 // Likewise, if the HitProtocol_2 is set to Tamiya, automatically check for Tamiya 2-Shot kill code as well
-                if (!hit && BattleSettings.IR_HitProtocol_2 == IR_TAMIYA) { hit = TwoShotHit = IR_Decoder.decode(IR_TAMIYA_2SHOT); if (hit) { _lastHit = IR_TAMIYA_2SHOT; } }
+                if (!hit && BattleSettings.IR_HitProtocol_2 == IR_TAMIYA) { hit = IR_Decoder.decode(IR_TAMIYA_2SHOT); if (hit) { _lastHit = IR_TAMIYA_2SHOT; } }
             }
             
             // If hit is true, we were hit with cannon fire. But some protocols implement teams and if we were hit with one of those we want to record
@@ -374,48 +393,49 @@ boolean TwoShotHit = false;
                 }
             }
 
+
+            // Each shot is sent several times over. If this is just another copy of a shot we already counted, ignore it but keep listening - 
+            // someone else may be shooting at us too
+            if (hit && isRepeatShot())
+            {
+                EnableHitReception();
+                return HIT_TYPE_NONE;
+            }
             
             // Ok, now if hit is still true we really were hit by cannon fire
             if (hit)
             {   
-                DisableHitReception();      // Temporary invulnerability after being hit (mostly so we only proces the hit a single time)
-                
                 // What about if we were in the middle of being repaired? We need to cancel the repair and turn off the repair lights
                 // to make way for the cannon hit lights. 
                 if (RepairOngoing) CancelRepair(); 
                 
                 CannonHitsTaken += 1;       // Increment number of cannon hits taken
                 
-                // Increment our overall damage percent 
-                if (TwoShotHit)
+                // Increment our overall damage
+                // How much depends on what hit us - the damage profile can weight some protocols differently, for example Tamiya two-shot hits 
+                // increase damage by 50 percent each time. Everything else increases by the amount-per-cannon-hit
+                if (AddDamage(CannonHitPoints(_lastHit)))
                 {
-                    DamagePct += 50;    // Two-shot hits increase damage by 50 percent each time
-                }
-                else
-                {
-                    DamagePct += DamagePctPerCannonHit; // Regular hits increase by the amount-per-cannon-hit
-                }
-                
-                if (DamagePct >= 100.0)
-                {
-                    // Don't let damage go above 100%
-                    DamagePct = 100.0;
-                                        
                     // After destruction, the tank becomes inoperative for some period of time (15 seconds is the Tamiya spec - NOT the same as recovery/invulnerability time!)
                     // After that time it will automatically recover itself. During invulnerability time, the tank can fire but is impervious to enemy fire. 
                     // Invulnerabilty time is dependent on the weight class. 
                     isDestroyed = true;
+                    DisableHitReception();
                     TankTimer->setTimeout(DESTROYED_INOPERATIVE_TIME_mS, ResetBattle);   // DESTROYED_INOPERATIVE_TIME_mS is defined in Tank.h
                     // Start the destroyed light effect
-                    HitLEDs_CannonHit();    // After the cannon hit effect, because isDestroyed is true, the subsequent HitLEDs_Destroyed effect will start automatically
+                    HitLEDs_Destroyed();    // The destroyed effect plays underneath the cannon hit effect, and shows through once the flicker is done
+                    HitLEDs_CannonHit();    
+                    OP_EventBus::Emit(EVENT_CANNON_HIT, _lastHit);
+                    OP_EventBus::Emit(EVENT_DESTROYED, _lastHit);
                 }
                 else
                 {
                     // Flash the hit notification LEDs
                     HitLEDs_CannonHit();
-                    // Start a brief invulnerability timer. Each IR signal is sent multiple times, but we only want to count 
-                    // one hit per shot. For the next second after being hit, we ignore further hits
-                    TankTimer->setTimeout(HIT_FILTER_mS, EnableHitReception);
+                    // Reenable hit reception immediately. The rest of this shot's repeats will be recognized by isRepeatShot() and ignored, 
+                    // but a shot from anyone else will still count. 
+                    EnableHitReception();
+                    OP_EventBus::Emit(EVENT_CANNON_HIT, _lastHit);
                 }
                 return HIT_TYPE_CANNON; // Return cannon hit type 
             }
@@ -434,13 +454,9 @@ boolean TwoShotHit = false;
                 
                 // Unlike cannon fire, we don't disable IR reception, because we allow multiple MG hits to occur in quick succession
                 MGHitsTaken += 1;               // Increment number of machine gun hits taken
-                DamagePct += DamagePctPerMGHit; // Increment our overall damage percent
                 
-                if (DamagePct >= 100.0)
+                if (AddDamage(DamagePointsPerMGHit))    // Increment our overall damage
                 {
-                    // Don't let damage go above 100%
-                    DamagePct = 100.0;
-                    
                     // After destruction, the tank becomes inoperative for some period of time (15 seconds is the Tamiya spec - NOT the same as recovery/invulnerability time!)
                     // After that time it will automatically recover itself. During invulnerability time, the tank can fire but is impervious to enemy fire. 
                     // Invulnerability time is dependent on the weight class. 
@@ -448,6 +464,8 @@ boolean TwoShotHit = false;
                     TankTimer->setTimeout(DESTROYED_INOPERATIVE_TIME_mS, ResetBattle);   // DESTROYED_INOPERATIVE_TIME_mS is defined in OP_BattleTimes.h
                     // Start the destroyed light effect directly
                     HitLEDs_Destroyed();    
+                    OP_EventBus::Emit(EVENT_MG_HIT, _lastHit);
+                    OP_EventBus::Emit(EVENT_DESTROYED, _lastHit);
                 }
                 else
                 {
@@ -456,21 +474,24 @@ boolean TwoShotHit = false;
                     // Reenable hit reception immediately, we can take MG hits as fast as someone can send them. Even though we didn't call DisableHitReception()
                     // we still have to call EnableHitReception because the IR_Receiver automatically stops after being decoded. 
                     EnableHitReception();
+                    OP_EventBus::Emit(EVENT_MG_HIT, _lastHit);
                 }
                 return HIT_TYPE_MG; // Return MG hit type
             }
             // If that didn't match, we may still have been hit, but by a repair tank. 
             // Check but only if we haven't sustained any damage yet (otherwise there is no repair needed)
             // And also ignore it if we are already in the process of being repaired
-            else if (DamagePct > 0.0 && !RepairOngoing && IR_Decoder.decode(BattleSettings.IR_RepairProtocol))
+            else if (DamagePoints > 0 && !RepairOngoing && IR_Decoder.decode(BattleSettings.IR_RepairProtocol))
             {
                 _lastHit = BattleSettings.IR_RepairProtocol;// Save the protocol to the _lastHit variable
-                RepairOngoing = true;       // Set the repair flag
+                RepairOngoing = REPAIR_SELF;    // Set the repair flag - we are the one being repaired
                 Repair_BlinkHandler();      // Do the special repair light effect (start blinking slow and gradually increase faster and faster)
                 // Reenable hit reception immediately. The point is that while being repaired, the tank is vulnerable. 
                 EnableHitReception();
                 // Start the repair timer. During this time we can not be repaired again, nor can we move (the move disabling is handled by the sketch)
                 RepairTimerID = TankTimer->setTimeout(REPAIR_TIME_mS, RepairOver);   // REPAIR_TIME_mS is set in OP_BattleTimes.h
+                RepairStartTime = millis();
+                OP_EventBus::Emit(EVENT_REPAIR_STARTED, REPAIR_SELF);
                 // Return "hit" type
                 return HIT_TYPE_REPAIR;
                 // Note - we don't decrease the damage just yet. That only happens at the end of the repair operation, if the vehicle makes it that long
@@ -479,6 +500,7 @@ boolean TwoShotHit = false;
             else
             {
                 // We weren't hit. Re-enable reception
+                if (UnknownIRCount < 0xFFFF) UnknownIRCount += 1;
                 EnableHitReception();
             }
         }
@@ -486,6 +508,34 @@ boolean TwoShotHit = false;
     return HIT_TYPE_NONE;   // If we make it to here, we weren't hit
 }
 
+boolean OP_Tank::isRepeatShot(void)
+{
+    // Compare what we just decoded against the shots we've recently counted. _lastHit and _lastTeam have already been set by WasHit.
+    uint32_t now = millis();
+    uint8_t slot = 0;
+    for (uint8_t i=0; i<HIT_DEDUP_SLOTS; i++)
+    {
+        if (RecentShots[i].Protocol != IR_UNKNOWN && 
+            RecentShots[i].Protocol == _lastHit && RecentShots[i].Team == _lastTeam && RecentShots[i].Value == IR_Decoder.value &&
+            (now - RecentShots[i].LastSeen) <= HIT_REPEAT_GAP_mS && (now - RecentShots[i].FirstSeen) <= HIT_FILTER_mS)
+        {
+            RecentShots[i].LastSeen = now;  // Still the same burst, keep it going
+            return true;
+        }
+        // While we're at it, find an empty slot, or failing that the one that was last seen the longest time ago, in case this turns out to be a new shot
+        if (RecentShots[slot].Protocol != IR_UNKNOWN && 
+           (RecentShots[i].Protocol == IR_UNKNOWN || (now - RecentShots[i].LastSeen) > (now - RecentShots[slot].LastSeen))) slot = i;
+    }
+
+    // This is a new shot, remember it
+    RecentShots[slot].Protocol = _lastHit;
+    RecentShots[slot].Team = _lastTeam;
+    RecentShots[slot].Value = IR_Decoder.value;
+    RecentShots[slot].FirstSeen = now;
+    RecentShots[slot].LastSeen = now;
+    return false;
+}
+
 IRTYPES OP_Tank::LastHitProtocol(void)
 {
     return _lastHit;    // What protocol was the last successful hit
@@ -507,11 +557,14 @@ void OP_Tank::CancelRepair(void)
 void OP_Tank::RepairOver(void)
 {
     // Repair is over, we successfully made it through the whole 15 seconds. 
-    RepairOngoing = false;
+    uint8_t who = RepairOngoing;    // Us, or someone else?
+    RepairOngoing = REPAIR_NONE;
 
     // Now we do the opposite of taking damage.
-    DamagePct -= DamagePctPerCannonHit;     // Subtract a cannon hit
-    if (DamagePct < 0.0) DamagePct = 0.0;   // But don't go below zero      
+    // Subtract a cannon hit, but don't go below zero
+    if (DamagePoints > DamagePointsPerCannonHit) DamagePoints -= DamagePointsPerCannonHit;
+    else                                         DamagePoints = 0;
+    OP_EventBus::Emit(EVENT_REPAIR_COMPLETE, who);
 
     // Call the repair blink hander, it will turn off the lights. 
     Repair_BlinkHandler();
@@ -524,7 +577,8 @@ void OP_Tank::StopRepair(void)
     
     if (RepairOngoing) 
     { 
-        RepairOngoing = false;
+        OP_EventBus::Emit(EVENT_REPAIR_CANCELLED, RepairOngoing);
+        RepairOngoing = REPAIR_NONE;
         
         // Call the repair blink hander, it will turn off the lights. 
         Repair_BlinkHandler();
@@ -532,18 +586,96 @@ void OP_Tank::StopRepair(void)
 }
 
 boolean OP_Tank::isRepairOngoing()
+{
+    return RepairOngoing != REPAIR_NONE;
+}
+
+boolean OP_Tank::isIRBusy()
+{
+    if (!IR_Tx.isSendingDone()) return true;
+    // The receive state only ever holds small numbers, so a torn read of it can't give the wrong answer. STATE_STOP means a signal is complete 
+    // but hasn't been decoded yet - or that reception is switched off while we are invulnerable, which is busy enough.
+    rcvstate_t state = IR_ReceiveParams.rcvstate;
+    return (state == STATE_RUNNING || state == STATE_STOP);
+}
+
+uint8_t OP_Tank::RepairType(void)
 {
     return RepairOngoing;
 }
 
+uint8_t OP_Tank::RepairPctComplete(void)
+{
+    if (!RepairOngoing) return 0;
+    uint32_t elapsed = millis() - RepairStartTime;
+    if (elapsed >= REPAIR_TIME_mS) return 100;      // The timer may not have been serviced yet
+    return (elapsed * 100) / REPAIR_TIME_mS;
+}
+
+boolean OP_Tank::AddDamage(uint32_t Points)
+{
+    DamagePoints += Points;
+    if (DamagePoints >= DamagePointsMax)
+    {
+        // Don't let damage go above 100%
+        DamagePoints = DamagePointsMax;
+        return true;
+    }
+    return false;
+}
+
 uint8_t OP_Tank::PctDamaged(void)
 {
-    return round(DamagePct);
+    // Percent is only worked out for display, rounded to the nearest whole percent (halves round up). Damage never exceeds DamagePointsMax so neither does this exceed 100. 
+    return (uint8_t)((DamagePoints * 100UL + DamagePointsMax / 2) / DamagePointsMax);
 }
 
 uint8_t OP_Tank::PctHealthRemaining(void)
 {
-    return (100 - constrain(round(DamagePct),0,100));
+    return (100 - PctDamaged());
+}
+
+void OP_Tank::LoadDamageProfile(const damage_profile * dp)
+{
+    // Hits are processed from loop() rather than in an interrupt, so a plain copy is safe here
+    DamageProfile = *dp;
+}
+
+void OP_Tank::GetDamageProfile(DAMAGEPROFILES dProfile, damage_profile * dp)
+{
+    if (dProfile >= BUILT_IN_DAMAGE_PROFILES) dProfile = TAMIYA_DAMAGE;
+    memcpy_P(dp, &DamageProfileTable[dProfile], sizeof(damage_profile));
+}
+
+uint32_t OP_Tank::CannonHitPoints(IRTYPES protocol)
+{
+    // Look through the damage profile for a weight on this protocol. Unused entries are IR_DISABLED, which is also what _lastHit would be
+    // if we somehow got here without a known protocol, so we skip those rather than match them. 
+    for (uint8_t i=0; i<DAMAGE_WEIGHTS; i++)
+    {
+        if (DamageProfile.Weight[i].Protocol == IR_DISABLED || DamageProfile.Weight[i].Protocol != protocol) continue;
+        if (DamageProfile.Weight[i].Hits == DAMAGE_WEIGHT_HALF) return DamagePointsMax / 2;     // DamagePointsMax is always even
+        return (uint32_t)DamageProfile.Weight[i].Hits * DamagePointsPerCannonHit;
+    }
+    return DamagePointsPerCannonHit;
+}
+
+uint8_t OP_Tank::SpeedCutPct(void)
+{
+    // No damage never cuts speed, and destroyed always cuts all of it
+    if (DamagePoints == 0)               return 0;
+    if (DamagePoints >= DamagePointsMax) return 100;
+    
+    // Otherwise walk the curve. Comparing DamagePoints x 100 against DamagePct x DamagePointsMax rather than against PctDamaged() means a point 
+    // at exactly 50% is reached on exactly the hit that takes half our health, with no rounding. 
+    uint8_t cut = 0;
+    for (uint8_t i=0; i<SPEED_CUT_POINTS; i++)
+    {
+        if (DamageProfile.SpeedCut[i].DamagePct == 0) continue;    // Unused point
+        cut = DamageProfile.SpeedCut[i].CutPct;
+        if (DamagePoints * 100UL <= (uint32_t)DamageProfile.SpeedCut[i].DamagePct * DamagePointsMax) break;
+    }
+    return cut;
 }
 
 void OP_Tank::DisableHitReception(void)
@@ -574,47 +706,20 @@ void OP_Tank::EnableHitReception(void)
 /*
 void OP_Tank::Damage()
 {
-  
-int cut_Pct;
-
-    switch (BattleSettings.DamageProfile)
-    {
-        case TAMIYA_DAMAGE:
-            // For reference, see the package insert to Tamiya #53447 "Hop Up Options: Battle System".
-            // When a Tamiya tank is hit, the drive motor speed is reduced. Tamiya follows a consistent formula based on the number of hits
-            // taken compared to the max number of hits the given weight class can take before being destroyed. The formula is as follows: 
-            // 1. Subtract 1 from the number of max hits (because the last hit destroys the tank, it doesn't damage it)
-            // 2. Divide the remaining number of hits by 2. If an odd number, round up to the nearest integer. We will call this Halfway.
-            // 3. If the number of hits taken so far is less than or equal to Halfway, reduce the speed of the drive motors to 50%. 
-            // 4. If the number of hits taken is greater than Halfway, reduce the speed of the drive motors to 25%. 
-            // 5. If the number of hits taken equals the max number of hits allowed, the tank is destroyed. 
-            // Because this formula only needs to know the max number of hits allowed, we can easily apply it to any custom weight class the
-            // user may create, as well as the standard Tamiya classes: 
-            
-            // MaxHits = BattleSettings.ClassSettings.maxHits;     // The max number of hits for this weight class
-            // Halfway = round(float(MaxHits-1)/2.0);              // The Tamiya formula to calculate Halfway
-            // if      (hitsTaken <= Halfway) { cut_Pct = 50;  }   // Reduce speed to 50%
-            // else if (hitsTaken <  MaxHits) { cut_Pct = 75;  }   // Reduce speed to 25% (cut by 75%)
-            // else                           { cut_Pct = 100; }   // Destroyed (cut by 100%)
-
-            // EDIT: Well, that's the way Tamiya does it, but if you want to include machine gun damage, we need a slightly different approach. 
-            // This should give us the same result as the Tamiya approach, but also allow damage due to machine gun fire. 
-            if      (DamagePct <= 0.0)                          cut_Pct = 0;
-            else if (DamagePct >  0.0 && DamagePct <= 50.0 )    cut_Pct = 50;
-            else if (DamagePct > 50.0 && DamagePct <  100.0)    cut_Pct = 75;
-            else                                                cut_Pct = 100;
-                    
-            // Serial.print(F("Speed cut to "));
-            // Serial.print(100-cut_Pct);
-            // Serial.println(F("%"));
-            break;
-          
-        default:
-            cut_Pct = 0; 
-            break;
-          
-    }
-
+    // The speed-cut curve used to be a switch statement here with one case per damage profile. It now lives in DamageProfileTable at the top of this file
+    // (see SpeedCutPct). For reference, the Tamiya formula from the package insert to Tamiya #53447 "Hop Up Options: Battle System" is: 
+    // 1. Subtract 1 from the number of max hits (because the last hit destroys the tank, it doesn't damage it)
+    // 2. Divide the remaining number of hits by 2. If an odd number, round up to the nearest integer. We will call this Halfway.
+    // 3. If the number of hits taken so far is less than or equal to Halfway, reduce the speed of the drive motors to 50%. 
+    // 4. If the number of hits taken is greater than Halfway, reduce the speed of the drive motors to 25%. 
+    // 5. If the number of hits taken equals the max number of hits allowed, the tank is destroyed. 
+    // Expressed in terms of damage rather than hits (so machine gun damage counts too) that is the {50, 50}, {100, 75} curve in the TAMIYA_DAMAGE row.
+    
+    uint8_t cut_Pct = SpeedCutPct();
+    
+    // Serial.print(F("Speed cut to "));
+    // Serial.print(100-cut_Pct);
+    // Serial.println(F("%"));
 }
 */
 
@@ -623,11 +728,13 @@ void OP_Tank::ResetBattle(void)
     // This function is called when the tank is "regenerating" or "recovering" after being destroyed (or when the TCB has just rebooted). 
     // During invulnerability time the tank is invulnerable to enemy fire for a length of time dependent on its class. 
     isDestroyed = false;        // We are no longer destroyed
+    OP_LedFX::Release(LED_LAYER_DESTROYED); // Let the destroyed light effect fade out
     CannonHitsTaken = 0;        // Reset the hit counter
     MGHitsTaken = 0;
-    DamagePct = 0;
+    DamagePoints = 0;
     DisableHitReception();      // Ignore enemy fire
     TankTimer->setTimeout(BattleSettings.ClassSettings.recoveryTime, EnableHitReception);    // Enable hits after recovery (invulnerability) time has passed
+    OP_EventBus::Emit(EVENT_RESTORED);
 }
 
 
@@ -636,310 +743,98 @@ void OP_Tank::ResetBattle(void)
 //------------------------------------------------------------------------------------------------------------------------>>
 // HIT NOTIFICATION LEDs 
 //------------------------------------------------------------------------------------------------------------------------>>
-void OP_Tank::HitLEDs_On(void)
-{
-    digitalWrite(pin_HitNotifyLEDs, HIGH);
-    HitLEDsOn = true;
-}
-void OP_Tank::HitLEDs_Off(void)
-{
-    digitalWrite(pin_HitNotifyLEDs, LOW);
-    HitLEDsOn = false;
-}
-void OP_Tank::HitLEDs_Toggle(void)
-{
-    HitLEDsOn ? HitLEDs_Off() : HitLEDs_On();
-    HitLEDsOn = !HitLEDsOn;
-}
-void OP_Tank::HitLEDs_SetDim(uint8_t level)
-{
-    analogWrite(pin_HitNotifyLEDs, level);
-    level > 0 ? HitLEDsOn = true : HitLEDsOn = false;
-}
-void OP_Tank::HitLEDs_Blink(long blinkTime)
+// These light up the LEDs that are typically installed in the IR "apple" to indicate damage received or tank destroyed. 
+// Each effect is a script for OP_LedFX (see OP_LedFX.h for what the steps mean), which plays it on its own layer using a single timer. 
+// To change an effect you only need to change its script. 
+
+// CANNON HIT - randomly flickers the lights the same way Tamiya does. The effect is held for FLICKER_EFFECT_LENGTH_mS, and another hit 
+// in the meantime holds it again. Once it is let go the lights fade out slowly, unless another hit comes in during the fade. 
+const lfx_step CannonHitScript[] PROGMEM = 
+{
+    { LFX_SET,      MAX_BRIGHT, 0                       },  // 0 - We start off at max brightness
+    { LFX_RFADE,    MIN_BRIGHT, DIM_FADE_BREAK          },  // 1 - Fade to some random dim level at some random speed
+    { LFX_RFADE,    BRIGHT_FADE_BREAK, MAX_BRIGHT       },  // 2 - and back up to some random bright level
+    { LFX_JMP_HELD, 1, 0                                },  // 3 - Keep flickering while held
+    { LFX_FADE,     0, LFX_mS(1000)                     },  // 4 - Slow fade out
+    { LFX_JMP_HELD, 1, 0                                },  // 5 - Hit again while fading, start flickering again
+    { LFX_END,      0, 0                                }
+};
+
+// MACHINE GUN HIT - two short blinks
+const lfx_step MGHitScript[] PROGMEM = 
 {
-    digitalWrite(pin_HitNotifyLEDs, HIGH);
-    TankTimer->setTimeout(blinkTime, HitLEDs_Off); 
-}
+    { LFX_SET,      MAX_BRIGHT, 0                       },
+    { LFX_WAIT,     LFX_mS(100), 0                      },
+    { LFX_SET,      0, 0                                },
+    { LFX_WAIT,     LFX_mS(60), 0                       },
+    { LFX_SET,      MAX_BRIGHT, 0                       },
+    { LFX_WAIT,     LFX_mS(40), 0                       },
+    { LFX_END,      0, 0                                }
+};
 
-//------------------------------------------------------------------------------------------------------------------------>>
-// HIT NOTIFICATION LEDs - CANNON HIT
-//------------------------------------------------------------------------------------------------------------------------>>
-// These flicker the LEDs that are typically installed in the IR "apple" to indicate damage received or tank destroyed. 
-void OP_Tank::HitLEDs_CannonHit(void)
-{   // The Cannon Hit effect randomly flickers the lights the same way Tamiya does. 
+// DESTROYED - slow blink for as long as we are destroyed, then once let go, a slow fade out from fully on
+const lfx_step DestroyedScript[] PROGMEM = 
+{
+    { LFX_SET,      MAX_BRIGHT, 0                       },  // 0
+    { LFX_WAIT,     LFX_mS(450), 0                      },  // 1 - This is a slow blink, about half a second
+    { LFX_JMP_HELD, 5, 0                                },  // 2 - Still destroyed, keep blinking
+    { LFX_FADE,     0, LFX_mS(2560)                     },  // 3 - Done being destroyed, fade out
+    { LFX_END,      0, 0                                },  // 4
+    { LFX_SET,      0, 0                                },  // 5
+    { LFX_WAIT,     LFX_mS(450), 0                      },  // 6
+    { LFX_JMP,      0, 0                                }   // 7
+};
 
-    // If we are still in the middle of running a flickering effect, just 
-    // extend the time it runs. 
-    if (TankTimer->isEnabled(HitLED_TimerID)) 
-    { 
-        // Delete the currently running timeout timer
-        TankTimer->deleteTimer(HitLED_TimerID); 
-        // Start a new one
-        HitLED_TimerID = TankTimer->setTimeout(FLICKER_EFFECT_LENGTH_mS, CannonHitLEDs_Stop);
-        // In the meanwhile, the flickering effect will continue to run
-    }
-    
-    // In this case the previous effect is over, so start a new one
-    if (!TankTimer->isEnabled(FadeStep_TimerID))
-    {
-        // We will set FadeOut = true later, when we are done with the effect and want to fade out
-        FadeOut = false;
+// REPAIR - start blinking slowly and gradually blink faster and faster, then pause a moment and start over. Plays until the repair is over.
+const lfx_step RepairScript[] PROGMEM = 
+{
+    { LFX_PERIOD,   LFX_mS(500), 0                      },  // 0 - Start with half a second on and half a second off
+    { LFX_SET,      MAX_BRIGHT, 0                       },  // 1
+    { LFX_WAITP,    0, 0                                },  // 2
+    { LFX_SCALEP,   232, 0                              },  // 3 - Each blink about 10% quicker than the last
+    { LFX_SET,      0, 0                                },  // 4
+    { LFX_WAITP,    0, 0                                },  // 5
+    { LFX_SCALEP,   232, 0                              },  // 6
+    { LFX_JMP_PGT,  1, 1                                },  // 7 - Until we are as fast as we can go
+    { LFX_WAIT,     LFX_mS(250), 0                      },  // 8 - Pause
+    { LFX_JMP,      0, 0                                }   // 9 - and start over
+};
 
-        // We start off at max brightness, 
-        CurrentFadeLevel = 255;
-        HitLEDs_On();
-        
-        // Pick some random brightness to fade down to
-        FadeTarget = random(MIN_BRIGHT, DIM_FADE_BREAK);
-        // Pick some random fade speed to get there
-        FadeStep = -random(MIN_FADE_STEP, MAX_FADE_STEP);   // negative step value      
-        // Start the fade timer, it will decrement the brightness by FadeStep every FADE_UPDATE_mS milliseconds until it reaches FadeTarget
-        FadeStep_TimerID = TankTimer->setInterval(FADE_UPDATE_mS, CannonHitLEDs_Update);
-        // Now start another one-shot timer to cancel the overall effect after FLICKER_EFFECT_LENGTH_mS milliseconds
-        HitLED_TimerID = TankTimer->setTimeout(FLICKER_EFFECT_LENGTH_mS, CannonHitLEDs_Stop);
-    }
-}
-void OP_Tank::CannonHitLEDs_Update(void)
+// CANNON RELOADED - Short blink to notify user the cannon reload time has completed
+//                   Can be enabled/disabled with setting CANNON_RELOAD_NOTIFY on the A_Setup.h tab
+const lfx_step ReloadNotifyScript[] PROGMEM = 
 {
-static boolean StopNextTime = false; 
+    { LFX_SET,      MAX_BRIGHT, 0                       },
+    { LFX_WAIT,     LFX_mS(400), 0                      },
+    { LFX_END,      0, 0                                }
+};
 
-    // Increase or decrease the brightness level by FadeStep amount
-    CurrentFadeLevel += FadeStep;
-    // Set the LEDs to this brightness
-    HitLEDs_SetDim(CurrentFadeLevel);
-    
-    // That's usually it, unless we've reached our target brightness. If so, we pick some
-    // new random numbers and fade in the opposite direction
-    if (FadeStep > 0 && CurrentFadeLevel >= FadeTarget)
-    {
-        // We reached the brightness target - now swap to some dim value
-        if (FadeOut)
-        {
-            // This will be the last fade, and we will go slowly
-            FadeTarget = 0;
-            FadeStep = -4;  // Negative, because we are fading out. Small number so the fade takes time.  
-            StopNextTime = true;        // This lets us know after we're done fading, that's it. 
-        }
-        else
-        {   // This is a random fade
-            FadeTarget = random(MIN_BRIGHT, DIM_FADE_BREAK);
-            FadeStep = -random(MIN_FADE_STEP, MAX_FADE_STEP);   // negative step value
-        }
-    }
-    else if (FadeStep < 0 && CurrentFadeLevel <= FadeTarget)
-    {
-        if (StopNextTime)
-        {
-            // We've reached the end of the last fade. Stop the timer and turn off the lights
-            // (but they should already be off)
-            if (TankTimer->isEnabled(FadeStep_TimerID))
-            {
-                TankTimer->deleteTimer(FadeStep_TimerID);
-                HitLEDs_Off();
-                CurrentFadeLevel = 0;
-                // Reset
-                StopNextTime = false;
-                
-                // BUT! If the tank is destroyed, we now start the HitLEDs_Destroyed effect
-                if (isDestroyed) HitLEDs_Destroyed();
-            }
-        }
-        else
-        {
-            // We reached our random dim target - now swap to some random bright value
-            FadeTarget = random(BRIGHT_FADE_BREAK, MAX_BRIGHT);
-            FadeStep = random(MIN_FADE_STEP, MAX_FADE_STEP);   // positive value
-        }
-    }
-}
-void OP_Tank::CannonHitLEDs_Stop(void)
-{
-    if (TankTimer->isEnabled(FadeStep_TimerID))
-    {
-        FadeOut = true;
-    }
+
+void OP_Tank::HitLEDs_CannonHit(void)
+{   
+    STACK_PROBE("HitLEDs_CannonHit");
+    // If we are still in the middle of running a flickering effect, this just extends the time it runs
+    OP_LedFX::Play(LED_LAYER_CANNON_HIT, CannonHitScript, LFX_mS(FLICKER_EFFECT_LENGTH_mS));
 }
 
-//------------------------------------------------------------------------------------------------------------------------>>
-// HIT NOTIFICATION LEDs - MACHINE GUN HIT
-//------------------------------------------------------------------------------------------------------------------------>>
 void OP_Tank::HitLEDs_MGHit(void)
 {
-    // If we're hit by machine gun fire, we do a simple effect - two short blinks
-    // But because we can, we make a nice little routine that lets us adjust precisely the
-    // two blinks and the space between them. In fact with this approach you could create any 
-    // sequence of blinks and spaces of any length of time.
-    
-    static uint8_t curStep = 0;
-    const uint8_t steps = 3;
-    const uint8_t time[steps] = {100,60,40};
-  
-    if (curStep < steps)
-    {
-        // Odd numbers get turned off
-        if (curStep & 1)    
-        {
-            HitLEDs_Off();
-            // Come back to this routine after the specified time for this step is up
-            TankTimer->setTimeout(time[curStep], HitLEDs_MGHit);
-        } 
-        // Even numbers get turned on
-        else        
-        {
-            HitLEDs_On();
-            // Come back to this routine after the specified time for this step is up
-            TankTimer->setTimeout(time[curStep], HitLEDs_MGHit);
-        }
-        curStep += 1;
-    }
-    else
-    {
-        // We're done, turn off the lights and don't come back
-        HitLEDs_Off();
-        curStep = 0;    // reset
-    }
-    
+    OP_LedFX::Play(LED_LAYER_MG_HIT, MGHitScript);
 }
 
-
-//------------------------------------------------------------------------------------------------------------------------>>
-// HIT NOTIFICATION LEDs - DESTROYED
-//------------------------------------------------------------------------------------------------------------------------>>
-void OP_Tank::HitLEDs_Destroyed()
+void OP_Tank::HitLEDs_Destroyed(void)
 {
-    static int DestroyedBlinkerID = 0;
-    static boolean started = false;
-    static int16_t fadeLevel = 255; // This needs to be a signed two-byte integer
-    #define SLOW_FADE_OUT_STEP 2
-    
-    if (!started && isDestroyed)
-    {   // In this case, we are just starting at the beginning of being destroyed.
-    
-        // Shoudn't need to, but delete the timer if it already exists
-        if (TankTimer->isEnabled(DestroyedBlinkerID)) { TankTimer->deleteTimer(DestroyedBlinkerID); } 
-        
-        // Turn the lights on
-        HitLEDs_On();   
-        
-        // Now set a timer to keep coming back here after a short interval so we can blink the lights
-        DestroyedBlinkerID = TankTimer->setInterval(450, HitLEDs_Destroyed);     // This is a slow blink, about half a second
-        
-        // The effect has been started
-        started = true;
-    }
-    else if (started && isDestroyed)
-    {   // In this case, we already started the effect and we are coming back here just to blink the lights.  
-        HitLEDs_Toggle();
-    }
-    else if (started && !isDestroyed)
-    {   // Ok, the tank is done being destroyed. What we do now depends on whether the light is currently on or off
-        if (HitLEDsOn)
-        {
-            // In this case, we can start fading out slowly
-            TankTimer->deleteTimer(DestroyedBlinkerID);
-            // Start a new timer that will call us much more frequently
-            DestroyedBlinkerID = TankTimer->setInterval(FADE_UPDATE_mS, HitLEDs_Destroyed);
-            started = false; // Change this to false
-        }
-        else
-        {
-            // We need to wait for the light to be on before we can fade off, so do one more toggle
-            HitLEDs_Toggle();
-        }
-    }
-    else if (!started && !isDestroyed)
-    {
-        // Now we are in the final fade-out phase
-        fadeLevel -= SLOW_FADE_OUT_STEP;
-        if (fadeLevel > 0)
-        {   
-            HitLEDs_SetDim(fadeLevel); // Dim the light
-        }
-        else
-        {
-            // We're completely done
-            TankTimer->deleteTimer(DestroyedBlinkerID);
-            HitLEDs_Off();
-            fadeLevel = 255;    // reset for next time
-        }
-    }
+    // Held until ResetBattle lets it go
+    OP_LedFX::Play(LED_LAYER_DESTROYED, DestroyedScript);
 }
 
-
-//------------------------------------------------------------------------------------------------------------------------>>
-// HIT NOTIFICATION LEDs REPAIR EFFECT - used both when firing repair code, and receiving repair code
-//------------------------------------------------------------------------------------------------------------------------>>
 void OP_Tank::Repair_BlinkHandler(void)
 {   // Only start/continue the blinking effect if we are in the midst of being repaired
-    if (RepairOngoing) 
-    {
-        HitLEDs_Repair(); 
-    }
-    else 
-    {   // Stop the repair blinking effect
-        if (TankTimer->isEnabled(HitLED_TimerID)) TankTimer->deleteTimer(HitLED_TimerID);
-        HitLEDs_Off();
-    }
+    if (RepairOngoing) OP_LedFX::Play(LED_LAYER_REPAIR, RepairScript);
+    else               OP_LedFX::Stop(LED_LAYER_REPAIR);   // Stop the repair blinking effect
 }
 
-void OP_Tank::HitLEDs_Repair(void)
-{
-    static boolean LightState = false;
-    
-    static boolean effectStarted = false;
-    const int StartInterval = 500;   
-    const int InitialSubtract = 43; 
-    const int Knee1 = 36;
-    const int Knee2 = 18;
-    const int Knee3 = 1;
-    const uint8_t SC_1 = 4;
-    const uint8_t SC_2 = 2;
-    const uint8_t SC_3 = 1;
-    static int Interval;
-    static int Subtract;
-
-    if (!effectStarted) 
-    {
-        Interval = StartInterval;
-        Subtract = InitialSubtract;
-        effectStarted = true;
-    }
-    else
-    {
-        if      (Subtract > Knee1) Subtract -= SC_1;
-        else if (Subtract > Knee2) Subtract -= SC_2;
-        else if (Subtract > Knee3) Subtract -= SC_3;
-        if      (Subtract < 0)     Subtract = 0;
-    }
-
-    // Toggle the light state
-    LightState ? HitLEDs_Off() : HitLEDs_On();    
-    LightState = !LightState;      // Flop states
-
-    if (Interval <= 0)
-    {
-        effectStarted = false;
-        HitLEDs_Off();
-        // Effect is done, go back to Repair_BlinkHandler. It will restart the blinking effect if appropriate. 
-        HitLED_TimerID = TankTimer->setTimeout(250,Repair_BlinkHandler);
-    }
-    else
-    {
-        // Now set a timer to come back here and toggle it after the correct length of time has passed.
-        HitLED_TimerID = TankTimer->setTimeout(Interval, HitLEDs_Repair);
-    }
-
-    // For next time
-    Interval -= Subtract;    
-}
-
-
-//------------------------------------------------------------------------------------------------------------------------>>
-// HIT NOTIFICATION LEDs CANON RELOADED - Short blink to notify  user the canon reload time has completed
-//                                        Can be enabled/disabled with setting CANNON_RELOAD_NOTIFY on the A_Setup.h tab
-//------------------------------------------------------------------------------------------------------------------------>>
 void OP_Tank::HitLEDs_ReloadNotify(void)
 {   
-    HitLEDs_Blink(400);
+    OP_LedFX::Play(LED_LAYER_RELOAD, ReloadNotifyScript);
 }
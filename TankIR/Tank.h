@@ -12,6 +12,10 @@
 #include "IRLib.h"
 #include "SimpleTimer.h"
 #include "Motors.h"
+#include "PulseOut.h"
+#include "LedFX.h"
+#include "EventBus.h"
+#include "StackProbe.h"
 #include "A_Setup.h"
 
 // Repairs take 15 seconds
@@ -23,9 +27,16 @@
                                                 // the vehicle will automatically re-generate with full health restored. 
                                             
 
-#define HIT_FILTER_mS               1100    // After taking a hit, we ignore any further hits for this length of time in milliseconds. This prevents a single
-                                            // shot from being recorded as multiple hits. Should be at least 1000 mS because stock Tamiya fires the hit signal
-                                            // repeatedly for 1 full second
+// Every battle signal is sent several times in a row, but we only want to count one hit per shot. Rather than going deaf to everything for a second after
+// each hit (which let a second tank's shot go straight through us), we remember a "fingerprint" of the last few shots that hit us - protocol, team and 
+// decoded value (which carries the shooter's ID on protocols that have one) - and only ignore further receptions that match one of them, arrive within 
+// HIT_REPEAT_GAP_mS of the previous copy, and fall within HIT_FILTER_mS of the first. Anything else counts as a new shot. 
+// The one thing we can't tell apart is two tanks firing the exact same signal at us at the same moment - those are counted as one shot, as they always were. 
+#define HIT_FILTER_mS               1100    // The longest a single shot's burst of repeats can last. Should be at least 1000 mS because stock Tamiya fires the hit 
+                                            // signal repeatedly for 1 full second
+#define HIT_REPEAT_GAP_mS           300     // The longest gap between two copies of the same shot. Long enough to cover the longest frame we decode plus one copy 
+                                            // lost to interference, but much shorter than any tank's reload time
+#define HIT_DEDUP_SLOTS             4       // How many recent shots to remember. Each slot costs 14 bytes of RAM
 
 #define MUZZLE_FLASH_TRIGGER_mS     50      // Trigger signal length for Asiatam/Taigen high-intensity flash unit, or for user-supplied LED
 
@@ -33,16 +44,20 @@
 #define IR_RECEIVE_INT_NUM          0       // On Arduino UNO/Nano we use external interrupt 0 (which maps to pin 2)
 
 // These variables are used to create a flickering effect on the hit notification LEDs, similar to the way Tamiya does
+// (the speed of the flicker is set by LEDFX_MIN_FADE_STEP and LEDFX_MAX_FADE_STEP in Settings.h)
+// These are perceived brightness levels (see OP_LedPWM.h). They used to be raw PWM values of 10, 130 and 150, these look the same. 
 #define MAX_BRIGHT                  255     // Maximum LED brightness during the flicker effect (should be 255)
-#define MIN_BRIGHT                  10      // Minimum LED brightness during the flicker effect
-#define BRIGHT_FADE_BREAK           150     // We will always ramp up to some value above this. Must be less than MAX_BRIGHT.
-#define DIM_FADE_BREAK              130     // We will always ramp down to some value below this. Must by higher than MIN_BRIGHT.
-#define MAX_FADE_STEP               50      // Maximum amount we will increase/decrease the brightness per step
-#define MIN_FADE_STEP               10      // Minimum amount we will increase/decrease the brightness per step
-#define FADE_UPDATE_mS              20      // How often we will increment/decrement the brightness
-#define FLICKER_EFFECT_LENGTH_mS    3000    // How long to flicker the lights using the random fade up/down effect
-// This defines how long a single machine-gun hit blink will last
-#define MG_HIT_BLINK_TIME           100     // in milliSeconds
+#define MIN_BRIGHT                  58      // Minimum LED brightness during the flicker effect
+#define BRIGHT_FADE_BREAK           200     // We will always ramp up to some value above this. Must be less than MAX_BRIGHT.
+#define DIM_FADE_BREAK              188     // We will always ramp down to some value below this. Must by higher than MIN_BRIGHT.
+#define FLICKER_EFFECT_LENGTH_mS    3000    // How long to flicker the lights using the random fade up/down effect. Can't be more than 255 LED effect ticks.
+
+// The hit notification LED effects each play on their own OP_LedFX layer. When more than one is playing, the lowest numbered layer is the one you see. 
+#define LED_LAYER_CANNON_HIT        0       // Cannon hit flicker, shown over everything else
+#define LED_LAYER_DESTROYED         1       // Destroyed blink, started underneath the cannon hit flicker so it takes over when the flicker is done
+#define LED_LAYER_MG_HIT            2
+#define LED_LAYER_REPAIR            3
+#define LED_LAYER_RELOAD            4       // Reload notify blink, least important (LEDFX_LAYERS in Settings.h must be one more than this)
 
 // There are four possible weight classes - the three standard Tamiya classes, 
 // and one custom class defined by the user. 
@@ -60,10 +75,37 @@ typedef unsigned char DAMAGEPROFILES;
 #define TAMIYA_DAMAGE       0       // Stock Tamiya damage profile
 #define OPENPANZER_DAMAGE   1       // Open Panzer damage profile
 //#define ADDITIONAL (number)
-#define LAST_DAMAGE_PROFILE OPENPANZER_DAMAGE
+#define CUSTOM_DAMAGE       2       // A club's own profile, kept in the battle settings rather than the table (see CustomDamage below). Always the last one. 
+#define LAST_DAMAGE_PROFILE CUSTOM_DAMAGE
+#define BUILT_IN_DAMAGE_PROFILES CUSTOM_DAMAGE  // How many rows DamageProfileTable has
 const __FlashStringHelper *ptrDamageProfile(DAMAGEPROFILES dProfile); //Returns a character string that is name of the damage profile 
 
 
+// Each damage profile is one row of a table in program memory (see DamageProfileTable in OP_Tank.cpp) rather than a case in a switch statement. A club's 
+// house rules don't need any code at all: select CUSTOM_DAMAGE and the profile comes from the configuration instead, which Tools/tankconfig.py can change 
+// over the serial port (see OP_Config.h). A profile has two parts: 
+// [] Weights - cannon protocols that do more (or less) than the usual one hit's worth of damage. Each entry says how many cannon hits one hit with that 
+//    protocol counts as, or DAMAGE_WEIGHT_HALF for "half of full health" (the Tamiya 2-shot kill code). Any protocol not listed counts as one hit. 
+// [] SpeedCut - the curve used to reduce drive speed as damage is taken. Each point means "while damage is at or below DamagePct, cut speed by CutPct". 
+//    Points must be in order of increasing DamagePct. Damage above the last point (but short of destroyed) uses the last point's cut; destroyed is always 100. 
+// Unused entries are left as zeros (IR_DISABLED weights and DamagePct 0 points are skipped). 
+#define DAMAGE_WEIGHTS          4       // Max number of per-protocol weights in a profile
+#define SPEED_CUT_POINTS        4       // Max number of points on the speed-cut curve
+#define DAMAGE_WEIGHT_HALF      0xFF    // Special weight - one hit takes 50% of full health
+struct damage_weight{
+    IRTYPES  Protocol;          // Which cannon protocol this weight applies to
+    uint8_t  Hits;              // How many regular cannon hits a single hit of this protocol counts as (or DAMAGE_WEIGHT_HALF)
+};
+struct speed_cut_point{
+    uint8_t  DamagePct;         // Up to and including this much damage...
+    uint8_t  CutPct;            // ...cut the drive speed by this percent
+};
+struct damage_profile{
+    damage_weight   Weight[DAMAGE_WEIGHTS];
+    speed_cut_point SpeedCut[SPEED_CUT_POINTS];
+};
+
+
 // All the types of IR receptions possible
 typedef char HIT_TYPE;
 #define HIT_TYPE_NONE       0       // No hit, signal couldn't be decoded, or it didn't apply to us
@@ -71,13 +113,22 @@ typedef char HIT_TYPE;
 #define HIT_TYPE_MG         2
 #define HIT_TYPE_REPAIR     3
 
+// What we remember about a recent shot, to recognize its repeats (see HIT_FILTER_mS above)
+struct shot_fingerprint{
+    IRTYPES  Protocol;          // IR_UNKNOWN if the slot is empty
+    IRTEAMS  Team;
+    uint32_t Value;             // Decoded value
+    uint32_t FirstSeen;         // millis() of the copy we counted as a hit
+    uint32_t LastSeen;          // millis() of the most recent copy
+};
+
 // A collection of settings for the tank
 struct weightClassSettings{
     uint16_t reloadTime;        // How long (in mS) does it take to reload the cannon. Depends on weight class
     uint16_t recoveryTime;      // How long does recovery mode last (invulnerability time when tank is regenerating after being destroyed). Class-dependent. 
     uint8_t  maxHits;           // How many hits can the tank sustain before being destroyed. Depends on weight class
     uint8_t  maxMGHits;         // How many hits can the tank sustain from machine gun fire before being destroyed. Only applies to custom weight classes, 
-                                // and only if Accept_MG_Damage = TRUE
+                                // and only if Accept_MG_Damage = TRUE. In the weight class table a zero here means "keep whatever the sketch passed in"
 };
 struct battle_settings{
     char     WeightClass;       // What is the tank's current weight class
@@ -90,6 +141,9 @@ struct battle_settings{
     boolean  Use_MG_Protocol;   // If true, the Machine Gun IR code will be sent when firing the machine gun, otherwise, it will be skipped. 
     boolean  Accept_MG_Damage;  // If true, the vehicle will be susceptible to MG fire. 
     char     DamageProfile;     // Which Damage Profile are we using
+    damage_profile CustomDamage;    // The profile to use if DamageProfile is CUSTOM_DAMAGE
+    boolean  RepairTank;        // If true we send the repair protocol instead of the cannon protocol
+    boolean  ReloadNotify;      // Blink the hit notification LEDs when the cannon has reloaded
     boolean  SendTankID;        // Do we include the Tank ID in the cannon IR transmission
     uint16_t TankID;            // What is this tank's ID number
 };
@@ -109,18 +163,29 @@ class OP_Tank
         static void     TriggerMuzzleFlash(void);
         
         // Functions - IR receiving (ie, getting hit!)
-        static HIT_TYPE WasHit(void);               // Have we been hit
+        static HIT_TYPE WasHit(void);               // Have we been hit. Hits, destruction and repairs are also emitted as events on OP_EventBus (see EventCodes.h), 
+                                                    // as are the end of a repair, restoring after destruction, and reload complete.
         static IRTYPES  LastHitProtocol(void);      // What were we hit with
         static IRTEAMS  LastHitTeam(void);          // Which team hit us (if applicable)
         static uint8_t  PctDamaged(void);           // Returns a number from 0-100 of the percent damage taken
         static uint8_t  PctHealthRemaining(void);   // Returns a number from 0-100 of the percent of health remaining
         static boolean  isRepairOngoing(void);      // Returns the status of a repair operation
+        static boolean  isIRBusy(void);             // True while we are sending IR, or a signal is coming in or waiting for WasHit() to decode it
+        static uint8_t  RepairType(void);           // REPAIR_NONE, REPAIR_SELF or REPAIR_OTHER (see EventCodes.h)
+        static uint8_t  RepairPctComplete(void);    // Returns 0-100, how far through REPAIR_TIME_mS the ongoing repair is (0 if there isn't one)
 //        static void     Damage();                   // NOTE: The Standalone IR board does not have a speed to be reduced, therefore we have no "damage" function
+        static uint8_t  SpeedCutPct(void);          // Returns 0-100, how much the current damage profile says drive speed should be cut by at our present damage. 
+                                                    // Nothing on this board uses it, but it is there for anyone adding a drive motor. 
+        static void     LoadDamageProfile(const damage_profile *);  // Replace the working damage profile with one held in RAM. begin() loads the profile selected 
+                                                    // by BattleSettings.DamageProfile, this way for CUSTOM_DAMAGE. 
+        static void     GetDamageProfile(DAMAGEPROFILES, damage_profile *); // Copies one of the built-in profiles out of program memory
         static battle_settings BattleSettings;      // Battle settings struct
         static boolean  isInvulnerable;             // Is the tank presently invulnerable to incoming fire
         static boolean  isDestroyed;                // Is the tank destroyed
         static uint8_t  CannonHitsTaken;            // How many cannon hits have we sustained
         static uint8_t  MGHitsTaken;                // How many machine gun hits have we sustained
+        static uint16_t UnknownIRCount;             // How many IR signals have come in that didn't decode as anything we take hits or repairs from
+                                                    // (noise, bad reception, a protocol we aren't set up for). Never reset, OP_Stats keeps track of it.
                 
         // Misc
         static boolean  isRepairTank(void);         // Returns status of fight/repair switch on the TCB.
@@ -131,7 +196,7 @@ class OP_Tank
         
     private:
         // Setup
-        static void     SetupTamiyaWeightClass(char);   // Initializes the weight class settings for a standard Tamiya weight class
+        static void     LoadWeightClass(WEIGHTCLASS);   // Copies the settings for a standard Tamiya weight class out of the weight class table (custom classes are left alone)
     
         // IR objects
         static IRsend     IR_Tx;
@@ -146,49 +211,42 @@ class OP_Tank
         static void     ReloadComplete(void);
         static boolean  CannonReloadComplete;
     
-        // High Intensity Flash 
-        static void     ClearMuzzleFlash(void);
-
         // Incoming hits
         static void     EnableHitReception(void);
         static void     DisableHitReception(void);
         static void     ResetBattle(void);
         static IRTYPES  _lastHit;
         static IRTEAMS  _lastTeam;
+        static shot_fingerprint RecentShots[HIT_DEDUP_SLOTS];
+        static boolean  isRepeatShot(void);         // Returns true if the cannon hit just decoded is another copy of a shot we've already counted
         
-        // Hit notification LEDs
-        static boolean  HitLEDsOn;                  // True if currently ON or DIM, False if OFF
-        static void     HitLEDs_On(void);
-        static void     HitLEDs_Off(void);
-        static void     HitLEDs_Toggle(void);
-        static void     HitLEDs_SetDim(uint8_t level);
-        static void     HitLEDs_Blink(long blinkTime);
+        // Hit notification LEDs - these just start and stop the effect scripts in OP_Tank.cpp, OP_LedFX does the rest
         static void     HitLEDs_CannonHit(void);    // Cannon-hit damage light effect
-        static void     CannonHitLEDs_Update(void);
-        static void     CannonHitLEDs_Stop(void);
         static void     HitLEDs_MGHit(void);        // Machine gun-hit damage light effect
         static void     HitLEDs_Destroyed(void);    // Destroyed light effect
         static void     Repair_BlinkHandler(void);  // Repair light effect
-        static void     HitLEDs_Repair(void);       // Repair light effect
-        static int16_t      FadeStep;
-        static int16_t      FadeTarget;
-        static int16_t      CurrentFadeLevel;
-        static boolean  FadeOut;
-        static int      FadeStep_TimerID;
-        static int      HitLED_TimerID;
         static void     HitLEDs_ReloadNotify(void); // Blink on cannon reload, if enabled in A_Setup.h   
 
         // Damage/Repair
         static uint8_t  HitsTaken_Cannon;           // How many hits have we sustained
         static uint8_t  HitsTaken_MG;               // How many machine gun hits have we sustained      
-        static float    DamagePct;                  // Damage the vehicle has sustained, in percent
-        static float    DamagePctPerCannonHit;      // How many damage does a single cannon hit inflict
-        static float    DamagePctPerMGHit;          // How many damage does a single round of machine gun fire inflict
-        static boolean  RepairOngoing;              // Flag gets set if tank receives a repair code, and remains set until the operation is completed (see REPAIR_TIME_mS)
+        // Damage is kept as a whole number of "points" out of DamagePointsMax, rather than as a floating point percent. DamagePointsMax is chosen so that 
+        // one cannon hit, one MG hit and the half of a two-shot hit are all whole numbers of points, so there is never any rounding and the tank is destroyed 
+        // on exactly the hit it should be. It also keeps the floating point library out of flash. See begin() in the cpp.
+        static uint32_t DamagePoints;               // Damage the vehicle has sustained
+        static uint32_t DamagePointsMax;            // Damage at which the vehicle is destroyed (100%)
+        static uint16_t DamagePointsPerCannonHit;   // How much damage does a single cannon hit inflict
+        static uint16_t DamagePointsPerMGHit;       // How much damage does a single round of machine gun fire inflict
+        static boolean  AddDamage(uint32_t);        // Add damage, returns true if we are now destroyed
+        static damage_profile DamageProfile;        // Working copy of the damage profile in use
+        static uint32_t CannonHitPoints(IRTYPES);   // Looks up how many damage points a cannon hit with this protocol is worth
+        static uint8_t  RepairOngoing;              // REPAIR_NONE, or REPAIR_SELF if we received a repair code / REPAIR_OTHER if we sent one, until the operation is 
+                                                    // completed (see REPAIR_TIME_mS). The codes are in EventCodes.h
         static void     CancelRepair(void);         // If the model receive an enemy hit in the middle of a repair operation, we cancel the repair operation, do not increase the
                                                     // the health level, and apply damage as usual. 
         static void     RepairOver(void);           // This gets called if the repair is completed successfully. This is where the health is increased. 
         static int      RepairTimerID;              // Timer ID for the repair operation
+        static uint32_t RepairStartTime;            // millis() when the repair started
 
         // Misc
         static boolean  IR_Enabled;                 // True if either cannon or MG enabled, false if both disabled
@@ -29,7 +29,16 @@
 #include "SimpleTimer.h"
 #include "IRLib.h"
 #include "IRLibMatch.h"
+#include "IsrStats.h"
 #include "Button.h"
+#include "Config.h"
+#include "EventBus.h"
+#include "EventLog.h"
+#include "LoopProfile.h"
+#include "PulseOut.h"
+#include "StackProbe.h"
+#include "Stats.h"
+#include "Telemetry.h"
 #include "Tank.h"
 
 
@@ -51,33 +60,46 @@
 // MOTOR OBJECTS
     // We always have a recoil servo
         Servo_RECOIL * RecoilServo;
-// REPAIR
-    #define REPAIR_NONE     0                               // No repair operation ongoing
-    #define REPAIR_SELF     1                               // We are being repaired by another tank
-    #define REPAIR_OTHER    2                               // We are repairing another tank
-    uint8_t RepairOngoing = REPAIR_NONE;                    // Init 
+// CONFIGURATION
+    OP_Config Config;                                       // The settings from A_Setup.h, or the ones saved to EEPROM if there are any
 
 // INPUT BUTTON
-    OP_Button InputButton = OP_Button(pin_Button, true, true, 25);              // Initialize a button object. Set pin, internal pullup = true, inverted = true, debounce time = 25 mS
+    OP_Button InputButton;                                  // Interrupt driven, see Settings.h for debounce and press times
+
+// EVENTS
+    OP_EventBus EventBus;                                   // Hits, repairs, reloads and button presses are handed out to the functions in Events.ino
+    OP_EventLog EventLog;                                   // Which log them out the serial port without waiting on it, read with Tools/eventlog.py
+    OP_Stats Stats;                                         // And count them up for each match, in EEPROM, read with Tools/tankstats.py
+    OP_Telemetry Telemetry;                                 // Snapshots of our state go in the event log too, for a scoreboard to follow
+
+// STARTUP TIMING
+    uint32_t HitReadyMicros;                                // micros() when IR reception was enabled and the tank was ready to take hits
+    uint32_t SetupMicros;                                   // micros() when setup() was finished
 
 
 
 void setup()
-{   // Here we get everything started. Begin with the most important things, and keep going in descending order
+{   // Here we get everything started. Begin with the most important things, and keep going in descending order. The most important thing of all is
+    // to be ready for incoming fire, so nothing that waits (on a servo, or on the serial port) comes before IR reception is enabled. The battle info 
+    // printout, which takes the best part of 100 mS to trickle out at 115200 baud, is left until the sketch has been running for a moment and is idle. 
 
     // INIT SERIALS & COMMS
     // -------------------------------------------------------------------------------------------------------------------------------------------------->
         Serial.begin(USB_BAUD_RATE);                       // Hardware Serial 0 - Connected to FTDI/USB connector
 
+    // LOAD CONFIGURATION
+    // -------------------------------------------------------------------------------------------------------------------------------------------------->
+        Config.begin();                                     // Everything below uses Config.Values rather than the A_Setup.h defines directly
+
     // PINS 
     // -------------------------------------------------------------------------------------------------------------------------------------------------->
         // These pins are defined in Settings.h
 
         // Pushbutton - held to ground when pushed, or accepts a ground-switched signal from some other MFU
-            pinMode(pin_Button, INPUT_PULLUP);              // Input    - Pushbutton input
+            InputButton.begin();                            // Input    - Pushbutton input, with pullup and pin change interrupt
 
         // Positive voltage trigger - accepts a 5v signal from another device
-            if (USE_5VOLT_TRIGGER)
+            if (Config.Values.Use5VoltTrigger)
             {
                 pinMode(pin_VoltageTrigger, INPUT);         // Input    - In this case we do NOT want the pullup resistor enabled. 
                 digitalWrite(pin_VoltageTrigger, LOW);      //          - This statement makes certain the internal pullup is disconnected. We will use an external pull-down resistor (to ground)
@@ -135,197 +157,80 @@ void setup()
     // What will be used are recoil/return times, along with a reverse setting if the servo needs to be reversed. These can be modified
     // later but will be initialized to sensible defaults.
         ESC_POS_t SERVONUM_RECOIL = (ESC_POS_t)0;  // Recoil servo is servo #0 (Port B0)
-        RecoilServo = new Servo_RECOIL (SERVONUM_RECOIL,MOTOR_MAX_REVSPEED,MOTOR_MAX_FWDSPEED,0,RECOIL_MS,RETURN_MS,REVERSE_RECOIL);  
+        RecoilServo = new Servo_RECOIL (SERVONUM_RECOIL,MOTOR_MAX_REVSPEED,MOTOR_MAX_FWDSPEED,0,Config.Values.RecoilMS,Config.Values.ReturnMS,Config.Values.ReverseRecoil);  
         // Recoil servos also have custom end-points. Because RecoilServo is a motor of class Servo, we can call setMin/MaxPulseWidth from the servo class directly, rather than from TankServos
-        RecoilServo->setMinPulseWidth(SERVONUM_RECOIL, RECOIL_SERVO_EP_MIN);
-        RecoilServo->setMaxPulseWidth(SERVONUM_RECOIL, RECOIL_SERVO_EP_MAX);
+        RecoilServo->setMinPulseWidth(SERVONUM_RECOIL, Config.Values.RecoilEndPointMin);
+        RecoilServo->setMaxPulseWidth(SERVONUM_RECOIL, Config.Values.RecoilEndPointMax);
         // The reversed setting needs to be applied both to the motor class (flag) as well as to the servo class (actual recoil movement settings). 
-        RecoilServo->set_Reversed(REVERSE_RECOIL);                       // motor class method
-        RecoilServo->setRecoilReversed(SERVONUM_RECOIL, REVERSE_RECOIL); // servo class method
-        // The begin function will make sure the recoil servo is initialized to its "battery" position
-        RecoilServo->begin();
+        RecoilServo->set_Reversed(Config.Values.ReverseRecoil);                       // motor class method
+        RecoilServo->setRecoilReversed(SERVONUM_RECOIL, Config.Values.ReverseRecoil); // servo class method
+        // The recoil servo is sent to its "battery" position after IR reception has been started, below
 
     // BATTLE SETTINGS
     // -------------------------------------------------------------------------------------------------------------------------------------------------->    
-        // Initialize our "Tank" object. These settings are defined in A_Setup.h
-        weightClassSettings CustomClassSettings = { CUSTOM_CANNON_RELOAD, CUSTOM_RECOVERY_TIME, CUSTOM_CANNON_HITS, CUSTOM_MG_HITS };
+        // Initialize our "Tank" object. These settings are the defaults in A_Setup.h, unless different ones have been saved to EEPROM (see OP_Config.h)
         battle_settings BattleSettings;
-        BattleSettings.WeightClass = WEIGHT_CLASS;
-        BattleSettings.ClassSettings = CustomClassSettings;
-        BattleSettings.IR_FireProtocol = IR_FIRE_PROTOCOL;
-        BattleSettings.IR_Team = IR_TEAM;
-        BattleSettings.IR_HitProtocol_2 = IR_HIT_PROTOCOL_ALT;
-        BattleSettings.IR_RepairProtocol = IR_REPAIR_PROTOCOL;
-        BattleSettings.IR_MGProtocol = IR_MG_PROTOCOL;
+        BattleSettings.WeightClass = Config.Values.WeightClass;
+        BattleSettings.ClassSettings = Config.Values.CustomClass;
+        BattleSettings.IR_FireProtocol = Config.Values.IR_FireProtocol;
+        BattleSettings.IR_Team = Config.Values.IR_Team;
+        BattleSettings.IR_HitProtocol_2 = Config.Values.IR_HitProtocol_2;
+        BattleSettings.IR_RepairProtocol = Config.Values.IR_RepairProtocol;
+        BattleSettings.IR_MGProtocol = Config.Values.IR_MGProtocol;
         BattleSettings.Use_MG_Protocol = false;                         // We are not firing a machine gun
-        BattleSettings.Accept_MG_Damage = MG_DAMAGE;
-        BattleSettings.DamageProfile = TAMIYA_DAMAGE;
-        BattleSettings.SendTankID = SEND_ID;                                      
-        BattleSettings.TankID = TANK_ID;                                              
+        BattleSettings.Accept_MG_Damage = Config.Values.Accept_MG_Damage;
+        BattleSettings.DamageProfile = Config.Values.DamageProfile;
+        BattleSettings.CustomDamage = Config.Values.CustomDamage;
+        BattleSettings.RepairTank = Config.Values.RepairTank;
+        BattleSettings.ReloadNotify = Config.Values.CannonReloadNotify;
+        BattleSettings.SendTankID = Config.Values.SendTankID;                                      
+        BattleSettings.TankID = Config.Values.TankID;                                              
         // Now pass battle settings to the Tank object
         Tank.begin(BattleSettings, RecoilServo, &timer);
-  
-    // DUMP INFO
+        HitReadyMicros = micros();              // From here on any IR that comes in is captured, and decoded the first time through loop()
+
+    // EVENTS
     // -------------------------------------------------------------------------------------------------------------------------------------------------->        
-        DumpBattleInfo();
+        SubscribeEvents();                      // Tell the event bus which of our functions to call for each event, see Events.ino
 
+    // RECOIL SERVO TO BATTERY
+    // -------------------------------------------------------------------------------------------------------------------------------------------------->        
+        RecoilServo->begin();                   // Starts the move to its "battery" position, the servo ISR finishes it while we get on with everything else
+
+    // BATTLE STATISTICS
+    // -------------------------------------------------------------------------------------------------------------------------------------------------->        
+        Stats.begin(&timer);                    // Starts counting a new match, after the newest one saved in EEPROM
+
+    // TELEMETRY
+    // -------------------------------------------------------------------------------------------------------------------------------------------------->        
+        Telemetry.begin(&timer);                // Logs our starting state, then a snapshot whenever it changes
+  
     // LEDS OFF
     // -------------------------------------------------------------------------------------------------------------------------------------------------->        
         BoardLedOff();
         timer.setInterval(500, BoardLedOff);    // Because of some quirks in the way the IR receive library works, the board LED (which we use to indicate incoming IR whether decoded or not), 
                                                 // can often be left hanging in the on position. This timer will check every 500 mS and turn it off. 
-}
 
+    #ifdef USE_STACK_PROBE
+        timer.setInterval(STACK_PROBE_INTERVAL_mS, OP_StackProbe::Update);  // Keep track of how deep the stack has been
+    #endif
 
-void loop()
-{
-// MAIN LOOP VARIABLES
-// ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
-// Battle Variables
-    static boolean Alive = true;                                      // Has the tank been destroyed? If so, Alive = false
-    HIT_TYPE HitType;                                                 // If we were hit, what kind of hit was it
-// Button stuff
-    enum {BUTTON_WAIT, BUTTON_TO_WAIT};       
-    static uint8_t ButtonState;                                       //The current button state machine state
-
+    #ifdef LOOP_PROFILE
+        OP_LoopProfile::Reset();                // Start timing the loop from here
+    #endif
 
-    // PER-LOOP UPDATES
-    // -------------------------------------------------------------------------------------------------------------------------------------------------->
-        PerLoopUpdates();       // Reads the input button, and updates all timers
+    // DUMP INFO
+    // -------------------------------------------------------------------------------------------------------------------------------------------------->        
+        SetupMicros = micros();
+        LogBootTime();                          // How long it took us to be ready for hits, in the event log
+        timer.setTimeout(BOOT_INFO_DELAY_mS, DumpBattleInfoWhenIdle);  // And the battle settings once we're up and running and nothing else is going on. A double press prints them again.
+}
 
 
-    // PROCESS BUTTON PRESS
-    // -------------------------------------------------------------------------------------------------------------------------------------------------->
-        switch (ButtonState) 
-        {
-            // This state watches for short and long presses, dumps debug info with a short press, 
-            // or enters a special menu with a long press
-            case BUTTON_WAIT:                
-                if (InputButton.wasReleased())
-                {   // A single press (short) of the button will fire the cannon
-                    FireCannon();
-                }
-                else if (InputButton.pressedFor(2000)) 
-                {
-                    // User has held down the input button for two seconds (long press)
-                    // Wait for them to release the button before proceeding
-                    do { delay(10); InputButton.read(); } while (!InputButton.wasReleased());                     
-                    ButtonState = BUTTON_WAIT;
-
-                    // Now you could take some other action here to occur on long button press
-                    // bla bla
-                    
-                }
-                break;
-
-            //This is a transition state where we just wait for the user to release the button
-            //before moving back to the WAIT state.
-            case BUTTON_TO_WAIT:
-                if (InputButton.wasReleased()) ButtonState = BUTTON_WAIT;
-                break;
-        }
-
-
-    // PROCESS HITS
-    // ------------------------------------------------------------------------------------------------------------------------------------------------>  
-    // Were we hit? 
-    if (Alive) HitType = Tank.WasHit();
-    else       HitType = HIT_TYPE_NONE;
-    
-    if (HitType != HIT_TYPE_NONE)
-    {
-        // We flashed the onboard LED when IR signals were detected. Turn it off now they are done.
-        BoardLedOff();
-        
-        // We were hit. But was it a damaging hit, or a repair hit? 
-        switch (HitType)
-        {
-            case HIT_TYPE_CANNON: 
-                Serial.print(F("CANNON HIT! (")); 
-                Serial.print(ptrIRName(Tank.LastHitProtocol()));
-                if (Tank.LastHitTeam() != IR_TEAM_NONE) Serial.print(ptrIRTeam(Tank.LastHitTeam()));
-                Serial.println(F(")"));
-                
-                if (Tank.isRepairTank() && REPAIR_ON_HIT)
-                {
-                    // We want to respond to hits with a repair signal
-                    FireCannon();
-                    // Cancel the hit, it doesn't affect us
-                    HitType = HIT_TYPE_NONE;
-                }
-                else
-                {
-                    // Were we in the middle of a repair?
-                    if (RepairOngoing) { Serial.println(F("REPAIR OPERATION CANCELLED")); }
-                    if (RepairOngoing) { RepairOngoing = REPAIR_NONE; }   // End repair if we were in the middle of one
-                }
-                break;
-            
-            case HIT_TYPE_MG:
-                Serial.print(F("MACHINE GUN HIT! (")); 
-                Serial.print(ptrIRName(Tank.LastHitProtocol()));
-                Serial.println(F(")"));                    
-                // Were we in the middle of a repair?
-                if (RepairOngoing) { Serial.println(F("REPAIR OPERATION CANCELLED")); }
-                if (RepairOngoing) { RepairOngoing = REPAIR_NONE; }   // End repair if we were in the middle of one
-                break;
-            
-            case HIT_TYPE_REPAIR:
-                if (!RepairOngoing && Tank.isRepairOngoing()) 
-                {                   
-                    // This marks the start of a repair operation
-                    RepairOngoing = REPAIR_SELF;    // Repair self, meaning, we are the one being repaired
-                    TriggerRepairSound();           // Play the repair sound
-                    Serial.print(F("VEHICLE REPAIR STARTED (")); 
-                    Serial.print(ptrIRName(Tank.LastHitProtocol()));
-                    Serial.println(F(")"));                    
-                }
-                break;                
-        }
-
-        // Now apply "damage", it doesn't matter if we were "damaged" or "repaired". The Damage function will take into account
-        // the current amount of damage. If we were repaired, the amount of damage will be less than before, so the Damage function will 
-        // calculate a new, lesser damage. Of course if we were hit by cannon or machine gun fire, then Damage will calculate a new, more severe damage. 
-        // NOTE: Since this is the Standalone IR board, we are not a moving vehicle. Therefore, "damage" really does nothing (typically it would reduce our maximum speed)
-        // if (HitType != HIT_TYPE_NONE) { Tank.Damage(); }
-
-        // Now show the remaining health level if this was a damaging hit (not a repair hit)
-        if (HitType != HIT_TYPE_REPAIR && HitType != HIT_TYPE_NONE) { Serial.print(F("Health Level: ")); Serial.print(Tank.PctHealthRemaining()); Serial.println(F("%")); }
-
-        if (Tank.isDestroyed && Alive)
-        {
-            Serial.println(F("TANK DESTROYED")); 
-            Alive = false;
-            TriggerDesroyedSound(); 
-        }
-        else
-        {
-            // If not destroyed, but we were hit with a damaging hit, play hit sound
-             if (HitType != HIT_TYPE_REPAIR && HitType != HIT_TYPE_NONE) 
-             {
-                TriggerHitReceivedSound();
-             }
-        }
-        
-    }
-
-    // Were we in a repair operation, and now is it complete? 
-    if (RepairOngoing && !Tank.isRepairOngoing()) 
-    {                   
-        if (REPAIR_SELF) // Only show our health level if we were the one being repaired (as opposed to repairing someone else)
-        { 
-            Serial.println(F("VEHICLE REPAIR COMPLETE")); 
-            Serial.print(F("Health Level: ")); Serial.print(Tank.PctHealthRemaining()); Serial.println(F("%")); 
-        }  
-        // Tank repair is over. 
-        RepairOngoing = REPAIR_NONE;        
-    }
-
-    
-    // Were we destroyed and now are recovered? 
-    if (!Alive && !Tank.isDestroyed)
-    {   // We're now alive
-            Alive = true;
-            Serial.println(F("TANK RESTORED")); 
-    }
+void loop()
+{
+    // Everything the sketch does is now a response to something happening - a button press, a hit, a repair finishing, a timer running out. 
+    // The parts that notice these things emit an event, and the functions in Events.ino that subscribed to it get called from PerLoopUpdates.
+    // So there is nothing here to check for ourselves. 
+    PerLoopUpdates();       // Reads the input button, checks for hits, updates all timers and hands out any events
 }
@@ -0,0 +1,73 @@
+/* OP_Telemetry.cpp Open Panzer Telemetry - periodic snapshots of the tank's state for live scoreboards
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Every TELEMETRY_INTERVAL_mS we put together a snapshot of the tank's state, and if it differs from the last one sent (or it has been
+ * TELEMETRY_HEARTBEAT_mS since), it goes into the event log as an EVENT_SNAPSHOT frame. See OP_Telemetry.h for the payload.
+ *
+ */
+
+#include "Telemetry.h"
+
+
+// Static variables must be initialized outside the class
+uint8_t         OP_Telemetry::LastSent[TELEMETRY_PAYLOAD];
+uint32_t        OP_Telemetry::LastSentTime;
+uint16_t        OP_Telemetry::SkippedCount;
+
+
+void OP_Telemetry::begin(OP_SimpleTimer * t)
+{
+    Snapshot();                                 // Where we start from
+    t->setInterval(TELEMETRY_INTERVAL_mS, Sample);
+}
+
+void OP_Telemetry::Take(uint8_t * s)
+{
+    uint8_t flags = 0;
+    if (OP_Tank::CannonReloaded())                      flags |= TELEMETRY_RELOADED;
+    if (OP_Tank::isInvulnerable)                        flags |= TELEMETRY_INVULNERABLE;
+    if (OP_Tank::isDestroyed)                           flags |= TELEMETRY_DESTROYED;
+    if (OP_Tank::RepairType() == REPAIR_SELF)           flags |= TELEMETRY_REPAIR_SELF;
+    if (OP_Tank::RepairType() == REPAIR_OTHER)          flags |= TELEMETRY_REPAIR_OTHER;
+
+    s[0] = OP_Tank::PctHealthRemaining();
+    s[1] = flags;
+    s[2] = OP_Tank::RepairPctComplete();
+    s[3] = OP_Tank::LastHitProtocol();
+    s[4] = OP_Tank::LastHitTeam();
+}
+
+void OP_Telemetry::Sample(void)
+{
+    uint8_t s[TELEMETRY_PAYLOAD];
+    Take(s);
+
+    // Repair progress creeps up a percent every 150 mS, so during a repair there will be a snapshot every time. Otherwise the state only
+    // changes with an event, and the snapshot will follow it out within TELEMETRY_INTERVAL_mS.
+    if (memcmp(s, LastSent, TELEMETRY_PAYLOAD) == 0 && (millis() - LastSentTime) < TELEMETRY_HEARTBEAT_mS) return;
+
+    // Events come first. If logging this would leave less room than a couple of events need, leave it - LastSent isn't updated, so we'll try
+    // again next time round with the newer state.
+    if (OP_EventLog::Free() < EVENTLOG_OVERHEAD + TELEMETRY_PAYLOAD + TELEMETRY_RESERVE)
+    {
+        if (SkippedCount < 0xFFFF) SkippedCount += 1;
+        return;
+    }
+
+    OP_EventLog::Write(EVENT_SNAPSHOT, s, TELEMETRY_PAYLOAD);
+    memcpy(LastSent, s, TELEMETRY_PAYLOAD);
+    LastSentTime = millis();
+}
+
+void OP_Telemetry::Snapshot(void)
+{
+    Take(LastSent);
+    OP_EventLog::Write(EVENT_SNAPSHOT, LastSent, TELEMETRY_PAYLOAD);
+    LastSentTime = millis();
+}
+
+uint16_t OP_Telemetry::Skipped(void)
+{
+    return SkippedCount;
+}
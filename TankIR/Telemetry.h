@@ -0,0 +1,67 @@
+/* OP_Telemetry.h   Open Panzer Telemetry - periodic snapshots of the tank's state for live scoreboards
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * The event log tells a computer what happened, as it happens. But a scoreboard following a match also wants to know where things stand -
+ * how much health we have, whether the cannon is loaded, how far along a repair is - without having to replay every event since the board
+ * was switched on (and without getting it wrong if it started listening halfway through, or a frame was lost).
+ *
+ * So every TELEMETRY_INTERVAL_mS we put together a snapshot of the tank's state, and if it differs from the last one sent (or it has been
+ * TELEMETRY_HEARTBEAT_mS since), it goes into the event log as an EVENT_SNAPSHOT frame. That way it gets the same sequence number and CRC as
+ * every other frame, and the same guarantee that the sketch never waits on the serial port. Event frames are still logged the moment they
+ * happen, they don't wait for a snapshot.
+ *
+ * The bandwidth is bounded by the snapshot rate, and a snapshot is simply skipped (the next one will catch up) if the event log is short of
+ * room, so snapshots can never push out an event. See Settings.h under the TELEMETRY heading.
+ *
+ * Snapshot payload:
+ *      health          percent of health remaining, 0-100
+ *      flags           TELEMETRY_xxx bits below
+ *      repair          percent of the way through the ongoing repair, 0-100 (0 if there isn't one)
+ *      protocol        IR protocol we were last hit (or repaired) with
+ *      team            team we were last hit by, if the protocol has teams
+ *
+ * Tools/eventlog.py decodes them, and with --json prints every frame as a line of JSON for a scoreboard program to read.
+ *
+ */
+
+#ifndef OP_TELEMETRY_H
+#define OP_TELEMETRY_H
+
+#include <Arduino.h>
+#include "Settings.h"
+#include "SimpleTimer.h"
+#include "EventLog.h"
+#include "Tank.h"
+
+
+// Snapshot flag bits
+#define TELEMETRY_RELOADED      0x01    // The cannon can fire
+#define TELEMETRY_INVULNERABLE  0x02    // Recovering after being destroyed, hits are ignored
+#define TELEMETRY_DESTROYED     0x04
+#define TELEMETRY_REPAIR_SELF   0x08    // We are being repaired
+#define TELEMETRY_REPAIR_OTHER  0x10    // We are a repair tank, repairing someone else
+
+#define TELEMETRY_PAYLOAD       5
+
+
+class OP_Telemetry
+{
+    // Static for everything because there is only one tank to report on
+    public:
+        OP_Telemetry(void) {}
+
+        static void     begin(OP_SimpleTimer *);    // Starts the snapshot timer
+        static void     Snapshot(void);             // Logs a snapshot now, whether or not anything has changed
+        static uint16_t Skipped(void);              // How many snapshots weren't sent because the event log was short of room
+
+    private:
+        static void     Sample(void);               // Timer callback, logs a snapshot if the state has changed or the heartbeat is due
+        static void     Take(uint8_t *);            // Fills in a snapshot payload
+        static uint8_t  LastSent[TELEMETRY_PAYLOAD];
+        static uint32_t LastSentTime;
+        static uint16_t SkippedCount;
+};
+
+
+#endif
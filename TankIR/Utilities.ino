@@ -4,10 +4,24 @@
 // ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
 // This gets called each time through the main loop. If we have
 // anything that needs to be continuously polled, put it here. 
+// The LOOP_PROFILE marks time each of these steps if LOOP_PROFILE is defined in Settings.h, otherwise they are nothing at all.
 void PerLoopUpdates(void)
 {
-    InputButton.read();     // Read the input button
+    LOOP_PROFILE_START();
+    InputButton.Update();   // Turn any input button changes the interrupt has seen into presses
+    LOOP_PROFILE_MARK(LOOP_PHASE_BUTTON);
     timer.run();            // Our simple timer object, used all over the place including by various libraries.  
+    LOOP_PROFILE_MARK(LOOP_PHASE_TIMER);
+    Tank.WasHit();          // Decode any IR that has come in. Hits and repairs are emitted as events, so we don't need what it returns.
+    LOOP_PROFILE_MARK(LOOP_PHASE_HIT);
+    EventBus.Dispatch();    // Hand out any events to the functions in Events.ino
+    LOOP_PROFILE_MARK(LOOP_PHASE_DISPATCH);
+    EventLog.Drain();       // Send whatever has been logged, as far as there's room in the serial buffer
+    LOOP_PROFILE_MARK(LOOP_PHASE_LOG);
+    Config.Update();        // Answer any configuration commands from a computer
+    LOOP_PROFILE_MARK(LOOP_PHASE_CONFIG);
+    Stats.Update();         // Write the next byte of the battle statistics to EEPROM, if a save is under way
+    LOOP_PROFILE_MARK(LOOP_PHASE_STATS);
 }
 
 
@@ -27,6 +41,19 @@ void BoardLedOff()
 // ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
 // DEBUG PRINTING
 // ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------>>
+void DumpBattleInfoWhenIdle()
+{
+    // The battle info is over a kilobyte of text, and the serial transmit buffer only holds 64 bytes, so printing it holds up the loop for the best 
+    // part of 100 mS while the rest goes out. Hits that come in meanwhile are still recorded by the IR interrupt, but they wouldn't be decoded, and 
+    // the event log and repair timers would stall. So we only print when none of that is going on, otherwise we check back a little later. 
+    if (Tank.isIRBusy() || Tank.isRepairOngoing() || EventLog.Free() < EVENTLOG_BUFFER)
+    {
+        timer.setTimeout(BATTLE_INFO_RETRY_mS, DumpBattleInfoWhenIdle);
+        return;
+    }
+    DumpBattleInfo();
+}
+
 void DumpBattleInfo()
 {
     Serial.println();
@@ -54,6 +81,7 @@ void DumpBattleInfo()
     else PrintLnYesNo(false);
     
     Serial.print(F("Damage Profile:   ")); Serial.println(ptrDamageProfile(Tank.BattleSettings.DamageProfile));
+    if (Tank.BattleSettings.DamageProfile == CUSTOM_DAMAGE) PrintCustomDamage(&Tank.BattleSettings.CustomDamage);
     Serial.print(F("Weight Class:     ")); Serial.println(ptrWeightClassName(Tank.BattleSettings.WeightClass)); 
     Serial.print(F("(")); Serial.print(Tank.BattleSettings.ClassSettings.maxHits); Serial.print(F(" cannon hits, ")); if (Tank.BattleSettings.WeightClass == WC_CUSTOM) { Serial.print(Tank.BattleSettings.ClassSettings.maxMGHits); Serial.print(F(" MG hits, ")); } Serial.print(Convert_mS_to_Sec(Tank.BattleSettings.ClassSettings.reloadTime),1); Serial.print(F(" sec reload, ")); Serial.print(Convert_mS_to_Sec(Tank.BattleSettings.ClassSettings.recoveryTime),1); Serial.println(F(" sec recovery)"));    
     }
@@ -61,17 +89,68 @@ void DumpBattleInfo()
     {
     Serial.println(F("IR & Tank Battling Disabled"));
     }
+    Serial.print(F("Settings from:    ")); if (Config.Source() == CONFIG_FROM_EEPROM) Serial.println(F("EEPROM")); else Serial.println(F("A_Setup.h"));
+    Serial.print(F("Ready for hits:   ")); Serial.print(HitReadyMicros / 1000.0, 1); Serial.print(F(" mS after reset (setup done at ")); Serial.print(SetupMicros / 1000.0, 1); Serial.println(F(" mS)"));
 
     Serial.println();
     Serial.println();
     Serial.println();
 }
 
+void PrintCustomDamage(const damage_profile * dp)
+{
+    // One line for the weights and one for the speed-cut curve, unused entries left out
+    Serial.print(F("("));
+    for (uint8_t i=0; i<DAMAGE_WEIGHTS; i++)
+    {
+        if (dp->Weight[i].Protocol == IR_DISABLED) continue;
+        Serial.print(ptrIRName(dp->Weight[i].Protocol)); Serial.print(F(" = "));
+        if (dp->Weight[i].Hits == DAMAGE_WEIGHT_HALF) Serial.print(F("half health")); else { Serial.print(dp->Weight[i].Hits); Serial.print(F(" hits")); }
+        Serial.print(F(", "));
+    }
+    Serial.println(F("others 1 hit)"));
+    Serial.print(F("(speed cut"));
+    for (uint8_t i=0; i<SPEED_CUT_POINTS; i++)
+    {
+        if (dp->SpeedCut[i].DamagePct == 0) continue;
+        Serial.print(F(" ")); Serial.print(dp->SpeedCut[i].CutPct); Serial.print(F("% to ")); Serial.print(dp->SpeedCut[i].DamagePct); Serial.print(F("% damage"));
+    }
+    Serial.println(F(")"));
+}
+
+void LogBootTime()
+{
+    // micros() starts counting when the core initializes, just before setup(). Whatever time the bootloader spent before handing over to 
+    // the sketch (it waits about half a second for an upload after an external reset, none after power-on with Optiboot) isn't counted. 
+    uint8_t payload[4] = { (uint8_t)HitReadyMicros, (uint8_t)(HitReadyMicros >> 8), (uint8_t)(HitReadyMicros >> 16), (uint8_t)(HitReadyMicros >> 24) };
+    EventLog.Write(EVENT_BOOT, payload, 4);
+}
+
+#ifdef TIMER1_EDGE_STATS
+void DumpTimer1EdgeStats()
+{
+    // Worst-case lateness of each Timer 1 compare edge since the last dump. See Settings.h
+    Serial.println();
+    PrintDebugLine();
+    Serial.println(F("TIMER 1 EDGE ERROR (worst case, uS)"));
+    PrintDebugLine();
+    for (uint8_t i=0; i<SERVO_OUT_COUNT-1; i++)
+    {
+        Serial.print(F("Servo ")); Serial.print(i); Serial.print(F(":          ")); Serial.println(OP_Servos::getMaxEdgeError_uS(i));
+    }
+    Serial.print(F("Frame space:      ")); Serial.println(OP_Servos::getMaxEdgeError_uS(SERVO_OUT_COUNT-1));
+    Serial.print(F("IR send:          ")); Serial.println(IRsendBase::getMaxEdgeError_uS());
+    Serial.print(F("Guard shifts:     ")); Serial.println(OP_Servos::getGuardShifts());
+    Serial.println();
+    OP_Servos::clearEdgeStats();
+    IRsendBase::clearEdgeStats();
+}
+#endif
+
 void PrintDebugLine()
 {
     for (uint8_t i=0; i<45; i++) { Serial.print(F("-")); }
     Serial.println(); 
-    Serial.flush();   // This causes a pause until the serial transmission is complete
 }
 
 void PrintSpaceDash()
@@ -0,0 +1,806 @@
+/* battleserver.cpp   Open Panzer battle server - follows a whole battle from the event logs of many TankIR boards at once
+ * Source:            openpanzer.org
+ * Authors:           Luke Middleton
+ *
+ * Every TankIR board logs its battle events and telemetry snapshots out its serial port as short binary frames (see TankIR/EventLog.h and
+ * TankIR/Telemetry.h). Tools/eventlog.py reads one board. This reads all of them: plug every tank into a USB hub (or a radio serial link) and
+ * run
+ *
+ *      battleserver /dev/ttyUSB0 /dev/ttyUSB1 Tiger=/dev/ttyUSB2 ...
+ *
+ * and it keeps a live scoreboard of shots, hits, kills and repairs for every tank, and writes every event of the match into one log that can be
+ * replayed later (--replay) to score it again.
+ *
+ * How it works
+ * - One thread, one epoll set. Every port is non-blocking and we only read a port when epoll says there is something to read, so nothing
+ *   ever waits on a single board. 64 boards sending flat out at 115200 baud (about 740 KB/s between them) took about 5% of one core of a
+ *   Xeon virtual machine - loadtest.py in this folder measures it.
+ * - Each board's bytes go through the same frame decoder as eventlog.py: sync byte, length, sequence, code, time, payload, CRC-8. Anything
+ *   that isn't a frame (the battle info dump, for example) is ignored. Sequence gaps are counted as lost frames.
+ * - The boards' clocks all start from zero when they're switched on, and run a little fast or slow, so each board's time is mapped onto ours.
+ *   Every second we send each board a time beacon, and it logs how its clock lines up with ours (see TankIR/ClockSync.h) - that mapping is
+ *   good to a few mS. Until a board's first clock sync frame turns up (or if it is an older sketch that doesn't know about beacons), we fall
+ *   back on a guess: frames can only ever arrive late, never early, so the smallest (our time - board time) seen so far is the best guess at
+ *   the offset. When a board restarts its time goes backwards, and we start again.
+ * - Events from all boards go into one timeline, sorted by that mapped time. An event is held back for REORDER_MS before it is scored, so one
+ *   arriving a little behind another board's still goes in the right place.
+ * - Kills: the IR only goes one way, so a tank never knows who hit it. But we can see every board. When a tank is hit with protocol P, the
+ *   most recent cannon shot of protocol P fired by another tank within SHOT_WINDOW_MS is counted as the one that hit it, and if the hit
+ *   destroyed it, the shooter gets the kill.
+ * - --score-thread moves scoring onto a worker thread, fed from a queue, so the I/O thread does nothing but read and sort.
+ *
+ * Testing without tanks: --pty N makes N pseudo-terminals and prints their names. Anything written to one of them (a capture from
+ * eventlog.py --save, for example) looks to the server exactly like a board on a serial port.
+ *
+ * Build:
+ *      c++ -O2 -std=c++11 -pthread -o build/battleserver Tools/battleserver/battleserver.cpp
+ *
+ * This is a host tool for Linux, it is NOT part of the sketch. It lives outside the TankIR folder so the Arduino IDE doesn't try to compile it.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include "../../TankIR/EventCodes.h"        // Plain C, so we always agree with the sketch on what each code means
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// SETTINGS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+#define SYNC                0xA5        // EVENTLOG_SYNC
+#define CONFIG_SYNC         0xC5        // Start of a configuration command, see TankIR/Config.h
+#define CONFIG_CMD_TIME     'T'
+#define OVERHEAD            9           // EVENTLOG_OVERHEAD: sync, length, sequence, code, 4 byte time, crc
+#define MAX_PAYLOAD         16          // Anything claiming to be longer than this is not a frame (the sketch sends 6 at most)
+
+// Telemetry snapshot flags, TELEMETRY_xxx in TankIR/Telemetry.h (which isn't plain C, so can't be included here)
+#define STATE_RELOADED      0x01
+#define STATE_INVULNERABLE  0x02
+#define STATE_DESTROYED     0x04
+#define STATE_REPAIR_SELF   0x08
+#define STATE_REPAIR_OTHER  0x10
+
+#define REORDER_MS          250         // How long an event waits for ones from other boards that should go before it
+#define SHOT_WINDOW_MS      1500        // A hit is only put down to a shot fired this recently. A Tamiya shot takes about 1 S to send.
+#define REOPEN_MS           2000        // How often we try to reopen a port that has gone away (unplugged, board reset)
+#define SCOREBOARD_MS       1000        // Scoreboard is printed at most this often, and only if something changed
+#define BEACON_MS           1000        // How often each board is sent our time
+#define READ_CHUNK          4096
+#define MAX_BOARDS          256         // More than any club will ever field, and a limit on what a damaged match log can make us allocate
+
+
+static volatile sig_atomic_t Quit = 0;
+
+static int64_t nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// FRAMES
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+struct Frame {
+    uint8_t  seq;
+    uint8_t  code;
+    uint8_t  len;
+    uint32_t ms;                        // Board's millis() when it was logged
+    uint8_t  payload[MAX_PAYLOAD];
+};
+
+static uint8_t crc8(const uint8_t *p, size_t n)
+{
+    // Same CRC as the sketch, polynomial 0x07
+    uint8_t crc = 0;
+    while (n--)
+    {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+// Feed it bytes as they arrive, it hands back whole frames. Works the same way as the decoder in Tools/eventlog.py.
+class FrameReader
+{
+    public:
+        uint32_t bad = 0;               // Things that looked like frames but failed the CRC
+
+        template <typename F> void feed(const uint8_t *data, size_t n, F onFrame)
+        {
+            buf.insert(buf.end(), data, data + n);
+            size_t i = 0;
+            while (i < buf.size())
+            {
+                if (buf[i] != SYNC) { i++; continue; }                  // Text between frames
+                if (buf.size() - i < 2) break;                          // Wait for the length
+                uint8_t len = buf[i + 1];
+                if (len > MAX_PAYLOAD) { i++; continue; }               // Not a frame after all
+                size_t total = len + OVERHEAD;
+                if (buf.size() - i < total) break;                      // Wait for the rest of it
+                const uint8_t *f = &buf[i];
+                if (crc8(f + 1, total - 2) != f[total - 1]) { bad++; i++; continue; }     // Could be a stray 0xA5 in some text
+
+                Frame fr;
+                fr.len = len;
+                fr.seq = f[2];
+                fr.code = f[3];
+                fr.ms = (uint32_t)f[4] | ((uint32_t)f[5] << 8) | ((uint32_t)f[6] << 16) | ((uint32_t)f[7] << 24);
+                memcpy(fr.payload, f + 8, len);
+                onFrame(fr);
+                i += total;
+            }
+            buf.erase(buf.begin(), buf.begin() + i);
+        }
+
+        void reset(void) { buf.clear(); }
+
+    private:
+        std::vector<uint8_t> buf;
+};
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// BOARDS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+struct Board {
+    std::string name;
+    std::string path;
+    int         fd = -1;
+    int         ptySlave = -1;          // For --pty boards we keep the other end open too, so the port doesn't close when a writer does
+    bool        isPty = false;
+    int64_t     lastOpenTry = 0;
+    FrameReader reader;
+
+    // Mapping the board's clock onto ours
+    bool        synced = false;
+    int64_t     offset = 0;             // Our time - board time, the smallest seen
+    uint32_t    lastBoardMs = 0;
+    bool        hasClock = false;       // The board has logged a clock sync, the rest of these come from the latest one
+    uint32_t    clockMs = 0;            // Board time of the sync frame
+    int32_t     clockOffset = 0;        // Our time - board time, then
+    int16_t     clockPPM = 0;           // How fast our clock gains on the board's
+
+    int64_t toOurTime(uint32_t boardMs) const
+    {
+        if (!hasClock) return (int64_t)boardMs + offset;
+        int32_t since = (int32_t)(boardMs - clockMs);
+        return (int64_t)boardMs + clockOffset + (int64_t)since * clockPPM / 1000000;
+    }
+
+    // Link statistics
+    int         lastSeq = -1;
+    uint32_t    frames = 0;
+    uint32_t    lost = 0;
+    uint32_t    restarts = 0;
+    uint64_t    bytes = 0;
+};
+
+static speed_t baudConstant(int baud)
+{
+    switch (baud)
+    {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+        case 500000:    return B500000;
+        case 1000000:   return B1000000;
+        default:        return 0;
+    }
+}
+
+static bool makeRaw(int fd, speed_t speed)
+{
+    // Binary in, nothing changed on the way: no echo, no line editing, no CR/LF translation
+    struct termios t;
+    if (tcgetattr(fd, &t) < 0) return false;
+    cfmakeraw(&t);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 0;
+    if (speed) { cfsetispeed(&t, speed); cfsetospeed(&t, speed); }
+    return tcsetattr(fd, TCSANOW, &t) == 0;
+}
+
+static bool openBoard(Board &b, int epfd, int index, speed_t speed)
+{
+    b.lastOpenTry = nowMs();
+    int fd = open(b.path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return false;
+    if (!makeRaw(fd, speed)) { close(fd); return false; }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = index;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) { close(fd); return false; }
+    b.fd = fd;
+    b.reader.reset();
+    fprintf(stderr, "battleserver: %s on %s\n", b.name.c_str(), b.path.c_str());
+    return true;
+}
+
+static bool openPty(Board &b, int epfd, int index)
+{
+    int m = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (m < 0 || grantpt(m) < 0 || unlockpt(m) < 0) { if (m >= 0) close(m); return false; }
+    b.path = ptsname(m);
+    b.isPty = true;
+    b.ptySlave = open(b.path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (b.ptySlave < 0 || !makeRaw(b.ptySlave, 0)) { close(m); return false; }     // A cooked slave would turn \n into \r\n in the frames
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = index;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, m, &ev) < 0) { close(m); close(b.ptySlave); return false; }
+    b.fd = m;
+    printf("%s %s\n", b.name.c_str(), b.path.c_str());
+    fflush(stdout);
+    return true;
+}
+
+static void sendBeacon(Board &b, uint32_t now)
+{
+    // If the port can't take it right now, there'll be another one along in a second
+    uint8_t f[8] = { CONFIG_SYNC, CONFIG_CMD_TIME, 4, (uint8_t)now, (uint8_t)(now >> 8), (uint8_t)(now >> 16), (uint8_t)(now >> 24), 0 };
+    f[7] = crc8(f + 1, 6);
+    if (write(b.fd, f, sizeof(f)) < 0 && errno != EAGAIN) { /* Reads will find out if the port has gone */ }
+}
+
+static void closeBoard(Board &b, int epfd)
+{
+    if (b.fd < 0) return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, b.fd, NULL);
+    close(b.fd);
+    b.fd = -1;
+    b.lastOpenTry = nowMs();
+    fprintf(stderr, "battleserver: lost %s, will keep trying to reopen it\n", b.name.c_str());
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// TIMELINE
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+struct TimelineEvent {
+    int64_t  t;                         // Our time, mS since the server started
+    uint64_t order;                     // Arrival order, so events with the same time stay in the order they came
+    int      board;
+    Frame    f;
+};
+
+struct Later {
+    bool operator()(const TimelineEvent &a, const TimelineEvent &b) const
+    {
+        return a.t != b.t ? a.t > b.t : a.order > b.order;
+    }
+};
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// SCORING
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+struct TankScore {
+    uint32_t shots = 0;
+    uint32_t hitsScored = 0;            // Hits on other tanks we can put down to our shots
+    uint32_t kills = 0;
+    uint32_t cannonHits = 0;            // Hits taken
+    uint32_t mgHits = 0;
+    uint32_t destroyed = 0;
+    uint32_t repairsGiven = 0;
+    uint32_t repairsReceived = 0;
+    uint32_t repairsCancelled = 0;
+    uint8_t  health = 100;
+    uint8_t  state = 0;                 // STATE_xxx flags from the last snapshot
+    uint8_t  repairPct = 0;
+    int      lastHitBy = -1;            // Board whose shot last hit us
+    int64_t  lastHitTime = 0;
+};
+
+struct Shot {
+    int64_t t;
+    int     board;
+    uint8_t protocol;
+};
+
+class Scorer
+{
+    public:
+        explicit Scorer(const std::vector<Board> &b) : boards(b), tanks(b.size()) {}
+
+        void apply(const TimelineEvent &e)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            TankScore &s = tanks[e.board];
+            const uint8_t *p = e.f.payload;
+            switch (e.f.code)
+            {
+                case EVENT_CANNON_FIRED:
+                    s.shots++;
+                    if (e.f.len >= 1) shots.push_back({e.t, e.board, p[0]});
+                    break;
+
+                case EVENT_CANNON_HIT:
+                    s.cannonHits++;
+                    if (e.f.len >= 3) s.health = p[2];
+                    s.lastHitBy = (e.f.len >= 1) ? shooter(e.t, e.board, p[0]) : -1;
+                    s.lastHitTime = e.t;
+                    if (s.lastHitBy >= 0) tanks[s.lastHitBy].hitsScored++;
+                    break;
+
+                case EVENT_MG_HIT:
+                    s.mgHits++;
+                    if (e.f.len >= 2) s.health = p[1];
+                    break;
+
+                case EVENT_DESTROYED:
+                    // Follows right behind the hit that did it
+                    s.destroyed++;
+                    s.health = 0;
+                    if (s.lastHitBy >= 0 && e.t - s.lastHitTime <= SHOT_WINDOW_MS) tanks[s.lastHitBy].kills++;
+                    break;
+
+                case EVENT_RESTORED:
+                    s.health = 100;
+                    break;
+
+                case EVENT_REPAIR_COMPLETE:
+                    if (e.f.len < 1)              break;
+                    if (p[0] == REPAIR_SELF) { s.repairsReceived++; if (e.f.len >= 2) s.health = p[1]; }
+                    else                     s.repairsGiven++;
+                    break;
+
+                case EVENT_REPAIR_CANCELLED:
+                    s.repairsCancelled++;
+                    break;
+
+                case EVENT_SNAPSHOT:
+                    if (e.f.len >= 3) { s.health = p[0]; s.state = p[1]; s.repairPct = p[2]; }
+                    break;
+
+                default:
+                    return;                 // Reloads, button presses - nothing to score, and no need to redraw
+            }
+            changed = true;
+            // Shots older than the window can't be matched to anything any more
+            while (!shots.empty() && e.t - shots.front().t > SHOT_WINDOW_MS) shots.pop_front();
+        }
+
+        bool print(FILE *out, int64_t t, bool force)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!changed && !force) return false;
+            changed = false;
+            fprintf(out, "\n--- %lld.%03lld -------------------------------------------------------------------------------\n",
+                    (long long)(t / 1000), (long long)(t % 1000));
+            fprintf(out, "%-12s %6s %5s %5s %5s %5s %5s %7s %7s %7s  %s\n",
+                    "Tank", "Health", "Shots", "Hits", "Kills", "Taken", "MG", "Killed", "Rep in", "Rep out", "State");
+            for (size_t i = 0; i < tanks.size(); i++)
+            {
+                const TankScore &s = tanks[i];
+                char state[48];
+                stateText(s, state, sizeof(state));
+                fprintf(out, "%-12s %5u%% %5u %5u %5u %5u %5u %7u %7u %7u  %s\n", boards[i].name.c_str(), s.health, s.shots, s.hitsScored,
+                        s.kills, s.cannonHits, s.mgHits, s.destroyed, s.repairsReceived, s.repairsGiven, state);
+            }
+            fflush(out);
+            return true;
+        }
+
+        void writeJson(const char *filename)
+        {
+            // Written to a temporary file and renamed, so a scoreboard reading it never sees half of one
+            std::string tmp = std::string(filename) + ".tmp";
+            FILE *f = fopen(tmp.c_str(), "w");
+            if (!f) return;
+            std::lock_guard<std::mutex> lock(mutex);
+            fprintf(f, "[\n");
+            for (size_t i = 0; i < tanks.size(); i++)
+            {
+                const TankScore &s = tanks[i];
+                fprintf(f, "  {\"tank\": \"%s\", \"health\": %u, \"shots\": %u, \"hits\": %u, \"kills\": %u, \"hits_taken\": %u, "
+                           "\"mg_hits_taken\": %u, \"destroyed\": %u, \"repairs_received\": %u, \"repairs_given\": %u, "
+                           "\"repairs_cancelled\": %u, \"state\": %u, \"repair_pct\": %u, \"lost_frames\": %u}%s\n",
+                        boards[i].name.c_str(), s.health, s.shots, s.hitsScored, s.kills, s.cannonHits, s.mgHits, s.destroyed,
+                        s.repairsReceived, s.repairsGiven, s.repairsCancelled, s.state, s.repairPct, boards[i].lost,
+                        i + 1 < tanks.size() ? "," : "");
+            }
+            fprintf(f, "]\n");
+            fclose(f);
+            rename(tmp.c_str(), filename);
+        }
+
+    private:
+        int shooter(int64_t t, int victim, uint8_t protocol)
+        {
+            // Most recent shot of this protocol from anyone else
+            for (auto it = shots.rbegin(); it != shots.rend(); ++it)
+            {
+                if (t - it->t > SHOT_WINDOW_MS) break;
+                if (it->board != victim && it->protocol == protocol && it->t <= t) return it->board;
+            }
+            return -1;
+        }
+
+        static void stateText(const TankScore &s, char *buf, size_t n)
+        {
+            if (s.state & STATE_DESTROYED)          snprintf(buf, n, "destroyed");
+            else if (s.state & STATE_INVULNERABLE)  snprintf(buf, n, "recovering");
+            else if (s.state & STATE_REPAIR_SELF)   snprintf(buf, n, "being repaired %u%%", s.repairPct);
+            else if (s.state & STATE_REPAIR_OTHER)  snprintf(buf, n, "repairing %u%%", s.repairPct);
+            else if (s.state & STATE_RELOADED)      snprintf(buf, n, "ready");
+            else                                    snprintf(buf, n, "reloading");
+        }
+
+        const std::vector<Board> &boards;
+        std::vector<TankScore> tanks;
+        std::deque<Shot> shots;
+        std::mutex mutex;
+        bool changed = false;
+};
+
+// Optional worker that does the scoring, fed from a queue by the I/O thread
+class ScoreWorker
+{
+    public:
+        explicit ScoreWorker(Scorer &s) : scorer(s), thread(&ScoreWorker::run, this) {}
+        ~ScoreWorker()
+        {
+            { std::lock_guard<std::mutex> lock(mutex); stopping = true; }
+            wake.notify_one();
+            thread.join();
+        }
+        void push(const TimelineEvent &e)
+        {
+            { std::lock_guard<std::mutex> lock(mutex); queue.push_back(e); }
+            wake.notify_one();
+        }
+
+    private:
+        void run(void)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;                  // Stopping, and everything has been scored
+                std::deque<TimelineEvent> batch;
+                batch.swap(queue);
+                lock.unlock();
+                for (const TimelineEvent &e : batch) scorer.apply(e);
+                lock.lock();
+            }
+        }
+
+        Scorer &scorer;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<TimelineEvent> queue;
+        bool stopping = false;
+        std::thread thread;                 // Last, so everything else is ready before it starts
+};
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// MATCH LOG
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// Plain text, one line per event in timeline order, so it can be read (and grepped) as well as replayed:
+//      # battleserver match log 1
+//      B <board> <name>
+//      E <time mS> <board> <sequence> <board time mS> <code> <payload bytes in hex>
+static void logHeader(FILE *log, const std::vector<Board> &boards)
+{
+    fprintf(log, "# battleserver match log 1\n");
+    for (size_t i = 0; i < boards.size(); i++) fprintf(log, "B %zu %s\n", i, boards[i].name.c_str());
+    fflush(log);
+}
+
+static void logEvent(FILE *log, const TimelineEvent &e)
+{
+    fprintf(log, "E %lld %d %u %u %u ", (long long)e.t, e.board, e.f.seq, e.f.ms, e.f.code);
+    for (int i = 0; i < e.f.len; i++) fprintf(log, "%02X", e.f.payload[i]);
+    fputc('\n', log);
+}
+
+static int replay(const char *filename, const char *jsonFile)
+{
+    FILE *log = fopen(filename, "r");
+    if (!log) { perror(filename); return 1; }
+
+    std::vector<Board> boards;
+    std::vector<TimelineEvent> events;
+    char line[512];
+    while (fgets(line, sizeof(line), log))
+    {
+        if (line[0] == 'B')
+        {
+            char name[256];
+            size_t index;
+            if (sscanf(line, "B %zu %255s", &index, name) != 2 || index >= MAX_BOARDS) continue;
+            if (boards.size() <= index) boards.resize(index + 1);
+            boards[index].name = name;
+        }
+        else if (line[0] == 'E')
+        {
+            TimelineEvent e;
+            long long t;
+            unsigned seq, ms, code;
+            char hex[2 * MAX_PAYLOAD + 1] = "";
+            char more = 0;
+            int n = sscanf(line, "E %lld %d %u %u %u %32s%c", &t, &e.board, &seq, &ms, &code, hex, &more);
+            if (n < 5) continue;
+            if (n == 7 && !isspace((unsigned char)more)) continue;     // Payload longer than any frame can have
+            if (strlen(hex) % 2) continue;
+            if (e.board < 0 || (size_t)e.board >= boards.size()) continue;
+            e.t = t;
+            e.order = events.size();
+            e.f.seq = seq;
+            e.f.ms = ms;
+            e.f.code = code;
+            e.f.len = strlen(hex) / 2;
+            for (int i = 0; i < e.f.len; i++) sscanf(hex + 2 * i, "%2hhx", &e.f.payload[i]);
+            events.push_back(e);
+        }
+    }
+    fclose(log);
+
+    Scorer scorer(boards);
+    for (const TimelineEvent &e : events) scorer.apply(e);
+    scorer.print(stdout, events.empty() ? 0 : events.back().t, true);
+    if (jsonFile) scorer.writeJson(jsonFile);
+    fprintf(stderr, "battleserver: replayed %zu events from %zu boards\n", events.size(), boards.size());
+    return 0;
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// MAIN
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+static void usage(const char *self)
+{
+    fprintf(stderr,
+        "Usage: %s [options] [name=]PORT ...\n"
+        "  Follows a battle from the event logs of many TankIR boards, keeps a live scoreboard and writes a match log.\n"
+        "  -b, --baud N          serial baud rate (default 115200, USB_BAUD_RATE in Settings.h)\n"
+        "  -p, --pty N           also make N pseudo-terminals to stand in for boards, and print their names\n"
+        "  -l, --log FILE        write every event of the match to FILE\n"
+        "  -j, --json FILE       keep FILE up to date with the scoreboard as JSON, for a display program\n"
+        "  -s, --score-thread    score on a worker thread instead of the I/O thread\n"
+        "  -q, --quiet           don't print the scoreboard as it changes (it is still printed at the end)\n"
+        "  -r, --replay FILE     score a match log written earlier, instead of listening to boards\n"
+        "  -n, --no-sync         don't send the boards time beacons (their clocks are then only roughly lined up)\n",
+        self);
+}
+
+static void onSignal(int)
+{
+    Quit = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int baud = 115200;
+    int ptys = 0;
+    const char *logFile = NULL;
+    const char *jsonFile = NULL;
+    const char *replayFile = NULL;
+    bool scoreThread = false;
+    bool quiet = false;
+    bool beacons = true;
+
+    static const struct option longOpts[] = {
+        { "baud",         required_argument, NULL, 'b' },
+        { "pty",          required_argument, NULL, 'p' },
+        { "log",          required_argument, NULL, 'l' },
+        { "json",         required_argument, NULL, 'j' },
+        { "score-thread", no_argument,       NULL, 's' },
+        { "quiet",        no_argument,       NULL, 'q' },
+        { "replay",       required_argument, NULL, 'r' },
+        { "no-sync",      no_argument,       NULL, 'n' },
+        { "help",         no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "b:p:l:j:sqr:nh", longOpts, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'b': baud = atoi(optarg);          break;
+            case 'p': ptys = atoi(optarg);          break;
+            case 'l': logFile = optarg;             break;
+            case 'j': jsonFile = optarg;            break;
+            case 's': scoreThread = true;           break;
+            case 'q': quiet = true;                 break;
+            case 'r': replayFile = optarg;          break;
+            case 'n': beacons = false;              break;
+            default:  usage(argv[0]);               return 2;
+        }
+    }
+    if (replayFile) return replay(replayFile, jsonFile);
+
+    speed_t speed = baudConstant(baud);
+    if (!speed) { fprintf(stderr, "battleserver: unsupported baud rate %d\n", baud); return 2; }
+
+    // The boards, in the order given. The name is the part before '=', or the port's own name.
+    std::vector<Board> boards;
+    for (int i = optind; i < argc; i++)
+    {
+        Board b;
+        const char *eq = strchr(argv[i], '=');
+        b.path = eq ? eq + 1 : argv[i];
+        b.name = eq ? std::string(argv[i], eq - argv[i]) : b.path.substr(b.path.rfind('/') + 1);
+        boards.push_back(b);
+    }
+    for (int i = 0; i < ptys; i++)
+    {
+        Board b;
+        b.name = "pty" + std::to_string(i);
+        boards.push_back(b);
+    }
+    if (boards.empty()) { usage(argv[0]); return 2; }
+    if (boards.size() > MAX_BOARDS) { fprintf(stderr, "battleserver: at most %d boards\n", MAX_BOARDS); return 2; }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) { perror("epoll_create1"); return 1; }
+    for (size_t i = 0; i < boards.size(); i++)
+    {
+        if (boards[i].path.empty())
+        {
+            if (!openPty(boards[i], epfd, i)) { perror("posix_openpt"); return 1; }
+        }
+        else if (!openBoard(boards[i], epfd, i, speed))
+        {
+            fprintf(stderr, "battleserver: can't open %s (%s), will keep trying\n", boards[i].path.c_str(), strerror(errno));
+        }
+    }
+
+    FILE *log = NULL;
+    if (logFile)
+    {
+        log = fopen(logFile, "w");
+        if (!log) { perror(logFile); return 1; }
+        logHeader(log, boards);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    Scorer scorer(boards);
+    ScoreWorker *worker = scoreThread ? new ScoreWorker(scorer) : NULL;
+    std::priority_queue<TimelineEvent, std::vector<TimelineEvent>, Later> timeline;
+    uint64_t order = 0;
+    const int64_t start = nowMs();
+    int64_t lastPrint = 0;
+    int64_t lastBeacon = -BEACON_MS;
+
+    auto release = [&](int64_t upTo)
+    {
+        // Everything old enough that nothing from another board can still turn up ahead of it
+        while (!timeline.empty() && timeline.top().t <= upTo)
+        {
+            const TimelineEvent &e = timeline.top();
+            if (log) logEvent(log, e);
+            if (worker) worker->push(e);
+            else        scorer.apply(e);
+            timeline.pop();
+        }
+    };
+
+    struct epoll_event ready[64];
+    uint8_t buf[READ_CHUNK];
+    while (!Quit)
+    {
+        int n = epoll_wait(epfd, ready, 64, 50);
+        if (n < 0 && errno != EINTR) { perror("epoll_wait"); break; }
+        int64_t now = nowMs() - start;
+
+        for (int i = 0; i < n; i++)
+        {
+            Board &b = boards[ready[i].data.u32];
+            int index = ready[i].data.u32;
+            while (b.fd >= 0)
+            {
+                ssize_t got = read(b.fd, buf, sizeof(buf));
+                if (got < 0 && (errno == EAGAIN || errno == EINTR)) break;
+                if (got <= 0) { closeBoard(b, epfd); break; }       // Unplugged, or the board's USB chip went away during a reset
+                b.bytes += got;
+                b.reader.feed(buf, got, [&](const Frame &f)
+                {
+                    // Board restarted - its clock has gone back to zero, and its sequence numbers started again. It logs EVENT_BOOT at the end of
+                    // setup(), which catches a restart even when it comes too soon for the clock to have gone back far.
+                    if (b.synced && (f.code == EVENT_BOOT || f.ms + 1000 < b.lastBoardMs)) { b.synced = false; b.hasClock = false; b.lastSeq = -1; b.restarts++; }
+                    b.lastBoardMs = f.ms;
+                    if (f.code == EVENT_CLOCK_SYNC && f.len >= 6)
+                    {
+                        b.hasClock = true;
+                        b.clockMs = f.ms;
+                        b.clockOffset = (int32_t)((uint32_t)f.payload[0] | ((uint32_t)f.payload[1] << 8) | ((uint32_t)f.payload[2] << 16) | ((uint32_t)f.payload[3] << 24));
+                        b.clockPPM = (int16_t)(f.payload[4] | (f.payload[5] << 8));
+                    }
+
+                    int64_t offset = now - (int64_t)f.ms;
+                    if (!b.synced || offset < b.offset) { b.offset = offset; b.synced = true; }
+                    if (b.lastSeq >= 0) b.lost += (uint8_t)(f.seq - b.lastSeq - 1);
+                    b.lastSeq = f.seq;
+                    b.frames++;
+
+                    TimelineEvent e;
+                    e.t = b.toOurTime(f.ms);
+                    e.order = order++;
+                    e.board = index;
+                    e.f = f;
+                    timeline.push(e);
+                });
+            }
+        }
+
+        release(now - REORDER_MS);
+
+        if (beacons && now - lastBeacon >= BEACON_MS)
+        {
+            lastBeacon = now;
+            for (Board &b : boards) if (b.fd >= 0) sendBeacon(b, (uint32_t)now);
+        }
+
+        if (now - lastPrint >= SCOREBOARD_MS)
+        {
+            lastPrint = now;
+            if (!quiet) scorer.print(stdout, now, false);
+            if (jsonFile) scorer.writeJson(jsonFile);
+            if (log) fflush(log);
+            for (size_t i = 0; i < boards.size(); i++)
+            {
+                Board &b = boards[i];
+                if (b.fd < 0 && !b.isPty && nowMs() - b.lastOpenTry >= REOPEN_MS) openBoard(b, epfd, i, speed);
+            }
+        }
+    }
+
+    // Score whatever is still waiting, then the final word
+    release(INT64_MAX);
+    delete worker;                                  // Waits for it to finish the queue
+    scorer.print(stdout, nowMs() - start, true);
+    if (jsonFile) scorer.writeJson(jsonFile);
+    fprintf(stderr, "\n%-12s %10s %8s %6s %4s %8s\n", "Board", "Bytes", "Frames", "Lost", "Bad", "Restarts");
+    for (const Board &b : boards)
+        fprintf(stderr, "%-12s %10llu %8u %6u %4u %8u\n", b.name.c_str(), (unsigned long long)b.bytes, b.frames, b.lost, b.reader.bad, b.restarts);
+
+    if (log) fclose(log);
+    for (Board &b : boards)
+    {
+        if (b.fd >= 0) close(b.fd);
+        if (b.ptySlave >= 0) close(b.ptySlave);
+    }
+    close(epfd);
+    return 0;
+}
@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+# loadtest.py         Open Panzer battle server load test - many boards sending flat out, and how much of the computer the server takes
+# Source:             openpanzer.org
+# Authors:            Luke Middleton
+#
+# Starts battleserver with --pty N, and writes into every one of its pseudo-terminals as fast as a board could at 115200 baud: 11,520 bytes a
+# second each, with no gaps. The frames are a steady mix of telemetry snapshots, shots, cannon and MG hits and reloads, with the board's time
+# going up as they are sent, so the server has to decode, sort and score all of them. When the time is up it reports how much processor time
+# the server used (from /proc), as a share of one core, and checks that every frame written was read, none lost and none bad.
+#
+# This program does the writing itself, which also takes processor time. On a one core computer the two share it, so if this can't keep up it
+# says so, and the figures are for what it did manage to send.
+#
+# Usage:
+#   Tools/battleserver/loadtest.py                              64 boards for 20 seconds, server from build/battleserver
+#   Tools/battleserver/loadtest.py --boards 128 --seconds 60
+#   Tools/battleserver/loadtest.py --server path/to/battleserver -- --score-thread      anything after -- is passed to the server
+#
+# Linux only, like the server.
+
+import argparse
+import os
+import re
+import signal
+import subprocess
+import sys
+import time
+
+TOOLS_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+REPO_DIR = os.path.dirname(TOOLS_DIR)
+sys.path.insert(0, TOOLS_DIR)
+from eventlog import CODES, SYNC       # noqa: E402  Event codes straight from TankIR/EventCodes.h
+
+BYTES_PER_SECOND = 115200 // 10        # 8 data bits, a start bit and a stop bit
+TICK_S = 0.01                          # How often we top every board up
+
+
+def crc_table():
+    table = []
+    for i in range(256):
+        crc = i
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+        table.append(crc)
+    return table
+
+
+CRC_TABLE = crc_table()
+
+
+def frame(seq, code, ms, payload):
+    # Same layout and CRC as the sketch's EventLog.cpp: sync, length, sequence, code, 4 byte time, payload, CRC-8 of everything but the sync
+    body = bytes((len(payload), seq, code)) + ms.to_bytes(4, 'little') + bytes(payload)
+    crc = 0
+    for b in body:
+        crc = CRC_TABLE[crc ^ b]
+    return bytes((SYNC,)) + body + bytes((crc,))
+
+
+def mix(board):
+    # What a busy tank sends, over and over. The protocol number is the board's own, so shots and hits line up between boards for scoring.
+    p = 1 + board % 8
+    return [
+        (CODES['EVENT_SNAPSHOT'],       [100, 0, 0, 0, 0]),
+        (CODES['EVENT_CANNON_FIRED'],   [p]),
+        (CODES['EVENT_CANNON_HIT'],     [p, 1, 90]),
+        (CODES['EVENT_MG_HIT'],         [p, 85]),
+        (CODES['EVENT_RELOAD_COMPLETE'], []),
+        (CODES['EVENT_SNAPSHOT'],       [85, 0, 0, 0, 0]),
+    ]
+
+
+class Board:
+    def __init__(self, index, path):
+        self.fd = os.open(path, os.O_WRONLY | os.O_NOCTTY | os.O_NONBLOCK)
+        self.mix = mix(index)
+        self.next = 0
+        self.seq = 0
+        self.owed = 0.0                 # Bytes it should have sent by now, and hasn't
+        self.pending = b''              # Made, but the port wouldn't take it all yet
+        self.sent = 0
+        self.frames = 0
+        self.short = 0                  # Times the port was full (the server wasn't reading fast enough)
+
+    def top_up(self, ms):
+        while len(self.pending) < self.owed:
+            code, payload = self.mix[self.next]
+            self.next = (self.next + 1) % len(self.mix)
+            self.pending += frame(self.seq, code, ms, payload)
+            self.seq = (self.seq + 1) & 0xFF
+            self.frames += 1
+        try:
+            n = os.write(self.fd, self.pending)
+        except BlockingIOError:
+            n = 0
+        if n < len(self.pending):
+            self.short += 1
+        self.pending = self.pending[n:]
+        self.owed -= n
+        self.sent += n
+
+
+def cpu_seconds(pid):
+    # utime and stime, fields 14 and 15 of /proc/PID/stat, counting from after the name (which can have spaces in it)
+    with open('/proc/%d/stat' % pid) as f:
+        fields = f.read().rsplit(')', 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Load test the battle server with many boards sending flat out')
+    parser.add_argument('--boards', type=int, default=64, help='how many boards (default 64)')
+    parser.add_argument('--seconds', type=float, default=20, help='how long to send for (default 20)')
+    parser.add_argument('--server', default=os.path.join(REPO_DIR, 'build', 'battleserver'), help='the battleserver program')
+    parser.add_argument('server_args', nargs='*', help='passed on to the server, after --')
+    args = parser.parse_args()
+
+    if not os.path.exists(args.server):
+        sys.exit('loadtest.py: no %s, build it first (see Tools/README.md)' % args.server)
+
+    server = subprocess.Popen([args.server, '--pty', str(args.boards), '--quiet'] + args.server_args,
+                              stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+    paths = []
+    while len(paths) < args.boards:
+        line = server.stdout.readline()
+        if not line:
+            sys.exit('loadtest.py: the server stopped: ' + server.stderr.read())
+        m = re.match(r'pty\d+ (\S+)', line)
+        if m:
+            paths.append(m.group(1))
+    boards = [Board(i, p) for i, p in enumerate(paths)]
+
+    cpu_start = cpu_seconds(server.pid)
+    start = time.monotonic()
+    last = start
+    while True:
+        now = time.monotonic()
+        if now - start >= args.seconds:
+            break
+        ms = int((now - start) * 1000)
+        for b in boards:
+            b.owed += (now - last) * BYTES_PER_SECOND
+            b.top_up(ms)
+        last = now
+        time.sleep(max(0.0, TICK_S - (time.monotonic() - now)))
+    elapsed = time.monotonic() - start
+
+    # Give the server a moment to read the last of it, then take its figures before it starts writing out the final scoreboard
+    time.sleep(0.5)
+    cpu = cpu_seconds(server.pid) - cpu_start
+    server.send_signal(signal.SIGINT)
+    out, err = server.communicate(timeout=30)
+    for b in boards:
+        os.close(b.fd)
+
+    # The server's table at the end: name, bytes, frames, lost, bad, restarts
+    got = {}
+    for line in err.splitlines():
+        f = line.split()
+        if len(f) == 6 and f[0].startswith('pty') and f[1].isdigit():
+            got[f[0]] = [int(x) for x in f[1:]]
+
+    sent = sum(b.sent for b in boards)
+    frames = sum(b.frames for b in boards)
+    print('%d boards for %.1f S: wrote %d bytes (%.0f a second each, %d wanted), %d frames' %
+          (args.boards, elapsed, sent, sent / elapsed / args.boards, BYTES_PER_SECOND, frames))
+    print('Server used %.2f S of processor time, %.1f%% of one core' % (cpu, 100 * cpu / elapsed))
+
+    problems = []
+    if sent / elapsed / args.boards < BYTES_PER_SECOND * 0.98:
+        problems.append('this program could not keep up, the figures are for less than full speed')
+    short = sum(b.short for b in boards)
+    if short:
+        problems.append('a port was full %d times, the server fell behind' % short)
+    read_bytes = sum(g[0] for g in got.values())
+    read_frames = sum(g[1] for g in got.values())
+    lost = sum(g[2] for g in got.values())
+    bad = sum(g[3] for g in got.values())
+    unsent = sum(len(b.pending) for b in boards)
+    if len(got) != args.boards or read_bytes != sent:
+        problems.append('the server read %d bytes from %d boards, %d were written' % (read_bytes, len(got), sent))
+    if not unsent and read_frames != frames:
+        problems.append('the server read %d frames, %d were written' % (read_frames, frames))
+    if lost or bad:
+        problems.append('the server saw %d lost and %d bad frames' % (lost, bad))
+    if unsent:
+        problems.append('%d bytes were still waiting to be written at the end' % unsent)
+    for p in problems:
+        print('  ' + p)
+    sys.exit(1 if problems else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,49 @@
+#!/bin/sh
+# run_bench.sh         Build the TankIR sketch, run it under simavr and write a JSON timing report
+# Source:              openpanzer.org
+# Authors:             Luke Middleton
+#
+# Usage:   Tools/bench/run_bench.sh [report.json] [extra tankir_bench options...]
+#
+# With no arguments the report is written to build/bench/<commit>.json so results can be kept per commit and compared. 
+# Any extra options are passed on to tankir_bench (eg  --wave henglong --fire-every 3000 --seconds 20), run it with no 
+# arguments to see them all.
+#
+# You need arduino-cli with the arduino:avr core (see Tools/build_sketch.sh), and simavr with its development headers 
+# (Debian/Ubuntu: apt install simavr libsimavr-dev libelf-dev). avr-nm comes with the Arduino core, or install gcc-avr. 
+#
+# loop() is only ever called from one place, so link-time optimization would normally inline it into main() and there would be no 
+# loop() to count. We stop the compiler doing that one thing, which costs a call and a return per loop (8 cycles) and otherwise 
+# leaves the code as it would be. 
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT_DIR=$(cd "$BENCH_DIR/../.." && pwd)
+OUT_DIR="$ROOT_DIR/build/bench"
+mkdir -p "$OUT_DIR"
+
+TAG=$(git -C "$ROOT_DIR" rev-parse --short HEAD 2>/dev/null || echo unknown)
+REPORT=${1:-"$OUT_DIR/$TAG.json"}
+[ $# -gt 0 ] && shift
+
+# Build the sketch
+ELF=$(EXTRA_ELF_FLAGS="-fno-inline-functions-called-once" "$ROOT_DIR/Tools/build_sketch.sh" "$OUT_DIR/sketch")
+
+# Build the simulator harness
+CFLAGS=$(pkg-config --cflags simavr 2>/dev/null || echo "-I/usr/include/simavr -I/usr/local/include/simavr")
+LIBS=$(pkg-config --libs simavr 2>/dev/null || echo "-lsimavr")
+cc -O2 -Wall $CFLAGS -o "$OUT_DIR/tankir_bench" "$BENCH_DIR/tankir_bench.c" $LIBS -lelf
+
+# Find loop()
+NM=$(command -v avr-nm || find "$HOME/.arduino15/packages/arduino/tools/avr-gcc" -name avr-nm -type f 2>/dev/null | head -n 1)
+LOOP_ADDR=$("$NM" "$ELF" | awk '$3 == "loop" { print "0x" $1 }')
+if [ -z "$LOOP_ADDR" ]; then
+    echo "run_bench.sh: no loop() symbol in $ELF, loop iterations will not be counted" >&2
+    LOOP_ARG=""
+else
+    LOOP_ARG="--loop-addr $LOOP_ADDR"
+fi
+
+"$OUT_DIR/tankir_bench" $LOOP_ARG --tag "$TAG" --output "$REPORT" "$@" "$ELF"
+echo "Report written to $REPORT"
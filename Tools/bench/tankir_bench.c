@@ -0,0 +1,423 @@
+/* tankir_bench.c     Open Panzer TankIR benchmark - runs the sketch under the simavr simulator and measures its interrupts
+ * Source:            openpanzer.org
+ * Authors:           Luke Middleton
+ *
+ * This runs the real, compiled TankIR sketch (the .elf the Arduino IDE or Tools/build_sketch.sh produces) on a simulated ATmega328P
+ * at 16 MHz. While it runs we feed IR signals into the receiver pin (Arduino pin 2 / INT0) and optionally pulse the 5 volt fire input
+ * (A0 / PCINT1), and watch every interrupt as it happens. For each interrupt vector we record:
+ *   - latency:  cycles from the moment the interrupt flag was raised to the moment its vector started executing
+ *   - duration: cycles from the vector starting to its RETI. Our ISRs re-enable interrupts part way through, so this includes the time
+ *               spent in any interrupt that preempted it.
+ * We also count how many times loop() is entered, which gives loop iterations per second and the time each iteration took.
+ *
+ * Latency and duration are also given as histograms with the same buckets the sketch's own USE_ISR_STATS uses (under 1 uS, 2, 4 ... 64 uS,
+ * and longer), so a sketch built with it can be checked against this: --long-press holds the button down long enough for the sketch to
+ * print its own figures, and --serial shows them.
+ *
+ * Results are written as JSON so they can be kept per commit and compared. See run_bench.sh, which builds the sketch, finds the
+ * address of loop() and runs this program.
+ *
+ * This is a host tool, it is NOT part of the sketch. It lives outside the TankIR folder so the Arduino IDE doesn't try to compile it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "sim_interrupts.h"
+#include "sim_cycle_timers.h"
+#include "avr_ioport.h"
+#include "avr_uart.h"
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// IR WAVEFORMS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// Alternating mark and space lengths in uS, the last entry is the gap before the signal repeats. These are the same timings the sketch
+// sends (see TankIR/IRLibMatch.h). A mark pulls the receiver pin low, same as a real IR receiver module.
+typedef struct {
+    const char *    name;
+    const uint16_t *bits;
+    uint8_t         numBits;
+    uint8_t         timesToSend;
+} ir_wave_t;
+
+static const uint16_t TamiyaWave[]   = { 3000, 3000, 6000, 8000 };
+static const uint16_t HengLongWave[] = { 19000, 4700, 9500, 4700, 4700, 9500, 4700, 32700 };
+static const uint16_t TaigenWave[]   = { 600, 620, 600, 620, 600, 620, 600, 620, 600, 620, 600, 620, 600, 620, 600, 620, 600, 14000 };
+
+static const ir_wave_t Waves[] = {
+    { "tamiya",   TamiyaWave,   sizeof(TamiyaWave) / sizeof(uint16_t),   50 },
+    { "henglong", HengLongWave, sizeof(HengLongWave) / sizeof(uint16_t), 6  },
+    { "taigen",   TaigenWave,   sizeof(TaigenWave) / sizeof(uint16_t),   6  },
+};
+#define NUM_WAVES   (sizeof(Waves) / sizeof(ir_wave_t))
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// INTERRUPTS WE WATCH
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// ATmega328P vector numbers (datasheet table 11-6, less one because RESET is vector 0)
+typedef struct {
+    const char *name;
+    uint8_t     vector;
+} watched_vector_t;
+
+static const watched_vector_t Watched[] = {
+    { "INT0",           1  },   // IR receive (IRLib.cpp)
+    { "PCINT1",         4  },   // 5 volt fire input on A0 (Cannon.ino)
+    { "PCINT2",         5  },   // Port D pin change (push button, if used)
+    { "TIMER1_COMPA",   11 },   // Servo pulses (OP_Servos::OCR1A_ISR)
+    { "TIMER1_COMPB",   12 },   // IR send (IRsendBase::OCR1B_ISR)
+    { "TIMER0_COMPA",   14 },   // Output pulses (OP_PulseOut::COMPA_ISR)
+    { "TIMER0_COMPB",   15 },
+    { "TIMER0_OVF",     16 },   // Arduino core millis()
+    { "USART_RX",       18 },   // Arduino core Serial
+    { "USART_UDRE",     19 },
+};
+#define NUM_WATCHED (sizeof(Watched) / sizeof(watched_vector_t))
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// SAMPLE STORAGE
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+typedef struct {
+    uint32_t *  values;
+    size_t      count;
+    size_t      size;
+} samples_t;
+
+static void addSample(samples_t *s, uint32_t value)
+{
+    if (s->count == s->size)
+    {
+        s->size = s->size ? s->size * 2 : 1024;
+        s->values = realloc(s->values, s->size * sizeof(uint32_t));
+        if (!s->values) { fprintf(stderr, "tankir_bench: out of memory\n"); exit(1); }
+    }
+    s->values[s->count++] = value;
+}
+
+static int compareU32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Prints {"min": , "mean": , "p99": , "max": } - sorts the samples in place
+static void printStats(FILE *out, samples_t *s)
+{
+    if (s->count == 0) { fprintf(out, "null"); return; }
+
+    qsort(s->values, s->count, sizeof(uint32_t), compareU32);
+    double total = 0;
+    for (size_t i = 0; i < s->count; i++) total += s->values[i];
+    size_t p99 = (s->count * 99 + 99) / 100;    // Nearest-rank percentile
+    if (p99 > 0) p99 -= 1;
+    fprintf(out, "{\"min\": %u, \"mean\": %.1f, \"p99\": %u, \"max\": %u}",
+            s->values[0], total / s->count, s->values[p99], s->values[s->count - 1]);
+}
+
+// Prints [n, n, ...] - how many samples fell in each of the sketch's ISR_STATS buckets: under 1 uS, 2 uS, 4 uS ... 64 uS, and longer
+#define HIST_BUCKETS    8
+static void printHist(FILE *out, const samples_t *s, uint32_t cyclesPer_uS)
+{
+    uint32_t hist[HIST_BUCKETS] = { 0 };
+    for (size_t i = 0; i < s->count; i++)
+    {
+        int b = 0;
+        for (uint32_t t = s->values[i] / cyclesPer_uS; t && b < HIST_BUCKETS - 1; t >>= 1) b++;
+        hist[b]++;
+    }
+    fprintf(out, "[");
+    for (int b = 0; b < HIST_BUCKETS; b++) fprintf(out, "%s%u", b ? ", " : "", hist[b]);
+    fprintf(out, "]");
+}
+
+typedef struct {
+    avr_cycle_count_t   raisedAt;       // When the flag was raised, 0 if not pending
+    avr_cycle_count_t   startedAt;      // When the vector started running, 0 if not running
+    samples_t           latency;
+    samples_t           duration;
+} vector_stats_t;
+
+static vector_stats_t Stats[NUM_WATCHED];
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// INTERRUPT HOOKS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+static avr_t * avr = NULL;
+
+static void onPending(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    vector_stats_t *v = (vector_stats_t *)param;
+    if (value)  { if (!v->raisedAt) v->raisedAt = avr->cycle; }
+    else        { v->raisedAt = 0; }    // Flag cleared without running (software cleared it)
+}
+
+static void onRunning(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    vector_stats_t *v = (vector_stats_t *)param;
+    if (value)
+    {   // Vector has started
+        if (v->raisedAt) addSample(&v->latency, (uint32_t)(avr->cycle - v->raisedAt));
+        v->raisedAt = 0;
+        v->startedAt = avr->cycle;
+    }
+    else if (v->startedAt)
+    {   // RETI
+        addSample(&v->duration, (uint32_t)(avr->cycle - v->startedAt));
+        v->startedAt = 0;
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// INPUT STIMULUS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+static avr_irq_t * IR_Pin;          // PD2, Arduino pin 2
+static avr_irq_t * Fire_Pin;        // PC0, Arduino A0
+
+typedef struct {
+    const ir_wave_t *   wave;
+    uint32_t            shotEvery_uS;
+    uint8_t             bit;
+    uint8_t             repeat;
+    uint32_t            shots;
+} ir_injector_t;
+
+static avr_cycle_count_t injectIR(struct avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    ir_injector_t *ir = (ir_injector_t *)param;
+
+    if (ir->repeat == ir->wave->timesToSend)
+    {   // Signal complete, receiver idles high until the next shot
+        avr_raise_irq(IR_Pin, 1);
+        ir->repeat = 0;
+        ir->bit = 0;
+        ir->shots++;
+        return when + avr_usec_to_cycles(avr, ir->shotEvery_uS);
+    }
+
+    // Even entries are marks (receiver output low), odd entries are spaces (high). The gap is always the last entry and always a space.
+    avr_raise_irq(IR_Pin, (ir->bit & 1) ? 1 : 0);
+    uint16_t length_uS = ir->wave->bits[ir->bit];
+    if (++ir->bit == ir->wave->numBits)
+    {
+        ir->bit = 0;
+        ir->repeat++;
+    }
+    return when + avr_usec_to_cycles(avr, length_uS);
+}
+
+typedef struct {
+    uint32_t    every_uS;
+    uint8_t     high;
+    uint32_t    pulses;
+} fire_injector_t;
+
+static avr_cycle_count_t injectFire(struct avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    fire_injector_t *f = (fire_injector_t *)param;
+    f->high = !f->high;
+    avr_raise_irq(Fire_Pin, f->high);
+    if (f->high) { f->pulses++; return when + avr_usec_to_cycles(avr, 50000); }    // 50 mS pulse
+    return when + avr_usec_to_cycles(avr, f->every_uS - 50000);
+}
+
+static avr_irq_t * Button_Pin;      // PD4, Arduino pin 4
+
+static avr_cycle_count_t pressButton(struct avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    // Held to ground for 2.5 seconds, longer than the sketch's long press, then released
+    uint8_t *down = (uint8_t *)param;
+    *down = !*down;
+    avr_raise_irq(Button_Pin, *down ? 0 : 1);
+    return *down ? when + avr_usec_to_cycles(avr, 2500000UL) : 0;
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// SERIAL OUTPUT
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+static void onSerialByte(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    fputc((int)(value & 0xFF), stderr);
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// MAIN
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+static void usage(const char *self)
+{
+    fprintf(stderr,
+        "Usage: %s [options] TankIR.ino.elf\n"
+        "  -l, --loop-addr ADDR    Byte address of loop() (from avr-nm), used to count loop iterations\n"
+        "  -s, --seconds N         Simulated seconds to run (default 10)\n"
+        "  -w, --wave NAME         IR signal to inject on pin 2: tamiya, henglong, taigen or none (default tamiya)\n"
+        "  -e, --shot-every MS     Time between injected IR shots in mS (default 2000)\n"
+        "  -f, --fire-every MS     Pulse the A0 fire input every MS mS (default off)\n"
+        "  -p, --long-press MS     Hold the push button down for 2.5 seconds, starting MS mS in. The sketch prints its diagnostics\n"
+        "  -t, --tag TEXT          Label copied into the report, eg a commit hash\n"
+        "  -o, --output FILE       Write the JSON report here instead of stdout\n"
+        "  -v, --serial            Echo the sketch's Serial output to stderr\n", self);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t    loopAddr = 0;
+    double      seconds = 10.0;
+    const char *waveName = "tamiya";
+    uint32_t    shotEvery_mS = 2000;
+    uint32_t    fireEvery_mS = 0;
+    uint32_t    longPress_mS = 0;
+    const char *tag = "";
+    const char *outName = NULL;
+    int         echoSerial = 0;
+
+    static const struct option longOpts[] = {
+        { "loop-addr",  required_argument, NULL, 'l' },
+        { "seconds",    required_argument, NULL, 's' },
+        { "wave",       required_argument, NULL, 'w' },
+        { "shot-every", required_argument, NULL, 'e' },
+        { "fire-every", required_argument, NULL, 'f' },
+        { "long-press", required_argument, NULL, 'p' },
+        { "tag",        required_argument, NULL, 't' },
+        { "output",     required_argument, NULL, 'o' },
+        { "serial",     no_argument,       NULL, 'v' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "l:s:w:e:f:p:t:o:v", longOpts, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'l': loopAddr = strtoul(optarg, NULL, 0);  break;
+            case 's': seconds = atof(optarg);               break;
+            case 'w': waveName = optarg;                    break;
+            case 'e': shotEvery_mS = strtoul(optarg, NULL, 0); break;
+            case 'f': fireEvery_mS = strtoul(optarg, NULL, 0); break;
+            case 'p': longPress_mS = strtoul(optarg, NULL, 0); break;
+            case 't': tag = optarg;                         break;
+            case 'o': outName = optarg;                     break;
+            case 'v': echoSerial = 1;                       break;
+            default:  usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1 || seconds <= 0) { usage(argv[0]); return 2; }
+    if (fireEvery_mS && fireEvery_mS <= 50) { fprintf(stderr, "tankir_bench: --fire-every must be longer than the 50 mS pulse\n"); return 2; }
+
+    const ir_wave_t *wave = NULL;
+    if (strcmp(waveName, "none") != 0)
+    {
+        for (size_t i = 0; i < NUM_WAVES; i++) if (strcmp(waveName, Waves[i].name) == 0) wave = &Waves[i];
+        if (!wave) { fprintf(stderr, "tankir_bench: unknown wave '%s'\n", waveName); return 2; }
+    }
+
+    // Load the firmware
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[optind], &firmware) != 0) { fprintf(stderr, "tankir_bench: can't read %s\n", argv[optind]); return 1; }
+    strcpy(firmware.mmcu, "atmega328p");
+    firmware.frequency = 16000000;
+
+    avr = avr_make_mcu_by_name(firmware.mmcu);
+    if (!avr) { fprintf(stderr, "tankir_bench: simavr doesn't know the %s\n", firmware.mmcu); return 1; }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->log = LOG_ERROR;
+
+    // Serial goes nowhere unless asked for - in particular not to stdout, where the report goes
+    uint32_t uartFlags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &uartFlags);
+    uartFlags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &uartFlags);
+    if (echoSerial) avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), onSerialByte, NULL);
+
+    // Hook the interrupts
+    for (size_t i = 0; i < NUM_WATCHED; i++)
+    {
+        avr_irq_t *irq = avr_get_interrupt_irq(avr, Watched[i].vector);
+        if (!irq) continue;
+        avr_irq_register_notify(irq + AVR_INT_IRQ_PENDING, onPending, &Stats[i]);
+        avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, onRunning, &Stats[i]);
+    }
+
+    // Idle input levels: IR receiver output high, push button (PD4) released/high, fire input (A0) low
+    IR_Pin   = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2);
+    Fire_Pin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), 0);
+    avr_raise_irq(IR_Pin, 1);
+    Button_Pin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 4);
+    avr_raise_irq(Button_Pin, 1);
+    avr_raise_irq(Fire_Pin, 0);
+
+    // Start the stimulus after the sketch has had a second to boot
+    ir_injector_t ir = { wave, shotEvery_mS * 1000UL, 0, 0, 0 };
+    if (wave) avr_cycle_timer_register_usec(avr, 1000000UL, injectIR, &ir);
+    fire_injector_t fire = { fireEvery_mS * 1000UL, 0, 0 };
+    if (fireEvery_mS) avr_cycle_timer_register_usec(avr, 1000000UL + 500000UL, injectFire, &fire);
+    uint8_t buttonDown = 0;
+    if (longPress_mS) avr_cycle_timer_register_usec(avr, longPress_mS * 1000UL, pressButton, &buttonDown);
+
+    // Run
+    avr_cycle_count_t endCycle = (avr_cycle_count_t)(seconds * firmware.frequency);
+    avr_cycle_count_t lastLoop = 0;
+    uint64_t loopIterations = 0;
+    samples_t loopCycles = { NULL, 0, 0 };
+    int state = cpu_Running;
+
+    while (avr->cycle < endCycle)
+    {
+        state = avr_run(avr);
+        if (state == cpu_Done || state == cpu_Crashed) break;
+
+        if (loopAddr && avr->pc == loopAddr)
+        {
+            if (lastLoop) addSample(&loopCycles, (uint32_t)(avr->cycle - lastLoop));
+            lastLoop = avr->cycle;
+            loopIterations++;
+        }
+    }
+    double simSeconds = (double)avr->cycle / firmware.frequency;
+
+    // Report
+    FILE *out = stdout;
+    if (outName && !(out = fopen(outName, "w"))) { fprintf(stderr, "tankir_bench: can't write %s\n", outName); return 1; }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"tag\": \"%s\",\n", tag);
+    fprintf(out, "  \"mcu\": \"%s\",\n", firmware.mmcu);
+    fprintf(out, "  \"f_cpu\": %u,\n", firmware.frequency);
+    fprintf(out, "  \"sim_seconds\": %.3f,\n", simSeconds);
+    fprintf(out, "  \"crashed\": %s,\n", state == cpu_Crashed ? "true" : "false");
+    fprintf(out, "  \"stimulus\": {\"wave\": \"%s\", \"ir_shots\": %u, \"fire_pulses\": %u},\n", wave ? wave->name : "none", ir.shots, fire.pulses);
+    fprintf(out, "  \"loop\": {\"iterations\": %llu, \"per_second\": %.1f, \"cycles\": ",
+            (unsigned long long)loopIterations, loopAddr ? loopIterations / simSeconds : 0.0);
+    printStats(out, &loopCycles);
+    fprintf(out, "},\n");
+    fprintf(out, "  \"isr\": {\n");
+    for (size_t i = 0; i < NUM_WATCHED; i++)
+    {
+        uint32_t cyclesPer_uS = firmware.frequency / 1000000UL;
+        fprintf(out, "    \"%s\": {\"count\": %zu, \"latency_hist\": ", Watched[i].name, Stats[i].duration.count);
+        printHist(out, &Stats[i].latency, cyclesPer_uS);
+        fprintf(out, ", \"duration_hist\": ");
+        printHist(out, &Stats[i].duration, cyclesPer_uS);
+        fprintf(out, ", \"latency_cycles\": ");
+        printStats(out, &Stats[i].latency);
+        fprintf(out, ", \"duration_cycles\": ");
+        printStats(out, &Stats[i].duration);
+        fprintf(out, "}%s\n", i + 1 < NUM_WATCHED ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+    if (out != stdout) fclose(out);
+
+    return state == cpu_Crashed ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# build_sketch.sh      Build the TankIR sketch for the ATmega328P from the command line
+# Source:              openpanzer.org
+# Authors:             Luke Middleton
+#
+# This compiles the sketch exactly as the Arduino IDE would, using arduino-cli, and leaves the .elf, .hex and .map
+# in the output folder so the benchmark and size tools can look at them. The intermediate object files are kept in an
+# "objects" folder underneath it. Nothing in the TankIR folder is modified.
+#
+# Usage:   Tools/build_sketch.sh [output folder] [extra arduino-cli arguments...]
+#
+# The board defaults to an Uno (any ATmega328P board produces the same code). Set FQBN to build for something else,
+# eg  FQBN=arduino:avr:nano:cpu=atmega328 Tools/build_sketch.sh
+# Extra linker flags can be passed in EXTRA_ELF_FLAGS (they are added to the map file option, rather than replacing it).
+#
+# You need arduino-cli in your path with the arduino:avr core installed:
+#   arduino-cli core update-index && arduino-cli core install arduino:avr
+
+set -e
+
+TOOLS_DIR=$(cd "$(dirname "$0")" && pwd)
+SKETCH_DIR="$TOOLS_DIR/../TankIR"
+OUT_DIR=${1:-"$TOOLS_DIR/../build"}
+[ $# -gt 0 ] && shift
+FQBN=${FQBN:-arduino:avr:uno}
+
+if ! command -v arduino-cli >/dev/null 2>&1; then
+    echo "build_sketch.sh: arduino-cli not found. See https://arduino.github.io/arduino-cli/" >&2
+    exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+OUT_DIR=$(cd "$OUT_DIR" && pwd)
+
+# Keep a linker map file, handy for working out where a symbol came from
+arduino-cli compile --fqbn "$FQBN" --output-dir "$OUT_DIR" --build-path "$OUT_DIR/objects" \
+    --build-property "compiler.c.elf.extra_flags=-Wl,-Map,$OUT_DIR/TankIR.map ${EXTRA_ELF_FLAGS}" \
+    "$@" "$SKETCH_DIR" >&2
+
+echo "$OUT_DIR/TankIR.ino.elf"
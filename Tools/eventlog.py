@@ -0,0 +1,324 @@
+#!/usr/bin/env python3
+# eventlog.py         Open Panzer TankIR event log decoder
+# Source:             openpanzer.org
+# Authors:            Luke Middleton
+#
+# The sketch doesn't print battle events as text any more, it logs them as short binary frames (see TankIR/EventLog.h) so that a burst of
+# hits never has to wait on the serial port. This reads those frames from the serial port, or from a file you captured earlier, and prints
+# them as text again. Anything else the sketch prints (the battle info dump, profiler output, ...) is passed through as it is.
+#
+# Usage:
+#   Tools/eventlog.py /dev/ttyUSB0              read from the serial port at 115200 baud (needs pyserial: pip install pyserial)
+#   Tools/eventlog.py COM3 --baud 57600         ...at some other baud rate
+#   Tools/eventlog.py capture.bin               decode a file captured earlier
+#   Tools/eventlog.py - < capture.bin           ...or from stdin
+#   Tools/eventlog.py /dev/ttyUSB0 --save x.bin also save everything received, so it can be decoded again later
+#   Tools/eventlog.py capture.bin --raw         show the frame bytes as well
+#   Tools/eventlog.py /dev/ttyUSB0 --no-state   leave out the telemetry snapshots (see TankIR/Telemetry.h)
+#   Tools/eventlog.py /dev/ttyUSB0 --json       one line of JSON per frame, for a scoreboard program to read
+#
+# Event codes are read from TankIR/EventCodes.h and IR protocol names from TankIR/IRLib.cpp, so this never disagrees with the sketch about
+# what they mean. What the payload bytes of each event mean is in PAYLOADS below, which has to match TankIR/Events.ino.
+
+import argparse
+import json
+import os
+import re
+import sys
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+SKETCH_DIR = os.path.join(os.path.dirname(TOOLS_DIR), 'TankIR')
+
+SYNC = 0xA5
+OVERHEAD = 9            # Frame bytes not counting the payload: sync, length, sequence, code, 4 byte time, crc
+MAX_PAYLOAD = 16        # Anything claiming to be longer than this is not a frame (the sketch uses far less, see EVENTLOG_MAX_PAYLOAD)
+
+TEAMS = ['None', '2', '3', '4']             # ptrIRTeam() in IRLib.cpp
+GESTURES = ['None', 'single press', 'double press', 'long press']     # BUTTON_xxx in Button.h
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# NAMES
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def read_defines(path, prefix):
+    values = {}
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'\s*#define\s+(' + prefix + r'\w+)\s+(0x[0-9A-Fa-f]+|\d+)', line)
+            if m:
+                values[m.group(1)] = int(m.group(2), 0)
+    return values
+
+
+def read_protocol_names(path):
+    # The names are the F("...") strings in ptrIRName(), in protocol number order
+    with open(path) as f:
+        text = f.read()
+    m = re.search(r'ptrIRName\s*\(IRTYPES Type\)\s*\{(.*?)return', text, re.S)
+    if not m:
+        return []
+    return re.findall(r'F\("([^"]*)"\)', m.group(1))
+
+
+CODES = read_defines(os.path.join(SKETCH_DIR, 'EventCodes.h'), 'EVENT_')
+REPAIR = read_defines(os.path.join(SKETCH_DIR, 'EventCodes.h'), 'REPAIR_')
+STATE = read_defines(os.path.join(SKETCH_DIR, 'Telemetry.h'), 'TELEMETRY_')
+CODE_NAMES = {v: k for k, v in CODES.items()}
+PROTOCOLS = read_protocol_names(os.path.join(SKETCH_DIR, 'IRLib.cpp'))
+
+
+def protocol(p):
+    return PROTOCOLS[p] if p < len(PROTOCOLS) else 'protocol %d' % p
+
+
+def who(w):
+    return 'self' if w == REPAIR.get('REPAIR_SELF') else 'other'
+
+
+def health(h):
+    return '  Health Level: %d%%' % h
+
+
+def team(t):
+    return TEAMS[t] if t < len(TEAMS) else str(t)
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# EVENTS
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# Event name -> function that turns the payload bytes into text. Keep this in step with what Events.ino logs.
+def cannon_hit(p):
+    team = ' team %s' % TEAMS[p[1]] if len(p) > 1 and 0 < p[1] < len(TEAMS) else ''
+    return 'CANNON HIT! (%s%s)%s' % (protocol(p[0]), team, health(p[2]) if len(p) > 2 else '')
+
+
+def repair_started(p):
+    if who(p[0]) == 'self':
+        return 'VEHICLE REPAIR STARTED (%s)' % protocol(p[1])
+    return 'Fire Repair Signal (%s)' % protocol(p[1])
+
+
+def repair_complete(p):
+    if who(p[0]) == 'self':
+        return 'VEHICLE REPAIR COMPLETE' + health(p[1])
+    return 'Repair of other vehicle complete'
+
+
+def snapshot_fields(p):
+    flags = p[1]
+    repair = 'self' if flags & STATE['TELEMETRY_REPAIR_SELF'] else 'other' if flags & STATE['TELEMETRY_REPAIR_OTHER'] else None
+    return {'health': p[0], 'reloaded': bool(flags & STATE['TELEMETRY_RELOADED']),
+            'invulnerable': bool(flags & STATE['TELEMETRY_INVULNERABLE']), 'destroyed': bool(flags & STATE['TELEMETRY_DESTROYED']),
+            'repair': repair, 'repair_pct': p[2], 'last_hit_protocol': protocol(p[3]), 'last_hit_team': team(p[4])}
+
+
+def snapshot(p):
+    s = snapshot_fields(p)
+    text = 'State: health %d%%, %s' % (s['health'], 'loaded' if s['reloaded'] else 'reloading')
+    if s['destroyed']:
+        text += ', destroyed'
+    if s['invulnerable']:
+        text += ', invulnerable'
+    if s['repair']:
+        text += ', repair (%s) %d%%' % (s['repair'], s['repair_pct'])
+    return text + ', last hit %s team %s' % (s['last_hit_protocol'], s['last_hit_team'])
+
+
+def clock_sync(p):
+    # int32 offset and int16 drift, see TankIR/ClockSync.h
+    return int.from_bytes(p[0:4], 'little', signed=True), int.from_bytes(p[4:6], 'little', signed=True)
+
+
+PAYLOADS = {
+    'EVENT_CANNON_HIT':         cannon_hit,
+    'EVENT_MG_HIT':             lambda p: 'MACHINE GUN HIT! (%s)%s' % (protocol(p[0]), health(p[1])),
+    'EVENT_DESTROYED':          lambda p: 'TANK DESTROYED (%s)' % protocol(p[0]),
+    'EVENT_RESTORED':           lambda p: 'TANK RESTORED',
+    'EVENT_REPAIR_STARTED':     repair_started,
+    'EVENT_REPAIR_COMPLETE':    repair_complete,
+    'EVENT_REPAIR_CANCELLED':   lambda p: 'REPAIR OPERATION CANCELLED (%s)' % who(p[0]),
+    'EVENT_RELOAD_COMPLETE':    lambda p: 'Cannon reloaded',
+    'EVENT_CANNON_FIRED':       lambda p: 'Fire Cannon (%s)' % protocol(p[0]),
+    'EVENT_BUTTON':             lambda p: 'Button %s' % (GESTURES[p[0]] if p[0] < len(GESTURES) else p[0]),
+    'EVENT_SNAPSHOT':           snapshot,
+    'EVENT_CLOCK_SYNC':         lambda p: 'Clock sync: computer time = board time %+d mS, drift %+d ppm' % clock_sync(p),
+    'EVENT_BOOT':               lambda p: 'Board started, ready for hits %.1f mS after reset' % (int.from_bytes(p[0:4], 'little') / 1000.0),
+}
+
+# The same payloads as named values, for --json. Names of protocols, teams and so on are given as text.
+FIELDS = {
+    'EVENT_CANNON_HIT':         lambda p: {'protocol': protocol(p[0]), 'team': team(p[1]), 'health': p[2]},
+    'EVENT_MG_HIT':             lambda p: {'protocol': protocol(p[0]), 'health': p[1]},
+    'EVENT_DESTROYED':          lambda p: {'protocol': protocol(p[0])},
+    'EVENT_REPAIR_STARTED':     lambda p: {'who': who(p[0]), 'protocol': protocol(p[1])},
+    'EVENT_REPAIR_COMPLETE':    lambda p: {'who': who(p[0]), 'health': p[1]},
+    'EVENT_REPAIR_CANCELLED':   lambda p: {'who': who(p[0])},
+    'EVENT_CANNON_FIRED':       lambda p: {'protocol': protocol(p[0])},
+    'EVENT_BUTTON':             lambda p: {'gesture': GESTURES[p[0]] if p[0] < len(GESTURES) else p[0]},
+    'EVENT_SNAPSHOT':           snapshot_fields,
+    'EVENT_CLOCK_SYNC':         lambda p: dict(zip(('offset', 'drift_ppm'), clock_sync(p))),
+    'EVENT_BOOT':               lambda p: {'hit_ready_us': int.from_bytes(p[0:4], 'little')},
+}
+
+
+def describe(code, payload):
+    name = CODE_NAMES.get(code, 'EVENT %d' % code)
+    try:
+        return PAYLOADS[name](payload)
+    except (KeyError, IndexError):
+        # Unknown event, or not the payload we expected - show the raw bytes
+        return '%s %s' % (name, ' '.join('%02X' % b for b in payload))
+
+
+def fields(code, payload):
+    name = CODE_NAMES.get(code, 'EVENT %d' % code)
+    try:
+        return FIELDS[name](payload) if name in FIELDS else {}
+    except IndexError:
+        return {'payload': list(payload)}
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# FRAMES
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+class Decoder:
+    # Feed it bytes as they arrive, it calls out() with a line of text for every frame and every line of plain text
+    def __init__(self, out, raw=False, state=True, as_json=False):
+        self.out = out
+        self.raw = raw
+        self.state = state
+        self.as_json = as_json
+        self.buf = bytearray()
+        self.text = bytearray()
+        self.last_seq = None
+        self.frames = 0
+        self.lost = 0
+        self.bad = 0
+
+    def feed(self, data):
+        self.buf += data
+        while self.buf:
+            if self.buf[0] != SYNC:
+                self.take_text(self.buf[0])
+                del self.buf[0]
+                continue
+            if len(self.buf) < 2:
+                return                              # Wait for the length
+            length = self.buf[1]
+            if length > MAX_PAYLOAD:
+                self.take_text(self.buf[0])         # Not a frame after all
+                del self.buf[0]
+                continue
+            total = length + OVERHEAD
+            if len(self.buf) < total:
+                return                              # Wait for the rest of it
+            frame = bytes(self.buf[:total])
+            if crc8(frame[1:-1]) != frame[-1]:
+                self.bad += 1
+                self.take_text(self.buf[0])         # Could be a stray 0xA5 in some text, keep looking from the next byte
+                del self.buf[0]
+                continue
+            del self.buf[:total]
+            self.flush_text()
+            self.frame(frame)
+
+    def frame(self, frame):
+        seq, code = frame[2], frame[3]
+        ms = int.from_bytes(frame[4:8], 'little')
+        payload = frame[8:-1]
+        if self.last_seq is not None:
+            gap = (seq - self.last_seq - 1) & 0xFF
+            if gap:
+                self.lost += gap
+                if self.as_json:
+                    self.out(json.dumps({'lost': gap}))
+                else:
+                    self.out('           ... %d event%s lost (log buffer was full)' % (gap, '' if gap == 1 else 's'))
+        self.last_seq = seq
+        self.frames += 1
+        if code == CODES.get('EVENT_SNAPSHOT') and not self.state:
+            return
+        if self.as_json:
+            record = {'seq': seq, 'ms': ms, 'event': CODE_NAMES.get(code, code)}
+            record.update(fields(code, payload))
+            self.out(json.dumps(record))
+            return
+        line = '[%9.3f] %s' % (ms / 1000.0, describe(code, payload))
+        if self.raw:
+            line += '    <%s>' % ' '.join('%02X' % b for b in frame)
+        self.out(line)
+
+    def take_text(self, b):
+        if b == 0x0A:
+            self.flush_text()
+        elif b != 0x0D:
+            self.text.append(b)
+
+    def flush_text(self):
+        if self.text:
+            text = self.text.decode('latin-1')
+            self.out(json.dumps({'text': text}) if self.as_json else text)
+            self.text = bytearray()
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# MAIN
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def open_source(name, baud):
+    if name == '-':
+        return sys.stdin.buffer, False
+    if os.path.isfile(name):
+        return open(name, 'rb'), False
+    try:
+        import serial
+    except ImportError:
+        sys.exit('eventlog.py: reading from a serial port needs pyserial (pip install pyserial)')
+    return serial.Serial(name, baud, timeout=0.1), True
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the TankIR binary event log')
+    parser.add_argument('source', help='serial port, a captured file, or - for stdin')
+    parser.add_argument('--baud', type=int, default=115200, help='serial baud rate (USB_BAUD_RATE in Settings.h)')
+    parser.add_argument('--save', metavar='FILE', help='also save every byte received to FILE')
+    parser.add_argument('--raw', action='store_true', help='show the bytes of each frame too')
+    parser.add_argument('--no-state', action='store_true', help='leave out the telemetry snapshots')
+    parser.add_argument('--json', action='store_true', help='print each frame as a line of JSON')
+    args = parser.parse_args()
+
+    if not CODES:
+        sys.exit('eventlog.py: can\'t read the event codes from ' + os.path.join(SKETCH_DIR, 'EventCodes.h'))
+
+    source, is_port = open_source(args.source, args.baud)
+    save = open(args.save, 'wb') if args.save else None
+    decoder = Decoder(lambda line: print(line, flush=True), args.raw, not args.no_state, args.json)
+    try:
+        while True:
+            data = source.read(256)
+            if not data:
+                if is_port:
+                    continue
+                break
+            if save:
+                save.write(data)
+            decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+    decoder.flush_text()
+    if save:
+        save.close()
+    if decoder.lost or decoder.bad:
+        print('%d events, %d lost, %d bad frames' % (decoder.frames, decoder.lost, decoder.bad), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,227 @@
+/* damage_test.cpp  Open Panzer host tests - OP_Tank's integer damage points against the float percent they replaced
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * OP_Tank used to keep damage as a float percent, adding 100/maxHits for each cannon hit, 100/maxMGHits for each MG hit and 50 for a Tamiya
+ * 2-shot hit. It now counts whole damage points (see begin() in Tank.cpp). This runs the real begin(), CannonHitPoints(), AddDamage(),
+ * RepairOver(), PctDamaged(), PctHealthRemaining() and SpeedCutPct() from TankIR/Tank.cpp next to two copies of the old model:
+ *      float   the old code as it was, in single precision
+ *      exact   the same sums done in double precision, with the comparisons allowed a hair of slack - what the old code meant
+ *
+ * The integer model has to agree with "exact" on every step: destroyed or not, percent damaged and the Tamiya speed cut. The float model is
+ * allowed to disagree with it only where its own rounding puts it within a whisker of 100% (or of a whole-and-a-half percent) - those are the
+ * old bugs, and they are counted and printed rather than failed.
+ *
+ * Covers every weight class, the custom class at every maxHits and maxMGHits from 0 to 255, cannon and MG damage together, cannon only and
+ * MG only, runs of cannon hits and of MG hits to destruction, the 2-shot rule, and random mixes of cannon, 2-shot, MG and repairs.
+ *
+ * Build and run with the others:  Tools/hosttest/run_tests.sh
+ */
+
+#include <Arduino.h>
+#include <math.h>
+#include <stdio.h>
+
+// The damage points and the functions that work on them are private, the test needs to get at them
+#define private public
+#include "Tank.h"
+#undef private
+
+static OP_Tank          Tank;
+static OP_SimpleTimer   Timer;
+
+#define MODE_BOTH           0       // Cannon and MG damage
+#define MODE_CANNON         1       // Cannon only
+#define MODE_MG             2       // MG only
+static const char * const ModeName[3] = {"cannon+MG", "cannon", "MG"};
+
+#define EV_CANNON           0
+#define EV_TWOSHOT          1
+#define EV_MG               2
+#define EV_REPAIR           3
+
+// The old model. Real is float for the code as it was, double for what it was meant to do.
+template <typename Real> struct PercentTank
+{
+    Real DamagePct, PerCannonHit, PerMGHit;
+    double Slack;                                                   // How far short of a boundary still counts as reaching it
+
+    void begin(uint8_t mode, uint8_t maxHits, uint8_t maxMGHits, double slack)
+    {
+        // As begin() had it, except the double copy treats zero hits as one. The float code divided by zero and got infinity, which comes to
+        // the same thing (destroyed on the first hit).
+        Slack = slack;
+        Real cannon = (slack > 0 && maxHits == 0)   ? 100.0 : 100.0 / (Real)maxHits;
+        Real mg     = (slack > 0 && maxMGHits == 0) ? 100.0 : 100.0 / (Real)maxMGHits;
+        PerCannonHit = (mode == MODE_MG)     ? 0 : cannon;
+        PerMGHit     = (mode == MODE_CANNON) ? 0 : mg;
+        DamagePct = 0;
+    }
+    bool hit(uint8_t ev)
+    {
+        if      (ev == EV_TWOSHOT) DamagePct += 50;
+        else if (ev == EV_CANNON)  DamagePct += PerCannonHit;
+        else                       DamagePct += PerMGHit;
+        if (DamagePct >= 100.0 - Slack) { DamagePct = 100.0; return true; }
+        return false;
+    }
+    void repair(void)
+    {
+        DamagePct -= PerCannonHit;
+        if (DamagePct < Slack) DamagePct = 0.0;
+    }
+    uint8_t pct(void)       { return (uint8_t)(long)(DamagePct + 0.5 + Slack); }     // The Arduino round() macro
+    uint8_t speedCut(void)
+    {   // The TAMIYA_DAMAGE speed cut as it was written before the damage profile table
+        if      (DamagePct <= Slack)                        return 0;
+        else if (DamagePct <= 50.0 + Slack)                 return 50;
+        else if (DamagePct <  100.0 - Slack)                return 75;
+        else                                                return 100;
+    }
+};
+
+static uint64_t Seed = 0x9E3779B97F4A7C15ULL;
+static uint32_t nextRandom(void)
+{   // xorshift64, so every run checks the same sequences
+    Seed ^= Seed << 13; Seed ^= Seed >> 7; Seed ^= Seed << 17;
+    return (uint32_t)(Seed >> 32);
+}
+
+static uint32_t Steps, Failures, FloatDiffers, FloatLateKills;
+static bool     FloatDead;                                         // Did the last step destroy the float model
+
+static void fail(const char * what, uint8_t wc, uint8_t mode, uint8_t maxHits, uint8_t maxMGHits, const char * seq)
+{
+    if (Failures++ < 20) printf("FAIL  %s: %s, %s, maxHits %u, maxMGHits %u, after %s\n", what, (const char *)ptrWeightClassName(wc),
+                                 ModeName[mode], maxHits, maxMGHits, seq);
+}
+
+static void setup(uint8_t wc, uint8_t mode, uint8_t maxHits, uint8_t maxMGHits)
+{
+    battle_settings bs;
+    memset(&bs, 0, sizeof(bs));
+    bs.WeightClass = wc;
+    bs.ClassSettings.maxHits = maxHits;
+    bs.ClassSettings.maxMGHits = maxMGHits;
+    bs.IR_FireProtocol = (mode == MODE_MG)     ? IR_DISABLED : IR_TAMIYA;
+    bs.IR_MGProtocol   = (mode == MODE_CANNON) ? IR_DISABLED : IR_MG_CLARK;
+    bs.Accept_MG_Damage = (mode != MODE_CANNON);
+    bs.DamageProfile = TAMIYA_DAMAGE;
+    OP_Tank::begin(bs, NULL, &Timer);
+    OP_Tank::DamagePoints = 0;
+    OP_Tank::isDestroyed = false;
+}
+
+// One event on all three. Returns true if the real one was destroyed (the caller starts a new battle).
+static bool step(uint8_t ev, PercentTank<float> & f, PercentTank<double> & x, uint8_t wc, uint8_t mode, uint8_t maxHits, uint8_t maxMGHits, char * seq, int & seqLen)
+{
+    static const char EvChar[4] = {'C', '2', 'M', 'R'};
+    if (seqLen < 60) { seq[seqLen++] = EvChar[ev]; seq[seqLen] = '\0'; }
+    Steps++;
+
+    bool dead = false, fDead = false, xDead = false;
+    if (ev == EV_REPAIR)
+    {
+        OP_Tank::RepairOngoing = REPAIR_SELF;
+        OP_Tank::RepairOver();
+        f.repair();
+        x.repair();
+    }
+    else
+    {
+        uint32_t points = (ev == EV_MG) ? OP_Tank::DamagePointsPerMGHit : OP_Tank::CannonHitPoints((ev == EV_TWOSHOT) ? IR_TAMIYA_2SHOT : IR_TAMIYA);
+        dead = OP_Tank::AddDamage(points);
+        fDead = f.hit(ev);
+        xDead = x.hit(ev);
+    }
+    FloatDead = fDead;
+
+    if (dead != xDead)                                   fail(dead ? "destroyed too soon" : "not destroyed", wc, mode, maxHits, maxMGHits, seq);
+    if (OP_Tank::PctDamaged() != x.pct())                fail("percent damaged", wc, mode, maxHits, maxMGHits, seq);
+    if (OP_Tank::PctHealthRemaining() != 100 - x.pct())  fail("percent health", wc, mode, maxHits, maxMGHits, seq);
+    if (OP_Tank::SpeedCutPct() != x.speedCut())          fail("speed cut", wc, mode, maxHits, maxMGHits, seq);
+
+    // The float model is only allowed to be out where single precision rounding put it right at a boundary
+    if (fDead != xDead || f.pct() != x.pct() || f.speedCut() != x.speedCut())
+    {
+        FloatDiffers++;
+        if (fabs((double)f.DamagePct - x.DamagePct) > 1e-3 && fDead == xDead) fail("float model differs by more than rounding", wc, mode, maxHits, maxMGHits, seq);
+    }
+
+    if (dead || xDead || fDead)
+    {   // A new battle, as ResetBattle() would
+        OP_Tank::DamagePoints = 0;
+        f.DamagePct = 0;
+        x.DamagePct = 0;
+    }
+    return dead;
+}
+
+static void checkSettings(uint8_t wc, uint8_t mode, uint8_t maxHits, uint8_t maxMGHits, int mixes)
+{
+    PercentTank<float> f;
+    PercentTank<double> x;
+    char seq[64];
+    int seqLen;
+
+    setup(wc, mode, maxHits, maxMGHits);
+    maxHits = OP_Tank::BattleSettings.ClassSettings.maxHits;        // The standard classes load theirs from the table
+    f.begin(mode, maxHits, maxMGHits, 0);
+    x.begin(mode, maxHits, maxMGHits, 1e-9);
+
+    // Cannon hits, then MG hits, until destroyed. It must take exactly maxHits (or maxMGHits) of them, zero counting as one.
+    for (uint8_t ev = EV_CANNON; ev <= EV_MG; ev += 2)
+    {
+        if ((ev == EV_CANNON && mode == MODE_MG) || (ev == EV_MG && mode == MODE_CANNON)) continue;
+        uint16_t need = (ev == EV_CANNON) ? (maxHits ? maxHits : 1) : (maxMGHits ? maxMGHits : 1);
+        uint16_t n = 0;
+        bool dead = false;
+        seqLen = 0;
+        while (!dead && n < 300)
+        {
+            n++;
+            dead = step(ev, f, x, wc, mode, maxHits, maxMGHits, seq, seqLen);
+        }
+        if (n != need) fail("wrong number of hits to destroy", wc, mode, maxHits, maxMGHits, seq);
+        if (!FloatDead) FloatLateKills++;                           // It never dies early, only late
+    }
+
+    // The 2-shot rule: one hit is always exactly half of full health, however many hits the class takes, and two of them destroy
+    if (mode != MODE_MG)
+    {
+        seqLen = 0;
+        if (step(EV_TWOSHOT, f, x, wc, mode, maxHits, maxMGHits, seq, seqLen) || OP_Tank::DamagePoints * 2 != OP_Tank::DamagePointsMax || OP_Tank::PctDamaged() != 50)
+            fail("2-shot hit is not half of full health", wc, mode, maxHits, maxMGHits, seq);
+        if (!step(EV_TWOSHOT, f, x, wc, mode, maxHits, maxMGHits, seq, seqLen))
+            fail("two 2-shot hits did not destroy", wc, mode, maxHits, maxMGHits, seq);
+    }
+
+    // Random mixes. Repairs are rarer than hits, and a battle carries on after each destruction.
+    for (int m = 0; m < mixes; m++)
+    {
+        seqLen = 0;
+        for (int e = 0; e < 120; e++)
+        {
+            uint32_t r = nextRandom() % 16;
+            uint8_t ev = (r < 6) ? EV_CANNON : (r < 7) ? EV_TWOSHOT : (r < 13) ? EV_MG : EV_REPAIR;
+            if (step(ev, f, x, wc, mode, maxHits, maxMGHits, seq, seqLen)) seqLen = 0;
+        }
+        OP_Tank::DamagePoints = 0; f.DamagePct = 0; x.DamagePct = 0;
+    }
+}
+
+int main(void)
+{
+    // The standard classes at every maxMGHits (they only set the cannon hits), and the custom class at every combination
+    for (uint8_t wc = WC_LIGHT; wc <= LAST_WEIGHT_CLASS; wc++)
+        for (int mg = 0; mg <= 255; mg++)
+            for (uint8_t mode = MODE_BOTH; mode <= MODE_MG; mode++) checkSettings(wc, mode, 0, mg, 8);
+    for (int hits = 0; hits <= 255; hits++)
+        for (int mg = 0; mg <= 255; mg++)
+            for (uint8_t mode = MODE_BOTH; mode <= MODE_MG; mode++) checkSettings(WC_CUSTOM, mode, hits, mg, 1);
+
+    printf("%u steps checked, %u failures\n", Steps, Failures);
+    printf("The old float model disagreed on %u steps, and took an extra hit to destroy in %u runs to destruction - the integer model doesn't\n",
+           FloatDiffers, FloatLateKills);
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+/* host.cpp         Open Panzer host tests - the Arduino core functions the sketch calls, for running parts of it on a PC
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Writing a pin does nothing, and reading one gives whatever a test has put in HostPin[] (low to begin with). The timer registers are plain
+ * variables a test can look at, and Serial prints to stdout. Time stands still unless a test moves HostMillis / HostMicros. See run_tests.sh
+ * for how this is built with each test.
+ */
+
+#include <Arduino.h>
+#include <stdio.h>
+
+// The registers declared in stub/avr/io.h
+#undef R8
+#undef R16
+#define R8(n) volatile uint8_t n;
+#define R16(n) volatile uint16_t n;
+R8(SREG) R16(SP) R8(SPL) R8(SPH) R8(MCUSR) R8(MCUCR)
+R8(PORTB) R8(PORTC) R8(PORTD) R8(DDRB) R8(DDRC) R8(DDRD) R8(PINB) R8(PINC) R8(PIND)
+R8(TCCR0A) R8(TCCR0B) R8(TCNT0) R8(OCR0A) R8(OCR0B) R8(TIMSK0) R8(TIFR0)
+R8(TCCR1A) R8(TCCR1B) R8(TCCR1C) R16(TCNT1) R16(OCR1A) R16(OCR1B) R16(ICR1) R8(TIMSK1) R8(TIFR1)
+R8(TCCR2A) R8(TCCR2B) R8(TCNT2) R8(OCR2A) R8(OCR2B) R8(TIMSK2) R8(TIFR2)
+R8(EICRA) R8(EIMSK) R8(EIFR) R8(PCICR) R8(PCIFR) R8(PCMSK0) R8(PCMSK1) R8(PCMSK2)
+R8(GPIOR0) R8(WDTCSR)
+
+unsigned long HostMillis, HostMicros;
+unsigned long HostFlashReads;
+uint8_t HostPin[32];
+unsigned long millis(void)                  { return HostMillis; }
+unsigned long micros(void)                  { return HostMicros; }
+void delay(unsigned long d)                 { HostMillis += d; HostMicros += d * 1000; }
+void delayMicroseconds(unsigned int d)      { HostMicros += d; }
+
+void pinMode(uint8_t, uint8_t)              { }
+void digitalWrite(uint8_t, uint8_t)         { }
+int  digitalRead(uint8_t p)                 { return HostPin[p & 31]; }
+void analogWrite(uint8_t, int)              { }
+int  analogRead(uint8_t)                    { return 0; }
+void attachInterrupt(uint8_t, void (*)(void), int) { }
+void detachInterrupt(uint8_t)               { }
+
+long random(long m)                         { return m > 0 ? rand() % m : 0; }
+long random(long a, long b)                 { return b > a ? a + rand() % (b - a) : a; }
+void randomSeed(unsigned long s)            { srand(s); }
+long map(long x, long a, long b, long c, long d) { return (x - a) * (d - c) / (b - a) + c; }
+
+HardwareSerial Serial;
+void HardwareSerial::begin(unsigned long)   { }
+int  HardwareSerial::available(void)        { return 0; }
+int  HardwareSerial::availableForWrite(void){ return 63; }
+int  HardwareSerial::read(void)             { return -1; }
+int  HardwareSerial::peek(void)             { return -1; }
+void HardwareSerial::flush(void)            { fflush(stdout); }
+
+size_t Print::write(uint8_t c)                      { putchar(c); return 1; }
+size_t Print::write(const uint8_t *b, size_t n)     { return fwrite(b, 1, n, stdout); }
+size_t Print::print(const __FlashStringHelper *s)   { return printf("%s", (const char *)s); }
+size_t Print::print(const char *s)                  { return printf("%s", s); }
+size_t Print::print(char c)                         { return printf("%c", c); }
+size_t Print::print(unsigned char v, int b)         { return print((unsigned long)v, b); }
+size_t Print::print(int v, int b)                   { return print((long)v, b); }
+size_t Print::print(unsigned int v, int b)          { return print((unsigned long)v, b); }
+size_t Print::print(long v, int b)                  { return (b == HEX) ? printf("%lX", v) : printf("%ld", v); }
+size_t Print::print(unsigned long v, int b)         { return (b == HEX) ? printf("%lX", v) : printf("%lu", v); }
+size_t Print::print(double v, int d)                { return printf("%.*f", d, v); }
+size_t Print::println(void)                         { return printf("\n"); }
+size_t Print::println(const __FlashStringHelper *s) { return print(s) + println(); }
+size_t Print::println(const char *s)                { return print(s) + println(); }
+size_t Print::println(char c)                       { return print(c) + println(); }
+size_t Print::println(unsigned char v, int b)       { return print(v, b) + println(); }
+size_t Print::println(int v, int b)                 { return print(v, b) + println(); }
+size_t Print::println(unsigned int v, int b)        { return print(v, b) + println(); }
+size_t Print::println(long v, int b)                { return print(v, b) + println(); }
+size_t Print::println(unsigned long v, int b)       { return print(v, b) + println(); }
+size_t Print::println(double v, int d)              { return print(v, d) + println(); }
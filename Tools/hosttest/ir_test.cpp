@@ -0,0 +1,191 @@
+/* ir_test.cpp      Open Panzer host tests - the sketch's IR send, receive and decode, and Tools/irwave against all three
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * irwave.h writes the send routines out again for the PC, so it can make millions of signals a second. This makes sure it still says the same
+ * thing as the sketch, and that what it makes is what the sketch's decoders are written for. For every protocol, and every team or data value
+ * that has one:
+ *      send        IRsend::send() from TankIR/IRLib.cpp is run, and the real IRsendBase::OCR1B_ISR() is called at every compare, with each one
+ *                  on time. Where it turns the carrier on and off has to be exactly where irwave's IRSend() says, edge for edge, to the end.
+ *      receive     the sketch's signal is fed into the real INT0 interrupt of IRrecvPCI, one pin change at a time, with micros() counting in 4s
+ *                  as it does on the board. What it records in IR_ReceiveParams.rawbuf has to be exactly what irwave's IRReceive() gives.
+ *      decode      IRrecvPCI::GetResults() hands that to IRdecode::decode(protocol), the way OP_Tank::WasHit() does, which has to give back
+ *                  the protocol and, for those that carry data, the value. irwave's own rawbuf is decoded too, clean and with the mark excess
+ *                  a real receiver adds.
+ *
+ * Build and run with the others:  Tools/hosttest/run_tests.sh
+ */
+
+#include <Arduino.h>
+#include <stdio.h>
+#include "Tank.h"                       // IRLib.h, and IR_RECEIVE_INT_NUM
+#include "../irwave/irwave.h"
+
+extern "C" void INT0_vect(void);
+
+static IRsend       Tx;
+static IRrecvPCI    Rx(IR_RECEIVE_INT_NUM);
+static IRdecode     Decoder;
+static uint32_t     Checks, Failures;
+
+#define START_uS    1000000UL       // When the signal starts, on micros(). A multiple of 4, so rounding to micros() is the same as irwave's.
+
+static void fail(IRTYPES p, uint32_t data, const char * what)
+{
+    Failures++;
+    printf("FAIL  %s, data %lu: %s\n", IRName(p), (unsigned long)data, what);
+}
+
+// Runs IRsend::send() through the send interrupt and records where the carrier goes on and off, in uS. Timer 1 counts half microseconds.
+static void sketchSend(IRWave & w, IRTYPES p, uint32_t data)
+{
+    w.clear();
+    TCNT1 = 0;
+    TCCR2A = 0;
+    Tx.send(p, data);
+    if (!IR_SendParams.sending) return;                 // OpenPanzer isn't written yet, and sends nothing
+    w.kHz = IR_SendParams.kHz;
+
+    uint32_t ticks = 0;
+    uint16_t last = TCNT1;
+    bool on = true;                                     // startSending() turns the carrier on straight away
+    w.add(0);
+    while (IR_SendParams.sending)
+    {
+        uint16_t due = OCR1B;
+        ticks += (uint16_t)(due - last);                // Timer 1 wraps every 32 mS, the signal goes on longer than that
+        last = due;
+        TCNT1 = due;                                    // Right on time
+        IRsendBase::OCR1B_ISR();
+        bool nowOn = (TCCR2A & _BV(COM2B1)) != 0;
+        if (nowOn != on) { w.add(ticks / 2); on = nowOn; }
+    }
+    w.even();
+    w.length = ticks / 2;
+}
+
+// Feeds a signal into the INT0 interrupt, from resume() at time 0 until it stops recording. The receiver's output is low during a mark.
+static void sketchReceive(const IRWave & w)
+{
+    HostPin[IR_ReceiveParams.recvpin] = HIGH;
+    HostMicros = START_uS;
+    Rx.resume();
+    for (uint16_t i = 0; i < w.edges && IR_ReceiveParams.rcvstate != STATE_STOP; i++)
+    {
+        HostMicros = (START_uS + w.edge[i]) & ~3UL;
+        HostPin[IR_ReceiveParams.recvpin] = (i & 1) ? HIGH : LOW;
+        INT0_vect();
+    }
+    HostPin[IR_ReceiveParams.recvpin] = HIGH;
+    HostMicros = START_uS + w.length + GAP + 4;         // Long enough after the last mark for GetResults() to call it a gap
+}
+
+// What GetResults() does with a rawbuf: takes the mark excess off the marks and adds it to the spaces
+static void decodeRawbuf(IRdecode & d, uint16_t * buf, const uint16_t * raw, uint8_t rawlen, uint8_t markExcess)
+{
+    d.Reset();
+    d.UseExtnBuf(buf);
+    d.rawlen = rawlen;
+    for (uint8_t i = 0; i < rawlen; i++) buf[i] = raw[i] + ((i % 2) ? -markExcess : markExcess);
+}
+
+static bool hasData(IRTYPES p)
+{
+    return p == IR_FOV || p == IR_VSTANK || p == IR_SONY || p == IR_RPR_CLARK || p == IR_MG_CLARK;
+}
+
+static void checkDecoded(IRdecode & d, IRTYPES p, uint32_t data, const char * what)
+{
+    char msg[96];
+    Checks++;
+    if (!d.decode(p))                                   { snprintf(msg, sizeof(msg), "%s doesn't decode", what); fail(p, data, msg); }
+    else if (d.decode_type != p)                        { snprintf(msg, sizeof(msg), "%s decodes as %s", what, IRName(d.decode_type)); fail(p, data, msg); }
+    else if (hasData(p) && d.value != data)             { snprintf(msg, sizeof(msg), "%s decodes to %lu", what, (unsigned long)d.value); fail(p, data, msg); }
+}
+
+static void check(IRTYPES p, uint32_t data)
+{
+    static IRWave sketch, wave, spoiled;
+    char msg[96];
+
+    // Send: the sketch and irwave have to put out the same thing. Clark's codes are fixed whatever data is asked for.
+    if (p == IR_RPR_CLARK) data = Clark_REPAIR_CODE;
+    if (p == IR_MG_CLARK)  data = Clark_MG_CODE;
+    sketchSend(sketch, p, data);
+    IRSend(wave, p, data);
+    Checks++;
+    if (sketch.edges != wave.edges || sketch.length != wave.length || (wave.edges && sketch.kHz != wave.kHz))
+    {
+        snprintf(msg, sizeof(msg), "sketch sends %u edges over %ld uS at %u kHz, irwave %u over %ld at %u", sketch.edges, (long)sketch.length, sketch.kHz,
+                 wave.edges, (long)wave.length, wave.kHz);
+        fail(p, data, msg);
+        return;
+    }
+    for (uint16_t i = 0; i < wave.edges; i++)
+    {
+        if (sketch.edge[i] != wave.edge[i])
+        {
+            snprintf(msg, sizeof(msg), "edge %u is at %ld uS from the sketch, %ld from irwave", i, (long)sketch.edge[i], (long)wave.edge[i]);
+            fail(p, data, msg);
+            return;
+        }
+    }
+    if (p == IR_OPENPANZER) return;
+
+    // Receive: the INT0 interrupt and irwave have to record the same thing
+    uint16_t raw[IRWAVE_RAWBUF];
+    uint8_t rawlen = IRReceive(wave, raw);
+    sketchReceive(sketch);
+    Checks++;
+    bool same = (IR_ReceiveParams.rawlen == rawlen);
+    for (uint8_t i = 0; same && i < rawlen; i++) same = (IR_ReceiveParams.rawbuf[i] == raw[i]);
+    if (!same)
+    {
+        snprintf(msg, sizeof(msg), "INT0 recorded %u marks and spaces, irwave %u, or they differ", IR_ReceiveParams.rawlen, rawlen);
+        fail(p, data, msg);
+    }
+
+    // Decode: what the board recorded, what irwave recorded, and irwave's with a real receiver's mark excess
+    Checks++;
+    if (!Rx.GetResults(&Decoder)) fail(p, data, "GetResults() has nothing");
+    else checkDecoded(Decoder, p, data, "the INT0 recording");
+
+    static IRdecode d;
+    uint16_t buf[RAWBUF];
+    decodeRawbuf(d, buf, raw, rawlen, Rx.Mark_Excess);
+    checkDecoded(d, p, data, "irwave's recording");
+
+    IRImpair imp;
+    IRWaveRandom rnd;
+    imp.markExcess_uS = MARK_EXCESS_DEFAULT;
+    spoiled = wave;
+    IRImpairWave(spoiled, imp, rnd);
+    rawlen = IRReceive(spoiled, raw);
+    decodeRawbuf(d, buf, raw, rawlen, Rx.Mark_Excess);
+    checkDecoded(d, p, data, "irwave's recording with mark excess");
+}
+
+int main(void)
+{
+    Rx.enableIRIn();
+    for (IRTYPES p = 1; p <= LAST_IRPROTOCOL; p++)
+    {
+        switch (p)
+        {
+            case IR_FOV:
+                check(p, FOV_TEAM_1_VALUE); check(p, FOV_TEAM_2_VALUE); check(p, FOV_TEAM_3_VALUE); check(p, FOV_TEAM_4_VALUE);
+                break;
+            case IR_VSTANK:
+                check(p, VsTank_HIT_VALUE);
+                break;
+            case IR_SONY:
+                // Every 12 bit value
+                for (uint32_t v = 0; v < 4096; v++) check(p, v);
+                break;
+            default:
+                check(p, IRDefaultData(p));
+        }
+    }
+    printf("%u checks, %u failures\n", Checks, Failures);
+    return Failures ? 1 : 0;
+}
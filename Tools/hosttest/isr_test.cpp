@@ -0,0 +1,261 @@
+/* isr_test.cpp     Open Panzer host tests - OP_IsrStats' histograms and its nested and back to back counts
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Built with USE_ISR_STATS defined (see run_tests.sh), so every ISR_STATS scope in the sketch is there. Timer 1 is a plain variable on the PC,
+ * and only moves when this moves it, so every run time and latency is known exactly. Checks:
+ *      - every run time from 0 to 300 ticks lands in the right bucket, and the largest is kept
+ *      - latency from the compare register, for ISR_STATS_LATE, and none at all for ISR_STATS
+ *      - a full bucket halves the whole histogram, rounding up, so a bucket with anything in it never goes back to zero
+ *      - a handler interrupted by another is counted as nested in the inner one only, and the inner one's time comes out of the outer one's,
+ *        two deep and across Timer 1 wrapping round
+ *      - a handler starting just under ISR_STATS_BACK_TO_BACK_TICKS after another finished is back to back, one starting right on it is not
+ *      - the real INT0 (IRrecvPCI) and PCINT2 (OP_Button) handlers, and the PCINT1 fire input's scope, nested and back to back with each other
+ *      - Dump() prints, then starts over
+ * The PCINT1 handler is in Cannon.ino, which needs the whole sketch, so it is stood in for here by a handler with the same ISR_STATS line.
+ *
+ * Build and run with the others:  Tools/hosttest/run_tests.sh
+ */
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include "Tank.h"                       // IRLib.h, and IR_RECEIVE_INT_NUM
+#include "Button.h"
+
+// The counts are private, the test needs to get at them
+#define private public
+#include "IsrStats.h"
+#undef private
+
+extern "C" void INT0_vect(void);
+extern "C" void PCINT2_vect(void);
+
+static IRrecvPCI    Rx(IR_RECEIVE_INT_NUM);
+static uint32_t     Checks, Failures;
+
+#define STATS(isr)  (OP_IsrStats::Isr[isr])
+
+static void expect(bool ok, const char * what, long got, long want)
+{
+    Checks++;
+    if (!ok) { Failures++; printf("FAIL  %s: %ld, should be %ld\n", what, got, want); }
+}
+#define EXPECT_EQ(got, want, what)  expect((long)(got) == (long)(want), what, (long)(got), (long)(want))
+
+// Stand-in handlers. Each one takes the given number of Timer 1 ticks, and the nesting one lets another handler in half way through, the
+// way the servo and IR send handlers turn interrupts back on.
+static void handler(uint8_t isr, uint16_t ticks)
+{
+    ISR_STATS(isr);
+    TCNT1 += ticks;
+}
+
+static void lateHandler(uint8_t isr, uint16_t late, uint16_t ticks)
+{
+    ISR_STATS_LATE(isr, late);
+    TCNT1 += ticks;
+}
+
+static void fireInput(void)
+{
+    ISR_STATS(ISR_STATS_FIRE_INPUT);    // As in ISR(PCINT1_vect) in Cannon.ino
+}
+
+static void nesting(uint8_t isr, uint16_t before, void (*inner)(void), uint16_t after)
+{
+    ISR_STATS(isr);
+    TCNT1 += before;
+    inner();
+    TCNT1 += after;
+}
+
+// The bucket a time in ticks should go in: under 1 uS (2 ticks), under 2 uS, 4, 8, 16, 32, 64, and longer
+static uint8_t bucket(uint16_t ticks)
+{
+    uint8_t b = 0;
+    while (b < ISR_STATS_BUCKETS - 1 && ticks >= (2U << b)) b++;
+    return b;
+}
+
+// A long way after anything else, so it can't be back to back
+static void idle(void)
+{
+    TCNT1 += 1000;
+}
+
+static void checkBuckets(void)
+{
+    // Every run time, one at a time so no bucket comes near filling
+    for (uint16_t t = 0; t <= 300; t++)
+    {
+        OP_IsrStats::Reset();
+        idle();
+        handler(ISR_STATS_SERVO, t);
+        for (uint8_t b = 0; b < ISR_STATS_BUCKETS; b++) EXPECT_EQ(STATS(ISR_STATS_SERVO).Run[b], b == bucket(t) ? 1 : 0, "run bucket");
+        EXPECT_EQ(STATS(ISR_STATS_SERVO).MaxRunTicks, t, "largest run time");
+        EXPECT_EQ(STATS(ISR_STATS_SERVO).BusyTicks, t, "busy ticks");
+        EXPECT_EQ(STATS(ISR_STATS_SERVO).Count, 1, "count");
+    }
+
+    // Latency, from the compare register for the compares. ISR_STATS leaves it alone.
+    for (uint16_t late = 0; late <= 300; late++)
+    {
+        OP_IsrStats::Reset();
+        idle();
+        lateHandler(ISR_STATS_IR_SEND, late, 5);
+        for (uint8_t b = 0; b < ISR_STATS_BUCKETS; b++) EXPECT_EQ(STATS(ISR_STATS_IR_SEND).Late[b], b == bucket(late) ? 1 : 0, "latency bucket");
+        EXPECT_EQ(STATS(ISR_STATS_IR_SEND).MaxLateTicks, late, "largest latency");
+    }
+    OP_IsrStats::Reset();
+    idle();
+    handler(ISR_STATS_BUTTON, 5);
+    for (uint8_t b = 0; b < ISR_STATS_BUCKETS; b++) EXPECT_EQ(STATS(ISR_STATS_BUTTON).Late[b], 0, "latency with ISR_STATS");
+    EXPECT_EQ(STATS(ISR_STATS_BUTTON).MaxLateTicks, 0, "largest latency with ISR_STATS");
+
+    // The largest is kept when a smaller one comes after it
+    OP_IsrStats::Reset();
+    idle(); handler(ISR_STATS_SERVO, 200);
+    idle(); handler(ISR_STATS_SERVO, 3);
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).MaxRunTicks, 200, "largest run time after a smaller one");
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).BusyTicks, 203, "busy ticks of two");
+}
+
+static void checkHalving(void)
+{
+    // One run in the 64 uS bucket, then the 2 uS bucket up to 255. The next one halves them all, rounding up, then counts.
+    OP_IsrStats::Reset();
+    idle(); handler(ISR_STATS_LED_PWM, 200);
+    for (uint16_t i = 0; i < 255; i++) { idle(); handler(ISR_STATS_LED_PWM, 3); }
+    EXPECT_EQ(STATS(ISR_STATS_LED_PWM).Run[1], 255, "full bucket");
+    EXPECT_EQ(STATS(ISR_STATS_LED_PWM).Run[7], 1, "other bucket before halving");
+    idle(); handler(ISR_STATS_LED_PWM, 3);
+    EXPECT_EQ(STATS(ISR_STATS_LED_PWM).Run[1], 129, "full bucket halved, plus the new one");
+    EXPECT_EQ(STATS(ISR_STATS_LED_PWM).Run[7], 1, "bucket of one halved, rounding up");
+    EXPECT_EQ(STATS(ISR_STATS_LED_PWM).Run[0], 0, "empty bucket halved");
+    EXPECT_EQ(STATS(ISR_STATS_LED_PWM).Count, 257, "count carries on through halving");
+    EXPECT_EQ(STATS(ISR_STATS_LED_PWM).MaxRunTicks, 200, "largest carries on through halving");
+}
+
+static void inner20(void)   { handler(ISR_STATS_IR_RECEIVE, 20); }
+static void inner2deep(void){ nesting(ISR_STATS_IR_SEND, 6, inner20, 4); }
+
+static void checkNested(void)
+{
+    // Servo 10 ticks, IR receive 20 inside it, servo 10 more: each is charged only its own 20
+    OP_IsrStats::Reset();
+    idle();
+    nesting(ISR_STATS_SERVO, 10, inner20, 10);
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).MaxRunTicks, 20, "outer run time, less the inner one");
+    EXPECT_EQ(STATS(ISR_STATS_IR_RECEIVE).MaxRunTicks, 20, "inner run time");
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).Nested, 0, "outer handler not nested");
+    EXPECT_EQ(STATS(ISR_STATS_IR_RECEIVE).Nested, 1, "inner handler nested");
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).BackToBack + STATS(ISR_STATS_IR_RECEIVE).BackToBack, 0, "nested isn't back to back");
+    EXPECT_EQ(OP_IsrStats::Depth, 0, "depth after");
+
+    // Two deep, starting just before Timer 1 wraps round
+    OP_IsrStats::Reset();
+    idle();
+    TCNT1 = 0xFFF0;
+    nesting(ISR_STATS_SERVO, 10, inner2deep, 10);
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).MaxRunTicks, 20, "outer of three");
+    EXPECT_EQ(STATS(ISR_STATS_IR_SEND).MaxRunTicks, 10, "middle of three");
+    EXPECT_EQ(STATS(ISR_STATS_IR_RECEIVE).MaxRunTicks, 20, "inner of three");
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).Nested, 0, "outer of three nested");
+    EXPECT_EQ(STATS(ISR_STATS_IR_SEND).Nested, 1, "middle of three nested");
+    EXPECT_EQ(STATS(ISR_STATS_IR_RECEIVE).Nested, 1, "inner of three nested");
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).BusyTicks + STATS(ISR_STATS_IR_SEND).BusyTicks + STATS(ISR_STATS_IR_RECEIVE).BusyTicks, 50, "busy ticks of three add up to the time taken");
+    EXPECT_EQ(OP_IsrStats::Depth, 0, "depth after three");
+}
+
+static void checkBackToBack(void)
+{
+    // Every gap either side of ISR_STATS_BACK_TO_BACK_TICKS, from one handler finishing to the next starting
+    for (uint16_t gap = 0; gap <= 2 * ISR_STATS_BACK_TO_BACK_TICKS; gap++)
+    {
+        OP_IsrStats::Reset();
+        idle();
+        handler(ISR_STATS_PULSE_OUT, 7);
+        TCNT1 += gap;
+        handler(ISR_STATS_LED_PWM, 7);
+        EXPECT_EQ(STATS(ISR_STATS_LED_PWM).BackToBack, gap < ISR_STATS_BACK_TO_BACK_TICKS ? 1 : 0, "back to back");
+        EXPECT_EQ(STATS(ISR_STATS_PULSE_OUT).BackToBack, 0, "first of two back to back");
+        EXPECT_EQ(STATS(ISR_STATS_LED_PWM).Nested, 0, "back to back isn't nested");
+    }
+
+    // From whichever handler finished last: here the outer one, 100 ticks after the one nested in it
+    OP_IsrStats::Reset();
+    idle();
+    nesting(ISR_STATS_SERVO, 10, inner20, 100);
+    handler(ISR_STATS_BUTTON, 3);
+    EXPECT_EQ(STATS(ISR_STATS_BUTTON).BackToBack, 1, "back to back with a handler that had one nested in it");
+}
+
+static void checkRealHandlers(void)
+{
+    // The pin change and INT0 handlers, which have no latency. Timer 1 stands still inside them, so they take no time here.
+    Rx.enableIRIn();
+    OP_Button::begin();
+    OP_IsrStats::Reset();
+
+    idle();
+    HostPin[IR_ReceiveParams.recvpin] = LOW;
+    HostMicros += 1000;
+    INT0_vect();
+    EXPECT_EQ(STATS(ISR_STATS_IR_RECEIVE).Count, 1, "INT0 count");
+    EXPECT_EQ(STATS(ISR_STATS_IR_RECEIVE).Run[0], 1, "INT0 run time");
+    EXPECT_EQ(STATS(ISR_STATS_IR_RECEIVE).MaxLateTicks + STATS(ISR_STATS_IR_RECEIVE).Late[0], 0, "INT0 latency");
+    EXPECT_EQ(STATS(ISR_STATS_IR_RECEIVE).BackToBack + STATS(ISR_STATS_IR_RECEIVE).Nested, 0, "INT0 on its own");
+
+    // PCINT2 straight after INT0, then PCINT1 a long way after
+    TCNT1 += ISR_STATS_BACK_TO_BACK_TICKS / 2;
+    HostPin[pin_Button] = LOW;
+    HostMillis += 10;
+    PCINT2_vect();
+    EXPECT_EQ(STATS(ISR_STATS_BUTTON).Count, 1, "PCINT2 count");
+    EXPECT_EQ(STATS(ISR_STATS_BUTTON).BackToBack, 1, "PCINT2 straight after INT0");
+    EXPECT_EQ(STATS(ISR_STATS_BUTTON).MaxLateTicks + STATS(ISR_STATS_BUTTON).Late[0], 0, "PCINT2 latency");
+    idle();
+    fireInput();
+    EXPECT_EQ(STATS(ISR_STATS_FIRE_INPUT).Count, 1, "PCINT1 count");
+    EXPECT_EQ(STATS(ISR_STATS_FIRE_INPUT).BackToBack + STATS(ISR_STATS_FIRE_INPUT).Nested, 0, "PCINT1 on its own");
+
+    // All three inside a servo compare that has turned interrupts back on: each of them nested
+    idle();
+    nesting(ISR_STATS_SERVO, 10, INT0_vect, 0);
+    HostPin[pin_Button] = HIGH;
+    HostMillis += 10;
+    idle();
+    nesting(ISR_STATS_SERVO, 10 + ISR_STATS_BACK_TO_BACK_TICKS, PCINT2_vect, 0);
+    idle();
+    nesting(ISR_STATS_SERVO, 10 + ISR_STATS_BACK_TO_BACK_TICKS, fireInput, 0);
+    EXPECT_EQ(STATS(ISR_STATS_IR_RECEIVE).Nested, 1, "INT0 nested");
+    EXPECT_EQ(STATS(ISR_STATS_BUTTON).Nested, 1, "PCINT2 nested");
+    EXPECT_EQ(STATS(ISR_STATS_FIRE_INPUT).Nested, 1, "PCINT1 nested");
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).Count, 3, "servo count");
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).BusyTicks, 10 + 2 * (10 + ISR_STATS_BACK_TO_BACK_TICKS), "servo busy, the nested ones taking none");
+    EXPECT_EQ(STATS(ISR_STATS_SERVO).BackToBack, 0, "servo back to back");
+    EXPECT_EQ(OP_IsrStats::Depth, 0, "depth after the real handlers");
+}
+
+static void checkDump(void)
+{
+    // Prints everything (shown here, so it can be looked over), then starts over
+    HostMillis += 1000;
+    OP_IsrStats::Dump();
+    uint32_t left = 0;
+    for (uint8_t i = 0; i < ISR_STATS_COUNT; i++) left += STATS(i).Count;
+    EXPECT_EQ(left, 0, "runs left after Dump()");
+}
+
+int main(void)
+{
+    checkBuckets();
+    checkHalving();
+    checkNested();
+    checkBackToBack();
+    checkRealHandlers();
+    checkDump();
+    printf("%u checks, %u failures\n", Checks, Failures);
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+# run_tests.sh         Build and run the TankIR host tests
+# Source:              openpanzer.org
+# Authors:             Luke Middleton
+#
+# Each *_test.cpp in this folder is compiled with the PC's own compiler, together with the sketch modules it exercises (unmodified, straight
+# out of the TankIR folder), host.cpp and the stand-in Arduino headers in stub/. Each test prints what it checked and exits non-zero if
+# anything was wrong. The programs are left in build/hosttest.
+#
+# Usage:   Tools/hosttest/run_tests.sh [test name...]       eg  Tools/hosttest/run_tests.sh damage
+#
+# Set CXX to use a different compiler, and CXXFLAGS to add flags (eg CXXFLAGS=-fsanitize=address,undefined).
+
+set -e
+
+TEST_DIR=$(cd "$(dirname "$0")" && pwd)
+SKETCH_DIR="$TEST_DIR/../../TankIR"
+OUT_DIR="$TEST_DIR/../../build/hosttest"
+CXX=${CXX:-c++}
+
+# The sketch modules OP_Tank and OP_Servos pull in between them
+MODULES="Tank IRLib SimpleTimer Motors PulseOut LedFX LedPWM EventBus StackProbe Servo IsrStats"
+
+mkdir -p "$OUT_DIR"
+SOURCES=""
+for m in $MODULES; do SOURCES="$SOURCES $SKETCH_DIR/$m.cpp"; done
+
+if [ $# -gt 0 ]; then TESTS="$*"; else TESTS=$(cd "$TEST_DIR" && ls *_test.cpp | sed 's/_test\.cpp$//'); fi
+
+failed=0
+for t in $TESTS; do
+    echo "== $t"
+    # A test that needs an optional feature from Settings.h turned on has it turned on in the sketch modules too, and can add modules of its own
+    case $t in
+        isr)    FLAGS="-DUSE_ISR_STATS";    EXTRA="$SKETCH_DIR/Button.cpp" ;;
+        *)      FLAGS="";                   EXTRA="" ;;
+    esac
+    $CXX -std=gnu++11 -O2 $FLAGS $CXXFLAGS -I "$TEST_DIR/stub" -I "$SKETCH_DIR" -o "$OUT_DIR/${t}_test" "$TEST_DIR/${t}_test.cpp" "$TEST_DIR/host.cpp" $SOURCES $EXTRA
+    "$OUT_DIR/${t}_test" || failed=1
+done
+exit $failed
@@ -0,0 +1,264 @@
+/* servo_test.cpp   Open Panzer host tests - OP_Servos motion profiles, keyframes and recoil, frame by frame
+ * Source:          openpanzer.org
+ * Authors:         Luke Middleton
+ *
+ * Drives the real OP_Servos::OCR1A_ISR() from TankIR/Servo.cpp one servo frame at a time (five compares: four servos and the frame space),
+ * with every compare on time, and records the pulse width it gives servo 0 in each frame. Checks:
+ *      - the trapezoid and S-curve tables, and easePhase() at every phase, against the curves they were made from
+ *      - linear, trapezoid and S-curve moves of every length from 1 to 1600 frames (28.8 seconds), up and down: each pulse is where the
+ *        curve says it should be on that frame, the move never goes backwards, it lands exactly on the target on its last frame and not a
+ *        frame sooner or later, and the phase stays below 32768 the whole way
+ *      - a keyframe table from PROGMEM, each keyframe landing exactly where the table says on the frame it should
+ *      - a recoil: straight back, held, then eased back into battery, landing exactly on the end-point
+ * and reports what one updateMotion() costs: at most how many flash reads, and how long it takes on this PC (there's no AVR here to time it on,
+ * but the flash reads and the one table lookup are all there is to it - it doesn't divide).
+ *
+ * Build and run with the others:  Tools/hosttest/run_tests.sh
+ */
+
+#include <Arduino.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include "Servo.h"
+
+// The channels and the motion functions are protected, a subclass can get at them
+class ServoTest : public OP_Servos
+{
+public:
+    static volatile PortPin & channel(uint8_t c)    { return Channel[c]; }
+    static uint16_t ease(uint8_t p, uint16_t phase) { return easePhase(p, phase); }
+    static void     update(uint8_t c)               { updateMotion(c); }
+    static void     start(uint8_t c, uint16_t ticks, uint16_t frames, uint8_t p) { beginMove(c, ticks, frames, SERVO_PHASE_END / frames, p); }
+
+    // One servo frame, every compare right on time. Returns the pulse width servo 0 was given, in ticks.
+    static uint16_t frame(void)
+    {
+        uint16_t pulse = 0;
+        for (uint8_t c = 0; c < SERVO_OUT_COUNT; c++)
+        {
+            uint8_t ch = (CurrentChannel >= SERVO_OUT_COUNT) ? 0 : CurrentChannel;
+            TCNT1 = OCR1A;
+            uint16_t due = OCR1A;
+            OCR1A_ISR();
+            if (ch == 0) pulse = OCR1A - due;
+            if (Channel[0].MoveProfile != SERVO_PROFILE_NONE && Channel[0].MovePhase >= SERVO_PHASE_END) PhaseOverruns++;
+        }
+        return pulse;
+    }
+    static uint32_t PhaseOverruns;
+};
+uint32_t ServoTest::PhaseOverruns;
+
+static ServoTest Servos;
+static uint32_t  Failures, Checks;
+
+static const char * const ProfileName[4] = {"none", "linear", "trapezoid", "S-curve"};
+
+// The curves the tables were made from, distance covered (0 - 1) at time t (0 - 1)
+static double curve(uint8_t profile, double t)
+{
+    switch (profile)
+    {
+        case SERVO_PROFILE_TRAPEZOID:
+            // Accelerate for a third, constant speed for a third, decelerate for a third. Top speed is 1.5, acceleration 4.5.
+            if (t < 1.0/3) return 2.25 * t * t;
+            if (t < 2.0/3) return 0.25 + 1.5 * (t - 1.0/3);
+            return 1.0 - 2.25 * (1.0 - t) * (1.0 - t);
+        case SERVO_PROFILE_SCURVE:
+            return t * t * (3.0 - 2.0 * t);
+        default:
+            return t;
+    }
+}
+
+#define EASE_TOLERANCE  32      // Worst the 33 point tables may be off from the curve, in phase units (1/32768). Straight lines between points
+                                // are at most 1/8 x (1/32)^2 x the curve's greatest acceleration out (4.5 and 6 here), plus rounding.
+
+static void fail(const char * fmt, ...) __attribute__((format(printf, 1, 2)));
+static void fail(const char * fmt, ...)
+{
+    if (Failures++ < 20)
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        printf("FAIL  ");
+        vprintf(fmt, ap);
+        printf("\n");
+        va_end(ap);
+    }
+}
+
+static void checkTables(void)
+{
+    for (uint8_t p = SERVO_PROFILE_LINEAR; p <= SERVO_PROFILE_SCURVE; p++)
+    {
+        uint16_t last = 0, worst = 0;
+        for (uint32_t phase = 0; phase < SERVO_PHASE_END; phase++)
+        {
+            uint16_t e = ServoTest::ease(p, phase);
+            double want = curve(p, phase / 32768.0) * 32768.0;
+            uint16_t off = (uint16_t)fabs(e - want);
+            if (off > worst) worst = off;
+            if (e < last)                   fail("%s easePhase(%u) = %u goes backwards", ProfileName[p], phase, e);
+            if (e >= SERVO_PHASE_END)       fail("%s easePhase(%u) = %u reaches the end before the phase does", ProfileName[p], phase, e);
+            last = e;
+            Checks++;
+        }
+        if (worst > EASE_TOLERANCE) fail("%s easePhase is up to %u off the curve", ProfileName[p], worst);
+        printf("%-10s easePhase within %2u of the curve (of 32768) at every phase\n", ProfileName[p], worst);
+    }
+}
+
+// Move servo 0 from where it is to Target over Frames frames and check every pulse. The first frame's pulse is still the old position, the
+// move's first step comes out a frame later.
+static void checkMove(uint8_t profile, uint16_t startTicks, uint16_t targetTicks, uint16_t frames)
+{
+    ServoTest::channel(0).NumTicks = startTicks;
+    Servos.moveTo(0, SERVO_TICKS_TO_uS(targetTicks), frames * (SERVO_FRAME_uS / 1000), profile);
+    if (ServoTest::channel(0).FrameCount != frames) { fail("moveTo of %u mS is %u frames, not %u", frames * 18, ServoTest::channel(0).FrameCount, frames); return; }
+
+    int32_t delta = (int32_t)targetTicks - startTicks;
+    uint16_t pulse = ServoTest::frame();
+    if (pulse != startTicks) fail("%s %u frames: first pulse %u, should still be %u", ProfileName[profile], frames, pulse, startTicks);
+
+    uint16_t last = pulse;
+    for (uint16_t k = 1; k <= frames; k++)
+    {
+        pulse = ServoTest::frame();
+        Checks++;
+        double want = startTicks + delta * curve(profile, (double)k / frames);
+        double slack = (EASE_TOLERANCE + 2) * fabs((double)delta) / 32768.0 + 1;
+        if (k == frames && pulse != targetTicks)
+            fail("%s %u frames, %u to %u: lands on %u", ProfileName[profile], frames, startTicks, targetTicks, pulse);
+        else if (fabs(pulse - want) > slack)
+            fail("%s %u frames, %u to %u: frame %u is %u, should be %.1f", ProfileName[profile], frames, startTicks, targetTicks, k, pulse, want);
+        if ((delta > 0 && pulse < last) || (delta < 0 && pulse > last))
+            fail("%s %u frames, %u to %u: goes backwards at frame %u", ProfileName[profile], frames, startTicks, targetTicks, k);
+        if (k + 1 < frames && !Servos.isMoving(0))             // The landing is worked out a frame before it goes out
+            fail("%s %u frames: stopped after %u", ProfileName[profile], frames, k);
+        last = pulse;
+    }
+    if (Servos.isMoving(0)) fail("%s %u frames: still moving after the last frame", ProfileName[profile], frames);
+    if (ServoTest::frame() != targetTicks) fail("%s %u frames: didn't stay on the target", ProfileName[profile], frames);
+}
+
+const servo_keyframe Nod[] PROGMEM = {  SERVO_KEYFRAME(1700,  400, SERVO_PROFILE_SCURVE),
+                                        SERVO_KEYFRAME(1300,  800, SERVO_PROFILE_SCURVE),
+                                        SERVO_KEYFRAME(1300,  100, SERVO_PROFILE_LINEAR),       // A pause
+                                        SERVO_KEYFRAME(2250, 1000, SERVO_PROFILE_TRAPEZOID),
+                                        SERVO_KEYFRAME( 750,   18, SERVO_PROFILE_LINEAR),       // One frame
+                                        SERVO_KEYFRAME(1500,  333, SERVO_PROFILE_TRAPEZOID) };
+#define NOD_COUNT   (sizeof(Nod) / sizeof(Nod[0]))
+
+static void checkKeyframes(void)
+{
+    ServoTest::channel(0).NumTicks = SERVO_uS_TO_TICKS(1500);
+    Servos.playKeyframes(0, Nod, NOD_COUNT);
+    ServoTest::frame();                                                 // Still at the start
+
+    uint16_t total = 0;
+    unsigned long most = 0;
+    for (uint8_t i = 0; i < NOD_COUNT; i++)
+    {
+        uint16_t frames = Nod[i].Frames, pulse = 0;
+        for (uint16_t k = 1; k <= frames; k++)
+        {
+            unsigned long before = HostFlashReads;
+            pulse = ServoTest::frame();
+            if (HostFlashReads - before > most) most = HostFlashReads - before;
+        }
+        total += frames;
+        Checks++;
+        if (pulse != Nod[i].PulseTicks) fail("keyframe %u lands on %u, not %u", i, pulse, Nod[i].PulseTicks);
+        if ((i + 1 < NOD_COUNT) != Servos.isMoving(0)) fail("keyframe %u: %s", i, Servos.isMoving(0) ? "still moving after the last one" : "stopped early");
+    }
+    printf("keyframes  %u keyframes, %u frames, each landed on its frame. At most %lu flash reads in a frame (changing keyframes)\n", (unsigned)NOD_COUNT, total, most);
+}
+
+static void checkRecoil(boolean reversed)
+{
+    const uint16_t recoil_mS = 100, return_mS = 900;
+    Servos.setupRecoil_mS(0, recoil_mS, return_mS, reversed);
+    uint16_t battery = ServoTest::channel(0).BatteryNumTicks, back = ServoTest::channel(0).RecoiledNumTicks;
+    ServoTest::channel(0).NumTicks = battery;
+    ServoTest::frame();
+
+    Servos.StartRecoil(0);
+    uint16_t hold = SERVO_FRAMES(recoil_mS), ret = SERVO_FRAMES(return_mS), k = 0, pulse, last = back;
+    while ((pulse = ServoTest::frame()) == back && k < 1000) k++;      // Straight back on the next frame, and held there for RecoilFrames
+    Checks++;
+    if (k != hold) fail("recoil%s held for %u frames, not %u", reversed ? " (reversed)" : "", k, hold);
+    for (uint16_t r = 1; r <= ret; r++)
+    {   // Then eased back over the return time
+        if (r > 1) pulse = ServoTest::frame();
+        double want = back + ((int32_t)battery - back) * curve(RECOIL_RETURN_PROFILE, (double)r / ret);
+        if (fabs(pulse - want) > (EASE_TOLERANCE + 2) * fabs((double)battery - back) / 32768.0 + 1)
+            fail("recoil return frame %u is %u, should be %.1f", r, pulse, want);
+        if (reversed ? (pulse > last) : (pulse < last)) fail("recoil return goes backwards at frame %u", r);
+        last = pulse;
+        Checks++;
+    }
+    if (pulse != battery)   fail("recoil%s lands on %u, not %u", reversed ? " (reversed)" : "", pulse, battery);
+    if (Servos.isMoving(0)) fail("recoil%s still going after the return", reversed ? " (reversed)" : "");
+    printf("recoil     %s: %u frames back, %u to return, landed on %u\n", reversed ? "reversed" : "normal  ", hold, ret, pulse);
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void reportCost(void)
+{
+    // Flash reads are counted by the pgm_read macros in stub/avr/pgmspace.h. A keyframe change reads the next keyframe as well.
+    for (uint8_t p = SERVO_PROFILE_LINEAR; p <= SERVO_PROFILE_SCURVE; p++)
+    {
+        uint32_t calls = 0, most = 0;
+        double start = seconds();
+        while (calls < 20000000UL)
+        {
+            ServoTest::start(0, (calls & 0x10000) ? 1600 : 4400, 1000, p);
+            for (uint16_t f = 0; f < 1000; f++, calls++)
+            {
+                unsigned long before = HostFlashReads;
+                ServoTest::update(0);
+                if (HostFlashReads - before > most) most = HostFlashReads - before;
+            }
+        }
+        double ns = (seconds() - start) * 1e9 / calls;
+        printf("%-10s updateMotion() at most %u flash reads a frame, %.1f nS a frame on this PC\n", ProfileName[p], most, ns);
+    }
+}
+
+int main(void)
+{
+    Servos.attach(0);
+    Servos.setMinPulseWidth(0, SERVO_OUT_MINPULSE);
+    Servos.setMaxPulseWidth(0, SERVO_OUT_MAXPULSE);
+    ServoTest::frame();
+
+    checkTables();
+
+    static const uint16_t Ends[][2] = { {1500, 4500}, {4500, 1500}, {3000, 3002}, {3000, 2000}, {1500, 1500} };
+    for (uint8_t p = SERVO_PROFILE_LINEAR; p <= SERVO_PROFILE_SCURVE; p++)
+    {
+        uint32_t before = Checks;
+        for (uint8_t e = 0; e < sizeof(Ends) / sizeof(Ends[0]); e++)
+            for (uint16_t frames = 1; frames <= 1600; frames++) checkMove(p, Ends[e][0], Ends[e][1], frames);
+        printf("%-10s moves of 1 to 1600 frames: %u frames checked\n", ProfileName[p], Checks - before);
+    }
+
+    checkKeyframes();
+    checkRecoil(false);
+    checkRecoil(true);
+    if (ServoTest::PhaseOverruns) fail("the phase reached 32768 during a move %u times", ServoTest::PhaseOverruns);
+
+    reportCost();
+
+    printf("%u checks, %u failures\n", Checks, Failures);
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+// Arduino.h   Host stand-in for the Arduino core, just enough of it to compile and run parts of the sketch on a PC (see Tools/hosttest)
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "avr/pgmspace.h"
+#include "avr/interrupt.h"
+#include "avr/io.h"
+#include "binary.h"
+typedef bool boolean;
+typedef uint8_t byte;
+typedef unsigned int word;
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define DEC 10
+#define HEX 16
+#define BIN 2
+#define NOT_A_PORT 0
+#define bit(b) (1UL << (b))
+#define bitRead(v,b) (((v) >> (b)) & 1)
+#define constrain(a,l,h) ((a)<(l)?(l):((a)>(h)?(h):(a)))
+#ifndef min
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#endif
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define digitalPinToPort(p) ((uint8_t)((p) < 8 ? 4 : ((p) < 14 ? 2 : 3)))
+#define digitalPinToBitMask(p) ((uint8_t)(1 << ((p) < 8 ? (p) : ((p) < 14 ? (p)-8 : (p)-14))))
+#define portOutputRegister(P) (&PORTB)
+#define portInputRegister(P) (&PINB)
+#define portModeRegister(P) (&DDRB)
+#define digitalPinToPCICR(p) (&PCICR)
+#define digitalPinToPCICRbit(p) (((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p) (((p) <= 7) ? (&PCMSK2) : (((p) <= 13) ? (&PCMSK0) : (&PCMSK1)))
+#define digitalPinToPCMSKbit(p) (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+class Print {
+public:
+    size_t write(uint8_t);
+    size_t write(const uint8_t *, size_t);
+    size_t print(const __FlashStringHelper *);
+    size_t print(const char *);
+    size_t print(char);
+    size_t print(unsigned char, int = DEC);
+    size_t print(int, int = DEC);
+    size_t print(unsigned int, int = DEC);
+    size_t print(long, int = DEC);
+    size_t print(unsigned long, int = DEC);
+    size_t print(double, int = 2);
+    size_t println(const __FlashStringHelper *);
+    size_t println(const char *);
+    size_t println(char);
+    size_t println(unsigned char, int = DEC);
+    size_t println(int, int = DEC);
+    size_t println(unsigned int, int = DEC);
+    size_t println(long, int = DEC);
+    size_t println(unsigned long, int = DEC);
+    size_t println(double, int = 2);
+    size_t println(void);
+};
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long);
+    int available(void);
+    int availableForWrite(void);
+    int read(void);
+    int peek(void);
+    void flush(void);
+    operator bool() { return true; }
+};
+extern HardwareSerial Serial;
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+void analogWrite(uint8_t, int);
+int analogRead(uint8_t);
+long random(long);
+long random(long, long);
+void randomSeed(unsigned long);
+long map(long, long, long, long, long);
+void attachInterrupt(uint8_t, void (*)(void), int);
+void detachInterrupt(uint8_t);
+void setup(void);
+void loop(void);
+
+// Host only: what millis() and micros() return. Nothing moves them on by itself, a test sets them. Defined in host.cpp
+extern unsigned long HostMillis, HostMicros;
+// Host only: what digitalRead() returns for each pin. Defined in host.cpp
+extern uint8_t HostPin[32];
@@ -0,0 +1,9 @@
+// avr/interrupt.h   Host stand-in. Interrupts never happen on the PC, so cli() and sei() do nothing and an ISR is an ordinary function a test can call
+#pragma once
+#include "io.h"
+#define ISR(v, ...) extern "C" void v(void); void v(void)
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define cli() (void)0
+#define sei() (void)0
+#define reti() (void)0
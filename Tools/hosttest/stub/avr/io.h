@@ -0,0 +1,26 @@
+// avr/io.h   Host stand-in. The registers are plain variables, defined in host.cpp
+#pragma once
+#include <stdint.h>
+#define _BV(b) (1 << (b))
+#define R8(n) extern volatile uint8_t n;
+#define R16(n) extern volatile uint16_t n;
+R8(SREG) R16(SP) R8(SPL) R8(SPH) R8(MCUSR) R8(MCUCR)
+R8(PORTB) R8(PORTC) R8(PORTD) R8(DDRB) R8(DDRC) R8(DDRD) R8(PINB) R8(PINC) R8(PIND)
+R8(TCCR0A) R8(TCCR0B) R8(TCNT0) R8(OCR0A) R8(OCR0B) R8(TIMSK0) R8(TIFR0)
+R8(TCCR1A) R8(TCCR1B) R8(TCCR1C) R16(TCNT1) R16(OCR1A) R16(OCR1B) R16(ICR1) R8(TIMSK1) R8(TIFR1)
+R8(TCCR2A) R8(TCCR2B) R8(TCNT2) R8(OCR2A) R8(OCR2B) R8(TIMSK2) R8(TIFR2)
+R8(EICRA) R8(EIMSK) R8(EIFR) R8(PCICR) R8(PCIFR) R8(PCMSK0) R8(PCMSK1) R8(PCMSK2)
+R8(GPIOR0) R8(WDTCSR)
+#define RAMEND 0x8FF
+#define RAMSTART 0x100
+#define E2END 0x3FF
+enum { CS00=0,CS01,CS02 }; enum { CS10=0,CS11,CS12 }; enum { CS20=0,CS21,CS22 };
+enum { WGM00=0,WGM01 }; enum { WGM02=3 }; enum { WGM10=0,WGM11 }; enum { WGM12=3,WGM13 };
+enum { WGM20=0,WGM21 }; enum { WGM22=3 };
+enum { COM0B0=4,COM0B1,COM0A0,COM0A1 }; enum { COM1B0=4,COM1B1,COM1A0,COM1A1 }; enum { COM2B0=4,COM2B1,COM2A0,COM2A1 };
+enum { TOIE0=0,OCIE0A,OCIE0B }; enum { TOIE1=0,OCIE1A,OCIE1B }; enum { TOIE2=0,OCIE2A,OCIE2B };
+enum { TOV0=0,OCF0A,OCF0B }; enum { TOV1=0,OCF1A,OCF1B }; enum { TOV2=0,OCF2A,OCF2B };
+enum { ISC00=0,ISC01,ISC10,ISC11 }; enum { INT0=0,INT1 }; enum { INTF0=0,INTF1 };
+enum { PCIE0=0,PCIE1,PCIE2 }; enum { PCIF0=0,PCIF1,PCIF2 };
+enum { PORF=0,EXTRF,BORF,WDRF };
+enum { PCINT8=0,PCINT9 }; enum { PCINT20=4 };
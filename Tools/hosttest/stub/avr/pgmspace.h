@@ -0,0 +1,19 @@
+// avr/pgmspace.h   Host stand-in. There is only one memory on the PC, program memory reads are ordinary reads
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+// Every read is counted, so a test can see how many a routine makes (each is 3 cycles on the AVR). Defined in host.cpp
+// Functions rather than macros, so two reads in one expression each count once and don't upset each other
+extern unsigned long HostFlashReads;
+static inline uint8_t  pgm_read_byte(const void *a)  { HostFlashReads++; return *(const uint8_t *)a; }
+static inline uint16_t pgm_read_word(const void *a)  { HostFlashReads++; uint16_t v; memcpy(&v, a, sizeof(v)); return v; }
+static inline uint32_t pgm_read_dword(const void *a) { HostFlashReads++; uint32_t v; memcpy(&v, a, sizeof(v)); return v; }
+static inline void *   pgm_read_ptr(const void *a)   { HostFlashReads++; void *v; memcpy(&v, a, sizeof(v)); return v; }
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define pgm_read_byte_near pgm_read_byte
+#define pgm_read_word_near pgm_read_word
+#define pgm_read_dword_near pgm_read_dword
@@ -0,0 +1,434 @@
+/* irwave.h     Open Panzer IR waveforms - the marks and spaces every IRsendXxx::send() puts out, and the things real IR does to them
+ * Source:      openpanzer.org
+ * Authors:     Luke Middleton
+ *
+ * To test the decoders we need IR signals, lots of them, and not just clean ones. This builds, on the PC, exactly the marks and spaces the
+ * sketch's send routines put out, from the same timing constants (TankIR/IRLibMatch.h is included as it is), and then lets you spoil them
+ * the way the real world does:
+ *
+ *      jitter      every edge moved a random amount either way
+ *      clock       the sender's clock running fast or slow, which stretches or shrinks everything
+ *      dropouts    the carrier lost part way through a mark (the turret swings, a tree gets in the way), which splits the mark in two,
+ *                  or loses it altogether
+ *      echoes      a reflection off a wall or the floor. Light goes 300 metres in a microsecond, so the extra path itself is nothing, but
+ *                  a weaker signal takes the receiver's demodulator longer to pick up and let go of. So an echo is a copy of the signal,
+ *                  delayed by however much you say, on top of the original - marks get longer, spaces shorter.
+ *      mark excess the receiver reporting marks long and spaces short (MARK_EXCESS_DEFAULT is what the decoder expects)
+ *      shooters    two signals arriving on top of each other, with any offset between them (IRMix)
+ *
+ * Then IRReceive() records a signal the way IRrecvPCI does - starting at the first mark, stopping at a space longer than GAP or when rawbuf
+ * is full, with micros() only good to 4 uS - so what comes out is just what the decoder would have been handed.
+ *
+ * A signal is kept as the times (in uS from the start) at which the carrier goes on and off: even numbered edges turn it on, odd ones turn
+ * it off, so there is always an even number of them. Everything is in fixed arrays and nothing is allocated, so it is fast enough to make
+ * millions of signals a second for benchmarks and fuzzing (see irwave_bench.cpp).
+ *
+ * The send routines are written out again here rather than shared with the sketch, because they fill in Timer 1 ticks for an interrupt
+ * to send. If you change one of them in TankIR/IRLib.cpp, change it here too - Tools/hosttest/ir_test.cpp runs the sketch's send interrupt
+ * and fails if the two put out anything different. irwave_bench --print shows what we make, to compare against a scope.
+ *
+ * This is a host library, it is NOT part of the sketch. It lives outside the TankIR folder so the Arduino IDE doesn't try to compile it.
+ * Header only, C++11, no dependencies.
+ */
+
+#ifndef OP_irwave_h
+#define OP_irwave_h
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef PROGMEM
+#define PROGMEM                 // On the PC the signal tables are ordinary constants
+#endif
+#include "../../TankIR/IRLibMatch.h"
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// PROTOCOLS - the same numbers as TankIR/IRLib.h
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+#ifndef LAST_IRPROTOCOL
+typedef unsigned char IRTYPES;
+#define IR_UNKNOWN          0
+#define IR_DISABLED         0
+#define IR_TAMIYA           1
+#define IR_TAMIYA_2SHOT     2
+#define IR_TAMIYA_35        3
+#define IR_HENGLONG         4
+#define IR_TAIGEN_V1        5
+#define IR_FOV              6
+#define IR_VSTANK           7
+#define IR_OPENPANZER       8       // Not written yet, sends nothing
+#define IR_RPR_CLARK        9
+#define IR_RPR_IBU          10
+#define IR_RPR_RCTA         11
+#define IR_MG_CLARK         12
+#define IR_MG_RCTA          13
+#define IR_SONY             14
+#define IR_TAIGEN           15
+#define LAST_IRPROTOCOL     IR_TAIGEN
+#endif
+
+#define IRWAVE_RAWBUF       51      // RAWBUF in TankIR/IRLib.h
+#define IRWAVE_MAX_STREAM   130     // Longest single transmission: Tamiya 1/35, a header and 64 bits
+#define IRWAVE_MAX_EDGES    2048    // Longest signal we keep. A whole Tamiya 1/35 send is 520 edges, a dropout in every mark would double that.
+#define IRWAVE_MICROS_STEP  4       // micros() on a 16 MHz Arduino counts in 4s
+
+static inline const char *IRName(IRTYPES type)
+{
+    static const char * const Names[LAST_IRPROTOCOL + 1] = {"Unknown", "Tamiya", "Tamiya 2-shot", "Tamiya 1/35", "HengLong", "Taigen V1", "FOV",
+                                                            "VsTank", "OpenPanzer", "Clark repair", "IBU repair", "RCTA repair", "Clark MG",
+                                                            "RCTA MG", "Sony", "Taigen"};
+    return (type <= LAST_IRPROTOCOL) ? Names[type] : Names[0];
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// SIGNALS
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+struct IRWave {
+    int32_t  edge[IRWAVE_MAX_EDGES];    // uS from the start. Even ones turn the carrier on, odd ones turn it off.
+    uint16_t edges;
+    int32_t  length;                    // uS, including the gap after the last mark
+    uint8_t  kHz;                       // Carrier. Just for information, the receiver only gives us the envelope.
+    bool     truncated;                 // Ran out of room, the end of the signal is missing
+
+    void clear(void) { edges = 0; length = 0; kHz = 0; truncated = false; }
+
+    void add(int32_t t)
+    {
+        if (edges < IRWAVE_MAX_EDGES) edge[edges++] = t;
+        else truncated = true;
+    }
+
+    // Closes a mark we've just turned on if there's no room for its end, so we never keep an odd number of edges
+    void even(void) { if (edges & 1) { edges -= 1; truncated = true; } }
+
+    // Takes out any mark or space that has come to nothing (or less), joining what was either side of it. The edges have to come out in
+    // order after jitter, echoes or mark excess have moved them about.
+    void tidy(void)
+    {
+        uint16_t n = 0;
+        for (uint16_t i = 0; i < edges; i++)
+        {
+            if (n && edge[i] <= edge[n-1]) n -= 1;      // This edge and the one before cancel out
+            else edge[n++] = edge[i];
+        }
+        edges = n;
+        if (edges && edge[0] < 0)
+        {   // Something moved the first mark to before the start, so the whole thing starts later
+            int32_t shift = -edge[0];
+            for (uint16_t i = 0; i < edges; i++) edge[i] += shift;
+            length += shift;
+        }
+        if (edges && length < edge[edges-1]) length = edge[edges-1];
+    }
+
+    int32_t mark(uint16_t i) const  { return edge[2*i+1] - edge[2*i]; }     // Length of the i'th mark
+    uint16_t marks(void) const      { return edges / 2; }
+};
+
+// Fast random numbers for the spoilers (xorshift64*). Seed it with anything but zero.
+struct IRWaveRandom {
+    uint64_t s;
+
+    IRWaveRandom(uint64_t seed = 0x9E3779B97F4A7C15ULL) : s(seed ? seed : 1) {}
+
+    uint32_t next(void)
+    {
+        s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+        return (uint32_t)((s * 0x2545F4914F6CDD1DULL) >> 32);
+    }
+    uint32_t below(uint32_t n)                      { return (uint32_t)(((uint64_t)next() * n) >> 32); }   // 0 to n-1
+    int32_t  between(int32_t lo, int32_t hi)        { return (hi <= lo) ? lo : lo + (int32_t)below((uint32_t)(hi - lo + 1)); }
+    bool     chance(uint16_t permille)              { return below(1000) < permille; }
+};
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// WHAT THE SEND ROUTINES PUT OUT
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// The data each protocol sends if you don't give it any, the same as IRsend::send(Type)
+static inline uint32_t IRDefaultData(IRTYPES type)
+{
+    switch (type)
+    {
+        case IR_FOV:        return FOV_TEAM_1_VALUE;
+        case IR_VSTANK:     return VsTank_HIT_VALUE;
+        case IR_RPR_CLARK:  return Clark_REPAIR_CODE;
+        case IR_MG_CLARK:   return Clark_MG_CODE;
+        default:            return 0;
+    }
+}
+
+// Puts one transmission into us[] as alternating mark and space lengths in uS, starting with a mark and ending with the gap before the next
+// one - that is, IR_SendParams.sendStream for every step, strung together. Returns how many there are, and tells you the carrier and how
+// many times send() repeats it. data is only used by FOV, VsTank and Sony, the same as IRsend::send(Type, data).
+static inline uint8_t IRStream(IRTYPES type, uint32_t data, uint16_t *us, uint8_t *kHz, uint8_t *times)
+{
+    const uint16_t *sig = 0;
+    uint8_t n = 0, j = 0;
+    *kHz = 38; *times = 1;
+
+    switch (type)
+    {
+        case IR_TAMIYA:         sig = Tamiya16Sig;          n = Tamiya_BITS+1;      *times = Tamiya_TIMESTOSEND;        break;
+        case IR_TAMIYA_2SHOT:   sig = Tamiya16TwoShotSig;   n = Tamiya_BITS+1;      *times = Tamiya_TIMESTOSEND;        break;
+        case IR_HENGLONG:       sig = HengLongSig;          n = HengLong_BITS+1;    *times = HengLong_TIMESTOSEND;      break;
+        case IR_TAIGEN_V1:      sig = TaigenSigV1;          n = TaigenV1_BITS+1;    *times = Taigen_TIMESTOSEND;    *kHz = 39;  break;
+        case IR_TAIGEN:         sig = TaigenSig;            n = Taigen_BITS+1;      *times = Taigen_TIMESTOSEND;    *kHz = 39;  break;
+        case IR_RPR_IBU:        sig = IBU2RepairSig;        n = IBU2_BITS;          *times = IBU2_TIMESTOSEND;          break;
+        case IR_RPR_RCTA:       sig = RCTARepairSig;        n = RCTA_BITS;          *times = RCTA_REPAIR_TIMESTOSEND;   break;
+        case IR_MG_RCTA:        sig = RCTAMGSig;            n = RCTA_BITS;          *times = RCTA_MG_TIMESTOSEND;       break;
+
+        case IR_TAMIYA_35:
+            // A short mark and the long header space, then the 8 bytes MSB first: a 1 is a long mark and short space, a 0 the other way round.
+            // There is no gap, the header space is what marks the start of the next one.
+            *kHz = 37; *times = TAMIYA_135_TIMESTOSEND;
+            us[j++] = TAMIYA_135_SHORT_BIT;
+            us[j++] = TAMIYA_135_HDR_SPACE;
+            for (uint8_t step = 0; step < TAMIYA_135_STEPS; step++)
+            {
+                uint8_t value = Tamiya135Cannon[step];
+                for (uint8_t i = 0; i < 8; i++, value <<= 1)
+                {
+                    us[j++] = (value & 0x80) ? TAMIYA_135_LONG_BIT : TAMIYA_135_SHORT_BIT;
+                    us[j++] = (value & 0x80) ? TAMIYA_135_SHORT_BIT : TAMIYA_135_LONG_BIT;
+                }
+            }
+            return j;
+
+        case IR_FOV:
+            // Header mark and space, then 8 bits MSB first in the length of the marks, the last space made into the gap
+            *times = FOV_TIMESTOSEND;
+            us[j++] = FOV_HDR_MARK;
+            us[j++] = FOV_SPACE;
+            data <<= (32 - FOV_DATA_BITS);
+            for (uint8_t i = 0; i < FOV_DATA_BITS; i++, data <<= 1)
+            {
+                us[j++] = (data & 0x80000000UL) ? FOV_ONE_MARK : FOV_ZERO_MARK;
+                us[j++] = FOV_SPACE;
+            }
+            us[j-1] = FOV_GAP;
+            return j;
+
+        case IR_VSTANK:
+            // Header mark, then 8 bits MSB first in the length of the spaces, each followed by a mark of the opposite length, then the gap
+            *kHz = 34; *times = VsTank_TIMESTOSEND;
+            us[j++] = VsTank_HDR_MARK;
+            data <<= (32 - VsTank_DATA_BITS);
+            for (uint8_t i = 0; i < VsTank_DATA_BITS; i++, data <<= 1)
+            {
+                us[j++] = (data & 0x80000000UL) ? VsTank_LONG_BIT : VsTank_SHORT_BIT;
+                us[j++] = (data & 0x80000000UL) ? VsTank_SHORT_BIT : VsTank_LONG_BIT;
+            }
+            us[j++] = VsTank_GAP;
+            return j;
+
+        case IR_RPR_CLARK:
+        case IR_MG_CLARK:
+        case IR_SONY:
+            // 12 bit Sony: header mark and space, then 12 bits MSB first in the length of the marks, the last space made into the gap.
+            // Clark's codes are fixed, and its machine gun is sent once - the tank repeats it for as long as the gun is firing.
+            if (type == IR_RPR_CLARK)       { data = Clark_REPAIR_CODE;  *times = Clark_REPAIR_TIMESTOSEND; }
+            else if (type == IR_MG_CLARK)   { data = Clark_MG_CODE;      *times = 1; }
+            else                            { *times = Sony_TIMESTOSEND; }
+            *kHz = Sony_KHZ;
+            us[j++] = Sony_HDR_MARK;
+            us[j++] = Sony_SPACE;
+            data <<= (32 - Sony_12_BIT);
+            for (uint8_t i = 0; i < Sony_12_BIT; i++, data <<= 1)
+            {
+                us[j++] = (data & 0x80000000UL) ? Sony_ONE_MARK : Sony_ZERO_MARK;
+                us[j++] = Sony_SPACE;
+            }
+            us[j-1] = Sony_GAP;
+            return j;
+
+        default:                // Unknown, and OpenPanzer which isn't written yet: send() puts out nothing
+            *times = 0;
+            return 0;
+    }
+
+    for (uint8_t i = 0; i < n; i++) us[i] = sig[i];
+    return n;
+}
+
+// Everything one call to send() puts out: the transmission, repeated. times = 0 repeats it as many times as send() does, anything else
+// overrides that (times = 1 for a single transmission, say).
+static inline void IRSend(IRWave &w, IRTYPES type, uint32_t data, uint8_t times = 0)
+{
+    uint16_t us[IRWAVE_MAX_STREAM];
+    uint8_t kHz, sendTimes;
+    uint8_t n = IRStream(type, data, us, &kHz, &sendTimes);
+    if (times == 0) times = sendTimes;
+
+    w.clear();
+    w.kHz = kHz;
+    if (n == 0) return;
+
+    // n is always even, so each transmission starts with the carrier going on
+    int32_t t = 0;
+    for (uint8_t r = 0; r < times; r++)
+    {
+        for (uint8_t i = 0; i < n; i++)
+        {
+            w.add(t);
+            t += us[i];
+        }
+    }
+    w.even();
+    w.length = t;
+}
+
+static inline void IRSend(IRWave &w, IRTYPES type) { IRSend(w, type, IRDefaultData(type)); }
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// SPOILING THEM
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// Everything is off (zero) to begin with, so a plain IRImpair changes nothing
+struct IRImpair {
+    uint16_t jitter_uS;             // Each edge moved by up to this much, either way
+    int32_t  clock_ppm;             // The sender's clock, parts per million fast (+) or slow (-). A ceramic resonator is good to a few thousand.
+    uint16_t dropout_permille;      // Chance, for each mark, that the carrier drops out somewhere in it
+    uint16_t dropoutMin_uS;         // and for how long
+    uint16_t dropoutMax_uS;
+    uint16_t echo_permille;         // Chance, for the whole signal, of an echo on top of it
+    uint16_t echoMin_uS;            // and how far behind it is
+    uint16_t echoMax_uS;
+    int16_t  markExcess_uS;         // The receiver makes every mark this much longer, and every space this much shorter
+
+    IRImpair(void) : jitter_uS(0), clock_ppm(0), dropout_permille(0), dropoutMin_uS(0), dropoutMax_uS(0),
+                     echo_permille(0), echoMin_uS(0), echoMax_uS(0), markExcess_uS(0) {}
+};
+
+// Puts b on top of a, offset uS later (or earlier if it's negative). The carrier is on wherever either of them has it on, which is what a
+// receiver makes of two transmitters at once. out can't be a or b.
+static inline void IRMix(IRWave &out, const IRWave &a, const IRWave &b, int32_t offset)
+{
+    out.clear();
+    out.kHz = a.kHz;
+    out.truncated = a.truncated || b.truncated;
+
+    // Walk both lists of edges in time order. Each edge turns its own signal on or off, and we only make an edge when both together change.
+    uint16_t i = 0, k = 0;
+    while (i < a.edges || k < b.edges)
+    {
+        int32_t ta = (i < a.edges) ? a.edge[i] : INT32_MAX;
+        int32_t tb = (k < b.edges) ? b.edge[k] + offset : INT32_MAX;
+        bool was = (i & 1) || (k & 1);
+        int32_t t = 0;
+        if (ta <= tb) { t = ta; i++; }
+        if (tb <= ta) { t = tb; k++; }
+        bool now = (i & 1) || (k & 1);
+        if (now != was) out.add(t);
+    }
+    out.even();
+
+    int32_t endB = b.length + offset;
+    out.length = (a.length > endB) ? a.length : endB;
+    out.tidy();                         // A negative offset could start before zero
+}
+
+// Spoils a signal in place: the sender's clock first, then dropouts and echoes on the way, then jitter, then what the receiver does
+static inline void IRImpairWave(IRWave &w, const IRImpair &p, IRWaveRandom &rnd)
+{
+    if (p.clock_ppm)
+    {
+        for (uint16_t i = 0; i < w.edges; i++) w.edge[i] += (int32_t)(((int64_t)w.edge[i] * p.clock_ppm) / 1000000);
+        w.length += (int32_t)(((int64_t)w.length * p.clock_ppm) / 1000000);
+    }
+
+    if (p.dropout_permille)
+    {   // Choose the marks first, so we know how much room we need, then open them up in place, going backwards from the end
+        uint8_t hit[IRWAVE_MAX_EDGES / 2];
+        uint16_t extra = 0;
+        for (uint16_t m = 0; m < w.marks(); m++) { hit[m] = rnd.chance(p.dropout_permille); extra += 2 * hit[m]; }
+        if (w.edges + extra > IRWAVE_MAX_EDGES) { extra = 0; w.truncated = true; }    // Rare enough to just leave them all out
+
+        if (extra)
+        {
+            uint16_t to = w.edges + extra;
+            for (uint16_t m = w.marks(); m--; )
+            {
+                int32_t on  = w.edge[2*m];
+                int32_t off = w.edge[2*m+1];
+                w.edge[--to] = off;
+                if (hit[m])
+                {   // Lost from somewhere in the mark, for a while. If that's the rest of it, stop and off are the same and tidy() joins them.
+                    int32_t start = on + (int32_t)rnd.below((uint32_t)(off - on));
+                    int32_t stop  = start + rnd.between(p.dropoutMin_uS, p.dropoutMax_uS);
+                    if (stop > off) stop = off;
+                    w.edge[--to] = stop;
+                    w.edge[--to] = start;
+                }
+                w.edge[--to] = on;
+            }
+            w.edges += extra;
+            w.tidy();
+        }
+    }
+
+    if (p.echo_permille && rnd.chance(p.echo_permille))
+    {
+        static thread_local IRWave mixed;
+        IRMix(mixed, w, w, rnd.between(p.echoMin_uS, p.echoMax_uS));
+        memcpy(w.edge, mixed.edge, mixed.edges * sizeof(int32_t));
+        w.edges = mixed.edges;
+        w.length = mixed.length;
+        w.truncated = mixed.truncated;
+    }
+
+    if (p.jitter_uS)
+    {
+        for (uint16_t i = 0; i < w.edges; i++) w.edge[i] += rnd.between(-(int32_t)p.jitter_uS, p.jitter_uS);
+        w.tidy();
+    }
+
+    if (p.markExcess_uS)
+    {
+        for (uint16_t i = 1; i < w.edges; i += 2) w.edge[i] += p.markExcess_uS;
+        w.tidy();
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// RECEIVING THEM
+// ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+// Records a signal the way IRrecvPCI does after resume() is called at time start (uS, on the signal's clock). rawbuf[0] is the time from
+// resume() to the first mark, then the marks and spaces follow; recording stops at a space longer than GAP, at the end of the signal, or
+// when the buffer is full. This is IR_ReceiveParams.rawbuf, before GetResults() takes Mark_Excess off the marks and adds it to the spaces.
+// Returns rawlen (zero if there was no mark after start), and sets *next to just after the edge that stopped the recording, the soonest
+// resume() could be called again. That edge is lost, the same as on the board.
+// micros_step is how finely micros() counts, 4 on the Arduino, or 1 to record the signal exactly.
+static inline uint8_t IRReceive(const IRWave &w, uint16_t *rawbuf, int32_t start = 0, int32_t *next = 0,
+                                uint8_t max = IRWAVE_RAWBUF, uint8_t micros_step = IRWAVE_MICROS_STEP)
+{
+    // micros() at an edge, rounded down to a multiple of micros_step as if it had been counting from well before the signal
+    #define IRWAVE_MICROS(t)    ((t) - (int32_t)((uint32_t)((t) + 0x40000000) % micros_step))
+
+    uint16_t i = 0;
+    while (i < w.edges && w.edge[i] < start) i++;       // Edges before resume() are missed...
+    if (i & 1) i++;                                     // ...and an edge that ends a mark, while we're idle, is ignored
+    if (i >= w.edges) { if (next) *next = w.length; return 0; }
+
+    uint8_t rawlen = 0;
+    int32_t timer = IRWAVE_MICROS(start);
+    for (; i < w.edges; i++)
+    {
+        int32_t stamp = IRWAVE_MICROS(w.edge[i]);
+        uint32_t delta = (uint32_t)(stamp - timer);
+        if (rawlen && !(i & 1) && delta > GAP) { if (next) *next = w.edge[i] + 1; return rawlen; }
+        rawbuf[rawlen++] = (uint16_t)delta;             // rawbuf[0] usually overflows, just the same as on the board
+        timer = stamp;
+        if (rawlen >= max) { if (next) *next = w.edge[i] + 1; return rawlen; }
+    }
+    // The last space lasts until the next signal. GetResults() calls it a gap once GAP has gone by.
+    if (next) *next = w.edge[w.edges-1] + GAP;
+    return rawlen;
+
+    #undef IRWAVE_MICROS
+}
+
+#endif // OP_irwave_h
@@ -0,0 +1,199 @@
+/* irwave_bench.cpp    Open Panzer IR waveforms - how fast irwave.h makes signals, and what they look like
+ * Source:             openpanzer.org
+ * Authors:            Luke Middleton
+ *
+ * With no arguments, times every protocol three ways, in frames (single transmissions, or --times of them) a second on one core:
+ *      clean       IRSend() alone
+ *      spoiled     IRSend(), then jitter, dropouts, an echo now and then and mark excess, then IRReceive() into a rawbuf
+ *      shooters    two IRSend()s on top of each other at a random offset, then IRReceive()
+ *
+ * --print shows the marks and spaces of one protocol, spoiled if you give any spoilers, and what IRrecvPCI would record from them.
+ * Whether they are what the sketch sends, and whether its decoders read them back, is checked by Tools/hosttest/ir_test.cpp.
+ *
+ * Build:
+ *      c++ -O2 -std=c++11 -o build/irwave_bench Tools/irwave/irwave_bench.cpp
+ *
+ * This is a host tool, it is NOT part of the sketch.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "irwave.h"
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Short names for the command line, in IRTYPES order
+static const char * const Short[LAST_IRPROTOCOL + 1] = {"", "tamiya", "2shot", "tamiya35", "henglong", "taigen1", "fov", "vstank", "",
+                                                        "clark", "ibu", "rcta", "clarkmg", "rctamg", "sony", "taigen"};
+
+static IRTYPES protocolByName(const char *name)
+{
+    for (IRTYPES p = 1; p <= LAST_IRPROTOCOL; p++) if (Short[p][0] && strcmp(name, Short[p]) == 0) return p;
+    return IR_UNKNOWN;
+}
+
+static volatile uint32_t Sink;                      // Somewhere for the results to go, so the compiler can't skip making them
+
+// Runs fn over and over for about secs, returns how many times a second
+template <typename F> static double rate(double secs, F fn)
+{
+    uint32_t n = 0;
+    double start = seconds(), now;
+    do {
+        for (int i = 0; i < 1000; i++) Sink += fn();
+        n += 1000;
+        now = seconds();
+    } while (now - start < secs);
+    return n / (now - start);
+}
+
+static void printWave(const IRWave &w)
+{
+    for (uint16_t i = 0; i < w.edges; i++)
+    {
+        int32_t next = (i + 1 < w.edges) ? w.edge[i+1] : w.length;
+        printf("%c%d%s", (i & 1) ? '-' : '+', next - w.edge[i], ((i & 15) == 15) ? "\n" : " ");
+    }
+    printf("\n");
+}
+
+static void usage(const char *self)
+{
+    fprintf(stderr,
+        "usage: %s [options]                times every protocol\n"
+        "       %s --print PROTOCOL [options]\n"
+        "protocols: tamiya 2shot tamiya35 henglong taigen1 taigen fov vstank clark clarkmg ibu rcta rctamg sony\n"
+        "  -p, --print NAME        show one protocol's marks (+) and spaces (-) in uS, and what IRrecvPCI records\n"
+        "  -D, --data N            data for fov, vstank and sony (default: what send() sends)\n"
+        "  -t, --times N           transmissions in a frame (default 1 to time, what send() does to print)\n"
+        "  -j, --jitter US         move each edge up to this much either way\n"
+        "  -c, --clock PPM         sender's clock fast (+) or slow (-)\n"
+        "  -d, --dropout PERMILLE  chance of the carrier dropping out in each mark, for 50 to 500 uS\n"
+        "  -e, --echo PERMILLE     chance of an echo 20 to 200 uS behind\n"
+        "  -x, --excess US         receiver's mark excess\n"
+        "  -s, --seconds S         how long to time each one (default 0.2)\n"
+        "  -r, --seed N            random seed\n",
+        self, self);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *print = NULL;
+    bool spoilersGiven = false, dataGiven = false;
+    uint32_t data = 0;
+    int times = -1;
+    double secs = 0.2;
+    uint64_t seed = 1;
+    IRImpair imp;
+
+    static const struct option longOpts[] = {
+        { "print",   required_argument, NULL, 'p' },
+        { "data",    required_argument, NULL, 'D' },
+        { "times",   required_argument, NULL, 't' },
+        { "jitter",  required_argument, NULL, 'j' },
+        { "clock",   required_argument, NULL, 'c' },
+        { "dropout", required_argument, NULL, 'd' },
+        { "echo",    required_argument, NULL, 'e' },
+        { "excess",  required_argument, NULL, 'x' },
+        { "seconds", required_argument, NULL, 's' },
+        { "seed",    required_argument, NULL, 'r' },
+        { "help",    no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:D:t:j:c:d:e:x:s:r:h", longOpts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'p': print = optarg;                                           break;
+            case 'D': data = strtoul(optarg, NULL, 0); dataGiven = true;        break;
+            case 't': times = atoi(optarg);                                     break;
+            case 'j': imp.jitter_uS = atoi(optarg);         spoilersGiven = true;   break;
+            case 'c': imp.clock_ppm = atoi(optarg);         spoilersGiven = true;   break;
+            case 'd': imp.dropout_permille = atoi(optarg);  spoilersGiven = true;   break;
+            case 'e': imp.echo_permille = atoi(optarg);     spoilersGiven = true;   break;
+            case 'x': imp.markExcess_uS = atoi(optarg);     spoilersGiven = true;   break;
+            case 's': secs = atof(optarg);                                      break;
+            case 'r': seed = strtoull(optarg, NULL, 0);                         break;
+            default:  usage(argv[0]);                                           return 2;
+        }
+    }
+    if (optind < argc || times > 255) { usage(argv[0]); return 2; }
+    imp.dropoutMin_uS = 50;  imp.dropoutMax_uS = 500;
+    imp.echoMin_uS = 20;     imp.echoMax_uS = 200;
+
+    IRWaveRandom rnd(seed);
+    static IRWave w, w2, mixed;
+    uint16_t rawbuf[256];
+
+    if (print)
+    {
+        IRTYPES p = protocolByName(print);
+        if (p == IR_UNKNOWN) { fprintf(stderr, "irwave_bench: unknown protocol '%s'\n", print); return 2; }
+        IRSend(w, p, dataGiven ? data : IRDefaultData(p), (times < 0) ? 0 : times);
+        printf("%s, %u kHz, %u marks, %.1f mS\n", IRName(p), w.kHz, w.marks(), w.length / 1000.0);
+        printWave(w);
+        if (spoilersGiven)
+        {
+            IRImpairWave(w, imp, rnd);
+            printf("Spoiled: %u marks, %.1f mS\n", w.marks(), w.length / 1000.0);
+            printWave(w);
+        }
+
+        // Resume again after each recording, the way the sketch does, until we run out of signal
+        int32_t at = 0;
+        for (int n = 1; ; n++)
+        {
+            uint8_t rawlen = IRReceive(w, rawbuf, at, &at);
+            if (rawlen == 0) break;
+            printf("IRrecvPCI %d, rawlen %u:", n, rawlen);
+            for (uint8_t i = 0; i < rawlen; i++) printf(" %u", rawbuf[i]);
+            printf("\n");
+        }
+        return 0;
+    }
+
+    // Timing
+    uint8_t frameTimes = (times < 0) ? 1 : times;
+    if (!spoilersGiven)
+    {   // Something like a bad day at the club
+        imp.jitter_uS = 60;
+        imp.dropout_permille = 20;
+        imp.echo_permille = 100;
+        imp.markExcess_uS = MARK_EXCESS_DEFAULT;
+    }
+    printf("Millions of frames a second (%u transmission%s each), one core\n", frameTimes, (frameTimes == 1) ? "" : "s");
+    printf("%-14s %6s %8s %8s %9s\n", "", "edges", "clean", "spoiled", "shooters");
+    for (IRTYPES p = 1; p <= LAST_IRPROTOCOL; p++)
+    {
+        if (!Short[p][0]) continue;
+        uint32_t d = IRDefaultData(p);
+        IRSend(w, p, d, frameTimes);
+        uint16_t edges = w.edges;
+        int32_t len = w.length;
+
+        double clean = rate(secs, [&]() { IRSend(w, p, d, frameTimes); return (uint32_t)w.edge[w.edges-1]; });
+        double spoiled = rate(secs, [&]() {
+            IRSend(w, p, d, frameTimes);
+            IRImpairWave(w, imp, rnd);
+            return (uint32_t)IRReceive(w, rawbuf) + rawbuf[1];
+        });
+        double shooters = rate(secs, [&]() {
+            IRSend(w, p, d, frameTimes);
+            IRSend(w2, p, d, frameTimes);
+            IRMix(mixed, w, w2, rnd.between(-len, len));
+            return (uint32_t)IRReceive(mixed, rawbuf) + rawbuf[1];
+        });
+        printf("%-14s %6u %8.2f %8.2f %9.2f\n", IRName(p), edges, clean / 1e6, spoiled / 1e6, shooters / 1e6);
+    }
+    return 0;
+}
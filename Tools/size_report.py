@@ -0,0 +1,369 @@
+#!/usr/bin/env python3
+# size_report.py      Open Panzer TankIR flash, RAM and stack budget report
+# Source:             openpanzer.org
+# Authors:            Luke Middleton
+#
+# The ATmega328 has 32 KB of flash and only 2 KB of RAM, and the IR buffers, the timer slots, the servo table and the stack all have to
+# share that RAM. This builds the sketch and tells you where it all went, broken down by module (IRLib, Tank, SimpleTimer, Servo, ...)
+# and by symbol, along with an estimate of the worst-case stack. It can save the result as a baseline and show what changed against it,
+# which is how we check that an optimization actually saved something.
+#
+# Usage:
+#   Tools/size_report.py                        build, print the report and save it to build/size/<commit>.json
+#   Tools/size_report.py --save-baseline        ...and also save it as the baseline (build/size/baseline.json)
+#   Tools/size_report.py --diff                 ...and print what changed against the baseline
+#   Tools/size_report.py --diff --no-build      compare the last build against the baseline without building again
+#   Tools/size_report.py --symbols 40           show the 40 largest symbols instead of 25
+#
+# Needs arduino-cli with the arduino:avr core (see Tools/build_sketch.sh). The avr binutils are taken from your path, or from the
+# toolchain arduino-cli installed.
+#
+# How the numbers are worked out:
+#   - Flash and RAM come from the real build, with link-time optimization, exactly as it would be uploaded. Every symbol in the final
+#     .elf is credited to the module that defined it, which we find by listing the symbols in each module's object file. Functions
+#     that were inlined away take no space of their own, their code is counted in whatever called them.
+#   - Stack is estimated from a second build with link-time optimization turned off and -fstack-usage turned on, which gives the frame
+#     size of every function. We follow direct calls from main() and from each interrupt vector to find the deepest path, adding 2 bytes
+#     for each return address. Calls through a pointer (virtual functions, OP_SimpleTimer callbacks) can't be followed and are listed
+#     as a warning, so treat the result as a lower bound. The servo and IR send ISRs re-enable interrupts part way through, so the
+#     worst case assumes every interrupt could be nested on top of the deepest point of loop().
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+from glob import glob
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+ROOT_DIR = os.path.dirname(TOOLS_DIR)
+OUT_DIR = os.path.join(ROOT_DIR, 'build', 'size')
+BASELINE = os.path.join(OUT_DIR, 'baseline.json')
+
+FLASH_AVAILABLE = 32256     # 32 KB less the 512 byte Optiboot bootloader
+RAM_AVAILABLE = 2048
+
+# Object file name -> module name. Anything from the Arduino core is "core", anything we can't place at all (libgcc and libc helpers
+# pulled in by the linker) is "libc".
+MODULES = {
+    'TankIR.ino.cpp': 'sketch',
+    'IRLib.cpp':      'IRLib',
+    'Tank.cpp':       'Tank',
+    'SimpleTimer.cpp': 'SimpleTimer',
+    'Servo.cpp':      'Servo',
+    'Button.cpp':     'Button',
+    'Motors.cpp':     'Motors',
+    'PulseOut.cpp':   'PulseOut',
+    'LedFX.cpp':      'LedFX',
+    'LedPWM.cpp':     'LedPWM',
+    'StackProbe.cpp': 'StackProbe',
+    'EventBus.cpp':   'EventBus',
+    'EventLog.cpp':   'EventLog',
+    'Config.cpp':     'Config',
+    'Stats.cpp':      'Stats',
+    'Telemetry.cpp':  'Telemetry',
+    'ClockSync.cpp':  'ClockSync',
+    'LoopProfile.cpp': 'LoopProfile',
+    'IsrStats.cpp':   'IsrStats',
+}
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# TOOLCHAIN
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def find_tool(name):
+    path = shutil.which(name)
+    if path:
+        return path
+    found = sorted(glob(os.path.expanduser('~/.arduino15/packages/arduino/tools/avr-gcc/*/bin/' + name)))
+    if found:
+        return found[-1]
+    sys.exit('size_report.py: can\'t find ' + name)
+
+
+def run(args):
+    return subprocess.run(args, check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+
+
+def build(out_dir, extra_flags=None, elf_flags=''):
+    env = dict(os.environ, EXTRA_ELF_FLAGS=elf_flags)
+    args = [os.path.join(TOOLS_DIR, 'build_sketch.sh'), out_dir]
+    for prop in extra_flags or []:
+        args += ['--build-property', prop]
+    return subprocess.run(args, check=True, stdout=subprocess.PIPE, universal_newlines=True, env=env).stdout.strip()
+
+
+def module_of_object(path):
+    name = os.path.basename(path)
+    if name.endswith('.o'):
+        name = name[:-2]
+    if name in MODULES:
+        return MODULES[name]
+    return 'core'
+
+
+def base_name(sym):
+    # LTO and the optimizer add suffixes to the copies of functions they make (foo.lto_priv.0, foo.constprop.3, foo.isra.1, ...)
+    return sym.split('.', 1)[0]
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# SIZES
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def symbol_owners(objects_dir, gcc_nm):
+    # gcc-nm can read the LTO objects the Arduino build produces, plain nm can't
+    owners = {}
+    objects = glob(os.path.join(objects_dir, 'sketch', '*.o')) + glob(os.path.join(objects_dir, 'core', '**', '*.o'), recursive=True)
+    for obj in objects:
+        module = module_of_object(obj)
+        for line in run([gcc_nm, '--defined-only', obj]).splitlines():
+            parts = line.split()
+            if len(parts) == 3:
+                owners.setdefault(parts[2], module)
+    return owners
+
+
+def demangle(names, cxxfilt):
+    if not names:
+        return {}
+    out = subprocess.run([cxxfilt], input='\n'.join(names), check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    return dict(zip(names, out.splitlines()))
+
+
+def measure_sizes(elf, objects_dir):
+    nm, gcc_nm, cxxfilt, size = find_tool('avr-nm'), find_tool('avr-gcc-nm'), find_tool('avr-c++filt'), find_tool('avr-size')
+
+    sections = {}
+    for line in run([size, '-A', elf]).splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith('.') and parts[1].isdigit():
+            sections[parts[0]] = int(parts[1])
+    flash = sections.get('.text', 0) + sections.get('.data', 0)
+    ram = sections.get('.data', 0) + sections.get('.bss', 0) + sections.get('.noinit', 0)
+
+    owners = symbol_owners(objects_dir, gcc_nm)
+    symbols = {}
+    for line in run([nm, '--print-size', '--size-sort', elf]).splitlines():
+        parts = line.split()
+        if len(parts) != 4:
+            continue
+        size_bytes, kind, name = int(parts[1], 16), parts[2].lower(), parts[3]
+        # t = code and PROGMEM, d = initialized RAM (costs flash for the initial values too), b = zeroed RAM
+        if kind == 't':
+            f, r = size_bytes, 0
+        elif kind == 'd':
+            f, r = size_bytes, size_bytes
+        elif kind == 'b':
+            f, r = 0, size_bytes
+        else:
+            continue
+        entry = symbols.setdefault(name, {'module': owners.get(name, owners.get(base_name(name), 'libc')), 'flash': 0, 'ram': 0})
+        entry['flash'] += f
+        entry['ram'] += r
+
+    names = demangle(list(symbols), cxxfilt)
+    symbols = {names[k]: v for k, v in symbols.items()}
+
+    modules = {}
+    for sym in symbols.values():
+        m = modules.setdefault(sym['module'], {'flash': 0, 'ram': 0})
+        m['flash'] += sym['flash']
+        m['ram'] += sym['ram']
+    return {'flash': flash, 'ram': ram}, modules, symbols
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# STACK
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def func_key(name):
+    # Reduce both "void OP_Servos::OCR1A_ISR()" (from .su files) and "OP_Servos::OCR1A_ISR()" (from objdump) to "OP_Servos::OCR1A_ISR"
+    name = name.split('(', 1)[0].strip()
+    return name.split(' ')[-1]
+
+
+def measure_stack(elf, objects_dir):
+    objdump = find_tool('avr-objdump')
+
+    frames, frame_module = {}, {}
+    for su in glob(os.path.join(objects_dir, '**', '*.su'), recursive=True):
+        module = module_of_object(su[:-3] + '.o')
+        with open(su) as f:
+            for line in f:
+                fields = line.rstrip('\n').split('\t')
+                if len(fields) < 2:
+                    continue
+                key = func_key(fields[0].split(':', 3)[-1])
+                frames[key] = max(frames.get(key, 0), int(fields[1]))
+                frame_module[key] = module
+
+    # Direct calls between functions, from the disassembly
+    calls, indirect, current = {}, set(), None
+    header = re.compile(r'^[0-9a-f]+ <(.+)>:$')
+    call = re.compile(r'\s(r?call)\s.*<([^>+]+)>')
+    for line in run([objdump, '-d', '-C', elf]).splitlines():
+        m = header.match(line)
+        if m:
+            current = func_key(m.group(1))
+            calls.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        m = call.search(line)
+        if m:
+            calls[current].add(func_key(m.group(2)))
+        elif re.search(r'\se?icall\b', line):
+            indirect.add(current)
+
+    def deepest(fn, seen):
+        # Returns (bytes, path). Recursion is cut off where it repeats.
+        if fn in seen:
+            return 0, [fn + ' (recursive)']
+        best, best_path = 0, []
+        for callee in calls.get(fn, ()):
+            depth, path = deepest(callee, seen | {fn})
+            if depth + 2 > best:
+                best, best_path = depth + 2, path
+        return frames.get(fn, 0) + best, [fn] + best_path
+
+    roots = {'main': deepest('main', set())}
+    for fn in calls:
+        if re.match(r'^__vector_\d+$', fn):
+            roots[fn] = deepest(fn, set())
+    # An interrupt costs its own frame plus the 2 byte return address pushed when it is entered
+    isr_total = sum(depth + 2 for name, (depth, _) in roots.items() if name != 'main')
+
+    per_module = {}
+    for fn, size in frames.items():
+        m = frame_module[fn]
+        per_module[m] = max(per_module.get(m, 0), size)
+
+    return {
+        'main': {'bytes': roots['main'][0], 'path': roots['main'][1]},
+        'isr': {name: {'bytes': d, 'path': p} for name, (d, p) in sorted(roots.items()) if name != 'main'},
+        'worst_case': roots['main'][0] + isr_total,
+        'largest_frame_per_module': per_module,
+        'indirect_calls_in': sorted(f for f in indirect if f in frames),
+    }
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# REPORT
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def print_report(report, num_symbols):
+    t = report['totals']
+    stack = report['stack']
+    print('TankIR size report  ({})'.format(report['tag']))
+    print('-' * 72)
+    print('Flash:  {:6d} of {} bytes ({:.1f}%)'.format(t['flash'], FLASH_AVAILABLE, 100.0 * t['flash'] / FLASH_AVAILABLE))
+    print('RAM:    {:6d} of {} bytes ({:.1f}%) static'.format(t['ram'], RAM_AVAILABLE, 100.0 * t['ram'] / RAM_AVAILABLE))
+    if stack:
+        free = RAM_AVAILABLE - t['ram'] - stack['worst_case']
+        print('Stack:  {:6d} bytes estimated worst case ({} loop + interrupts), leaving {} bytes'.format(stack['worst_case'], stack['main']['bytes'], free))
+    print()
+    print('{:<14}{:>8}{:>8}{:>12}'.format('Module', 'Flash', 'RAM', 'Max frame'))
+    for name, m in sorted(report['modules'].items(), key=lambda i: -i[1]['flash']):
+        frame = stack['largest_frame_per_module'].get(name, '') if stack else ''
+        print('{:<14}{:>8}{:>8}{:>12}'.format(name, m['flash'], m['ram'], frame))
+    print()
+    print('Largest symbols')
+    print('{:<52}{:<14}{:>7}{:>6}'.format('Symbol', 'Module', 'Flash', 'RAM'))
+    ranked = sorted(report['symbols'].items(), key=lambda i: -(i[1]['flash'] + 4 * i[1]['ram']))   # RAM is the scarcer of the two
+    for name, s in ranked[:num_symbols]:
+        print('{:<52}{:<14}{:>7}{:>6}'.format(name[:51], s['module'], s['flash'], s['ram']))
+    if stack:
+        print()
+        print('Deepest stack paths')
+        print('  main ({} bytes): {}'.format(stack['main']['bytes'], ' > '.join(stack['main']['path'])))
+        for name, isr in stack['isr'].items():
+            print('  {} ({} bytes): {}'.format(name, isr['bytes'], ' > '.join(isr['path'])))
+        if stack['indirect_calls_in']:
+            print('  Not followed - calls through pointers in: ' + ', '.join(stack['indirect_calls_in']))
+
+
+def print_diff(report, baseline, num_symbols):
+    def delta(new, old):
+        d = new - old
+        return '{:+d}'.format(d) if d else '0'
+
+    print()
+    print('Changes since baseline ({})'.format(baseline['tag']))
+    print('-' * 72)
+    for key in ('flash', 'ram'):
+        print('{:<8}{:>7} -> {:<7}{:>8}'.format(key.capitalize() + ':', baseline['totals'][key], report['totals'][key],
+                                               delta(report['totals'][key], baseline['totals'][key])))
+    if report['stack'] and baseline.get('stack'):
+        print('{:<8}{:>7} -> {:<7}{:>8}'.format('Stack:', baseline['stack']['worst_case'], report['stack']['worst_case'],
+                                               delta(report['stack']['worst_case'], baseline['stack']['worst_case'])))
+    print()
+    print('{:<14}{:>10}{:>10}'.format('Module', 'Flash', 'RAM'))
+    for name in sorted(set(report['modules']) | set(baseline['modules'])):
+        new = report['modules'].get(name, {'flash': 0, 'ram': 0})
+        old = baseline['modules'].get(name, {'flash': 0, 'ram': 0})
+        if new != old:
+            print('{:<14}{:>10}{:>10}'.format(name, delta(new['flash'], old['flash']), delta(new['ram'], old['ram'])))
+    changed = []
+    for name in set(report['symbols']) | set(baseline['symbols']):
+        new = report['symbols'].get(name, {'flash': 0, 'ram': 0})
+        old = baseline['symbols'].get(name, {'flash': 0, 'ram': 0})
+        if new['flash'] != old['flash'] or new['ram'] != old['ram']:
+            changed.append((name, new['flash'] - old['flash'], new['ram'] - old['ram']))
+    if changed:
+        print()
+        print('{:<52}{:>10}{:>10}'.format('Symbol', 'Flash', 'RAM'))
+        for name, f, r in sorted(changed, key=lambda c: -(abs(c[1]) + 4 * abs(c[2])))[:num_symbols]:
+            print('{:<52}{:>10}{:>10}'.format(name[:51], '{:+d}'.format(f) if f else '0', '{:+d}'.format(r) if r else '0'))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='TankIR flash, RAM and stack budget report')
+    parser.add_argument('--no-build', action='store_true', help='use the last build instead of building again')
+    parser.add_argument('--no-stack', action='store_true', help='skip the stack estimate (saves the second build)')
+    parser.add_argument('--save-baseline', action='store_true', help='save this report as the baseline')
+    parser.add_argument('--diff', action='store_true', help='compare against the baseline')
+    parser.add_argument('--baseline', default=BASELINE, help='baseline file (default build/size/baseline.json)')
+    parser.add_argument('--symbols', type=int, default=25, help='how many symbols to list')
+    parser.add_argument('--json', help='also write the report here')
+    args = parser.parse_args()
+
+    sizes_dir = os.path.join(OUT_DIR, 'sketch')
+    stack_dir = os.path.join(OUT_DIR, 'stack')
+    elf, stack_elf = os.path.join(sizes_dir, 'TankIR.ino.elf'), os.path.join(stack_dir, 'TankIR.ino.elf')
+    if not args.no_build:
+        elf = build(sizes_dir)
+        if not args.no_stack:
+            flags = '-fstack-usage -fno-lto'
+            stack_elf = build(stack_dir, ['compiler.c.extra_flags=' + flags, 'compiler.cpp.extra_flags=' + flags], '-fno-lto')
+
+    try:
+        tag = run(['git', '-C', ROOT_DIR, 'rev-parse', '--short', 'HEAD']).strip()
+    except (subprocess.CalledProcessError, OSError):
+        tag = 'unknown'
+
+    totals, modules, symbols = measure_sizes(elf, os.path.join(sizes_dir, 'objects'))
+    stack = None
+    if not args.no_stack and os.path.exists(stack_elf):
+        stack = measure_stack(stack_elf, os.path.join(stack_dir, 'objects'))
+    report = {'tag': tag, 'totals': totals, 'modules': modules, 'symbols': symbols, 'stack': stack}
+
+    print_report(report, args.symbols)
+    if args.diff:
+        if not os.path.exists(args.baseline):
+            sys.exit('size_report.py: no baseline at {}, run with --save-baseline first'.format(args.baseline))
+        with open(args.baseline) as f:
+            print_diff(report, json.load(f), args.symbols)
+
+    os.makedirs(OUT_DIR, exist_ok=True)
+    outputs = [os.path.join(OUT_DIR, tag + '.json')]
+    if args.json:
+        outputs.append(args.json)
+    if args.save_baseline:
+        outputs.append(args.baseline)
+    for path in outputs:
+        with open(path, 'w') as f:
+            json.dump(report, f, indent=1, sort_keys=True)
+
+
+if __name__ == '__main__':
+    main()
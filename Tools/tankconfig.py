@@ -0,0 +1,292 @@
+#!/usr/bin/env python3
+# tankconfig.py       Open Panzer TankIR configuration over the serial port
+# Source:             openpanzer.org
+# Authors:            Luke Middleton
+#
+# Reads and changes the battle settings a TankIR board keeps in EEPROM (see TankIR/Config.h), so changing teams or weight classes between
+# matches takes a few seconds per tank instead of a reflash. Settings you don't mention are left as they are.
+#
+# Usage:
+#   Tools/tankconfig.py PORT                                    show the running settings, and where they came from
+#   Tools/tankconfig.py PORT set IR_Team=IR_TEAM_FOV_2          change one or more settings, save them, and restart the board
+#   Tools/tankconfig.py PORT set WeightClass=WC_HEAVY RepairTank=false IR_FireProtocol=IR_HENGLONG
+#   Tools/tankconfig.py PORT set DamageProfile=CUSTOM_DAMAGE CustomWeight1Proto=IR_TAMIYA_2SHOT CustomWeight1Hits=DAMAGE_WEIGHT_HALF
+#   Tools/tankconfig.py PORT defaults                           show the defaults compiled in from A_Setup.h
+#   Tools/tankconfig.py PORT erase                              forget the saved settings, go back to the A_Setup.h defaults
+#   Tools/tankconfig.py PORT set ... --no-reset                 save, but don't restart (takes effect next power up)
+#   Tools/tankconfig.py --list                                  list the setting names and the values they accept
+#
+# Names for values (IR_TAMIYA, IR_TEAM_FOV_2, WC_MEDIUM, TAMIYA_DAMAGE, ...) are read from the sketch's own headers, plain numbers work too.
+# Needs pyserial (pip install pyserial).
+
+import argparse
+import os
+import re
+import struct
+import sys
+import time
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+SKETCH_DIR = os.path.join(os.path.dirname(TOOLS_DIR), 'TankIR')
+
+SYNC = 0xC5
+CONFIG_VERSION = 2
+
+# The fields of device_config in Config.h, in order, with their struct format and the prefix of the names they accept.
+# The AVR doesn't pad structures, so this is the exact byte layout. Only ever add to the end, same as the sketch.
+FIELDS = [
+    ('WeightClass',         'B', 'WC_'),
+    ('CustomReloadTime',    'H', None),     # CustomClass.reloadTime, mS
+    ('CustomRecoveryTime',  'H', None),     # CustomClass.recoveryTime, mS
+    ('CustomCannonHits',    'B', None),     # CustomClass.maxHits
+    ('CustomMGHits',        'B', None),     # CustomClass.maxMGHits
+    ('IR_FireProtocol',     'B', 'IR_'),
+    ('IR_HitProtocol_2',    'B', 'IR_'),
+    ('IR_RepairProtocol',   'B', 'IR_'),
+    ('IR_MGProtocol',       'B', 'IR_'),
+    ('IR_Team',             'B', 'IR_TEAM_'),
+    ('Accept_MG_Damage',    '?', None),
+    ('DamageProfile',       'B', '_DAMAGE'),
+    ('RepairTank',          '?', None),
+    ('RepairOnHit',         '?', None),
+    ('CannonReloadNotify',  '?', None),
+    ('SendTankID',          '?', None),
+    ('TankID',              'H', None),
+    ('RecoilMS',            'H', None),
+    ('ReturnMS',            'H', None),
+    ('ReverseRecoil',       '?', None),
+    ('RecoilEndPointMin',   'H', None),
+    ('RecoilEndPointMax',   'H', None),
+    ('Use5VoltTrigger',     '?', None),
+    # Version 2: CustomDamage, the profile used when DamageProfile is CUSTOM_DAMAGE (see damage_profile in Tank.h)
+    ('CustomWeight1Proto',  'B', 'IR_'),                 # Weight[0].Protocol, IR_DISABLED if unused
+    ('CustomWeight1Hits',   'B', 'DAMAGE_WEIGHT_'),      # Weight[0].Hits, cannon hits or DAMAGE_WEIGHT_HALF
+    ('CustomWeight2Proto',  'B', 'IR_'),                 # Weight[1].Protocol, IR_DISABLED if unused
+    ('CustomWeight2Hits',   'B', 'DAMAGE_WEIGHT_'),      # Weight[1].Hits, cannon hits or DAMAGE_WEIGHT_HALF
+    ('CustomWeight3Proto',  'B', 'IR_'),                 # Weight[2].Protocol, IR_DISABLED if unused
+    ('CustomWeight3Hits',   'B', 'DAMAGE_WEIGHT_'),      # Weight[2].Hits, cannon hits or DAMAGE_WEIGHT_HALF
+    ('CustomWeight4Proto',  'B', 'IR_'),                 # Weight[3].Protocol, IR_DISABLED if unused
+    ('CustomWeight4Hits',   'B', 'DAMAGE_WEIGHT_'),      # Weight[3].Hits, cannon hits or DAMAGE_WEIGHT_HALF
+    ('CustomCut1Damage',    'B', None),                  # SpeedCut[0].DamagePct, 0 if unused
+    ('CustomCut1Speed',     'B', None),                  # SpeedCut[0].CutPct
+    ('CustomCut2Damage',    'B', None),                  # SpeedCut[1].DamagePct, 0 if unused
+    ('CustomCut2Speed',     'B', None),                  # SpeedCut[1].CutPct
+    ('CustomCut3Damage',    'B', None),                  # SpeedCut[2].DamagePct, 0 if unused
+    ('CustomCut3Speed',     'B', None),                  # SpeedCut[2].CutPct
+    ('CustomCut4Damage',    'B', None),                  # SpeedCut[3].DamagePct, 0 if unused
+    ('CustomCut4Speed',     'B', None),                  # SpeedCut[3].CutPct
+]
+LAYOUT = '<' + ''.join(f[1] for f in FIELDS)
+
+ERRORS = {0: 'ok', 1: 'CRC error', 2: 'unknown command', 3: 'wrong length', 4: 'a setting was out of range, nothing was saved',
+          5: 'EEPROM did not verify'}
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# NAMES
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def read_defines(filename, start, end):
+    # Numeric defines between the line containing start and the one containing end
+    values = {}
+    with open(os.path.join(SKETCH_DIR, filename)) as f:
+        text = f.read()
+    block = text[text.index(start):]
+    block = block[:block.index(end)]
+    for m in re.finditer(r'#define\s+(\w+)\s+(0x[0-9A-Fa-f]+|\d+)\b', block):
+        values[m.group(1)] = int(m.group(2), 0)
+    return values
+
+
+DEFINES = {}
+DEFINES.update(read_defines('IRLib.h', 'typedef unsigned char IRTYPES', 'LAST_IRPROTOCOL'))
+DEFINES.update(read_defines('IRLib.h', 'typedef unsigned char IRTEAMS', 'LAST_IRTEAM'))
+DEFINES.update(read_defines('Tank.h', 'typedef unsigned char WEIGHTCLASS', 'LAST_WEIGHT_CLASS'))
+DEFINES.update(read_defines('Tank.h', 'typedef unsigned char DAMAGEPROFILES', 'LAST_DAMAGE_PROFILE'))
+DEFINES.update(read_defines('Tank.h', '#define DAMAGE_WEIGHT_HALF', 'struct damage_weight'))
+
+
+def names_for(kind):
+    # Every define that fits this kind of setting. IR_ matches the teams too, so leave those out of the protocols.
+    if kind == '_DAMAGE':
+        return {k: v for k, v in DEFINES.items() if k.endswith('_DAMAGE') and not k.startswith('LAST_')}
+    names = {k: v for k, v in DEFINES.items() if k.startswith(kind)}
+    if kind == 'IR_':
+        names = {k: v for k, v in names.items() if not k.startswith('IR_TEAM_')}
+    return names
+
+
+def show_value(kind, fmt, value):
+    if fmt == '?':
+        return 'true' if value else 'false'
+    if kind:
+        matches = [k for k, v in names_for(kind).items() if v == value and k != 'IR_DISABLED' and k != 'IR_TEAM_FOV_1']
+        if matches:
+            return '%s (%d)' % (matches[0], value)
+    return str(value)
+
+
+def parse_value(name, kind, fmt, text):
+    t = text.strip()
+    if fmt == '?':
+        if t.lower() in ('1', 'true', 'yes', 'on'):
+            return True
+        if t.lower() in ('0', 'false', 'no', 'off'):
+            return False
+        sys.exit('tankconfig.py: %s must be true or false' % name)
+    if kind and t in names_for(kind):
+        return names_for(kind)[t]
+    try:
+        return int(t, 0)
+    except ValueError:
+        hint = ', '.join(sorted(names_for(kind))) if kind else 'a number'
+        sys.exit('tankconfig.py: don\'t know "%s" for %s (try %s)' % (t, name, hint))
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# PROTOCOL
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+class Board:
+    def __init__(self, port, baud, wait):
+        try:
+            import serial
+        except ImportError:
+            sys.exit('tankconfig.py: needs pyserial (pip install pyserial)')
+        self.port = serial.Serial(port, baud, timeout=0.2)
+        # Opening the port restarts most Arduinos, give the bootloader time to hand over to the sketch
+        if wait:
+            time.sleep(2.0)
+        self.port.reset_input_buffer()
+
+    def command(self, cmd, payload=b''):
+        body = bytes([ord(cmd), len(payload)]) + payload
+        self.port.write(bytes([SYNC]) + body + bytes([crc8(body)]))
+        return self.reply(cmd)
+
+    def reply(self, cmd):
+        # The sketch may be sending other things (event log frames, text), skip everything until our reply turns up
+        buf = bytearray()
+        deadline = time.time() + 2.0
+        while time.time() < deadline:
+            buf += self.port.read(64)
+            while True:
+                i = buf.find(SYNC)
+                if i < 0:
+                    buf.clear()
+                    break
+                del buf[:i]
+                if len(buf) < 3 or len(buf) < buf[2] + 4:
+                    break
+                frame = bytes(buf[:buf[2] + 4])
+                if crc8(frame[1:-1]) != frame[-1]:
+                    del buf[0]                      # Not a frame, keep looking
+                    continue
+                del buf[:len(frame)]
+                if frame[1] == ord('?'):
+                    sys.exit('tankconfig.py: board says %s' % ERRORS.get(frame[3], frame[3]))
+                if frame[1] == ord(cmd):
+                    return frame[3:-1]
+        sys.exit('tankconfig.py: no reply from the board (is the TankIR sketch running, at the right baud rate?)')
+
+    def restart(self):
+        # Pulsing DTR restarts the board the same way the Arduino IDE does before an upload
+        self.port.dtr = False
+        time.sleep(0.1)
+        self.port.dtr = True
+
+
+def check_layout(board):
+    version, size, source = board.command('I')
+    if version > CONFIG_VERSION or size != struct.calcsize(LAYOUT):
+        sys.exit('tankconfig.py: the board has configuration version %d (%d bytes), this tool knows version %d (%d bytes). '
+                 'Update the tool or the sketch so they match.' % (version, size, CONFIG_VERSION, struct.calcsize(LAYOUT)))
+    return source
+
+
+def decode(payload):
+    return dict(zip([f[0] for f in FIELDS], struct.unpack(LAYOUT, payload)))
+
+
+def encode(values):
+    return struct.pack(LAYOUT, *[values[f[0]] for f in FIELDS])
+
+
+def print_config(values, title):
+    print(title)
+    for name, fmt, kind in FIELDS:
+        print('    %-20s %s' % (name, show_value(kind, fmt, values[name])))
+
+
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+# MAIN
+# ------------------------------------------------------------------------------------------------------------------------------------------------------->>
+def main():
+    parser = argparse.ArgumentParser(description='Read and change TankIR settings over the serial port')
+    parser.add_argument('port', nargs='?', help='serial port the board is on')
+    parser.add_argument('action', nargs='?', default='show', choices=['show', 'set', 'defaults', 'erase'])
+    parser.add_argument('settings', nargs='*', help='Name=value for set')
+    parser.add_argument('--baud', type=int, default=115200, help='serial baud rate (USB_BAUD_RATE in Settings.h)')
+    parser.add_argument('--no-reset', action='store_true', help='don\'t restart the board after saving')
+    parser.add_argument('--no-wait', action='store_true', help='don\'t wait for the board to restart when the port is opened')
+    parser.add_argument('--list', action='store_true', help='list the settings and the names they accept')
+    args = parser.parse_args()
+
+    if args.list:
+        for name, fmt, kind in FIELDS:
+            accepts = 'true/false' if fmt == '?' else (', '.join(sorted(names_for(kind))) if kind else 'number')
+            if kind == 'DAMAGE_WEIGHT_':
+                accepts = 'number, ' + accepts      # A number of hits, or the special weights
+            print('%-20s %s' % (name, accepts))
+        return
+    if not args.port:
+        parser.error('which serial port?')
+
+    changes = {}
+    for s in args.settings:
+        if '=' not in s:
+            sys.exit('tankconfig.py: expected Name=value, got "%s"' % s)
+        name, text = s.split('=', 1)
+        field = [f for f in FIELDS if f[0].lower() == name.strip().lower()]
+        if not field:
+            sys.exit('tankconfig.py: no setting called "%s" (see --list)' % name)
+        changes[field[0][0]] = parse_value(*field[0], text=text)
+    if args.action == 'set' and not changes:
+        sys.exit('tankconfig.py: nothing to set')
+
+    board = Board(args.port, args.baud, not args.no_wait)
+    source = check_layout(board)
+
+    if args.action == 'show':
+        print_config(decode(board.command('R')), 'Running settings (from %s):' % ('EEPROM' if source else 'A_Setup.h defaults'))
+
+    elif args.action == 'defaults':
+        print_config(decode(board.command('D')), 'A_Setup.h defaults:')
+
+    elif args.action == 'set':
+        values = decode(board.command('R'))
+        values.update(changes)
+        result = board.command('W', encode(values))[0]
+        if result:
+            sys.exit('tankconfig.py: not saved, %s' % ERRORS.get(result, result))
+        print_config(values, 'Saved:')
+        if not args.no_reset:
+            board.restart()
+            print('Board restarted with the new settings')
+
+    elif args.action == 'erase':
+        board.command('E')
+        print('Saved settings erased, the A_Setup.h defaults will be used')
+        if not args.no_reset:
+            board.restart()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+# tankstats.py        Open Panzer TankIR battle statistics over the serial port
+# Source:             openpanzer.org
+# Authors:            Luke Middleton
+#
+# Reads back the battle statistics a TankIR board keeps in EEPROM for each match (see TankIR/Stats.h): shots fired, hits by protocol and team,
+# times destroyed, repairs, time switched on and IR that couldn't be decoded. Match 0 is the one running now, the rest are the matches before it,
+# as many as the board's EEPROM has room for.
+#
+# Usage:
+#   Tools/tankstats.py PORT                 table of every match the board remembers, newest first
+#   Tools/tankstats.py PORT --last 3        just this match and the two before it
+#   Tools/tankstats.py PORT --csv out.csv   ...and save them as CSV, one row per match, for adding up a whole club's tanks in a spreadsheet
+#   Tools/tankstats.py PORT clear           forget every saved match
+#
+# Talks to the board the same way as tankconfig.py, and needs pyserial.
+
+import argparse
+import csv
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from tankconfig import Board, names_for             # noqa: E402
+
+STATS_VERSION = 2
+PROTOCOLS = 16                                      # LAST_IRPROTOCOL + 1
+TEAMS = 4                                           # LAST_IRTEAM + 1
+
+# The fields of stats_record in Stats.h, in order. The AVR doesn't pad structures, so this is the exact byte layout.
+LAYOUT = '<BHIHHH%dB%dBBBBBHBB' % (PROTOCOLS, TEAMS)
+COUNTS = ['Destroyed', 'RepairsReceived', 'RepairsGiven', 'RepairsCancelled', 'DecodeErrors']
+
+
+def decode(payload):
+    v = struct.unpack(LAYOUT, payload)
+    r = {'Version': v[0], 'Match': v[1], 'Uptime_S': v[2], 'ShotsFired': v[3], 'CannonHits': v[4], 'MGHits': v[5]}
+    r['HitsByProtocol'] = list(v[6:6 + PROTOCOLS])
+    r['HitsByTeam'] = list(v[6 + PROTOCOLS:6 + PROTOCOLS + TEAMS])
+    r.update(zip(COUNTS, v[6 + PROTOCOLS + TEAMS:-2]))
+    r['Saves'] = v[-2]
+    return r
+
+
+def protocol_names():
+    names = {v: k for k, v in names_for('IR_').items() if k != 'IR_DISABLED'}
+    return [names.get(i, 'protocol %d' % i) for i in range(PROTOCOLS)]
+
+
+def team_names():
+    names = {v: k for k, v in names_for('IR_TEAM_').items() if k != 'IR_TEAM_FOV_1'}
+    return [names.get(i, 'team %d' % i) for i in range(TEAMS)]
+
+
+def read_matches(board, last):
+    matches = []
+    for age in range(last if last else 256):
+        payload = board.command('S', bytes([age]))
+        if not payload:
+            break
+        if len(payload) != struct.calcsize(LAYOUT) or payload[0] != STATS_VERSION:
+            sys.exit('tankstats.py: the board has statistics version %d (%d bytes), this tool knows version %d (%d bytes). '
+                     'Update the tool or the sketch so they match.' % (payload[0], len(payload), STATS_VERSION, struct.calcsize(LAYOUT)))
+        matches.append(decode(payload))
+    return matches
+
+
+def duration(seconds):
+    return '%d:%02d:%02d' % (seconds // 3600, seconds // 60 % 60, seconds % 60)
+
+
+def print_matches(matches):
+    protocols = protocol_names()
+    teams = team_names()
+    for age, r in enumerate(matches):
+        print('Match %d%s, on for %s' % (r['Match'], ' (this one)' if age == 0 else '', duration(r['Uptime_S'])))
+        print('    Shots fired          %d' % r['ShotsFired'])
+        print('    Cannon hits          %d' % r['CannonHits'])
+        print('    Machine gun hits     %d' % r['MGHits'])
+        for name, count in zip(protocols, r['HitsByProtocol']):
+            if count:
+                print('        from %-15s %d' % (name, count))
+        for name, count in zip(teams, r['HitsByTeam']):
+            if count:
+                print('        team %-15s %d' % (name, count))
+        for name in COUNTS:
+            print('    %-20s %d' % (name, r[name]))
+
+
+def save_csv(matches, filename):
+    protocols = protocol_names()
+    teams = team_names()
+    header = ['Match', 'Uptime_S', 'ShotsFired', 'CannonHits', 'MGHits'] + ['Hits ' + p for p in protocols] + ['Team ' + t for t in teams] + COUNTS
+    with open(filename, 'w', newline='') as f:
+        w = csv.writer(f)
+        w.writerow(header)
+        for r in matches:
+            w.writerow([r['Match'], r['Uptime_S'], r['ShotsFired'], r['CannonHits'], r['MGHits']] + r['HitsByProtocol'] + r['HitsByTeam'] +
+                       [r[c] for c in COUNTS])
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Read TankIR battle statistics over the serial port')
+    parser.add_argument('port', help='serial port the board is on')
+    parser.add_argument('action', nargs='?', default='show', choices=['show', 'clear'])
+    parser.add_argument('--last', type=int, default=0, help='only this many matches, counting the running one')
+    parser.add_argument('--csv', metavar='FILE', help='also save the matches as CSV')
+    parser.add_argument('--baud', type=int, default=115200, help='serial baud rate (USB_BAUD_RATE in Settings.h)')
+    parser.add_argument('--no-wait', action='store_true', help='don\'t wait for the board to restart when the port is opened')
+    args = parser.parse_args()
+
+    board = Board(args.port, args.baud, not args.no_wait)
+
+    if args.action == 'clear':
+        board.command('X')
+        print('Saved battle statistics erased')
+        return
+
+    matches = read_matches(board, args.last)
+    print_matches(matches)
+    if args.csv:
+        save_csv(matches, args.csv)
+        print('Saved %d matches to %s' % (len(matches), args.csv))
+
+
+if __name__ == '__main__':
+    main()